@@ -29,6 +29,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "utils.h"
 #include "movie.h"
+#include "lua.h"
 
 #include "context_sensitive_tab.h"
 #include "tokenize_string.h"
@@ -1464,6 +1465,8 @@ void CL_Demo_Jump_f(void)
 	}
 
 	cls.demotime = newdemotime;
+
+	Lua_DemoSeek(cls.demotime - demostarttime);
 }
 
 static int playdemo_checkdemo (char  *name, struct tokenized_string *check)
@@ -25,6 +25,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "pmove.h"
 #include "teamplay.h"
+#include "workerpool.h"
 
 #ifdef NETQW
 #include "netqw.h"
@@ -42,7 +43,7 @@ void TP_ParsePlayerInfo(player_state_t *, player_state_t *, player_info_t *info)
 #define ISDEAD(i) ( (i) >= 41 && (i) <= 102 )
 
 extern cvar_t cl_nodelta;
-extern cvar_t cl_predictPlayers, cl_solidPlayers, cl_rocket2grenade;
+extern cvar_t cl_predictPlayers, cl_predictPlayers_full, cl_predictThreads, cl_solidPlayers, cl_rocket2grenade;
 extern cvar_t cl_model_bobbing;
 extern cvar_t cl_nolerp;
 
@@ -60,6 +61,21 @@ static struct predicted_player
 
 } predicted_players[MAX_CLIENTS];
 
+struct predictjob
+{
+	player_state_t *state;
+	int playernum;
+	qboolean solidplayers;
+	vec3_t origin;	// result
+};
+
+static struct predictjob predictjobs[MAX_CLIENTS];
+static struct WorkerPool *predictpool;
+static int predictpoolthreads = -1;
+
+static void CL_RunPredictJobs (int numjobs);
+static int CL_PlayerPredictMsec (player_state_t *state, double playertime);
+
 char *cl_modelnames[cl_num_modelindices];
 cl_modelindex_t cl_modelindices[cl_num_modelindices];
 
@@ -146,6 +162,14 @@ int CL_InitEnts(void)
 
 void CL_ShutdownEnts()
 {
+	if (predictpool)
+	{
+		WorkerPool_Delete(predictpool);
+		predictpool = 0;
+	}
+
+	predictpoolthreads = -1;
+
 #ifdef GLQUAKE
 	free(cl_firstpassents.list);
 	free(cl_visents.list);
@@ -1354,16 +1378,17 @@ void CL_AddFlagModels (entity_t *ent, int team)
 //Create visible entities in the correct position for all current players
 void CL_LinkPlayers (void)
 {
-	int j, msec, i, flicker, oldphysent;
+	int j, msec, i, flicker, numjobs;
 	float *org;
 	vec3_t	tmp;
 	double playertime;
 	player_info_t *info;
-	player_state_t *state, exact;
+	player_state_t *state;
 	entity_t ent;
 	centity_t *cent;
 	frame_t *frame;
 	dlighttype_t dimlightcolor;
+	struct predictjob *predicted[MAX_CLIENTS];
 
 	playertime = cls.realtime - cls.latency + 0.02;
 	if (playertime > cls.realtime)
@@ -1372,6 +1397,33 @@ void CL_LinkPlayers (void)
 	frame = &cl.frames[cl.parsecount & UPDATE_MASK];
 	memset (&ent, 0, sizeof(entity_t));
 
+	// predict the movement of all visible players at once, clipping against the others
+	numjobs = 0;
+	for (j = 0; j < MAX_CLIENTS; j++)
+	{
+		state = &frame->playerstate[j];
+		predicted[j] = 0;
+
+		if (state->messagenum != cl.parsecount || !state->modelindex)
+			continue;
+
+		if (j == cl.playernum || !Cam_DrawPlayer(j))
+			continue;
+
+		msec = CL_PlayerPredictMsec(state, playertime);
+		if (msec <= 0 || !cl_predictPlayers.value || cls.mvdplayback)
+			continue;
+
+		state->command.msec = msec;
+
+		predicted[j] = &predictjobs[numjobs++];
+		predicted[j]->state = state;
+		predicted[j]->playernum = j;
+		predicted[j]->solidplayers = true;
+	}
+
+	CL_RunPredictJobs(numjobs);
+
 	for (j = 0; j < MAX_CLIENTS; j++, info++, state++)
 	{
 		info = &cl.players[j];
@@ -1462,25 +1514,10 @@ void CL_LinkPlayers (void)
 		ent.angles[ROLL] = 0;
 		ent.angles[ROLL] = 4 * V_CalcRoll (ent.angles, state->velocity);
 
-		// only predict half the move to minimize overruns
-		msec = 500 * (playertime - state->state_time);
-		if (msec <= 0 || !cl_predictPlayers.value || cls.mvdplayback)
-		{
-			VectorCopy (state->origin, ent.origin);
-		}
+		if (predicted[j])
+			VectorCopy (predicted[j]->origin, ent.origin);
 		else
-		{
-			// predict players movement
-			if (msec > 255)
-				msec = 255;
-			state->command.msec = msec;
-
-			oldphysent = pmove.numphysent;
-			CL_SetSolidPlayers (j);
-			CL_PredictUsercmd (state, &exact, &state->command);
-			pmove.numphysent = oldphysent;
-			VectorCopy (exact.origin, ent.origin);
-		}
+			VectorCopy (state->origin, ent.origin);
 
 		if (state->effects & (EF_FLAG1|EF_FLAG2))
 			CL_AddFlagModels (&ent, !!(state->effects & EF_FLAG2));
@@ -1538,11 +1575,12 @@ This sets up the first phase.
 */
 void CL_SetUpPlayerPrediction(qboolean dopred)
 {
-	int j, msec;
-	player_state_t *state, exact;
+	int j, msec, numjobs;
+	player_state_t *state;
 	double playertime;
 	frame_t *frame;
 	struct predicted_player *pplayer;
+	struct predictjob *job;
 
 	playertime = cls.realtime - cls.latency + 0.02;
 	if (playertime > cls.realtime)
@@ -1550,6 +1588,7 @@ void CL_SetUpPlayerPrediction(qboolean dopred)
 
 	frame = &cl.frames[cl.parsecount & UPDATE_MASK];
 
+	numjobs = 0;
 	for (j = 0; j < MAX_CLIENTS; j++)
 	{
 		pplayer = &predicted_players[j];
@@ -1573,8 +1612,7 @@ void CL_SetUpPlayerPrediction(qboolean dopred)
 		}
 		else
 		{
-			// only predict half the move to minimize overruns
-			msec = 500 * (playertime - state->state_time);
+			msec = CL_PlayerPredictMsec(state, playertime);
 			if (msec <= 0 || !cl_predictPlayers.value || !dopred || cls.mvdplayback)
 			{
 				VectorCopy (state->origin, pplayer->origin);
@@ -1582,21 +1620,26 @@ void CL_SetUpPlayerPrediction(qboolean dopred)
 			else
 			{
 				// predict players movement
-				if (msec > 255)
-					msec = 255;
 				state->command.msec = msec;
 
-				CL_PredictUsercmd (state, &exact, &state->command);
-				VectorCopy (exact.origin, pplayer->origin);
+				job = &predictjobs[numjobs++];
+				job->state = state;
+				job->playernum = j;
+				job->solidplayers = false;
 			}
 		}
 	}
+
+	CL_RunPredictJobs(numjobs);
+
+	for (j = 0; j < numjobs; j++)
+		VectorCopy (predictjobs[j].origin, predicted_players[predictjobs[j].playernum].origin);
 }
 
 //Builds all the pmove physents for the current frame.
 //Note that CL_SetUpPlayerPrediction() must be called first!
-//pmove must be setup with world and solid entity hulls before calling (via CL_PredictMove)
-void CL_SetSolidPlayers (int playernum)
+//pm must be setup with world and solid entity hulls before calling (via CL_PredictMove)
+static void CL_SetSolidPlayersEx (playermove_t *pm, int playernum)
 {
 	int j;
 	struct predicted_player *pplayer;
@@ -1606,14 +1649,14 @@ void CL_SetSolidPlayers (int playernum)
 	if (!cl_solidPlayers.value)
 		return;
 
-	pent = pmove.physents + pmove.numphysent;
+	pent = pm->physents + pm->numphysent;
 
 	for (j = 0; j < MAX_CLIENTS; j++)
 	{
 		pplayer = &predicted_players[j];
 
 
-		if (pmove.numphysent == MAX_PHYSENTS)
+		if (pm->numphysent == MAX_PHYSENTS)
 			break;
 
 
@@ -1631,11 +1674,81 @@ void CL_SetSolidPlayers (int playernum)
 		VectorCopy(pplayer->origin, pent->origin);
 		VectorCopy(player_mins, pent->mins);
 		VectorCopy(player_maxs, pent->maxs);
-		pmove.numphysent++;
+		pm->numphysent++;
 		pent++;
 	}
 }
 
+void CL_SetSolidPlayers (int playernum)
+{
+	CL_SetSolidPlayersEx (&pmove, playernum);
+}
+
+//Predicts a single player on a private copy of pmove, so that any number of these can run at once
+static void CL_PredictPlayerJob (void *arg, unsigned int jobnum)
+{
+	struct predictjob *job;
+	struct PMoveContext ctx;
+	playermove_t pm;
+	movevars_t mv;
+	player_state_t exact;
+
+	job = (struct predictjob *)arg + jobnum;
+
+	pm.numphysent = pmove.numphysent;
+	memcpy (pm.physents, pmove.physents, pmove.numphysent * sizeof(*pm.physents));
+	mv = movevars;
+
+	if (job->solidplayers)
+		CL_SetSolidPlayersEx (&pm, job->playernum);
+
+	PM_InitContext (&ctx, &pm, &mv);
+	CL_PredictUsercmdEx (&ctx, job->state, &exact, &job->state->command);
+	VectorCopy (exact.origin, job->origin);
+}
+
+static void CL_RunPredictJobs (int numjobs)
+{
+	int numthreads;
+
+	numthreads = bound(0, (int)cl_predictThreads.value, MAX_CLIENTS);
+	if (numthreads != predictpoolthreads)
+	{
+		if (predictpool)
+			WorkerPool_Delete(predictpool);
+
+		predictpool = WorkerPool_Create(numthreads);
+		predictpoolthreads = numthreads;
+	}
+
+	if (predictpool)
+	{
+		WorkerPool_Run(predictpool, CL_PredictPlayerJob, predictjobs, numjobs);
+	}
+	else
+	{
+		for (numthreads = 0; numthreads < numjobs; numthreads++)
+			CL_PredictPlayerJob(predictjobs, numthreads);
+	}
+}
+
+//How far ahead to extrapolate another player, in milliseconds
+static int CL_PlayerPredictMsec (player_state_t *state, double playertime)
+{
+	int msec;
+
+	// only predict half the move to minimize overruns, unless asked to run the full move
+	if (cl_predictPlayers_full.value)
+		msec = 1000 * (playertime - state->state_time);
+	else
+		msec = 500 * (playertime - state->state_time);
+
+	if (msec > 255)
+		msec = 255;
+
+	return msec;
+}
+
 //Builds the visedicts array for cl.time
 //Made up of: clients, packet_entities, nails, and tents
 void CL_EmitEntities (void)
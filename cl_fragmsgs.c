@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 #include "filesystem.h"
+#include "lua.h"
 
 cvar_t cl_parsefrags = {"cl_parseFrags", "0"};
 cvar_t cl_loadFragfiles = {"cl_loadFragfiles", "0"};
@@ -648,11 +649,13 @@ foundmatch:
 	case mt_death:
 		fragstats[i].totaldeaths++;
 		fragstats[i].wdeaths[fragmsg->wclass_index]++;
+		Lua_Frag(-1, i, wclasses[fragmsg->wclass_index].name, "death");
 		break;
 
 	case mt_suicide:
 		fragstats[i].totalsuicides++;
 		fragstats[i].totaldeaths++;
+		Lua_Frag(i, i, wclasses[fragmsg->wclass_index].name, "suicide");
 		break;
 
 	case mt_fragged:
@@ -667,11 +670,13 @@ foundmatch:
 		fragstats[victim].deaths[killer]++;
 		fragstats[victim].totaldeaths++;
 		fragstats[victim].wdeaths[fragmsg->wclass_index]++;
+		Lua_Frag(killer, victim, wclasses[fragmsg->wclass_index].name, "frag");
 		break;
 
 	case mt_frag:
 		fragstats[i].totalfrags++;
 		fragstats[i].wkills[fragmsg->wclass_index]++;
+		Lua_Frag(i, -1, wclasses[fragmsg->wclass_index].name, "frag");
 		break;
 
 	case mt_tkilled:
@@ -684,10 +689,12 @@ foundmatch:
 
 		fragstats[victim].teamdeaths[killer]++;
 		fragstats[victim].totaldeaths++;
+		Lua_Frag(killer, victim, wclasses[fragmsg->wclass_index].name, "teamkill");
 		break;
 
 	case mt_tkill:
 		fragstats[i].totalteamkills++;
+		Lua_Frag(i, -1, wclasses[fragmsg->wclass_index].name, "teamkill");
 		break;
 
 	case mt_flagtouch:
@@ -723,11 +723,6 @@ void CL_SendCmd (void)
 		dropcount = 0;
 	}
 
-	if (cls.download && (cls.ftexsupported&FTEX_CHUNKEDDOWNLOADS))
-	{
-		CL_RequestNextFTEDownloadChunk(&buf);
-	}
-
 	// deliver the message
 	Netchan_Transmit(&cls.netchan, buf.cursize, buf.data);
 }
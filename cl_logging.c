@@ -18,28 +18,468 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "quakedef.h"
 #include "filesystem.h"
 #include "logging.h"
 #include "utils.h"
+#include "readablechars.h"
+#include "sys_lib.h"
+#include "sys_thread.h"
 
 static qboolean OnChange_log_dir(cvar_t *var, char *string);
 
 cvar_t		log_dir			= {"log_dir", "", 0, OnChange_log_dir};
 cvar_t		log_readable	= {"log_readable", "0"};
+cvar_t		log_flushinterval	= {"log_flushinterval", "1"};
+cvar_t		log_rotatesize	= {"log_rotatesize", "0"};
+cvar_t		log_compress	= {"log_compress", "0"};
 
 #define			LOG_FILENAME_MAXSIZE	(MAX_OSPATH * 2)
 
-static FILE		*logfile;				
+/* Text is handed to the writer once this much has been queued, or after log_flushinterval seconds */
+#define			LOG_BATCHSIZE		(16 * 1024)
+#define			LOG_ROTATECOUNT		5
+
+static qboolean	logging;
 static char		logfilename[LOG_FILENAME_MAXSIZE];
 
 static qboolean autologging = false;
 
+/*
+ * All file access happens on a writer thread, which is fed through a queue of
+ * records. Console text is appended to the queue under a mutex which is only
+ * held for the copy, and the writer swaps the queue out before doing any I/O.
+ * If no thread can be created, the queue is written out from the main thread
+ * instead.
+ */
+
+enum logrecordtype
+{
+	LOGRECORD_DATA,
+	LOGRECORD_OPEN,
+	LOGRECORD_CLOSE,
+	LOGRECORD_ARCHIVE,
+	LOGRECORD_SYNC
+};
+
+struct logrecord
+{
+	enum logrecordtype type;
+	unsigned int length; /* Of the data following the record */
+	FILE *file; /* LOGRECORD_OPEN */
+	unsigned int rotatesize; /* LOGRECORD_OPEN */
+	int compress; /* LOGRECORD_ARCHIVE */
+};
+
+#define LOG_RECORDSIZE(length) ((sizeof(struct logrecord) + (length) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+static struct SysThread *logthread;
+static struct SysMutex *logmutex;
+static struct SysSignal *logsignal;
+static struct SysSignal *logsyncsignal;
+static volatile unsigned int logquit;
+static qboolean logwriterfailed;
+static double loglastflush;
+
+/* Protected by logmutex */
+static char *logqueue;
+static unsigned int logqueuesize;
+static unsigned int logqueueused;
+static int logqueuelastdata;
+static char logarchivedname[LOG_FILENAME_MAXSIZE];
+static int logarchiveresult;
+
+/* Only used by the writer */
+static char *logbatch;
+static unsigned int logbatchsize;
+static FILE *logfile;
+static char logfilepath[LOG_FILENAME_MAXSIZE];
+static unsigned int logfilewritten;
+static unsigned int logfilerotatesize;
+
+/* zlib is only loaded if archived match logs are to be compressed */
+static struct SysLib *zlib_handle;
+static void *(*qgzopen)(const char *path, const char *mode);
+static int (*qgzwrite)(void *file, const void *buf, unsigned int len);
+static int (*qgzclose)(void *file);
+
+static qboolean Log_LoadZlib(void)
+{
+	if (zlib_handle)
+		return true;
+
+	zlib_handle = Sys_Lib_Open("z");
+	if (zlib_handle == 0)
+		return false;
+
+	qgzopen = Sys_Lib_GetAddressByName(zlib_handle, "gzopen");
+	qgzwrite = Sys_Lib_GetAddressByName(zlib_handle, "gzwrite");
+	qgzclose = Sys_Lib_GetAddressByName(zlib_handle, "gzclose");
+	if (qgzopen && qgzwrite && qgzclose)
+		return true;
+
+	Sys_Lib_Close(zlib_handle);
+	zlib_handle = 0;
+
+	return false;
+}
+
+static void Log_RotateFile(void)
+{
+	char from[LOG_FILENAME_MAXSIZE + 8];
+	char to[LOG_FILENAME_MAXSIZE + 8];
+	int i;
+
+	fclose(logfile);
+	logfile = NULL;
+
+	snprintf(to, sizeof(to), "%s.%d", logfilepath, LOG_ROTATECOUNT);
+	remove(to);
+
+	for(i=LOG_ROTATECOUNT-1;i>0;i--)
+	{
+		snprintf(from, sizeof(from), "%s.%d", logfilepath, i);
+		snprintf(to, sizeof(to), "%s.%d", logfilepath, i + 1);
+		rename(from, to);
+	}
+
+	snprintf(to, sizeof(to), "%s.1", logfilepath);
+	rename(logfilepath, to);
+
+	logfile = fopen(logfilepath, "wb");
+	logfilewritten = 0;
+}
+
+static int Log_CompressFile(const char *source, const char *dest)
+{
+	char buf[8192];
+	char gzname[LOG_FILENAME_MAXSIZE + 4];
+	FILE *f;
+	void *gz;
+	size_t r;
+	int error;
+
+	snprintf(gzname, sizeof(gzname), "%s.gz", dest);
+
+	f = fopen(source, "rb");
+	if (f == NULL)
+		return 1;
+
+	gz = qgzopen(gzname, "wb");
+	if (gz == NULL)
+	{
+		fclose(f);
+		return 1;
+	}
+
+	error = 0;
+	while((r = fread(buf, 1, sizeof(buf), f)) > 0)
+	{
+		if (qgzwrite(gz, buf, r) != r)
+		{
+			error = 1;
+			break;
+		}
+	}
+
+	fclose(f);
+
+	if (qgzclose(gz) != 0)
+		error = 1;
+
+	if (error)
+	{
+		remove(gzname);
+		return 1;
+	}
+
+	remove(source);
+
+	return 0;
+}
+
+static void Log_ArchiveFile(const char *source, const char *dest, int compress)
+{
+	int error;
+
+	if (compress && Log_CompressFile(source, dest) == 0)
+	{
+		error = 0;
+	}
+	else
+	{
+		compress = 0;
+		error = rename(source, dest);
+	}
+
+	Sys_Thread_LockMutex(logmutex);
+	snprintf(logarchivedname, sizeof(logarchivedname), "%s%s", dest, compress ? ".gz" : "");
+	logarchiveresult = error ? -1 : 1;
+	Sys_Thread_UnlockMutex(logmutex);
+}
+
+static void Log_ProcessBatch(unsigned int used)
+{
+	struct logrecord *record;
+	char *data;
+	unsigned int offset;
+
+	for(offset=0;offset<used;offset+=LOG_RECORDSIZE(record->length))
+	{
+		record = (struct logrecord *)(logbatch + offset);
+		data = (char *)(record + 1);
+
+		switch(record->type)
+		{
+			case LOGRECORD_DATA:
+				if (logfile == NULL)
+					break;
+
+				fwrite(data, 1, record->length, logfile);
+				logfilewritten += record->length;
+
+				if (logfilerotatesize && logfilewritten >= logfilerotatesize)
+					Log_RotateFile();
+
+				break;
+
+			case LOGRECORD_OPEN:
+				if (logfile)
+					fclose(logfile);
+
+				logfile = record->file;
+				logfilewritten = 0;
+				logfilerotatesize = record->rotatesize;
+				Q_strncpyz(logfilepath, data, sizeof(logfilepath));
+
+				break;
+
+			case LOGRECORD_CLOSE:
+				if (logfile)
+				{
+					fclose(logfile);
+					logfile = NULL;
+				}
+
+				break;
+
+			case LOGRECORD_ARCHIVE:
+				Log_ArchiveFile(data, data + strlen(data) + 1, record->compress);
+
+				break;
+
+			case LOGRECORD_SYNC:
+				if (logfile)
+					fflush(logfile);
+
+				if (logsyncsignal)
+					Sys_Thread_SendSignal(logsyncsignal);
+
+				break;
+		}
+	}
+
+	if (logfile)
+		fflush(logfile);
+}
+
+/* Takes everything queued so far and writes it out, returns 0 if the queue was empty */
+static int Log_WriteQueue(void)
+{
+	char *batch;
+	unsigned int size;
+	unsigned int used;
+
+	Sys_Thread_LockMutex(logmutex);
+
+	batch = logqueue;
+	size = logqueuesize;
+	used = logqueueused;
+
+	logqueue = logbatch;
+	logqueuesize = logbatchsize;
+	logqueueused = 0;
+	logqueuelastdata = -1;
+
+	Sys_Thread_UnlockMutex(logmutex);
+
+	logbatch = batch;
+	logbatchsize = size;
+
+	if (used == 0)
+		return 0;
+
+	Log_ProcessBatch(used);
+
+	return 1;
+}
+
+static void Log_Thread(void *arg)
+{
+	while(1)
+	{
+		Sys_Thread_WaitSignal(logsignal);
+
+		while(Log_WriteQueue());
+
+		if (logquit)
+			break;
+	}
+}
+
+static void Log_StartWriter(void)
+{
+	if (logmutex || logwriterfailed)
+		return;
+
+	logqueuelastdata = -1;
+
+	logmutex = Sys_Thread_CreateMutex();
+	if (logmutex == 0)
+	{
+		logwriterfailed = true;
+		return;
+	}
+
+	logsignal = Sys_Thread_CreateSignal();
+	logsyncsignal = Sys_Thread_CreateSignal();
+	if (logsignal && logsyncsignal)
+	{
+		logthread = Sys_Thread_CreateThread(Log_Thread, 0);
+		if (logthread)
+		{
+			Sys_Thread_SetThreadPriority(logthread, SYSTHREAD_PRIORITY_LOW);
+			return;
+		}
+	}
+
+	/* Fall back to writing the queue from the main thread */
+	if (logsignal)
+		Sys_Thread_DeleteSignal(logsignal);
+	if (logsyncsignal)
+		Sys_Thread_DeleteSignal(logsyncsignal);
+
+	logsignal = 0;
+	logsyncsignal = 0;
+}
+
+static void Log_StopWriter(void)
+{
+	if (logthread)
+	{
+		logquit = 1;
+		Sys_Thread_SendSignal(logsignal);
+		Sys_Thread_DeleteThread(logthread);
+		logthread = 0;
+		logquit = 0;
+
+		Sys_Thread_DeleteSignal(logsignal);
+		Sys_Thread_DeleteSignal(logsyncsignal);
+		logsignal = 0;
+		logsyncsignal = 0;
+	}
+
+	if (logmutex)
+	{
+		while(Log_WriteQueue());
+
+		Sys_Thread_DeleteMutex(logmutex);
+		logmutex = 0;
+	}
+
+	free(logqueue);
+	free(logbatch);
+	logqueue = NULL;
+	logbatch = NULL;
+	logqueuesize = 0;
+	logbatchsize = 0;
+
+	if (zlib_handle)
+	{
+		Sys_Lib_Close(zlib_handle);
+		zlib_handle = 0;
+	}
+}
+
+/* Must be called with logmutex held */
+static qboolean Log_QueueReserve(unsigned int size)
+{
+	char *newqueue;
+	unsigned int newsize;
+
+	if (size <= logqueuesize)
+		return true;
+
+	newsize = logqueuesize ? logqueuesize : LOG_BATCHSIZE * 2;
+	while(newsize < size)
+		newsize *= 2;
+
+	newqueue = realloc(logqueue, newsize);
+	if (newqueue == NULL)
+		return false;
+
+	logqueue = newqueue;
+	logqueuesize = newsize;
+
+	return true;
+}
+
+static void Log_QueueRecord(struct logrecord *record, const void *data)
+{
+	struct logrecord *queued;
+
+	Sys_Thread_LockMutex(logmutex);
+
+	if (Log_QueueReserve(logqueueused + LOG_RECORDSIZE(record->length)))
+	{
+		queued = (struct logrecord *)(logqueue + logqueueused);
+		*queued = *record;
+		if (record->length)
+			memcpy(queued + 1, data, record->length);
+
+		logqueueused += LOG_RECORDSIZE(record->length);
+		logqueuelastdata = -1;
+	}
+
+	Sys_Thread_UnlockMutex(logmutex);
+}
+
+/* Hands the queue to the writer */
+static void Log_Kick(void)
+{
+	loglastflush = Sys_DoubleTime();
+
+	if (logthread)
+		Sys_Thread_SendSignal(logsignal);
+	else if (logmutex)
+		while(Log_WriteQueue());
+}
+
+/* Returns once everything queued so far has been written */
+static void Log_Sync(void)
+{
+	struct logrecord record;
+
+	if (logthread)
+	{
+		memset(&record, 0, sizeof(record));
+		record.type = LOGRECORD_SYNC;
+		Log_QueueRecord(&record, NULL);
+
+		Sys_Thread_SendSignal(logsignal);
+		Sys_Thread_WaitSignal(logsyncsignal);
+	}
+	else
+		Log_Kick();
+}
+
 qboolean Log_IsLogging(void)
 {
-	return logfile ? true : false;
+	return logging;
 }
 
 static char *Log_LogDirectory(void)
@@ -50,13 +490,42 @@ static char *Log_LogDirectory(void)
 	return dir;
 }
 
+static void Log_Start(FILE *file, const char *path, unsigned int rotatesize)
+{
+	struct logrecord record;
+
+	Log_StartWriter();
+	if (logmutex == 0)
+	{
+		fclose(file);
+		Com_Printf("Error: Couldn't start the log writer\n");
+		return;
+	}
+
+	memset(&record, 0, sizeof(record));
+	record.type = LOGRECORD_OPEN;
+	record.length = strlen(path) + 1;
+	record.file = file;
+	record.rotatesize = rotatesize;
+	Log_QueueRecord(&record, path);
+	Log_Kick();
+
+	logging = true;
+}
+
 static void Log_Stop(void)
 {
+	struct logrecord record;
+
 	if (!Log_IsLogging())
 		return;
 
-	fclose(logfile);
-	logfile = NULL;
+	memset(&record, 0, sizeof(record));
+	record.type = LOGRECORD_CLOSE;
+	Log_QueueRecord(&record, NULL);
+	Log_Kick();
+
+	logging = false;
 }
 
 static qboolean OnChange_log_dir(cvar_t *var, char *string)
@@ -150,7 +619,7 @@ static void Log_log_f(void)
 			}
 
 			Com_Printf("Logging to %s\n", logfilename);
-			logfile = templog;
+			Log_Start(templog, fulllogname, log_rotatesize.value * 1024);
 
 			break;
 		default:
@@ -165,6 +634,9 @@ void Log_CvarInit(void)
 	Cvar_SetCurrentGroup(CVAR_GROUP_CONSOLE);
 	Cvar_Register (&log_dir);
 	Cvar_Register (&log_readable);
+	Cvar_Register (&log_flushinterval);
+	Cvar_Register (&log_rotatesize);
+	Cvar_Register (&log_compress);
 
 	Cvar_ResetCurrentGroup();
 
@@ -175,14 +647,96 @@ void Log_Shutdown(void)
 {
 	if (Log_IsLogging())	
 		Log_Stop();
+
+	Log_StopWriter();
 }
 
 void Log_Write(const char *s)
 {
+	struct logrecord *record;
+	unsigned int length;
+	unsigned int queued;
+	unsigned int i;
+	char *data;
+
 	if (!Log_IsLogging())
 		return;
 
-	fprintf(logfile, "%s", s);
+	length = strlen(s);
+	if (length == 0)
+		return;
+
+	Sys_Thread_LockMutex(logmutex);
+
+	/* Consecutive lines are merged into one record */
+	if (logqueuelastdata < 0)
+	{
+		if (!Log_QueueReserve(logqueueused + LOG_RECORDSIZE(length)))
+		{
+			Sys_Thread_UnlockMutex(logmutex);
+			return;
+		}
+
+		record = (struct logrecord *)(logqueue + logqueueused);
+		memset(record, 0, sizeof(*record));
+		record->type = LOGRECORD_DATA;
+		logqueuelastdata = logqueueused;
+	}
+	else
+	{
+		record = (struct logrecord *)(logqueue + logqueuelastdata);
+		if (!Log_QueueReserve(logqueuelastdata + LOG_RECORDSIZE(record->length + length)))
+		{
+			Sys_Thread_UnlockMutex(logmutex);
+			return;
+		}
+
+		record = (struct logrecord *)(logqueue + logqueuelastdata);
+	}
+
+	data = (char *)(record + 1) + record->length;
+
+	if (log_readable.value)
+	{
+		for(i=0;i<length;i++)
+			data[i] = readablechars[(unsigned char)s[i]];
+	}
+	else
+		memcpy(data, s, length);
+
+	record->length += length;
+	logqueueused = logqueuelastdata + LOG_RECORDSIZE(record->length);
+	queued = logqueueused;
+
+	Sys_Thread_UnlockMutex(logmutex);
+
+	if (queued >= LOG_BATCHSIZE)
+		Log_Kick();
+}
+
+void Log_Frame(void)
+{
+	char archivedname[LOG_FILENAME_MAXSIZE];
+	unsigned int queued;
+	int result;
+
+	if (logmutex == 0)
+		return;
+
+	Sys_Thread_LockMutex(logmutex);
+	queued = logqueueused;
+	result = logarchiveresult;
+	logarchiveresult = 0;
+	Q_strncpyz(archivedname, logarchivedname, sizeof(archivedname));
+	Sys_Thread_UnlockMutex(logmutex);
+
+	if (result > 0)
+		Com_Printf("Match console log saved to %s\n", COM_SkipPath(archivedname));
+	else if (result < 0)
+		Com_Printf("Error: Couldn't save match console log to %s\n", COM_SkipPath(archivedname));
+
+	if (queued && Sys_DoubleTime() - loglastflush >= log_flushinterval.value)
+		Log_Kick();
 }
 
 //=============================================================================
@@ -267,6 +821,9 @@ void Log_AutoLogging_StartMatch(char *logname)
 
 	Q_strncpyz(auto_matchname, logname, sizeof(auto_matchname));
 
+	/* The previous match may still be being archived from the temp file */
+	Log_Sync();
+
 	Q_strncpyz (extendedname, TEMP_LOG_NAME, sizeof(extendedname));
 	COM_ForceExtension(extendedname, ".log");
 	fullname = va("%s/%s", MT_TempDirectory(), extendedname);
@@ -283,7 +840,7 @@ void Log_AutoLogging_StartMatch(char *logname)
 
 	Com_Printf ("Auto console logging commenced\n");
 
-	logfile = templog;
+	Log_Start(templog, fullname, 0);
 	autologging = true;
 	auto_starttime = cls.realtime;
 }
@@ -295,9 +852,11 @@ qboolean Log_AutoLogging_Status(void)
 
 void Log_AutoLogging_SaveMatch(void)
 {
-	int error, num;
+	struct logrecord record;
+	int num;
 	FILE *f;
-	char *dir, *tempname, savedname[2 * MAX_OSPATH], *fullsavedname, *exts[] = {"log", NULL};
+	char *dir, *tempname, savedname[2 * MAX_OSPATH], *fullsavedname, *exts[] = {"log", "log.gz", NULL};
+	char names[LOG_FILENAME_MAXSIZE * 2];
 
 	if (!temp_log_ready)
 		return;
@@ -322,13 +881,21 @@ void Log_AutoLogging_SaveMatch(void)
 
 	fclose(f);
 
-	if ((error = rename(tempname, fullsavedname)))
-	{
-		FS_CreatePath(fullsavedname);
-		error = rename(tempname, fullsavedname);
-	}
+	FS_CreatePath(fullsavedname);
+
+	/* Renaming and compressing is left to the writer, which reports back through Log_Frame */
+	memset(&record, 0, sizeof(record));
+	record.type = LOGRECORD_ARCHIVE;
+	record.length = snprintf(names, sizeof(names), "%s%c%s", tempname, 0, fullsavedname) + 1;
+	record.compress = log_compress.value && Log_LoadZlib();
+	if (record.length > sizeof(names))
+		return;
+
+	Log_StartWriter();
+	if (logmutex == 0)
+		return;
 
-	if (!error)
-		Com_Printf("Match console log saved to %s\n", savedname);
+	Log_QueueRecord(&record, names);
+	Log_Kick();
 }
 
@@ -74,6 +74,7 @@ static qboolean net_lag_callback(cvar_t *var, char *string);
 static qboolean net_lag_ezcheat_callback(cvar_t *var, char *string);
 
 #include "pmove.h"
+#include "pvscache.h"
 
 static qboolean cl_imitate_client_callback(cvar_t *var, char *string);
 static qboolean cl_imitate_os_callback(cvar_t *var, char *string);
@@ -98,7 +99,10 @@ cvar_t	cl_hudswap	= {"cl_hudswap", "0", CVAR_ARCHIVE};
 cvar_t	cl_maxfps	= {"cl_maxfps", "0", CVAR_ARCHIVE};
 
 cvar_t	cl_predictPlayers = {"cl_predictPlayers", "1"};
+cvar_t	cl_predictPlayers_full = {"cl_predictPlayers_full", "0"};
+cvar_t	cl_predictThreads = {"cl_predictThreads", "0"};
 cvar_t	cl_solidPlayers = {"cl_solidPlayers", "1"};
+cvar_t	cl_download_window = {"cl_download_window", "32"};
 
 cvar_t  localid = {"localid", ""};
 
@@ -1385,6 +1389,129 @@ void CL_Disconnect_f(void)
 	Host_EndGame();
 }
 
+/* Times a walk through the leafs of the current map, fetching each leaf's PVS
+ * and visiting its visible leafs the way R_MarkLeaves does, once by plain
+ * decompression and a bit at a time and once through the PVS cache a word at
+ * a time. */
+static void CL_VisBench_f(void)
+{
+	model_t *model;
+	unsigned int *walk;
+	unsigned int iterations;
+	unsigned int numleafs;
+	unsigned int numwords;
+	unsigned int leafnum;
+	unsigned int visible;
+	unsigned int pick;
+	unsigned int i;
+	unsigned int j;
+	unsigned int uncachedcount;
+	unsigned int cachedcount;
+	const unsigned char *row;
+	const unsigned long *vis;
+	unsigned long bits;
+	double start;
+	double uncachedtime;
+	double cachedtime;
+
+	model = cl.worldmodel;
+	if (model == 0 || model->numleafs == 0)
+	{
+		Com_Printf("vis_bench: no map loaded\n");
+		return;
+	}
+
+	iterations = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 20000;
+	if (iterations == 0)
+		iterations = 1;
+
+	walk = malloc(iterations * sizeof(*walk));
+	if (walk == 0)
+	{
+		Com_Printf("vis_bench: out of memory\n");
+		return;
+	}
+
+	numleafs = model->numleafs;
+	numwords = PVSCACHE_ROWBYTES(numleafs) / sizeof(unsigned long);
+
+	/* Walk from each leaf to a random leaf it can see, like a player moving around the map */
+	srand(1);
+	leafnum = rand() % numleafs;
+	for(i=0;i<iterations;i++)
+	{
+		walk[i] = leafnum;
+
+		row = PVSCache_Get(0, leafnum, model->leafs[leafnum + 1].compressed_vis, numleafs);
+
+		visible = 0;
+		for(j=0;j<numleafs;j++)
+		{
+			if (row[j >> 3] & (1 << (j & 7)))
+				visible++;
+		}
+
+		if (visible == 0)
+		{
+			leafnum = rand() % numleafs;
+			continue;
+		}
+
+		pick = rand() % visible;
+		for(j=0;j<numleafs;j++)
+		{
+			if ((row[j >> 3] & (1 << (j & 7))) && pick-- == 0)
+				break;
+		}
+
+		leafnum = j;
+	}
+
+	uncachedcount = 0;
+	start = Sys_DoubleTime();
+	for(i=0;i<iterations;i++)
+	{
+		row = PVSCache_Get(0, walk[i], model->leafs[walk[i] + 1].compressed_vis, numleafs);
+
+		for(j=0;j<numleafs;j++)
+		{
+			if (row[j >> 3] & (1 << (j & 7)))
+				uncachedcount += j;
+		}
+	}
+	uncachedtime = Sys_DoubleTime() - start;
+
+	cachedcount = 0;
+	start = Sys_DoubleTime();
+	for(i=0;i<iterations;i++)
+	{
+		vis = (const unsigned long *)PVSCache_Get(model->pvscache, walk[i], model->leafs[walk[i] + 1].compressed_vis, numleafs);
+
+		for(j=0;j<numwords;j++)
+		{
+			bits = vis[j];
+			while (bits)
+			{
+				leafnum = j * (sizeof(bits) * 8) + __builtin_ctzl(bits);
+				bits &= bits - 1;
+
+				if (leafnum < numleafs)
+					cachedcount += leafnum;
+			}
+		}
+	}
+	cachedtime = Sys_DoubleTime() - start;
+
+	free(walk);
+
+	Com_Printf("%u leaf changes on %u leafs\n", iterations, numleafs);
+	Com_Printf("uncached, bit by bit:  %.2f us each\n", uncachedtime * 1000000 / iterations);
+	Com_Printf("cached, word by word:  %.2f us each\n", cachedtime * 1000000 / iterations);
+
+	if (uncachedcount != cachedcount)
+		Com_Printf("vis_bench: the two walks visited different leafs!\n");
+}
+
 //The server is changing levels
 void CL_Reconnect_f(void)
 {
@@ -1902,10 +2029,13 @@ void CL_CvarInit(void)
 
 	Cvar_SetCurrentGroup(CVAR_GROUP_NETWORK);
 	Cvar_Register(&cl_predictPlayers);
+	Cvar_Register(&cl_predictPlayers_full);
+	Cvar_Register(&cl_predictThreads);
 	Cvar_Register(&cl_solidPlayers);
 	Cvar_Register(&cl_oldPL);
 	Cvar_Register(&cl_timeout);
 	Cvar_Register(&cl_useproxy);
+	Cvar_Register(&cl_download_window);
 
 	Cvar_Register(&net_maxfps);
 	Cvar_Register(&net_lag);
@@ -1920,6 +2050,7 @@ void CL_CvarInit(void)
 	Cvar_Register(&rcon_address);
 	Cvar_Register(&localid);
 	Cvar_Register(&cl_warncmd);
+	Cvar_Register(&cmd_compilealiases);
 	Cvar_Register(&cl_cmdline);
 
 	Cvar_ResetCurrentGroup();
@@ -1962,6 +2093,8 @@ void CL_CvarInit(void)
 
 	Cmd_AddCommand("reconnect", CL_Reconnect_f);
 
+	Cmd_AddCommand("vis_bench", CL_VisBench_f);
+
 	Cmd_AddMacro("connectiontype", CL_Macro_ConnectionType);
 	Cmd_AddMacro("demoplayback", CL_Macro_Demoplayback);
 	Cmd_AddMacro("matchstatus", CL_Macro_Serverstatus);
@@ -2201,12 +2334,17 @@ void CL_Frame (double time)
 	// fetch results from server
 	CL_ReadPackets();
 
+	if (cls.download && (cls.ftexsupported&FTEX_CHUNKEDDOWNLOADS))
+		CL_RequestNextFTEDownloadChunks();
+
 	if (cls.mvdplayback)
 		MVD_Interpolate();
 
 	// process stuffed commands
 	Cbuf_ExecuteEx(cbuf_svc);
 
+	Cvar_Frame();
+
 	if (!cls.demoplayback || cls.mvdplayback)
 		Mouse_GetViewAngles(cl.viewangles);
 
@@ -2277,6 +2415,7 @@ void CL_Frame (double time)
 	CDAudio_Update();
 	MP3_Frame();
 	MT_Frame();
+	Log_Frame();
 	Lua_Frame();
 
 	if (Movie_IsCapturing())
@@ -42,6 +42,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "strl.h"
 
 extern cvar_t net_maxfps;
+extern cvar_t cl_download_window;
+extern cvar_t rate;
 
 void R_PreMapLoad(void);
 
@@ -307,6 +309,7 @@ void Model_NextDownload (void)
 	MT_NewMap();
 	Stats_NewMap();
 	R_DrawFlat_NewMap();
+	Lua_MapChange();
 
 #ifdef NETQW
 	if (cls.netqw)
@@ -399,7 +402,12 @@ static qboolean CL_OpenDownloadFile()
 
 	cls.download = fopen(name, "wb");
 	if (cls.download)
+	{
+		cls.downloadstarttime = cls.realtime;
+		cls.downloadbytes = 0;
+		cls.downloadrate = 0;
 		return true;
+	}
 
 	Com_ErrorPrintf("Failed to open output file \"%s\" for writing.\n", name);
 
@@ -433,6 +441,7 @@ static void CL_FinishDownloadFile()
 
 	cls.download = NULL;
 	cls.downloadpercent = 0;
+	cls.downloadrate = 0;
 
 	// get another file if needed
 
@@ -440,60 +449,109 @@ static void CL_FinishDownloadFile()
 }
 
 #define FTEFILECHUNKSIZE 1024
-#define FTEMAXCHUNKS 64
-
-static int downloadchunkrequestsequencenumber[FTEMAXCHUNKS];
-static unsigned char downloadchunkdata[FTEMAXCHUNKS*FTEFILECHUNKSIZE];
+#define FTEMAXCHUNKS 256
+#define FTEMAXREQUESTSPERFRAME 16
+#define FTEMINREQUESTTIMEOUT 0.2
+#define FTEMAXREQUESTBACKOFF 4
+
+// chunks [downloadfirstchunk, downloadfirstchunk + FTEMAXCHUNKS) are tracked in a ring starting at downloadchunkwindowoffset
+static double downloadchunkrequesttime[FTEMAXCHUNKS];
+static unsigned char downloadchunkretries[FTEMAXCHUNKS];
+static unsigned char downloadchunkreceived[FTEMAXCHUNKS / 8];
 static unsigned int downloadchunkwindowoffset;
-static unsigned int downloadchunkcycle;
 static unsigned int downloadfirstchunk;
 static unsigned int downloadlastchunknumber;
-static unsigned int downloadchunksinbuffer;
+static unsigned int downloadchunksreceived;
+static unsigned int downloadfilesize;
+
+static void CL_UpdateDownloadRate(unsigned int bytes)
+{
+	cls.downloadbytes += bytes;
+
+	if (cls.realtime > cls.downloadstarttime)
+		cls.downloadrate = cls.downloadbytes / (cls.realtime - cls.downloadstarttime);
+}
 
-static void CL_GetFTEDownloadChunk(sizebuf_t *buf, int chunknumber)
+static qboolean CL_GetFTEDownloadChunk(unsigned int chunknumber)
 {
-	MSG_WriteByte(buf, clc_stringcmd);
-	MSG_WriteString(buf, va("nextdl %d", chunknumber));
+#ifdef NETQW
+	char buf[32];
+	int i;
+
+	i = snprintf(buf, sizeof(buf), "%cnextdl %u", clc_stringcmd, chunknumber);
+	if (i >= sizeof(buf) || !NetQW_AppendReliableBuffer(cls.netqw, buf, i + 1))
+		return false;
+#else
+	if (cls.netchan.message.maxsize - cls.netchan.message.cursize < 32)
+		return false;
+
+	MSG_WriteByte(&cls.netchan.message, clc_stringcmd);
+	MSG_WriteString(&cls.netchan.message, va("nextdl %u", chunknumber));
+#endif
+
+	downloadchunkrequesttime[((chunknumber-downloadfirstchunk)+downloadchunkwindowoffset)%FTEMAXCHUNKS] = cls.realtime;
 
-	downloadchunkrequestsequencenumber[((chunknumber-downloadfirstchunk)+downloadchunkwindowoffset)%FTEMAXCHUNKS] = cls.netchan.outgoing_sequence;
+	return true;
 }
 
-void CL_RequestNextFTEDownloadChunk(sizebuf_t *buf)
+// keeps up to cl_download_window chunks past the first missing one requested, and asks again for those that have not arrived in time
+void CL_RequestNextFTEDownloadChunks(void)
 {
 	unsigned int i, j;
-	int oldestrequest;
-	int oldestrequestage;
-	int age;
+	unsigned int window;
+	unsigned int requests;
+	unsigned int outstanding;
+	qboolean resend;
+	double bytespersecond;
+	double timeout;
 
-	oldestrequest = -1;
-	oldestrequestage = 0;
+	window = bound(1, cl_download_window.value, FTEMAXCHUNKS);
 
-	for(i=downloadchunkwindowoffset,j=0;j<FTEMAXCHUNKS&&downloadfirstchunk+j<=downloadlastchunknumber;j++,i++)
+	outstanding = 0;
+	for(j=0;j<window&&downloadfirstchunk+j<=downloadlastchunknumber;j++)
 	{
-		i%= FTEMAXCHUNKS;
-		if (downloadchunkrequestsequencenumber[i] == -1)
-		{
-			CL_GetFTEDownloadChunk(buf, j+downloadfirstchunk);
-			return;
-		}
+		i = (downloadchunkwindowoffset+j)%FTEMAXCHUNKS;
 
-		age = cls.netchan.incoming_sequence-downloadchunkrequestsequencenumber[i];
-
-		if (downloadchunkrequestsequencenumber[i] != -2 && age > oldestrequestage)
-		{
-			oldestrequestage = age;
-			oldestrequest = j;
-		}
+		if (downloadchunkrequesttime[i] && !(downloadchunkreceived[i/8]&(1<<(i&7))))
+			outstanding++;
 	}
 
-	if (oldestrequest != -1)
-		CL_GetFTEDownloadChunk(buf, downloadfirstchunk+oldestrequest);
+	// the server sends the outstanding chunks one after another at its rate limit, so wait for all of them to get through before asking again
+	bytespersecond = cls.downloadrate > 0 ? cls.downloadrate : max(rate.value, 500);
+	timeout = max(FTEMINREQUESTTIMEOUT, cls.latency * 3);
+	timeout = max(timeout, cls.latency + outstanding * FTEFILECHUNKSIZE / bytespersecond);
+	requests = 0;
+
+	for(j=0;j<window&&downloadfirstchunk+j<=downloadlastchunknumber&&requests<FTEMAXREQUESTSPERFRAME;j++)
+	{
+		i = (downloadchunkwindowoffset+j)%FTEMAXCHUNKS;
+
+		if ((downloadchunkreceived[i/8]&(1<<(i&7))))
+			continue;
+
+		// and back off further every time the same chunk has to be asked for again
+		if (downloadchunkrequesttime[i] && downloadchunkrequesttime[i] + timeout * (1<<downloadchunkretries[i]) > cls.realtime)
+			continue;
+
+		resend = downloadchunkrequesttime[i] != 0;
+
+		if (!CL_GetFTEDownloadChunk(downloadfirstchunk+j))
+			break;
+
+		if (resend && downloadchunkretries[i] < FTEMAXREQUESTBACKOFF)
+			downloadchunkretries[i]++;
+
+		requests++;
+	}
 }
 
 static void CL_ParseFTEChunkedDownload()
 {
+	unsigned char buf[FTEFILECHUNKSIZE];
+	unsigned int i;
+	unsigned int size;
 	int chunk;
-	static int filesize;
+	int filesize;
 
 	chunk = MSG_ReadLong();
 
@@ -514,14 +572,16 @@ static void CL_ParseFTEChunkedDownload()
 				{
 					if (CL_OpenDownloadFile())
 					{
-						MSG_WriteByte(&cls.netchan.message, clc_stringcmd);
-						MSG_WriteString(&cls.netchan.message, va("nextdl %d", 1));
-
-						memset(downloadchunkrequestsequencenumber, 0xff, sizeof(downloadchunkrequestsequencenumber));
+						memset(downloadchunkrequesttime, 0, sizeof(downloadchunkrequesttime));
+						memset(downloadchunkretries, 0, sizeof(downloadchunkretries));
+						memset(downloadchunkreceived, 0, sizeof(downloadchunkreceived));
 						downloadchunkwindowoffset = 0;
-						downloadchunkcycle = 0;
 						downloadfirstchunk = 0;
-						downloadlastchunknumber = (filesize>0?filesize-1:filesize)/FTEFILECHUNKSIZE;
+						downloadchunksreceived = 0;
+						downloadfilesize = filesize;
+						downloadlastchunknumber = (filesize-1)/FTEFILECHUNKSIZE;
+
+						CL_RequestNextFTEDownloadChunks();
 						return;
 					}
 					else
@@ -552,70 +612,48 @@ static void CL_ParseFTEChunkedDownload()
 		}
 
 		CL_RequestNextDownload();
+		return;
 	}
-	else if (cls.download)
-	{
-		if (chunk >= downloadfirstchunk)
-		{
-			if (chunk < downloadfirstchunk+FTEMAXCHUNKS)
-			{
-				if (downloadchunkrequestsequencenumber[((chunk-downloadfirstchunk)+downloadchunkwindowoffset)%FTEMAXCHUNKS] != -2)
-				{
-					unsigned int numreadychunks;
-					downloadchunksinbuffer++;
 
-					downloadchunkrequestsequencenumber[((chunk-downloadfirstchunk)+downloadchunkwindowoffset)%FTEMAXCHUNKS] = -2;
-					MSG_ReadData(downloadchunkdata+((((chunk-downloadfirstchunk)+downloadchunkwindowoffset)%FTEMAXCHUNKS)*FTEFILECHUNKSIZE), FTEFILECHUNKSIZE);
+	MSG_ReadData(buf, FTEFILECHUNKSIZE);
 
-					cls.downloadpercent = (100*(downloadfirstchunk+downloadchunksinbuffer))/(downloadlastchunknumber+1);
+	if (!cls.download || chunk < downloadfirstchunk || chunk >= downloadfirstchunk+FTEMAXCHUNKS || chunk > downloadlastchunknumber)
+		return;
 
-					numreadychunks = 0;
-					while(numreadychunks < FTEMAXCHUNKS && downloadchunkrequestsequencenumber[(numreadychunks+downloadchunkwindowoffset)%FTEMAXCHUNKS] == -2)
-					{
-						downloadchunkrequestsequencenumber[(numreadychunks+downloadchunkwindowoffset)%FTEMAXCHUNKS] = -1;
-						numreadychunks++;
-					}
+	i = ((chunk-downloadfirstchunk)+downloadchunkwindowoffset)%FTEMAXCHUNKS;
+	if ((downloadchunkreceived[i/8]&(1<<(i&7))))
+		return;
 
-					if (numreadychunks)
-					{
-						if (downloadchunkwindowoffset+numreadychunks > FTEMAXCHUNKS)
-						{
-							fwrite(downloadchunkdata+downloadchunkwindowoffset*FTEFILECHUNKSIZE, 1, (FTEMAXCHUNKS-downloadchunkwindowoffset)*FTEFILECHUNKSIZE, cls.download);
-							fwrite(downloadchunkdata, 1, (numreadychunks-(FTEMAXCHUNKS-downloadchunkwindowoffset))*FTEFILECHUNKSIZE, cls.download);
-						}
-						else
-						{
-							unsigned int size = numreadychunks*FTEFILECHUNKSIZE;
-
-							if ((downloadfirstchunk*FTEFILECHUNKSIZE)+size > filesize)
-								size = filesize-(downloadfirstchunk*FTEFILECHUNKSIZE);
-
-							fwrite(downloadchunkdata+(downloadchunkwindowoffset*FTEFILECHUNKSIZE), 1, size, cls.download);
-						}
-
-						downloadchunkwindowoffset+= numreadychunks;
-						downloadchunkwindowoffset%= FTEMAXCHUNKS;
-						downloadfirstchunk+= numreadychunks;
-						downloadchunksinbuffer-= numreadychunks;
-
-						if (downloadfirstchunk == downloadlastchunknumber+1)
-						{
-							CL_FinishDownloadFile();
-						}
-					}
-					return;
-				}
-			}
-		}
+	// chunks can arrive in any order, so write each one straight to its place in the file
+	size = FTEFILECHUNKSIZE;
+	if (chunk*FTEFILECHUNKSIZE+size > downloadfilesize)
+		size = downloadfilesize-chunk*FTEFILECHUNKSIZE;
 
-		msg_readcount+= 1024;
-	}
-	else
+	if (fseek(cls.download, chunk*FTEFILECHUNKSIZE, SEEK_SET) != 0 || fwrite(buf, 1, size, cls.download) != size)
 	{
-		char buf[FTEFILECHUNKSIZE];
+		Com_ErrorPrintf("Failed to write to \"%s\".\n", cls.downloadtempname);
+		return;
+	}
 
-		MSG_ReadData(buf, FTEFILECHUNKSIZE);
+	downloadchunkreceived[i/8]|= 1<<(i&7);
+	downloadchunksreceived++;
+
+	CL_UpdateDownloadRate(size);
+
+	// slide the window past every chunk that is now complete
+	while((downloadchunkreceived[downloadchunkwindowoffset/8]&(1<<(downloadchunkwindowoffset&7))))
+	{
+		downloadchunkreceived[downloadchunkwindowoffset/8]&= ~(1<<(downloadchunkwindowoffset&7));
+		downloadchunkrequesttime[downloadchunkwindowoffset] = 0;
+		downloadchunkretries[downloadchunkwindowoffset] = 0;
+		downloadchunkwindowoffset = (downloadchunkwindowoffset+1)%FTEMAXCHUNKS;
+		downloadfirstchunk++;
 	}
+
+	cls.downloadpercent = (100*downloadchunksreceived)/(downloadlastchunknumber+1);
+
+	if (downloadfirstchunk == downloadlastchunknumber+1)
+		CL_FinishDownloadFile();
 }
 
 static void CL_ParseQWDownload (void)
@@ -662,6 +700,8 @@ static void CL_ParseQWDownload (void)
 	fwrite (cl_net_message.data + msg_readcount, 1, size, cls.download);
 	msg_readcount += size;
 
+	CL_UpdateDownloadRate(size);
+
 	if (percent != 100)
 	{
 // change display routines by zoid
@@ -1303,11 +1343,12 @@ void CL_PlayerEnterSlot(player_info_t *player)
 	player->ignored = false;
 	memset(&oldplayerstates[player - cl.players], 0, sizeof(player_state_t));
 	Stats_EnterSlot(player - cl.players);
+	Lua_PlayerEnter(player - cl.players);
 }
 
 void CL_PlayerLeaveSlot(player_info_t *player)
 {
-	return;
+	Lua_PlayerLeave(player - cl.players);
 }
 
 void CL_UpdateUserinfo (void)
@@ -1591,7 +1632,7 @@ void CL_ParseStufftext (void)
 
 void CL_SetStat (int stat, int value)
 {
-	int	j;
+	int	j, oldvalue;
 
 	if (stat < 0 || stat >= MAX_CL_STATS)
 		Host_Error ("CL_SetStat: %i is invalid", stat);
@@ -1615,6 +1656,7 @@ void CL_SetStat (int stat, int value)
 				cl.item_gettime[j] = cl.time;
 	}
 
+	oldvalue = cl.stats[stat];
 	cl.stats[stat] = value;
 
 	if (stat == STAT_TIME && (cl.z_ext & Z_EXT_SERVERTIME))
@@ -1624,6 +1666,9 @@ void CL_SetStat (int stat, int value)
 	}
 
 	TP_StatChanged(stat, value);
+
+	if (value != oldvalue)
+		Lua_StatChanged(stat, value, oldvalue);
 }
 
 void CL_MuzzleFlash (void)
@@ -35,7 +35,10 @@ qboolean OnChange_cl_pushlatency(cvar_t *cvar, char *string) {
 	return true;
 }
 
-void CL_PredictUsercmd (player_state_t *from, player_state_t *to, usercmd_t *u) {
+//Runs a player move on the given context, which may be one of several running at the same time
+void CL_PredictUsercmdEx (struct PMoveContext *ctx, player_state_t *from, player_state_t *to, usercmd_t *u) {
+	playermove_t *pm = ctx->pmove;
+
 	// split up very long moves
 	if (u->msec > 50) {
 		player_state_t temp;
@@ -44,42 +47,46 @@ void CL_PredictUsercmd (player_state_t *from, player_state_t *to, usercmd_t *u)
 		split = *u;
 		split.msec /= 2;
 
-		CL_PredictUsercmd (from, &temp, &split);
-		CL_PredictUsercmd (&temp, to, &split);
+		CL_PredictUsercmdEx (ctx, from, &temp, &split);
+		CL_PredictUsercmdEx (ctx, &temp, to, &split);
 		return;
 	}
 
-	VectorCopy (from->origin, pmove.origin);
-	VectorCopy (u->angles, pmove.angles);
-	VectorCopy (from->velocity, pmove.velocity);
+	VectorCopy (from->origin, pm->origin);
+	VectorCopy (u->angles, pm->angles);
+	VectorCopy (from->velocity, pm->velocity);
 
-	pmove.jump_msec = (cl.z_ext & Z_EXT_PM_TYPE) ? 0 : from->jump_msec;
-	pmove.jump_held = from->jump_held;
-	pmove.waterjumptime = from->waterjumptime;
-	pmove.pm_type = from->pm_type;
+	pm->jump_msec = (cl.z_ext & Z_EXT_PM_TYPE) ? 0 : from->jump_msec;
+	pm->jump_held = from->jump_held;
+	pm->waterjumptime = from->waterjumptime;
+	pm->pm_type = from->pm_type;
 
-	pmove.cmd = *u;
+	pm->cmd = *u;
 
-	movevars.entgravity = cl.entgravity;
-	movevars.maxspeed = cl.maxspeed;
-	movevars.bunnyspeedcap = cl.bunnyspeedcap;
+	ctx->movevars->entgravity = cl.entgravity;
+	ctx->movevars->maxspeed = cl.maxspeed;
+	ctx->movevars->bunnyspeedcap = cl.bunnyspeedcap;
 
-	PM_PlayerMove ();
+	PM_PlayerMoveEx (ctx);
 
-	to->waterjumptime = pmove.waterjumptime;
-	to->jump_held = pmove.jump_held;
-	to->jump_msec = pmove.jump_msec;
-	pmove.jump_msec = 0;
+	to->waterjumptime = pm->waterjumptime;
+	to->jump_held = pm->jump_held;
+	to->jump_msec = pm->jump_msec;
+	pm->jump_msec = 0;
 
-	VectorCopy (pmove.origin, to->origin);
-	VectorCopy (pmove.angles, to->viewangles);
-	VectorCopy (pmove.velocity, to->velocity);
-	to->onground = pmove.onground;
+	VectorCopy (pm->origin, to->origin);
+	VectorCopy (pm->angles, to->viewangles);
+	VectorCopy (pm->velocity, to->velocity);
+	to->onground = pm->onground;
 
 	to->weaponframe = from->weaponframe;
 	to->pm_type = from->pm_type;
 }
 
+void CL_PredictUsercmd (player_state_t *from, player_state_t *to, usercmd_t *u) {
+	CL_PredictUsercmdEx (&pmove_context, from, to, u);
+}
+
 //Used when cl_nopred is 1 to determine whether we are on ground, otherwise stepup smoothing code produces ugly jump physics
 void CL_CategorizePosition (void) {
 	if (cl.spectator && cl.playernum == cl.viewplayernum) {
@@ -81,7 +81,7 @@ static float con_cursorspeed = 4;
 
 unsigned int scr_clearnotifylines;
 
-float			oldscreensize, oldfov, oldsbar;
+static struct CvarSubscription *scr_refdefsubscription;
 cvar_t			scr_viewsize = {"viewsize", "100", CVAR_ARCHIVE};
 cvar_t			scr_fov = {"fov", "90", CVAR_ARCHIVE};	// 10 - 140
 cvar_t			scr_consize = {"scr_consize", "0.75"};
@@ -824,6 +824,7 @@ static void SCR_DrawDownload(unsigned int vislines)
 	int i, j, x, n;
 	char *text;
 	char dlbar[1024];
+	char rate[32];
 	unsigned int linewidth;
 	unsigned int textlength;
 	unsigned int dotlength;
@@ -846,6 +847,11 @@ static void SCR_DrawDownload(unsigned int vislines)
 
 	textlength = strlen(text);
 
+	if (cls.downloadrate)
+		snprintf(rate, sizeof(rate), " %dkB/s", (int)(cls.downloadrate / 1024));
+	else
+		rate[0] = 0;
+
 	if (strlen(text) > i)
 	{
 		barlength = x - i - 11;
@@ -858,7 +864,12 @@ static void SCR_DrawDownload(unsigned int vislines)
 		dotlength = 0;
 	}
 
-	if (textlength + dotlength + 2 + 1 + barlength + 1 + 5 + 1 > sizeof(dlbar))
+	if (barlength > strlen(rate) + 1)
+		barlength -= strlen(rate);
+	else
+		rate[0] = 0;
+
+	if (textlength + dotlength + 2 + 1 + barlength + 1 + 5 + strlen(rate) + 1 > sizeof(dlbar))
 		return;
 
 	memcpy(dlbar, text, textlength);
@@ -880,7 +891,7 @@ static void SCR_DrawDownload(unsigned int vislines)
 			dlbar[i++] = '\x81';
 	dlbar[i++] = '\x82';
 
-	sprintf(dlbar + i, " %02d%%", cls.downloadpercent);
+	sprintf(dlbar + i, " %02d%%%s", cls.downloadpercent, rate);
 
 	// draw it
 	Draw_String(8, vislines - 22 + 8, dlbar);
@@ -1258,21 +1269,8 @@ void SCR_UpdateScreen (void) {
 	scr_copytop = 0;
 	scr_copyeverything = 0;
 
-	// check for vid changes
-	if (oldfov != scr_fov.value) {
-		oldfov = scr_fov.value;
-		vid.recalc_refdef = true;
-	}
-
-	if (oldscreensize != scr_viewsize.value) {
-		oldscreensize = scr_viewsize.value;
-		vid.recalc_refdef = true;
-	}
-
-	if (oldsbar != cl_sbar.value) {
-		oldsbar = cl_sbar.value;
+	if (!scr_refdefsubscription)
 		vid.recalc_refdef = true;
-	}
 
 	if (vid.recalc_refdef)
 		SCR_CalcRefdef ();
@@ -1302,12 +1300,16 @@ void SCR_UpdateScreen (void) {
 	if (r_netgraph.value)
 		R_NetGraph ();
 
+	Draw_BeginBatch();
+
 	SCR_DrawElements();
 
 	SB_Frame();
 
 	Lua_Frame_2D();
 
+	Draw_EndBatch();
+
 	R_BrightenScreen ();
 
 	V_UpdatePalette(false);
@@ -1347,21 +1349,8 @@ void SCR_UpdateScreen (void) {
 	scr_copytop = 0;
 	scr_copyeverything = 0;
 
-	// check for vid changes
-	if (oldfov != scr_fov.value) {
-		oldfov = scr_fov.value;
-		vid.recalc_refdef = true;
-	}
-	
-	if (oldscreensize != scr_viewsize.value) {
-		oldscreensize = scr_viewsize.value;
-		vid.recalc_refdef = true;
-	}
-
-	if (oldsbar != cl_sbar.value) {
-		oldsbar = cl_sbar.value;
+	if (!scr_refdefsubscription)
 		vid.recalc_refdef = true;
-	}
 
 	if (vid.recalc_refdef) {
 		// something changed, so reorder the screen
@@ -1870,8 +1859,27 @@ void SCR_CvarInit (void)
 	Cmd_AddCommand ("messagemode2", Con_MessageMode2_f);
 }
 
+static void SCR_RefdefCvarChanged(void *userdata)
+{
+	vid.recalc_refdef = true;
+}
+
 void SCR_Init(void)
 {
+	scr_refdefsubscription = Cvar_Subscribe(SCR_RefdefCvarChanged, 0);
+	if (scr_refdefsubscription)
+	{
+		if (!Cvar_SubscribeCvar(scr_refdefsubscription, &scr_fov)
+		 || !Cvar_SubscribeCvar(scr_refdefsubscription, &scr_viewsize)
+		 || !Cvar_SubscribeCvar(scr_refdefsubscription, &cl_sbar))
+		{
+			Cvar_Unsubscribe(scr_refdefsubscription);
+			scr_refdefsubscription = 0;
+		}
+	}
+
+	vid.recalc_refdef = true;
+
 	rampic = Draw_LoadPicture("wad:ram", DRAW_LOADPICTURE_DUMMYFALLBACK);
 	netpic = Draw_LoadPicture("wad:net", DRAW_LOADPICTURE_DUMMYFALLBACK);
 	turtlepic = Draw_LoadPicture("wad:turtle", DRAW_LOADPICTURE_DUMMYFALLBACK);
@@ -1897,6 +1905,12 @@ void SCR_Shutdown()
 	Draw_FreePicture(netpic);
 	Draw_FreePicture(rampic);
 
+	if (scr_refdefsubscription)
+	{
+		Cvar_Unsubscribe(scr_refdefsubscription);
+		scr_refdefsubscription = 0;
+	}
+
 	scr_initialized = false;
 }
 
@@ -241,6 +241,9 @@ typedef struct {
 	int			downloadnumber;
 	dltype_t	downloadtype;
 	int			downloadpercent;
+	double		downloadstarttime;
+	unsigned int	downloadbytes;
+	float		downloadrate;	// bytes per second since the download started
 
 	// demo recording info must be here, because record is started before entering a map (and clearing clientState_t)
 	qboolean	demorecording;
@@ -439,6 +442,7 @@ extern cvar_t r_lightflicker;
 
 // ZQuake cvars
 extern cvar_t	cl_warncmd;
+extern cvar_t	cmd_compilealiases;
 extern	cvar_t	cl_shownet;
 extern	cvar_t	cl_sbar;
 extern	cvar_t	cl_hudswap;
@@ -515,7 +519,7 @@ void CL_StopUpload(void);
 
 void CL_ParseClientdata (void);	
 
-void CL_RequestNextFTEDownloadChunk(sizebuf_t *buf);
+void CL_RequestNextFTEDownloadChunks(void);
 
 void CL_FreeStatics(void);
 
@@ -565,6 +569,8 @@ void CL_ParseProjectiles(qboolean indexed);
 void CL_CvarInitPrediction (void);
 void CL_PredictMove (void);
 void CL_PredictUsercmd (player_state_t *from, player_state_t *to, usercmd_t *u);
+struct PMoveContext;
+void CL_PredictUsercmdEx (struct PMoveContext *ctx, player_state_t *from, player_state_t *to, usercmd_t *u);
 
 // cl_cam.c
 #define CAM_NONE	0
@@ -46,10 +46,12 @@ qboolean CL_CheckServerCommand (void);
 #endif
 
 static void Cmd_ExecuteStringEx (cbuf_t *context, char *text);
+static void Cmd_ReleaseCompiledAlias (cmd_alias_t *alias);
 
 static qboolean can_execute_functions;
 
 cvar_t cl_warncmd = {"cl_warncmd", "0"};
+cvar_t cmd_compilealiases = {"cmd_compilealiases", "1"};
 
 cbuf_t *cbuf_main;
 #ifndef SERVERONLY
@@ -121,23 +123,28 @@ void Cbuf_Init (void)
 	cbuf_main->text_start = cbuf_main->text_end = MAXCMDBUF >> 1;
 	cbuf_main->wait = false;
 	cbuf_main->runAwayLoop = 0;
+	cbuf_main->inserted = 0;
 #ifndef SERVERONLY
 	cbuf_safe->text_start = cbuf_safe->text_end = (MAXCMDBUF >> 1);
 	cbuf_safe->wait = false;
 	cbuf_safe->runAwayLoop = 0;
+	cbuf_safe->inserted = 0;
 
 	cbuf_formatted_comms->text_start = cbuf_formatted_comms->text_end = (MAXCMDBUF >> 1);
 	cbuf_formatted_comms->wait = false;
 	cbuf_formatted_comms->runAwayLoop = 0;
+	cbuf_formatted_comms->inserted = 0;
 
 	cbuf_svc->text_start = cbuf_svc->text_end = (MAXCMDBUF >> 1);
 	cbuf_svc->wait = false;
 	cbuf_svc->runAwayLoop = 0;
+	cbuf_svc->inserted = 0;
 #endif
 
 	cbuf_cmdsave->text_start = cbuf_cmdsave->text_end = (MAXCMDBUF >> 1);
 	cbuf_cmdsave->wait = false;
 	cbuf_cmdsave->runAwayLoop = 0;
+	cbuf_cmdsave->inserted = 0;
 }
 
 void Cbuf_Shutdown()
@@ -216,6 +223,7 @@ void Cbuf_InsertTextEx (cbuf_t *cbuf, char *text)
 	{
 		memcpy (cbuf->text_buf + (cbuf->text_start - len), text, len);
 		cbuf->text_start -= len;
+		cbuf->inserted += len;
 		return;
 	}
 
@@ -234,6 +242,7 @@ void Cbuf_InsertTextEx (cbuf_t *cbuf, char *text)
 	memcpy (cbuf->text_buf + new_start, text, len);
 	cbuf->text_start = new_start;
 	cbuf->text_end = cbuf->text_start + new_bufsize;
+	cbuf->inserted += len;
 }
 
 #define MAX_RUNAWAYLOOP 1000
@@ -615,6 +624,7 @@ void Cmd_Alias_f (void)
 	{
 		if (!Q_strcasecmp(a->name, s))
 		{
+			Cmd_ReleaseCompiledAlias(a);
 			Z_Free (a->value);
 			break;
 		}
@@ -682,6 +692,7 @@ qboolean Cmd_DeleteAlias (char *name)
 				cmd_alias = a->next;
 
 			// free
+			Cmd_ReleaseCompiledAlias(a);
 			Z_Free (a->value);
 			Z_Free (a);
 			return true;
@@ -722,6 +733,7 @@ void Cmd_UnAliasAll_f (void)
 	for (a = cmd_alias; a ; a = next)
 	{
 		next = a->next;
+		Cmd_ReleaseCompiledAlias(a);
 		Z_Free (a->value);
 		Z_Free (a);
 	}
@@ -837,6 +849,7 @@ static	int		cmd_argc;
 static	char	*cmd_argv[MAX_ARGS];
 static	char	*cmd_null_string = "";
 static	char	*cmd_args = NULL;
+static	char	cmd_argv_buf[1024];
 
 cmd_function_t	*cmd_hash_array[32];
 /*static*/ cmd_function_t	*cmd_functions;		// possible commands to execute
@@ -886,7 +899,6 @@ char *Cmd_MakeArgs (int start)
 void Cmd_TokenizeString (char *text)
 {
 	int idx;
-	static char argv_buf[1024];
 
 	idx = 0;
 
@@ -917,9 +929,9 @@ void Cmd_TokenizeString (char *text)
 
 		if (cmd_argc < MAX_ARGS)
 		{
-			if (idx+strlen(com_token) >= sizeof(argv_buf))
+			if (idx+strlen(com_token) >= sizeof(cmd_argv_buf))
 				break;
-			cmd_argv[cmd_argc] = argv_buf + idx;
+			cmd_argv[cmd_argc] = cmd_argv_buf + idx;
 			strcpy(cmd_argv[cmd_argc], com_token);
 			idx += strlen(com_token) + 1;
 			cmd_argc++;
@@ -1108,13 +1120,112 @@ typedef struct
 static macro_command_t macro_commands[MAX_MACROS];
 static int macro_count = 0;
 
+/* Cvar and macro names share a case insensitive prefix trie, so finding
+ * the longest name at the start of a $expression is a single walk. */
+struct expand_trie_node
+{
+	struct expand_trie_node *children;
+	struct expand_trie_node *next;
+	cvar_t *cvar;
+	int macro;		/* Index into macro_commands, -1 if none */
+	unsigned char c;
+};
+
+static struct expand_trie_node expand_trie_root = { 0, 0, 0, -1, 0 };
+
+static unsigned char Cmd_ExpandTrieChar(unsigned char c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c + ('a' - 'A');
+
+	return c;
+}
+
+static struct expand_trie_node *Cmd_ExpandTrieChild(struct expand_trie_node *node, unsigned char c)
+{
+	for(node=node->children;node;node=node->next)
+	{
+		if (node->c == c)
+			break;
+	}
+
+	return node;
+}
+
+static struct expand_trie_node *Cmd_ExpandTrieFind(const char *name, qboolean create)
+{
+	struct expand_trie_node *node, *child;
+	unsigned char c;
+
+	node = &expand_trie_root;
+	while(*name)
+	{
+		c = Cmd_ExpandTrieChar(*name++);
+		child = Cmd_ExpandTrieChild(node, c);
+		if (child == 0)
+		{
+			if (!create)
+				return 0;
+
+			child = malloc(sizeof(*child));
+			if (child == 0)
+				Sys_Error("Cmd_ExpandTrieFind: Out of memory\n");
+
+			child->children = 0;
+			child->cvar = 0;
+			child->macro = -1;
+			child->c = c;
+			child->next = node->children;
+			node->children = child;
+		}
+
+		node = child;
+	}
+
+	return node;
+}
+
+static void Cmd_ExpandTrieFree(struct expand_trie_node *node)
+{
+	struct expand_trie_node *child;
+
+	while((child = node->children))
+	{
+		node->children = child->next;
+		Cmd_ExpandTrieFree(child);
+		free(child);
+	}
+}
+
+void Cmd_AddExpandCvar(cvar_t *var)
+{
+	Cmd_ExpandTrieFind(var->name, true)->cvar = var;
+}
+
+void Cmd_RemoveExpandCvar(cvar_t *var)
+{
+	struct expand_trie_node *node;
+
+	node = Cmd_ExpandTrieFind(var->name, false);
+	if (node && node->cvar == var)
+		node->cvar = 0;
+}
+
 void Cmd_AddMacroEx(char *s, const char *(*f)(void), qboolean teamplay)
 {
+	struct expand_trie_node *node;
+
 	if (macro_count == MAX_MACROS)
 		Sys_Error("Cmd_AddMacro: macro_count == MAX_MACROS");
 	Q_strncpyz(macro_commands[macro_count].name, s, sizeof(macro_commands[macro_count].name));
 	macro_commands[macro_count].func = f;
 	macro_commands[macro_count].teamplay = teamplay;
+
+	/* Like the old linear search, the first macro registered with a name wins */
+	node = Cmd_ExpandTrieFind(macro_commands[macro_count].name, true);
+	if (node->macro < 0)
+		node->macro = macro_count;
+
 	macro_count++;
 }
 
@@ -1123,26 +1234,40 @@ void Cmd_AddMacro(char *s, const char *(*f)(void))
 	Cmd_AddMacroEx(s, f, false);
 }
 
-char *Cmd_MacroString (char *s, int *macro_length)
+static char *Cmd_CallMacro (int index)
 {
-	int i;
 	macro_command_t	*macro;
 
-	for (i = 0; i < macro_count; i++)
-	{
-		macro = &macro_commands[i];
-		if (!Q_strncasecmp(s, macro->name, strlen(macro->name)))
-		{
+	macro = &macro_commands[index];
 #ifndef SERVERONLY
-			if (cbuf_current == cbuf_main && macro->teamplay)
-				cbuf_current = cbuf_formatted_comms;
+	if (cbuf_current == cbuf_main && macro->teamplay)
+		cbuf_current = cbuf_formatted_comms;
 #endif
-			*macro_length = strlen(macro->name);
-			return macro->func();
+	return (char *)macro->func();
+}
+
+char *Cmd_MacroString (char *s, int *macro_length)
+{
+	struct expand_trie_node *node;
+	int i, best;
+
+	best = -1;
+	*macro_length = 0;
+
+	node = &expand_trie_root;
+	for (i = 0; s[i] && (node = Cmd_ExpandTrieChild(node, Cmd_ExpandTrieChar(s[i]))); i++)
+	{
+		if (node->macro >= 0 && (best < 0 || node->macro < best))
+		{
+			best = node->macro;
+			*macro_length = i + 1;
 		}
 	}
-	*macro_length = 0;
-	return NULL;
+
+	if (best < 0)
+		return NULL;
+
+	return Cmd_CallMacro(best);
 }
 
 int Cmd_MacroCompare (const void *p1, const void *p2)
@@ -1185,9 +1310,10 @@ void Cmd_ExpandString(char *data, char *dest, unsigned int maxlen)
 	unsigned int c;
 	char buf[255], *str;
 	int i, len, quotes = 0, name_length;
-	cvar_t	*var, *bestvar;
+	cvar_t	*bestvar;
+	struct expand_trie_node *node;
 #ifndef SERVERONLY
-	int macro_length;
+	int macro, macro_length;
 #endif
 
 	len = 0;
@@ -1202,10 +1328,16 @@ void Cmd_ExpandString(char *data, char *dest, unsigned int maxlen)
 			data++;
 
 			/* Copy the texter after '$' to a temporary buffer and
-			 * look for the longest cvar match in the process */
+			 * look for the longest cvar and the first macro match
+			 * in the process */
 			i = 0;
 			buf[0] = 0;
 			bestvar = NULL;
+#ifndef SERVERONLY
+			macro = -1;
+			macro_length = 0;
+#endif
+			node = &expand_trie_root;
 			while ((c = *data) > 32 && i < sizeof(buf)-1)
 			{
 				if (c == '$')
@@ -1213,16 +1345,24 @@ void Cmd_ExpandString(char *data, char *dest, unsigned int maxlen)
 				data++;
 				buf[i++] = c;
 				buf[i] = 0;
-				if ((var = Cvar_FindVar(buf)))
+				if (node && (node = Cmd_ExpandTrieChild(node, Cmd_ExpandTrieChar(c))))
 				{
-					bestvar = var;
+					if (node->cvar)
+						bestvar = node->cvar;
+#ifndef SERVERONLY
+					if (node->macro >= 0 && (macro < 0 || node->macro < macro))
+					{
+						macro = node->macro;
+						macro_length = i;
+					}
+#endif
 				}
 			}
 
 #ifndef SERVERONLY
 			if (!dedicated)
 			{
-				str = Cmd_MacroString (buf, &macro_length);
+				str = macro >= 0 ? Cmd_CallMacro(macro) : NULL;
 				name_length = macro_length;
 
 				if (bestvar && (!str || (strlen(bestvar->name) > macro_length)))
@@ -1280,6 +1420,434 @@ void Cmd_ExpandString(char *data, char *dest, unsigned int maxlen)
 	dest[len] = 0;
 }
 
+//Measures how fast Cmd_ExpandString() is, the text has to be quoted to keep it from being expanded right away
+void Cmd_ExpandBench_f (void)
+{
+	char *text, dest[1024];
+	unsigned int i, iterations;
+	cbuf_t *oldcontext;
+	double start, elapsed;
+
+	if (Cmd_Argc() > 3)
+	{
+		Com_Printf("%s [iterations] [\"text\"] : measure $variable expansion speed\n", Cmd_Argv(0));
+		return;
+	}
+
+	iterations = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 100000;
+	if (iterations == 0)
+		iterations = 1;
+
+	text = Cmd_Argc() > 2 ? Cmd_Argv(2) : "say_team $name: $health/$armor $bestweapon $location $cl_maxfps $undefined $rate";
+
+	oldcontext = cbuf_current;
+
+	start = Sys_DoubleTime();
+	for (i = 0; i < iterations; i++)
+	{
+		Cmd_ExpandString(text, dest, sizeof(dest));
+		cbuf_current = oldcontext;
+	}
+	elapsed = Sys_DoubleTime() - start;
+
+	Com_Printf("\"%s\"\n", dest);
+	Com_Printf("%u expansions in %.3f ms, %.2f us each, %.0f per second\n", iterations, elapsed * 1000, elapsed * 1000000 / iterations, elapsed > 0 ? iterations / elapsed : 0);
+}
+
+/*
+=============================================================================
+						COMPILED ALIASES
+=============================================================================
+*/
+
+/* Aliases are split into their commands the first time they are executed.
+ * Commands without a '$' are also tokenized and have their command function
+ * looked up, so running them again only costs a copy. The commands are run
+ * directly instead of going through the command buffer for as long as
+ * nothing else is inserted into it; as soon as a command inserts text or
+ * waits, the remaining commands are put back into the buffer after it. */
+
+#define MAX_COMPILED_ALIAS_DEPTH 16
+
+struct cmd_compiled_command
+{
+	char *text;
+	char *argv;		/* NUL separated tokens, 0 if the command needs $expansion */
+	unsigned int argvsize;
+	unsigned int argc;
+	int argsoffset;		/* Offset of Cmd_Args() into the text, -1 if there are no arguments */
+	cmd_function_t *function;
+};
+
+struct cmd_alias_compiled
+{
+	cmd_alias_t *alias;	/* 0 once the alias has been changed or deleted */
+	unsigned int running;
+	qboolean orphaned;
+	unsigned int numcommands;
+	struct cmd_compiled_command *commands;
+};
+
+static unsigned int cmd_alias_depth;
+static char cmd_expand_buf[2048];
+
+static void Cmd_ExecuteTokenized (char *text, cmd_function_t *cmd);
+
+static void Cmd_FreeCompiledAlias(struct cmd_alias_compiled *compiled)
+{
+	unsigned int i;
+
+	for(i=0;i<compiled->numcommands;i++)
+	{
+		free(compiled->commands[i].text);
+		free(compiled->commands[i].argv);
+	}
+
+	free(compiled->commands);
+	free(compiled);
+}
+
+static void Cmd_ReleaseCompiledAlias(cmd_alias_t *alias)
+{
+	struct cmd_alias_compiled *compiled;
+
+	compiled = alias->compiled;
+	if (compiled == 0)
+		return;
+
+	alias->compiled = 0;
+	compiled->alias = 0;
+
+	/* The alias may be changing itself, in which case the last one out frees it */
+	if (compiled->running)
+		compiled->orphaned = true;
+	else
+		Cmd_FreeCompiledAlias(compiled);
+}
+
+/* Returns 0 on out of memory. Empty commands are left with a 0 text. */
+static int Cmd_CompileCommand(struct cmd_compiled_command *command, const char *line)
+{
+	unsigned int i;
+	char *p;
+
+	command->argv = 0;
+	command->argvsize = 0;
+	command->argc = 0;
+	command->argsoffset = -1;
+	command->function = 0;
+
+	command->text = strdup(line);
+	if (command->text == 0)
+		return 0;
+
+	if (strchr(command->text, '$'))
+		return 1;
+
+	Cmd_TokenizeString(command->text);
+	if (cmd_argc == 0)
+	{
+		free(command->text);
+		command->text = 0;
+		return 1;
+	}
+
+	for(i=0;i<cmd_argc;i++)
+		command->argvsize += strlen(cmd_argv[i]) + 1;
+
+	command->argv = malloc(command->argvsize);
+	if (command->argv == 0)
+	{
+		free(command->text);
+		command->text = 0;
+		return 0;
+	}
+
+	for(i=0,p=command->argv;i<cmd_argc;i++)
+	{
+		strcpy(p, cmd_argv[i]);
+		p += strlen(p) + 1;
+	}
+
+	command->argc = cmd_argc;
+	if (cmd_args)
+		command->argsoffset = cmd_args - command->text;
+
+	command->function = Cmd_FindCommand(cmd_argv[0]);
+
+	return 1;
+}
+
+/* Splits the alias the same way Cbuf_ExecuteEx() would split it */
+static struct cmd_alias_compiled *Cmd_CompileAlias(cmd_alias_t *alias)
+{
+	struct cmd_alias_compiled *compiled;
+	const char *text, *end, *src;
+	char line[1400], *dest;
+	unsigned int i, j, cursize, maxcommands;
+	qboolean comment, quotes;
+
+	maxcommands = 1;
+	for(text=alias->value;*text;text++)
+	{
+		if (*text == ';' || *text == '\n')
+			maxcommands++;
+	}
+
+	compiled = malloc(sizeof(*compiled));
+	if (compiled == 0)
+		return 0;
+
+	compiled->commands = malloc(maxcommands * sizeof(*compiled->commands));
+	if (compiled->commands == 0)
+	{
+		free(compiled);
+		return 0;
+	}
+
+	compiled->alias = alias;
+	compiled->running = 0;
+	compiled->orphaned = false;
+	compiled->numcommands = 0;
+
+	text = alias->value;
+	end = text + strlen(text);
+	while(text < end)
+	{
+		cursize = end - text;
+		comment = quotes = false;
+		for(i=0;i<cursize;i++)
+		{
+			if (text[i] == '\n')
+				break;
+			if (text[i] == '"')
+			{
+				quotes = !quotes;
+				continue;
+			}
+			if (comment || quotes)
+				continue;
+
+			if (text[i] == '/' && i + 1 < cursize && text[i + 1] == '/')
+				comment = true;
+			else if (text[i] == ';')
+				break;
+		}
+
+		src = text;
+		dest = line;
+		j = min(i, sizeof(line) - 1);
+		for(;j;j--,src++)
+		{
+			if (*src != '\r')
+				*dest++ = *src;
+		}
+		*dest = 0;
+
+		text += i;
+		if (i < cursize)
+			text++;
+
+		if (!Cmd_CompileCommand(&compiled->commands[compiled->numcommands], line))
+		{
+			Cmd_FreeCompiledAlias(compiled);
+			return 0;
+		}
+
+		if (compiled->commands[compiled->numcommands].text)
+			compiled->numcommands++;
+	}
+
+	return compiled;
+}
+
+static void Cmd_ExecuteCompiledCommand(cbuf_t *context, struct cmd_compiled_command *command)
+{
+	cbuf_t *oldcontext;
+	unsigned int i;
+	char *p;
+
+	if (command->argv == 0)
+	{
+		Cmd_ExecuteStringEx(context, command->text);
+		return;
+	}
+
+	oldcontext = cbuf_current;
+	cbuf_current = context;
+
+	/* Commands get their own copy to mess with, just like after Cmd_TokenizeString() */
+	strcpy(cmd_expand_buf, command->text);
+	memcpy(cmd_argv_buf, command->argv, command->argvsize);
+	for(i=0,p=cmd_argv_buf;i<command->argc;i++)
+	{
+		cmd_argv[i] = p;
+		p += strlen(p) + 1;
+	}
+	cmd_argc = command->argc;
+	cmd_args = command->argsoffset >= 0 ? cmd_expand_buf + command->argsoffset : NULL;
+
+	Cmd_ExecuteTokenized(command->text, command->function);
+
+	cbuf_current = oldcontext;
+}
+
+/* Puts commands [first, numcommands) back at the front of the buffer, behind the 'inserted' bytes the last command put there */
+static void Cmd_InsertCompiledCommands(cbuf_t *cbuf, struct cmd_alias_compiled *compiled, unsigned int first, unsigned int inserted)
+{
+	unsigned int i;
+	char *held;
+
+	if (first >= compiled->numcommands)
+		return;
+
+	held = 0;
+	if (inserted)
+	{
+		held = malloc(inserted + 1);
+		if (held == 0)
+		{
+			Com_Printf("Cmd_InsertCompiledCommands: out of memory\n");
+			return;
+		}
+
+		memcpy(held, cbuf->text_buf + cbuf->text_start, inserted);
+		held[inserted] = 0;
+		cbuf->text_start += inserted;
+		cbuf->inserted -= inserted;
+	}
+
+	for(i=compiled->numcommands;i>first;i--)
+	{
+		Cbuf_InsertTextEx(cbuf, "\n");
+		Cbuf_InsertTextEx(cbuf, compiled->commands[i - 1].text);
+	}
+
+	if (held)
+	{
+		Cbuf_InsertTextEx(cbuf, held);
+		free(held);
+	}
+}
+
+/* Returns false if the alias has to go through the command buffer as text */
+static qboolean Cmd_ExecuteCompiledAlias(cmd_alias_t *alias)
+{
+	struct cmd_alias_compiled *compiled;
+	cbuf_t *context;
+	unsigned int i, inserted;
+	double start;
+
+	context = cbuf_current;
+	if (context == 0 || Cmd_Argc() != 1 || !cmd_compilealiases.value || cmd_alias_depth >= MAX_COMPILED_ALIAS_DEPTH)
+		return false;
+
+	if (alias->compiled == 0)
+		alias->compiled = Cmd_CompileAlias(alias);
+
+	compiled = alias->compiled;
+	if (compiled == 0)
+		return false;
+
+	compiled->running++;
+	cmd_alias_depth++;
+	start = Sys_DoubleTime();
+
+	for(i=0;i<compiled->numcommands;i++)
+	{
+		inserted = context->inserted;
+
+		Cmd_ExecuteCompiledCommand(context, &compiled->commands[i]);
+
+		if (context->wait || context->inserted != inserted)
+		{
+			Cmd_InsertCompiledCommands(context, compiled, i + 1, context->inserted - inserted);
+			break;
+		}
+	}
+
+	if (compiled->alias)
+		compiled->alias->time += Sys_DoubleTime() - start;
+
+	cmd_alias_depth--;
+	compiled->running--;
+	if (compiled->orphaned && compiled->running == 0)
+		Cmd_FreeCompiledAlias(compiled);
+
+	return true;
+}
+
+static int Cmd_ProfileCompare(const void *p1, const void *p2)
+{
+	const cmd_alias_t *a1, *a2;
+
+	a1 = *((const cmd_alias_t **)p1);
+	a2 = *((const cmd_alias_t **)p2);
+
+	if (a1->time != a2->time)
+		return a1->time < a2->time ? 1 : -1;
+	if (a1->calls != a2->calls)
+		return a1->calls < a2->calls ? 1 : -1;
+
+	return Q_strcasecmp(a1->name, a2->name);
+}
+
+void Cmd_Profile_f(void)
+{
+	cmd_alias_t *a, **sorted;
+	unsigned int i, count;
+
+	if (Cmd_Argc() == 2 && strcmp(Cmd_Argv(1), "reset") == 0)
+	{
+		for(a=cmd_alias;a;a=a->next)
+		{
+			a->calls = 0;
+			a->time = 0;
+		}
+
+		return;
+	}
+	else if (Cmd_Argc() != 1)
+	{
+		Com_Printf("%s [reset] : show how often aliases were executed and how long they took\n", Cmd_Argv(0));
+		return;
+	}
+
+	count = 0;
+	for(a=cmd_alias;a;a=a->next)
+	{
+		if (a->calls)
+			count++;
+	}
+
+	if (count == 0)
+	{
+		Com_Printf("No aliases have been executed\n");
+		return;
+	}
+
+	sorted = malloc(count * sizeof(*sorted));
+	if (sorted == 0)
+		return;
+
+	for(a=cmd_alias,i=0;a;a=a->next)
+	{
+		if (a->calls)
+			sorted[i++] = a;
+	}
+
+	qsort(sorted, count, sizeof(*sorted), Cmd_ProfileCompare);
+
+	/* Time is only measured for compiled executions and includes nested aliases */
+	Com_Printf("\x02%-24s %8s %10s %10s\n", "alias", "calls", "total ms", "avg us");
+	for(i=0;i<count;i++)
+		Com_Printf("%-24s %8u %10.3f %10.2f\n", sorted[i]->name, sorted[i]->calls, sorted[i]->time * 1000, sorted[i]->time * 1000000 / sorted[i]->calls);
+
+	Com_Printf("----------\n%u aliases executed\n", count);
+
+	free(sorted);
+}
+
 char *msgtrigger_commands[] =
 {
 	"play", "playvol", "stopsound", "set", "echo", "say", "say_team",
@@ -1298,32 +1866,40 @@ char *formatted_comms_commands[] =
 //A complete command line has been parsed, so try to execute it
 static void Cmd_ExecuteStringEx (cbuf_t *context, char *text)
 {
-	cvar_t *v;
-	cmd_function_t *cmd;
-	cmd_alias_t *a;
-	static char buf[2048];
-	cbuf_t *inserttarget, *oldcontext;
-	extern int weight_disable;
+	cbuf_t *oldcontext;
 
 	oldcontext = cbuf_current;
 	cbuf_current = context;
 
-	Cmd_ExpandString(text, buf, sizeof(buf));
-	Cmd_TokenizeString (buf);
+	Cmd_ExpandString(text, cmd_expand_buf, sizeof(cmd_expand_buf));
+	Cmd_TokenizeString (cmd_expand_buf);
+
+	Cmd_ExecuteTokenized(text, 0);
+
+	cbuf_current = oldcontext;
+}
+
+//Executes the tokenized command line, cmd is the already looked up command if there is one
+static void Cmd_ExecuteTokenized (char *text, cmd_function_t *cmd)
+{
+	cvar_t *v;
+	cmd_alias_t *a;
+	cbuf_t *inserttarget;
+	extern int weight_disable;
 
 	if (!Cmd_Argc())
-		goto done;		// no tokens
+		return;		// no tokens
 
 #ifndef SERVERONLY
 	if (cbuf_current == cbuf_svc)
 	{
 		if (CL_CheckServerCommand())
-			goto done;
+			return;
 	}
 #endif
 
 	// check functions
-	if ((cmd = Cmd_FindCommand(cmd_argv[0])))
+	if (cmd || (cmd = Cmd_FindCommand(cmd_argv[0])))
 	{
 #ifndef SERVERONLY
 		if (can_execute_functions || strcmp(cmd_argv[0], "cfg_load") == 0 || strcmp(cmd_argv[0], "exec") == 0 || strcmp(cmd_argv[0], "alias") == 0)
@@ -1340,7 +1916,7 @@ static void Cmd_ExecuteStringEx (cbuf_t *context, char *text)
 				if (!*s)
 				{
 					Com_Printf ("\"%s\" cannot be used in message triggers\n", cmd_argv[0]);
-					goto done;
+					return;
 				}
 			}
 			else if (cbuf_current == cbuf_formatted_comms)
@@ -1353,7 +1929,7 @@ static void Cmd_ExecuteStringEx (cbuf_t *context, char *text)
 				if (!*s)
 				{
 					Com_Printf("\"%s\" cannot be used in combination with teamplay $macros\n", cmd_argv[0]);
-					goto done;
+					return;
 				}
 			}
 #endif
@@ -1366,13 +1942,13 @@ static void Cmd_ExecuteStringEx (cbuf_t *context, char *text)
 			else
 				Cmd_ForwardToServer ();
 
-			goto done;
+			return;
 		}
 		else
 		{
 			Cbuf_AddTextEx(cbuf_cmdsave, text);
 			Cbuf_AddTextEx(cbuf_cmdsave, "\n");
-			goto done;
+			return;
 		}
 	}
 
@@ -1389,11 +1965,11 @@ static void Cmd_ExecuteStringEx (cbuf_t *context, char *text)
 		if (cbuf_current == cbuf_formatted_comms)
 		{
 			Com_Printf("\"%s\" cannot be used in combination with teamplay $macros\n", cmd_argv[0]);
-			goto done;
+			return;
 		}
 #endif
 		if (Cvar_Command())
-			goto done;
+			return;
 	}
 
 	// check aliases
@@ -1402,6 +1978,7 @@ checkaliases:
 	{
 		if (weight_disable == 0)
 			a->weight++;
+		a->calls++;
 #ifndef SERVERONLY
 		if (cbuf_current == cbuf_svc)
 		{
@@ -1410,6 +1987,7 @@ checkaliases:
 		}
 		else
 #endif
+		if (!Cmd_ExecuteCompiledAlias(a))
 		{
 
 #ifdef SERVERONLY
@@ -1431,12 +2009,12 @@ checkaliases:
 				}
 				Cbuf_InsertTextEx (inserttarget, a->value);
 		}
-		goto done;
+		return;
 	}
 
 #ifndef SERVERONLY
 	if (Cmd_LegacyCommand())
-		goto done;
+		return;
 #endif
 
 #ifndef SERVERONLY
@@ -1446,9 +2024,6 @@ checkaliases:
 		if (cl_warncmd.value || developer.value)
 			Com_Printf ("Unknown command \"%s\"\n", Cmd_Argv(0));
 	}
-
-done:
-	cbuf_current = oldcontext;
 }
 
 void Cmd_ExecuteString (char *text)
@@ -1769,6 +2344,8 @@ void Cmd_Init (void)
 	Cmd_AddCommand("cmdlist", Cmd_CmdList_f);
 	Cmd_AddCommand("if", Cmd_If_f);
 	Cmd_AddCommand("macrolist", Cmd_MacroList_f);
+	Cmd_AddCommand("cmd_profile", Cmd_Profile_f);
+	Cmd_AddCommand("cmd_expandbench", Cmd_ExpandBench_f);
 
 	CSTC_Add("alias", &cstc_alias_conditions, &cstc_alias_get_results, NULL, NULL, 0, "arrow up/down to navigate");
 	CSTC_Add("exec", NULL, &cstc_exec_get_results, &cstc_exec_get_data, NULL, CSTC_EXECUTE, "arrow up/down to navigate");
@@ -1783,5 +2360,7 @@ void Cmd_Shutdown()
 		cmd_functions = func->next;
 		free(func);
 	}
+
+	Cmd_ExpandTrieFree(&expand_trie_root);
 }
 
@@ -41,6 +41,7 @@ typedef struct cbuf_s
 	int text_end;
 	qboolean wait;
 	int runAwayLoop;
+	unsigned int inserted; /* Bytes added to the front of the buffer, used to fence compiled aliases */
 } cbuf_t;
 
 extern cbuf_t *cbuf_main;
@@ -163,6 +164,9 @@ typedef struct cmd_alias_s
 	char *value;
 	int  flags;
 	int  weight;
+	struct cmd_alias_compiled *compiled; /* Built on first execution, dropped when the alias changes */
+	unsigned int calls;
+	double time; /* Seconds spent executing the compiled alias, inclusive of nested aliases */
 } cmd_alias_t;
 
 qboolean Cmd_DeleteAlias(char *name); // return true if successful
@@ -174,4 +178,6 @@ void DeleteServerAliases(void);
 
 void Cmd_AddMacro(char *s, const char *(*f)(void));
 void Cmd_AddMacroEx(char *s, const char *(*f)(void), qboolean teamplay);
+void Cmd_AddExpandCvar(cvar_t *var);
+void Cmd_RemoveExpandCvar(cvar_t *var);
 char *Cmd_MacroString (char *s, int *macro_length);
@@ -17,6 +17,7 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -25,24 +26,31 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "strl.h"
 #include "utils.h"
 #include "console.h"
+#include "logging.h"
 
 static qboolean con_parsecolors_callback(cvar_t *, char *);
 
 static cvar_t con_notifylines = { "con_notifylines", "4" };
 static cvar_t con_notifytime = { "con_notifytime", "3" };
 static cvar_t con_parsecolors = { "con_parsecolors", "1", 0, con_parsecolors_callback };
+static cvar_t con_highlightcolour = { "con_highlightcolour", "210" };
 
 static unsigned char *conbuf;
 static unsigned int contail;
 static unsigned int consize;
 static unsigned int partiallinestart;
 
+/* One entry per text line, the rows a line wraps into are computed lazily when the line is needed */
 static unsigned int *lines;
-static unsigned short *linestartcolours;
+static unsigned int *linerows;
+static unsigned int *linegenerations; /* linerows is valid if this matches layoutgeneration */
 static unsigned int maxlines; /* Must be a power of 2 */
 static unsigned int firstline;
 static unsigned int lastline;
+static unsigned int firstlinenumber; /* Number of the line at firstline, counted since startup */
 static unsigned int displayline;
+static unsigned int displayrow;
+static unsigned int layoutgeneration = 1;
 
 static unsigned int textcolumns;
 
@@ -61,6 +69,38 @@ static unsigned int suppressed;
 static unsigned long long notifytimes[MAXNOTIFYLINES];
 static unsigned int notifystart;
 
+/* Trigram index over the lines in the buffer, used by con_search */
+#define CON_INDEX_BUCKETS 4096
+
+struct con_postinglist
+{
+	unsigned int *numbers; /* Line numbers in ascending order */
+	unsigned int start;
+	unsigned int count;
+	unsigned int size;
+};
+
+static struct con_postinglist *conindex;
+
+static char *plainbuf;
+static unsigned short *plaincolumns;
+static unsigned int plainbufsize;
+
+#define MAXSEARCHTERM 64
+static char searchterm[MAXSEARCHTERM];
+static unsigned int searchlast = ~0U; /* ~0 if the last search found nothing */
+
+struct con_rowiter
+{
+	unsigned int offset; /* Start of the current row */
+	unsigned int length; /* Length of the current row in bytes */
+	unsigned short colour; /* Colour at the start of the current row */
+	unsigned int next;
+	unsigned int remaining;
+	unsigned short nextcolour;
+	int started;
+};
+
 /* Ugly :( */
 #define MAXCMDLINE 256
 extern char key_lines[32][MAXCMDLINE];
@@ -185,126 +225,511 @@ static unsigned int Con_BufferFindLinebreak(unsigned int offset, unsigned int ma
 	return i;
 }
 
-static int Con_ExpandMaxLines()
+/* Returns a linear pointer to the text at offset, which belongs to the line starting at linestart */
+static char *Con_LinePointer(unsigned int linestart, unsigned int offset, unsigned int length)
+{
+	if (offset + length > consize)
+	{
+		if (stitchbuffer == 0)
+			return 0;
+
+		return stitchbuffer + (offset + consize - linestart) % consize;
+	}
+
+	return (char *)conbuf + offset;
+}
+
+static void Con_RowIterInit(struct con_rowiter *iter, unsigned int offset)
+{
+	iter->next = offset;
+	iter->remaining = Con_BufferStringLength(offset);
+	iter->nextcolour = 0x0fff;
+	iter->started = 0;
+}
+
+static int Con_RowIterNext(struct con_rowiter *iter)
+{
+	unsigned short lastcolour;
+
+	if (iter->started && iter->remaining == 0)
+		return 0;
+
+	iter->started = 1;
+
+	lastcolour = iter->nextcolour;
+
+	iter->offset = iter->next;
+	iter->colour = iter->nextcolour;
+	iter->length = Con_BufferFindLinebreak(iter->next, iter->remaining, &lastcolour);
+	if (iter->length > iter->remaining)
+		iter->length = iter->remaining;
+
+	iter->next = (iter->next + iter->length) % consize;
+	iter->remaining -= iter->length;
+	iter->nextcolour = lastcolour;
+
+	return 1;
+}
+
+static unsigned int Con_LineRows(unsigned int line)
+{
+	struct con_rowiter iter;
+	unsigned int rows;
+
+	if (linegenerations[line] != layoutgeneration)
+	{
+		rows = 0;
+
+		Con_RowIterInit(&iter, lines[line]);
+		while(Con_RowIterNext(&iter))
+			rows++;
+
+		linerows[line] = rows;
+		linegenerations[line] = layoutgeneration;
+	}
+
+	return linerows[line];
+}
+
+static int Con_IsEmpty()
+{
+	return firstline == ((lastline + 1) % maxlines);
+}
+
+static unsigned int Con_NumLines()
+{
+	return (lastline + 1 + maxlines - firstline) % maxlines;
+}
+
+static int Con_PlainBufferSize(unsigned int size)
+{
+	char *newplainbuf;
+	unsigned short *newplaincolumns;
+
+	if (size <= plainbufsize)
+		return 1;
+
+	newplainbuf = malloc(size);
+	newplaincolumns = malloc(size * sizeof(*plaincolumns));
+	if (newplainbuf == 0 || newplaincolumns == 0)
+	{
+		free(newplainbuf);
+		free(newplaincolumns);
+		return 0;
+	}
+
+	free(plainbuf);
+	free(plaincolumns);
+
+	plainbuf = newplainbuf;
+	plaincolumns = newplaincolumns;
+	plainbufsize = size;
+
+	return 1;
+}
+
+static int Con_IsColourCode(const char *text, unsigned int length)
+{
+	if (!con_parsecolors.value || length < 2 || text[0] != '&')
+		return 0;
+
+	if (text[1] == 'r')
+		return 2;
+
+	if (text[1] == 'c' && length >= 5 && isxdigit((unsigned char)text[2]) && isxdigit((unsigned char)text[3]) && isxdigit((unsigned char)text[4]))
+		return 5;
+
+	return 0;
+}
+
+/* Converts text to the lower case, colourless form search terms are matched against.
+ * Returns the length of the result, which is stored in plainbuf along with the column
+ * each character is displayed in. */
+static unsigned int Con_MakePlain(const char *text, unsigned int length)
 {
-	unsigned int *newlines;
-	unsigned short *newlinestartcolours;
 	unsigned int i;
 	unsigned int j;
+	unsigned int column;
+	unsigned int skip;
 
-	newlines = malloc(maxlines*2*sizeof(*lines));
-	if (newlines)
+	if (!Con_PlainBufferSize(length + 1))
+		return 0;
+
+	column = 0;
+
+	for(i=0,j=0;i<length;)
 	{
-		newlinestartcolours = malloc(maxlines*2*sizeof(*linestartcolours));
-		if (newlinestartcolours)
+		if ((skip = Con_IsColourCode(text + i, length - i)))
 		{
-			i = 0;
-			j = firstline;
-			while (j != ((lastline + 1) % maxlines))
+			i += skip;
+			continue;
+		}
+
+		plainbuf[j] = tolower(text[i] & 0x7f);
+		plaincolumns[j] = column++;
+		i++;
+		j++;
+	}
+
+	plainbuf[j] = 0;
+
+	return j;
+}
+
+static unsigned int Con_MakePlainLine(unsigned int line)
+{
+	const char *text;
+	unsigned int length;
+
+	length = Con_BufferStringLength(lines[line]);
+	text = Con_LinePointer(lines[line], lines[line], length);
+	if (text == 0)
+		return 0;
+
+	return Con_MakePlain(text, length);
+}
+
+static unsigned int Con_TrigramHash(const char *text)
+{
+	return ((((unsigned char)text[0] * 31) + (unsigned char)text[1]) * 31 + (unsigned char)text[2]) % CON_INDEX_BUCKETS;
+}
+
+static void Con_PrunePostingList(struct con_postinglist *list)
+{
+	while(list->start < list->count && list->numbers[list->start] < firstlinenumber)
+		list->start++;
+
+	if (list->start == list->count)
+	{
+		list->start = 0;
+		list->count = 0;
+	}
+}
+
+static void Con_IndexLine(unsigned int line)
+{
+	struct con_postinglist *list;
+	unsigned int *newnumbers;
+	unsigned int number;
+	unsigned int length;
+	unsigned int i;
+
+	if (conindex == 0)
+		return;
+
+	number = firstlinenumber + ((line + maxlines - firstline) % maxlines);
+
+	length = Con_MakePlainLine(line);
+
+	for(i=0;i+3<=length;i++)
+	{
+		list = &conindex[Con_TrigramHash(plainbuf + i)];
+
+		if (list->count > list->start && list->numbers[list->count - 1] == number)
+			continue;
+
+		if (list->count == list->size)
+		{
+			Con_PrunePostingList(list);
+
+			if (list->start > list->size / 2)
 			{
-				newlines[i] = lines[j];
-				newlinestartcolours[i] = linestartcolours[j];
-				i++;
-				j++;
-				j %= maxlines;
+				memmove(list->numbers, list->numbers + list->start, (list->count - list->start) * sizeof(*list->numbers));
+				list->count -= list->start;
+				list->start = 0;
 			}
 
-			displayline = (displayline - firstline) % maxlines;
-			lastline = (lastline - firstline) % maxlines;
-			firstline = 0;
+			if (list->count == list->size)
+			{
+				newnumbers = realloc(list->numbers, (list->size ? list->size * 2 : 16) * sizeof(*list->numbers));
+				if (newnumbers == 0)
+					continue;
 
-			free(lines);
-			free(linestartcolours);
+				list->numbers = newnumbers;
+				list->size = list->size ? list->size * 2 : 16;
+			}
+		}
 
-			lines = newlines;
-			linestartcolours = newlinestartcolours;
-			maxlines *= 2;
+		list->numbers[list->count++] = number;
+	}
+}
 
-			return 1;
-		}
+static void Con_ClearIndex()
+{
+	unsigned int i;
+
+	if (conindex == 0)
+		return;
 
-		free(newlines);
+	for(i=0;i<CON_INDEX_BUCKETS;i++)
+	{
+		conindex[i].start = 0;
+		conindex[i].count = 0;
 	}
+}
 
-	return 0;
+static int Con_LineMatches(unsigned int number, const char *term)
+{
+	unsigned int line;
+
+	line = (firstline + (number - firstlinenumber)) % maxlines;
+
+	if (Con_MakePlainLine(line) == 0)
+		return 0;
+
+	/* Don't find the console's echo of the search itself */
+	if (strncmp(plainbuf, "]con_search", 11) == 0)
+		return 0;
+
+	return strstr(plainbuf, term) != 0;
 }
 
-static void Con_LayoutLine(unsigned int offset)
+/* Finds the newest line older than 'before' which contains term */
+static int Con_FindLine(const char *term, unsigned int before, unsigned int *number)
 {
+	struct con_postinglist *list;
+	struct con_postinglist *shortest;
+	unsigned int termlength;
 	unsigned int i;
-	unsigned int j;
-	unsigned short linestartcolour;
-	unsigned short lastcolour;
 
-	linestartcolour = 0x0fff;
+	if (Con_IsEmpty())
+		return 0;
 
-	i = Con_BufferStringLength(offset);
+	if (before > firstlinenumber + Con_NumLines())
+		before = firstlinenumber + Con_NumLines();
 
-	do
+	termlength = strlen(term);
+
+	if (termlength >= 3 && conindex)
 	{
-		j = Con_BufferFindLinebreak(offset, i, &lastcolour);
+		shortest = 0;
+
+		for(i=0;i+3<=termlength;i++)
+		{
+			list = &conindex[Con_TrigramHash(term + i)];
+
+			Con_PrunePostingList(list);
 
-		if ((lastline+2)%maxlines == firstline)
+			if (shortest == 0 || list->count - list->start < shortest->count - shortest->start)
+				shortest = list;
+		}
+
+		i = shortest->count;
+		while(i > shortest->start)
 		{
-			if (!Con_ExpandMaxLines())
+			i--;
+
+			if (shortest->numbers[i] >= before)
+				continue;
+
+			if (Con_LineMatches(shortest->numbers[i], term))
 			{
-				firstline++;
-				firstline = firstline % maxlines;
+				*number = shortest->numbers[i];
+				return 1;
 			}
 		}
 
-		if (displayline == lastline)
+		return 0;
+	}
+
+	for(i=before;i>firstlinenumber;i--)
+	{
+		if (Con_LineMatches(i - 1, term))
+		{
+			*number = i - 1;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int Con_ExpandMaxLines()
+{
+	unsigned int *newlines;
+	unsigned int *newlinerows;
+	unsigned int *newlinegenerations;
+	unsigned int i;
+	unsigned int j;
+
+	newlines = malloc(maxlines*2*sizeof(*lines));
+	newlinerows = malloc(maxlines*2*sizeof(*linerows));
+	newlinegenerations = malloc(maxlines*2*sizeof(*linegenerations));
+	if (newlines && newlinerows && newlinegenerations)
+	{
+		i = 0;
+		j = firstline;
+		while (j != ((lastline + 1) % maxlines))
 		{
-			displayline++;
-			displayline %= maxlines;
+			newlines[i] = lines[j];
+			newlinerows[i] = linerows[j];
+			newlinegenerations[i] = linegenerations[j];
+			i++;
+			j++;
+			j %= maxlines;
 		}
 
-		lastline++;
-		lastline %= maxlines;
+		displayline = (displayline - firstline) % maxlines;
+		lastline = (lastline - firstline) % maxlines;
+		firstline = 0;
+
+		free(lines);
+		free(linerows);
+		free(linegenerations);
+
+		lines = newlines;
+		linerows = newlinerows;
+		linegenerations = newlinegenerations;
+		maxlines *= 2;
+
+		return 1;
+	}
+
+	free(newlines);
+	free(newlinerows);
+	free(newlinegenerations);
 
-		lines[lastline] = offset;
-		linestartcolours[lastline] = linestartcolour;
+	return 0;
+}
+
+static void Con_RemoveFirstLine()
+{
+	if (displayline == firstline)
+	{
+		displayline++;
+		displayline %= maxlines;
+		displayrow = 0;
+	}
 
+	lines[firstline++] = 0;
+	firstline %= maxlines;
+	firstlinenumber++;
+
+	if (Con_IsEmpty())
+	{
+		displayline = lastline;
+		displayrow = 0;
+	}
+}
+
+static int Con_AtEnd()
+{
+	return Con_IsEmpty() || (displayline == lastline && displayrow + 1 >= Con_LineRows(lastline));
+}
+
+static void Con_AddLine(unsigned int offset)
+{
+	unsigned int i;
+	unsigned int rows;
+	int follow;
+
+	if ((lastline+2)%maxlines == firstline)
+	{
+		if (!Con_ExpandMaxLines())
+			Con_RemoveFirstLine();
+	}
+
+	follow = Con_AtEnd();
+
+	lastline++;
+	lastline %= maxlines;
+
+	lines[lastline] = offset;
+	linegenerations[lastline] = layoutgeneration - 1;
+
+	rows = Con_LineRows(lastline);
+
+	for(i=0;i<rows && i<MAXNOTIFYLINES;i++)
+	{
 		notifytimes[notifystart] = Sys_IntTime();
 		notifystart++;
 		notifystart %= MAXNOTIFYLINES;
+	}
 
-		offset += j;
-		offset %= consize;
-		i -= j;
+	Con_IndexLine(lastline);
 
-		linestartcolour = lastcolour;
-	} while(i);
+	if (follow)
+	{
+		displayline = lastline;
+		displayrow = rows - 1;
+	}
 }
 
+/* Line breaks depend on the console width and colour parsing, so invalidate every line's layout */
 static void Con_Relayout()
 {
-	unsigned int i;
+	int atend;
 
-	if (firstline != ((lastline + 1) % maxlines))
-	{
-		i = lines[firstline];
+	atend = Con_AtEnd();
 
-		firstline = 0;
-		lastline = maxlines - 1;
-		displayline = lastline;
+	layoutgeneration++;
 
-		while(i != contail)
-		{
-			Con_LayoutLine(i);
-			i += Con_BufferStringLength(i) + 1;
-			i %= consize;
-		}
-	}
+	if (atend)
+		Con_End();
+	else if (displayrow >= Con_LineRows(displayline))
+		displayrow = Con_LineRows(displayline) - 1;
 }
 
 static void Con_Clear()
 {
+	firstlinenumber += Con_NumLines();
+	Con_ClearIndex();
+
 	contail = 0;
 	partiallinestart = 0;
 	firstline = 0;
 	lastline = maxlines - 1;
 	displayline = lastline;
+	displayrow = 0;
+}
+
+static void Con_Search_f()
+{
+	const char *term;
+	unsigned int number;
+	unsigned int before;
+	char newterm[MAXSEARCHTERM];
+	unsigned int i;
+
+	if (Cmd_Argc() < 2)
+	{
+		searchterm[0] = 0;
+		searchlast = ~0U;
+		Con_End();
+		return;
+	}
+
+	term = Cmd_Args();
+
+	for(i=0;term[i] && i<sizeof(newterm)-1;i++)
+		newterm[i] = tolower(term[i] & 0x7f);
+
+	newterm[i] = 0;
+
+	if (strcmp(newterm, searchterm) == 0 && searchlast != ~0U)
+	{
+		before = searchlast;
+	}
+	else
+	{
+		strcpy(searchterm, newterm);
+		before = firstlinenumber + Con_NumLines();
+	}
+
+	if (!Con_FindLine(searchterm, before, &number))
+	{
+		searchlast = ~0U;
+		Com_Printf("con_search: no %smatches\n", before == firstlinenumber + Con_NumLines() ? "" : "more ");
+		return;
+	}
+
+	searchlast = number;
+
+	displayline = (firstline + (number - firstlinenumber)) % maxlines;
+	displayrow = Con_LineRows(displayline) - 1;
+
+	/* The bottom row is covered by the scrollback marker */
+	Con_ScrollDown(1);
 }
 
 void Con_Init(void)
@@ -314,31 +739,61 @@ void Con_Init(void)
 	if (conbuf)
 	{
 		lines = malloc(sizeof(*lines)*512);
-		if (lines)
+		linerows = malloc(sizeof(*linerows)*512);
+		linegenerations = malloc(sizeof(*linegenerations)*512);
+		if (lines && linerows && linegenerations)
 		{
-			linestartcolours = malloc(sizeof(*linestartcolours)*512);
-			if (lines)
-			{
-				memset(lines, 0, sizeof(*lines)*512);
-				memset(linestartcolours, 0, sizeof(*linestartcolours)*512);
-				maxlines = 512;
-				lastline = maxlines - 1;
-				displayline = lastline;
+			memset(lines, 0, sizeof(*lines)*512);
+			memset(linerows, 0, sizeof(*linerows)*512);
+			memset(linegenerations, 0, sizeof(*linegenerations)*512);
+			maxlines = 512;
+			lastline = maxlines - 1;
+			displayline = lastline;
 
-				textcolumns = 65536;
-			}
+			textcolumns = 65536;
+
+			conindex = calloc(CON_INDEX_BUCKETS, sizeof(*conindex));
+		}
+		else
+		{
+			free(lines);
+			free(linerows);
+			free(linegenerations);
+
+			lines = 0;
+			linerows = 0;
+			linegenerations = 0;
 		}
 	}
 }
 
 void Con_Shutdown(void)
 {
+	unsigned int i;
+
+	if (conindex)
+	{
+		for(i=0;i<CON_INDEX_BUCKETS;i++)
+			free(conindex[i].numbers);
+	}
+
 	free(conbuf);
 	free(lines);
+	free(linerows);
+	free(linegenerations);
+	free(conindex);
+	free(plainbuf);
+	free(plaincolumns);
 	free(scrollupmarker);
 
 	conbuf = 0;
 	lines = 0;
+	linerows = 0;
+	linegenerations = 0;
+	conindex = 0;
+	plainbuf = 0;
+	plaincolumns = 0;
+	plainbufsize = 0;
 	scrollupmarker = 0;
 }
 
@@ -348,9 +803,11 @@ void Con_CvarInit(void)
 	Cvar_Register(&con_notifylines);
 	Cvar_Register(&con_notifytime);
 	Cvar_Register(&con_parsecolors);
+	Cvar_Register(&con_highlightcolour);
 	Cvar_ResetCurrentGroup();
 
 	Cmd_AddCommand("clear", Con_Clear);
+	Cmd_AddCommand("con_search", Con_Search_f);
 }
 
 static qboolean con_parsecolors_callback(cvar_t *cvar, char *value)
@@ -393,99 +850,156 @@ void Con_CheckResize(unsigned int pixelwidth)
 	}
 }
 
-static void Con_DrawTextLines(unsigned int y, unsigned int maxlinestodraw, unsigned int lastlinetodraw)
+static void Con_DrawHighlights(unsigned int y, const char *text, unsigned int length, const char *term)
 {
-	unsigned int i;
-	unsigned int j;
-	unsigned int nextline;
-	unsigned int linelength;
+	unsigned int termlength;
+	unsigned int plainlength;
+	const char *match;
 
-	if (firstline == ((lastline + 1) % maxlines))
-		return;
+	termlength = strlen(term);
 
-	if (maxlinestodraw == 0)
+	plainlength = Con_MakePlain(text, length);
+	if (plainlength < termlength)
 		return;
 
-	if (!con_parsecolors.value)
-		Draw_BeginTextRendering();
-
-	y += maxlinestodraw * 8;
-
-	j = lastlinetodraw;
-
-	if (firstline > lastlinetodraw)
-		j += maxlines;
-
-	if (firstline + maxlinestodraw - 1 <= j)
-	{
-		i = j - maxlinestodraw + 1;
-	}
-	else
+	match = plainbuf;
+	while((match = strstr(match, term)))
 	{
-		i = firstline;
-		maxlinestodraw = j - firstline + 1;
+		Draw_Fill(8 + plaincolumns[match - plainbuf] * 8, y, termlength * 8, 8, con_highlightcolour.value);
+		match += termlength;
 	}
+}
 
-	i %= maxlines;
+/* Draws up to maxrowstodraw rows, the last of which is row 'lastrowtodraw' of line 'lastlinetodraw' */
+static void Con_DrawTextLines(unsigned int y, unsigned int maxrowstodraw, unsigned int lastlinetodraw, unsigned int lastrowtodraw, const char *highlight)
+{
+	struct con_rowiter iter;
+	unsigned int i;
+	unsigned int row;
+	unsigned int rowstodraw;
+	unsigned int skip;
+	unsigned int pass;
+	unsigned int rowy;
+	unsigned int left;
+	char *text;
+
+	if (Con_IsEmpty())
+		return;
 
-	y -= maxlinestodraw * 8;
+	if (maxrowstodraw == 0)
+		return;
 
-	while(i != ((lastline + 1) % maxlines) && maxlinestodraw)
+	/* Walk back from the last row to find the first one, laying out only the lines passed on the way */
+	i = lastlinetodraw;
+	row = lastrowtodraw;
+	rowstodraw = 1;
+	while(rowstodraw < maxrowstodraw)
 	{
-		if (maxlinestodraw == 1 && i != lastline)
+		if (row)
+			row--;
+		else if (i != firstline)
 		{
-			Draw_String(8, y, scrollupmarker);
-			break;
+			i = (i + maxlines - 1) % maxlines;
+			row = Con_LineRows(i) - 1;
 		}
+		else
+			break;
 
-		nextline = (i + 1) % maxlines;
-		linelength = Con_BufferStringLength(lines[i]);
-		if (nextline != ((lastline + 1) % maxlines))
-		{
-			if (lines[nextline] < lines[i])
-				j = consize - lines[i] + lines[nextline];
-			else
-				j = lines[nextline] - lines[i];
+		rowstodraw++;
+	}
 
-			if (j < linelength)
-				linelength = j;
-		}
+	y += (maxrowstodraw - rowstodraw) * 8;
+
+	/* The highlights go in a separate pass so they end up behind the text */
+	for(pass=(highlight && *highlight)?0:1;pass<2;pass++)
+	{
+		if (pass == 1 && !con_parsecolors.value)
+			Draw_BeginTextRendering();
+
+		lastlinetodraw = i;
+		skip = row;
+		rowy = y;
+		left = rowstodraw;
 
-		if (lines[i] + linelength > consize)
+		while(left)
 		{
-			if (stitchbuffer)
+			Con_RowIterInit(&iter, lines[lastlinetodraw]);
+
+			while(left && Con_RowIterNext(&iter))
 			{
-				if (con_parsecolors.value)
-					Draw_ColoredString_Length(8, y, stitchbuffer, 0, linelength, linestartcolours[i]);
-				else
-					Draw_String_Length(8, y, stitchbuffer, linelength);
+				if (skip)
+				{
+					skip--;
+					continue;
+				}
+
+				if (left == 1 && (lastlinetodraw != lastline || iter.remaining))
+				{
+					if (pass == 1)
+						Draw_String(8, rowy, scrollupmarker);
+
+					left = 0;
+					break;
+				}
+
+				text = Con_LinePointer(lines[lastlinetodraw], iter.offset, iter.length);
+				if (text)
+				{
+					if (pass == 0)
+						Con_DrawHighlights(rowy, text, iter.length, highlight);
+					else if (con_parsecolors.value)
+						Draw_ColoredString_Length(8, rowy, text, 0, iter.length, iter.colour);
+					else
+						Draw_String_Length(8, rowy, text, iter.length);
+				}
+
+				rowy += 8;
+				left--;
 			}
-		}
-		else
-		{
-			if (con_parsecolors.value)
-				Draw_ColoredString_Length(8, y, conbuf + lines[i], 0, linelength, linestartcolours[i]);
-			else
-				Draw_String_Length(8, y, conbuf + lines[i], linelength);
+
+			if (lastlinetodraw == lastline)
+				break;
+
+			lastlinetodraw = (lastlinetodraw + 1) % maxlines;
 		}
 
-		y += 8;
-		i = nextline;
-		maxlinestodraw--;
+		if (pass == 1 && !con_parsecolors.value)
+			Draw_EndTextRendering();
 	}
+}
+
+/* The term to highlight, either what is being typed after con_search or the last search */
+static const char *Con_HighlightTerm(char *buf, unsigned int bufsize)
+{
+	const char *s;
+	unsigned int i;
+
+	s = key_lines[edit_line] + 1;
+	if (*s == '/' || *s == '\\')
+		s++;
+
+	if (strncmp(s, "con_search ", 11) != 0)
+		return searchterm;
+
+	s += 11;
+
+	for(i=0;s[i] && i<bufsize-1;i++)
+		buf[i] = tolower(s[i] & 0x7f);
 
-	if (!con_parsecolors.value)
-		Draw_EndTextRendering();
+	buf[i] = 0;
+
+	return buf;
 }
 
 void Con_DrawConsole(int pixellines)
 {
 	unsigned int linelength;
 	unsigned char tmpline[2048];
+	char highlight[MAXSEARCHTERM];
 
 	Draw_ConsoleBackground(pixellines);
 
-	Con_DrawTextLines((pixellines+2)%8, (pixellines - 22) / 8, displayline);
+	Con_DrawTextLines((pixellines+2)%8, (pixellines - 22) / 8, displayline, displayrow, Con_HighlightTerm(highlight, sizeof(highlight)));
 
 	if (key_linepos && key_linepos - 1 < editlinepos)
 		editlinepos = key_linepos - 1;
@@ -534,7 +1048,8 @@ unsigned int Con_DrawNotify(void)
 		maxnotifylines--;
 	}
 
-	Con_DrawTextLines(0, maxnotifylines, lastline);
+	if (!Con_IsEmpty())
+		Con_DrawTextLines(0, maxnotifylines, lastline, Con_LineRows(lastline) - 1, 0);
 
 	return maxnotifylines;
 }
@@ -563,14 +1078,7 @@ static void Con_ClearBufferSpace(unsigned int size)
 {
 	while(firstline != ((lastline + 1) % maxlines) && ((lines[firstline] >= contail && lines[firstline] < contail + size) || (contail + size >= consize && lines[firstline] < (((contail + size) % consize)))))
 	{
-		if (displayline == firstline)
-		{
-			displayline++;
-			displayline %= maxlines;
-		}
-
-		lines[firstline++] = 0;
-		firstline %= maxlines;
+		Con_RemoveFirstLine();
 	}
 }
 
@@ -587,6 +1095,8 @@ void Con_Print(const char *txt)
 	if (suppressed)
 		return;
 
+	Log_Write(*txt == 1 || *txt == 2 ? txt + 1 : txt);
+
 	if (lines == 0)
 	{
 		printf("%s\n", txt);
@@ -673,7 +1183,7 @@ void Con_Print(const char *txt)
 				}
 			}
 
-			Con_LayoutLine(linebegin);
+			Con_AddLine(linebegin);
 		}
 
 		partiallinestart = 0;
@@ -699,41 +1209,69 @@ void Con_Print(const char *txt)
 
 void Con_ScrollUp(unsigned int numlines)
 {
-	int distance;
+	if (Con_IsEmpty())
+		return;
 
-	distance = displayline - firstline;
-	if (distance < 0)
-		distance += maxlines;
+	while(numlines)
+	{
+		if (displayrow >= numlines)
+		{
+			displayrow -= numlines;
+			break;
+		}
 
-	if (numlines > distance)
-		numlines = distance;
+		if (displayline == firstline)
+		{
+			displayrow = 0;
+			break;
+		}
 
-	displayline -= numlines;
-	displayline %= maxlines;
+		numlines -= displayrow + 1;
+		displayline = (displayline + maxlines - 1) % maxlines;
+		displayrow = Con_LineRows(displayline) - 1;
+	}
 }
 
 void Con_ScrollDown(unsigned int numlines)
 {
-	int distance;
+	unsigned int rows;
+
+	if (Con_IsEmpty())
+		return;
+
+	while(numlines)
+	{
+		rows = Con_LineRows(displayline);
 
-	distance = lastline - displayline;
-	if (distance < 0)
-		distance += maxlines;
+		if (displayrow + numlines < rows)
+		{
+			displayrow += numlines;
+			break;
+		}
 
-	if (numlines > distance)
-		numlines = distance;
+		if (displayline == lastline)
+		{
+			displayrow = rows - 1;
+			break;
+		}
 
-	displayline += numlines;
-	displayline %= maxlines;
+		numlines -= rows - displayrow;
+		displayline = (displayline + 1) % maxlines;
+		displayrow = 0;
+	}
 }
 
 void Con_Home(void)
 {
 	displayline = firstline;
+	displayrow = 0;
 }
 
 void Con_End(void)
 {
 	displayline = lastline;
-}
+	displayrow = 0;
 
+	if (!Con_IsEmpty())
+		displayrow = Con_LineRows(lastline) - 1;
+}
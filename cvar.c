@@ -34,6 +34,26 @@ extern void SV_ServerinfoChanged (char *key, char *value);
 static cvar_t *cvar_hash[32];
 cvar_t *cvar_vars;
 
+unsigned int cvar_generation;
+
+struct CvarSubscription
+{
+	struct CvarSubscription *next;
+	void (*callback)(void *userdata);
+	void *userdata;
+	unsigned int generation;
+	cvar_t **cvars;
+	unsigned int numcvars;
+	cvar_group_t **groups;
+	unsigned int numgroups;
+	unsigned int dead;
+};
+
+static struct CvarSubscription *cvar_subscriptions;
+static unsigned int cvar_dispatching; /* Unsubscribing only marks the subscription dead while set */
+static unsigned int cvar_deadsubscriptions;
+static unsigned int cvar_frames;
+
 cvar_t	cvar_viewdefault = {"cvar_viewdefault", "1"};
 
 cvar_t *Cvar_FindVar (char *var_name)
@@ -46,6 +66,7 @@ cvar_t *Cvar_FindVar (char *var_name)
 	{
 		if (!Q_strcasecmp (var_name, var->name))
 		{
+			var->lookups++;
 			return var;
 		}
 	}
@@ -219,6 +240,11 @@ void Cvar_Set (cvar_t *var, char *value)
 	var->string = CopyString (value);
 	var->value = floatvalue;
 
+	var->generation = ++cvar_generation;
+	var->sets++;
+	if (var->group)
+		var->group->generation = cvar_generation;
+
 #ifndef CLIENTONLY
 	if (var->flags & CVAR_SERVERINFO)
 		SV_ServerinfoChanged (var->name, var->string);
@@ -305,6 +331,7 @@ static cvar_group_t *Cvar_AddGroup(char *name)
 	Q_strncpyz(newgroup->name, name, sizeof(newgroup->name));
 	newgroup->count = 0;
 	newgroup->head = NULL;
+	newgroup->generation = 0;
 	newgroup->next = cvar_groups;
 	cvar_groups = newgroup;
 
@@ -408,6 +435,7 @@ void Cvar_Register(cvar_t *var)
 	cvar_hash[key] = var;
 	var->next = cvar_vars;
 	cvar_vars = var;
+	Cmd_AddExpandCvar(var);
 
 	Cvar_AddCvarToGroup(var);
 
@@ -549,9 +577,244 @@ cvar_t *Cvar_Create(char *name, char *string, int cvarflags)
 	v->flags = cvarflags;
 	v->value = Q_atof(v->string);
 
+	Cmd_AddExpandCvar(v);
+
 	return v;
 }
 
+struct CvarSubscription *Cvar_Subscribe(void (*callback)(void *userdata), void *userdata)
+{
+	struct CvarSubscription *subscription;
+
+	subscription = malloc(sizeof(*subscription));
+	if (subscription)
+	{
+		subscription->callback = callback;
+		subscription->userdata = userdata;
+		subscription->generation = cvar_generation;
+		subscription->cvars = 0;
+		subscription->numcvars = 0;
+		subscription->groups = 0;
+		subscription->numgroups = 0;
+		subscription->dead = 0;
+
+		subscription->next = cvar_subscriptions;
+		cvar_subscriptions = subscription;
+	}
+
+	return subscription;
+}
+
+static void Cvar_FreeSubscription(struct CvarSubscription *subscription)
+{
+	free(subscription->cvars);
+	free(subscription->groups);
+	free(subscription);
+}
+
+/* Callbacks run from Cvar_Frame() may unsubscribe any subscription, the
+ * subscription is then freed once all callbacks have run. */
+void Cvar_Unsubscribe(struct CvarSubscription *subscription)
+{
+	struct CvarSubscription **prev;
+
+	if (cvar_dispatching)
+	{
+		subscription->dead = 1;
+		cvar_deadsubscriptions = 1;
+		return;
+	}
+
+	for (prev = &cvar_subscriptions; *prev; prev = &(*prev)->next)
+	{
+		if (*prev == subscription)
+		{
+			*prev = subscription->next;
+			break;
+		}
+	}
+
+	Cvar_FreeSubscription(subscription);
+}
+
+int Cvar_SubscribeCvar(struct CvarSubscription *subscription, cvar_t *var)
+{
+	cvar_t **newcvars;
+
+	newcvars = realloc(subscription->cvars, (subscription->numcvars + 1) * sizeof(*newcvars));
+	if (newcvars == 0)
+		return 0;
+
+	newcvars[subscription->numcvars++] = var;
+	subscription->cvars = newcvars;
+
+	return 1;
+}
+
+int Cvar_SubscribeGroup(struct CvarSubscription *subscription, char *groupname)
+{
+	cvar_group_t **newgroups;
+
+	newgroups = realloc(subscription->groups, (subscription->numgroups + 1) * sizeof(*newgroups));
+	if (newgroups == 0)
+		return 0;
+
+	newgroups[subscription->numgroups++] = Cvar_AddGroup(groupname);
+	subscription->groups = newgroups;
+
+	return 1;
+}
+
+static void Cvar_RemoveFromSubscriptions(cvar_t *var)
+{
+	struct CvarSubscription *subscription;
+	unsigned int i;
+
+	for (subscription = cvar_subscriptions; subscription; subscription = subscription->next)
+	{
+		for (i = 0; i < subscription->numcvars; i++)
+		{
+			if (subscription->cvars[i] == var)
+				subscription->cvars[i--] = subscription->cvars[--subscription->numcvars];
+		}
+	}
+}
+
+void Cvar_Frame()
+{
+	static unsigned int lastgeneration;
+	struct CvarSubscription *subscription;
+	struct CvarSubscription **prev;
+	unsigned int i;
+	int changed;
+
+	cvar_frames++;
+
+	if (cvar_generation == lastgeneration)
+		return;
+
+	/* Anything set by the callbacks themselves is picked up next frame */
+	lastgeneration = cvar_generation;
+
+	cvar_dispatching = 1;
+
+	for (subscription = cvar_subscriptions; subscription; subscription = subscription->next)
+	{
+		if (subscription->dead)
+			continue;
+
+		changed = 0;
+
+		for (i = 0; i < subscription->numcvars && !changed; i++)
+		{
+			if (subscription->cvars[i]->generation > subscription->generation)
+				changed = 1;
+		}
+
+		for (i = 0; i < subscription->numgroups && !changed; i++)
+		{
+			if (subscription->groups[i]->generation > subscription->generation)
+				changed = 1;
+		}
+
+		subscription->generation = lastgeneration;
+
+		if (changed)
+			subscription->callback(subscription->userdata);
+	}
+
+	cvar_dispatching = 0;
+
+	if (cvar_deadsubscriptions)
+	{
+		cvar_deadsubscriptions = 0;
+
+		prev = &cvar_subscriptions;
+		while ((subscription = *prev))
+		{
+			if (subscription->dead)
+			{
+				*prev = subscription->next;
+				Cvar_FreeSubscription(subscription);
+			}
+			else
+				prev = &subscription->next;
+		}
+	}
+}
+
+static int Cvar_StatsCompare(const void *p1, const void *p2)
+{
+	const cvar_t *var1 = *(const cvar_t **)p1;
+	const cvar_t *var2 = *(const cvar_t **)p2;
+
+	if (var1->lookups != var2->lookups)
+		return var1->lookups < var2->lookups ? 1 : -1;
+
+	if (var1->sets != var2->sets)
+		return var1->sets < var2->sets ? 1 : -1;
+
+	return strcmp(var1->name, var2->name);
+}
+
+static void Cvar_Stats_f(void)
+{
+	cvar_t *var;
+	cvar_t **sorted_cvars;
+	unsigned int count;
+	unsigned int frames;
+	unsigned int i;
+
+	if (Cmd_Argc() == 2 && strcmp(Cmd_Argv(1), "reset") == 0)
+	{
+		for (var = cvar_vars; var; var = var->next)
+		{
+			var->lookups = 0;
+			var->sets = 0;
+		}
+
+		cvar_frames = 0;
+
+		return;
+	}
+	else if (Cmd_Argc() != 1)
+	{
+		Com_Printf("Usage: %s [reset]\n", Cmd_Argv(0));
+		return;
+	}
+
+	for (var = cvar_vars, count = 0; var; var = var->next, count++);
+
+	sorted_cvars = malloc(count * sizeof(*sorted_cvars));
+	if (sorted_cvars == 0)
+	{
+		Com_ErrorPrintf("%s: out of memory\n", Cmd_Argv(0));
+		return;
+	}
+
+	for (var = cvar_vars, count = 0; var; var = var->next, count++)
+		sorted_cvars[count] = var;
+
+	qsort(sorted_cvars, count, sizeof(*sorted_cvars), Cvar_StatsCompare);
+
+	frames = cvar_frames ? cvar_frames : 1;
+
+	Com_Printf("lookups/frame     sets  name\n");
+
+	for (i = 0; i < count && i < 20; i++)
+	{
+		var = sorted_cvars[i];
+		if (!var->lookups && !var->sets)
+			break;
+
+		Com_Printf("%13.2f %8u  %s\n", (double)var->lookups / frames, var->sets, var->name);
+	}
+
+	Com_Printf("-------------\n%u frames, generation %u\n", cvar_frames, cvar_generation);
+
+	free(sorted_cvars);
+}
+
 //returns true if the cvar was found (and deleted)
 qboolean Cvar_Delete(char *name)
 {
@@ -589,6 +852,10 @@ qboolean Cvar_Delete(char *name)
 			else
 				cvar_vars = var->next;
 
+			Cmd_RemoveExpandCvar(var);
+
+			Cvar_RemoveFromSubscriptions(var);
+
 			// free
 			Z_Free(var->defaultvalue);
 			Z_Free(var->string);
@@ -679,6 +946,7 @@ void Cvar_Init(void)
 
 
 	Cmd_AddCommand("cvar_reset", Cvar_Reset_f);
+	Cmd_AddCommand("cvar_stats", Cvar_Stats_f);
 
 
 	Cvar_SetCurrentGroup(CVAR_GROUP_CONSOLE);
@@ -50,6 +50,9 @@ typedef struct cvar_s {
 	struct cvar_s *next_in_group;	
 	struct cvar_s *hash_next;
 	struct cvar_s *next;
+	unsigned int generation;	// value of cvar_generation when last set
+	unsigned int lookups;		// by-name lookups, for cvar_stats
+	unsigned int sets;
 } cvar_t;
 
 
@@ -58,9 +61,14 @@ typedef struct cvar_group_s {
 	char	name[65];
 	int		count;
 	cvar_t	*head;
+	unsigned int generation;	// highest generation of any cvar in the group
 	struct cvar_group_s *next;
 } cvar_group_t;
 
+// bumped every time any cvar changes value, so code that derives state
+// from cvars can skip recomputing it when nothing has changed
+extern unsigned int cvar_generation;
+
 
 // registers a cvar that already has the name, string, and optionally the
 // flags set
@@ -116,5 +124,16 @@ void Cvar_Shutdown(void);
 void Cvar_SetCurrentGroup(char *name);
 void Cvar_ResetCurrentGroup(void);
 
+// change notification. The callback of a subscription is called at most
+// once per frame, from Cvar_Frame(), if any of the cvars or groups it
+// watches changed since the last call. Callbacks may unsubscribe any
+// subscription, including their own.
+struct CvarSubscription *Cvar_Subscribe(void (*callback)(void *userdata), void *userdata);
+void Cvar_Unsubscribe(struct CvarSubscription *subscription);
+int Cvar_SubscribeCvar(struct CvarSubscription *subscription, cvar_t *var);
+int Cvar_SubscribeGroup(struct CvarSubscription *subscription, char *groupname);
+
+void Cvar_Frame(void);
+
 
 #endif	//_CVAR_H_
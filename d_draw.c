@@ -535,6 +535,14 @@ void Draw_AlphaFillRGB(int x, int y, int w, int h, float r, float g, float b, fl
 {
 }
 
+void Draw_BeginBatch()
+{
+}
+
+void Draw_EndBatch()
+{
+}
+
 void Draw_BeginTextRendering()
 {
 }
@@ -42,9 +42,14 @@ struct SkinImp *SkinImp_CreateSolidColour(float *colours)
 	return 0;
 }
 
-struct SkinImp *SkinImp_CreateTexturePaletted(void *data, unsigned int width, unsigned int height, unsigned int modulo)
+struct SkinImpData
 {
-	struct SkinImp *skinimp;
+	void *data;
+};
+
+struct SkinImpData *SkinImp_PrepareTexturePaletted(void *data, unsigned int width, unsigned int height, unsigned int modulo)
+{
+	struct SkinImpData *skinimpdata;
 	unsigned char *src;
 	unsigned char *dst;
 	unsigned int x;
@@ -55,17 +60,14 @@ struct SkinImp *SkinImp_CreateTexturePaletted(void *data, unsigned int width, un
 	if (height > 194)
 		height = 194;
 
-	skinimp = malloc(sizeof(*skinimp));
-	if (skinimp)
+	skinimpdata = malloc(sizeof(*skinimpdata));
+	if (skinimpdata)
 	{
-		skinimp->data = malloc(296*194);
-		if (skinimp->data)
+		skinimpdata->data = malloc(296*194);
+		if (skinimpdata->data)
 		{
-			skinimp->width = 296;
-			skinimp->height = 194;
-
 			src = data;
-			dst = skinimp->data;
+			dst = skinimpdata->data;
 
 			for(y=0;y<height;y++)
 			{
@@ -84,10 +86,53 @@ struct SkinImp *SkinImp_CreateTexturePaletted(void *data, unsigned int width, un
 			if (height != 194)
 				memset(dst, 0, (194-height)*296);
 
-			return skinimp;
+			return skinimpdata;
 		}
 
-		free(skinimp);
+		free(skinimpdata);
+	}
+
+	return 0;
+}
+
+struct SkinImp *SkinImp_CreateFromData(struct SkinImpData *skinimpdata)
+{
+	struct SkinImp *skinimp;
+
+	skinimp = malloc(sizeof(*skinimp));
+	if (skinimp)
+	{
+		skinimp->data = skinimpdata->data;
+		skinimp->width = 296;
+		skinimp->height = 194;
+		skinimp->colour = 0;
+
+		skinimpdata->data = 0;
+
+		return skinimp;
+	}
+
+	return 0;
+}
+
+void SkinImp_FreeData(struct SkinImpData *skinimpdata)
+{
+	free(skinimpdata->data);
+	free(skinimpdata);
+}
+
+struct SkinImp *SkinImp_CreateTexturePaletted(void *data, unsigned int width, unsigned int height, unsigned int modulo)
+{
+	struct SkinImpData *skinimpdata;
+	struct SkinImp *skinimp;
+
+	skinimpdata = SkinImp_PrepareTexturePaletted(data, width, height, modulo);
+	if (skinimpdata)
+	{
+		skinimp = SkinImp_CreateFromData(skinimpdata);
+		SkinImp_FreeData(skinimpdata);
+
+		return skinimp;
 	}
 
 	return 0;
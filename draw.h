@@ -35,6 +35,8 @@ void Draw_CvarInit(void);
 int Draw_Init(void);
 void Draw_Shutdown(void);
 void Draw_SetSize(unsigned int width, unsigned int height);
+void Draw_BeginBatch(void);
+void Draw_EndBatch(void);
 void Draw_BeginTextRendering(void);
 void Draw_EndTextRendering(void);
 void Draw_BeginColoredTextRendering(void);
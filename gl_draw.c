@@ -55,6 +55,7 @@ extern cvar_t crosshair, cl_crossx, cl_crossy, crosshaircolor, crosshairsize;
 extern cvar_t scr_coloredText;
 
 static void PostChange_crosshairstuff(cvar_t *);
+static void Draw_FlushBatch(void);
 
 qboolean OnChange_gl_crosshairimage(cvar_t *, char *);
 cvar_t	gl_crosshairimage   = {"crosshairimage", "", 0, OnChange_gl_crosshairimage};
@@ -450,6 +451,8 @@ void DrawImp_Init(void)
 
 void DrawImp_Shutdown()
 {
+	Draw_FlushBatch();
+
 	if (crosshairpic)
 	{
 		Draw_FreePicture(crosshairpic);
@@ -461,51 +464,34 @@ void DrawImp_Shutdown()
 	drawgl_inited = 0;
 }
 
-__inline static void Draw_CharPoly(int x, int y, int num)
-{
-	float coords[4*2];
-	float texcoords[4*2];
-	float frow, fcol;
-
-	frow = (num >> 4) * 0.0625;
-	fcol = (num & 15) * 0.0625;
-
-	coords[0*2 + 0] = x;
-	coords[0*2 + 1] = y;
-	coords[1*2 + 0] = x + 8;
-	coords[1*2 + 1] = y;
-	coords[2*2 + 0] = x + 8;
-	coords[2*2 + 1] = y + 8;
-	coords[3*2 + 0] = x;
-	coords[3*2 + 1] = y + 8;
-
-	texcoords[0*2 + 0] = fcol;
-	texcoords[0*2 + 1] = frow;
-	texcoords[1*2 + 0] = fcol + 0.0625;
-	texcoords[1*2 + 1] = frow;
-	texcoords[2*2 + 0] = fcol + 0.0625;
-	texcoords[2*2 + 1] = frow + 0.03125;
-	texcoords[3*2 + 0] = fcol;
-	texcoords[3*2 + 1] = frow + 0.03125;
+/* All textured 2D quads (text, pictures) go through one vertex batch which
+ * is only drawn when the texture or the blend mode changes, when it fills
+ * up, or when something else is about to be drawn. Between
+ * Draw_BeginBatch() and Draw_EndBatch() the batch is kept open across
+ * calls, so a whole HUD made up of strings ends up as a handful of draw
+ * calls instead of one per string. */
 
-	GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
-	GL_VertexPointer(2, GL_FLOAT, 0, coords);
-	GL_TexCoordPointer(0, 2, GL_FLOAT, 0, texcoords);
-	glDrawArrays(GL_QUADS, 0, 4);
-}
-
-static int textrenderingenabled;
-static int colouredtextrendering;
+enum DrawBatchMode
+{
+	DRAWBATCH_INHERIT,  /* Whatever alpha test/blend state was set before */
+	DRAWBATCH_TEXT,
+	DRAWBATCH_BLEND,
+};
 
-#define NUMBUFFEREDTEXTVERTICES 64
-#if (NUMBUFFEREDTEXTVERTICES%4) != 0
+#define NUMBATCHVERTICES 4096
+#if (NUMBATCHVERTICES%4) != 0
 #error Fail.
 #endif
 
-static float fontvertices[2*NUMBUFFEREDTEXTVERTICES] __attribute__((aligned(64)));
-static float fonttexcoords[2*NUMBUFFEREDTEXTVERTICES] __attribute__((aligned(64)));
-static unsigned int fontcolours[NUMBUFFEREDTEXTVERTICES] __attribute__((aligned(64)));
-static int fontindex;
+static float batchvertices[2*NUMBATCHVERTICES] __attribute__((aligned(64)));
+static float batchtexcoords[2*NUMBATCHVERTICES] __attribute__((aligned(64)));
+static unsigned int batchcolours[NUMBATCHVERTICES] __attribute__((aligned(64)));
+static unsigned int batchnumvertices;
+static int batchtexnum;
+static enum DrawBatchMode batchmode;
+static int batchdepth;
+
+static int colouredtextrendering;
 
 union
 {
@@ -516,102 +502,89 @@ union
 	{ 255, 255, 255, 255 }
 };
 
-static void Draw_CharPolyArray(int x, int y, int num)
+static void Draw_FlushBatch()
 {
-	int index;
-
-	float frow, fcol;
-
-	frow = (num >> 4) * 0.0625;
-	fcol = (num & 15) * 0.0625;
-
-	index = fontindex;
-
-	fontvertices[index++] = x;
-	fontvertices[index++] = y;
-
-	fontvertices[index++] = x + 8;
-	fontvertices[index++] = y;
-
-	fontvertices[index++] = x + 8;
-	fontvertices[index++] = y + 8;
-
-	fontvertices[index++] = x;
-	fontvertices[index++] = y + 8;
+	if (!batchnumvertices)
+		return;
 
-	index = fontindex;
+	GL_Bind(batchtexnum);
 
-	fonttexcoords[index++] = fcol;
-	fonttexcoords[index++] = frow;
+	if (batchmode == DRAWBATCH_TEXT)
+	{
+		GL_SetAlphaTestBlend(1, 0);
+	}
+	else if (batchmode == DRAWBATCH_BLEND)
+	{
+		GL_SetAlphaTestBlend(0, 1);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
 
-	fonttexcoords[index++] = fcol + 0.0625;
-	fonttexcoords[index++] = frow;
+	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
-	fonttexcoords[index++] = fcol + 0.0625;
-	fonttexcoords[index++] = frow + 0.03125;
+	GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_COLOR_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
+	GL_VertexPointer(2, GL_FLOAT, 0, batchvertices);
+	GL_TexCoordPointer(0, 2, GL_FLOAT, 0, batchtexcoords);
+	GL_ColorPointer(4, GL_UNSIGNED_BYTE, 0, batchcolours);
 
-	fonttexcoords[index++] = fcol;
-	fonttexcoords[index++] = frow + 0.03125;
+	glDrawArrays(GL_QUADS, 0, batchnumvertices);
 
-	fontindex += 8;
+	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glColor3ubv(color_white);
 
-	if (fontindex >= NUMBUFFEREDTEXTVERTICES*2)
-	{
-		glDrawArrays(GL_QUADS, 0, fontindex/2);
-		fontindex = 0;
-	}
+	batchnumvertices = 0;
 }
 
-static void Draw_CharPolyColourArray(int x, int y, int num)
+static void Draw_BatchQuad(int texnum, enum DrawBatchMode mode, float x, float y, float width, float height, const float *texcoords, unsigned int colour)
 {
-	int index;
-	float frow, fcol;
-
-	frow = (num >> 4) * 0.0625;
-	fcol = (num & 15) * 0.0625;
-
-	index = fontindex;
+	float *v;
+	unsigned int *c;
 
-	fontvertices[index++] = x;
-	fontvertices[index++] = y;
+	if (batchnumvertices && (texnum != batchtexnum || (mode != DRAWBATCH_INHERIT && mode != batchmode) || batchnumvertices == NUMBATCHVERTICES))
+		Draw_FlushBatch();
 
-	fontvertices[index++] = x + 8;
-	fontvertices[index++] = y;
-
-	fontvertices[index++] = x + 8;
-	fontvertices[index++] = y + 8;
+	if (!batchnumvertices)
+	{
+		batchtexnum = texnum;
+		batchmode = mode;
+	}
 
-	fontvertices[index++] = x;
-	fontvertices[index++] = y + 8;
+	v = batchvertices + batchnumvertices*2;
 
-	index = fontindex;
+	v[0] = x;
+	v[1] = y;
+	v[2] = x + width;
+	v[3] = y;
+	v[4] = x + width;
+	v[5] = y + height;
+	v[6] = x;
+	v[7] = y + height;
 
-	fonttexcoords[index++] = fcol;
-	fonttexcoords[index++] = frow;
+	memcpy(batchtexcoords + batchnumvertices*2, texcoords, sizeof(*texcoords)*4*2);
 
-	fonttexcoords[index++] = fcol + 0.0625;
-	fonttexcoords[index++] = frow;
+	c = batchcolours + batchnumvertices;
 
-	fonttexcoords[index++] = fcol + 0.0625;
-	fonttexcoords[index++] = frow + 0.03125;
+	c[0] = colour;
+	c[1] = colour;
+	c[2] = colour;
+	c[3] = colour;
 
-	fonttexcoords[index++] = fcol;
-	fonttexcoords[index++] = frow + 0.03125;
+	batchnumvertices += 4;
 
-	index = fontindex / 2;
+	if (!batchdepth)
+		Draw_FlushBatch();
+}
 
-	fontcolours[index+0] = fontcolour.ui;
-	fontcolours[index+1] = fontcolour.ui;
-	fontcolours[index+2] = fontcolour.ui;
-	fontcolours[index+3] = fontcolour.ui;
+void Draw_BeginBatch()
+{
+	batchdepth++;
+}
 
-	fontindex += 8;
+void Draw_EndBatch()
+{
+	batchdepth--;
 
-	if (fontindex >= NUMBUFFEREDTEXTVERTICES*2)
-	{
-		glDrawArrays(GL_QUADS, 0, fontindex/2);
-		fontindex = 0;
-	}
+	if (!batchdepth)
+		Draw_FlushBatch();
 }
 
 void DrawImp_SetTextColor(int r, int g, int b)
@@ -625,80 +598,49 @@ void DrawImp_SetTextColor(int r, int g, int b)
 //It can be clipped to the top of the screen to allow the console to be smoothly scrolled off.
 void DrawImp_Character(int x, int y, unsigned char num)
 {
-	if (textrenderingenabled)
-	{
-		if (colouredtextrendering)
-			Draw_CharPolyColourArray(x, y, num);
-		else
-			Draw_CharPolyArray(x, y, num);
+	float texcoords[4*2];
+	float frow, fcol;
 
-		return;
-	}
+	frow = (num >> 4) * 0.0625;
+	fcol = (num & 15) * 0.0625;
 
-	GL_Bind(char_texture);
-	GL_SetAlphaTestBlend(1, 0);
+	texcoords[0*2 + 0] = fcol;
+	texcoords[0*2 + 1] = frow;
+	texcoords[1*2 + 0] = fcol + 0.0625;
+	texcoords[1*2 + 1] = frow;
+	texcoords[2*2 + 0] = fcol + 0.0625;
+	texcoords[2*2 + 1] = frow + 0.03125;
+	texcoords[3*2 + 0] = fcol;
+	texcoords[3*2 + 1] = frow + 0.03125;
 
-	Draw_CharPoly(x, y, num);
+	Draw_BatchQuad(char_texture, DRAWBATCH_TEXT, x, y, 8, 8, texcoords, colouredtextrendering ? fontcolour.ui : 0xffffffff);
 }
 
 void Draw_BeginTextRendering()
 {
-	if (!textrenderingenabled)
-	{
-		GL_Bind(char_texture);
-		GL_SetAlphaTestBlend(1, 0);
-		GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
-
-		glColor3f(1, 1, 1);
-		GL_VertexPointer(2, GL_FLOAT, 0, fontvertices);
-		GL_TexCoordPointer(0, 2, GL_FLOAT, 0, fonttexcoords);
-
-		fontindex = 0;
-	}
-
-	textrenderingenabled++;
+	Draw_BeginBatch();
 }
 
 void Draw_EndTextRendering()
 {
-	textrenderingenabled--;
-
-	if (!textrenderingenabled)
-	{
-		if (fontindex)
-			glDrawArrays(GL_QUADS, 0, fontindex/2);
-
-		if (colouredtextrendering)
-			colouredtextrendering = 0;
-	}
+	Draw_EndBatch();
 }
 
 void Draw_BeginColoredTextRendering()
 {
-	if (!textrenderingenabled)
-	{
-		GL_Bind(char_texture);
-		GL_SetAlphaTestBlend(1, 0);
-		GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_COLOR_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-
-		GL_VertexPointer(2, GL_FLOAT, 0, fontvertices);
-		GL_TexCoordPointer(0, 2, GL_FLOAT, 0, fonttexcoords);
-		GL_ColorPointer(4, GL_UNSIGNED_BYTE, 0, fontcolours);
+	Draw_BeginBatch();
 
-		fontindex = 0;
-
-		colouredtextrendering = 1;
-	}
-
-	textrenderingenabled++;
+	colouredtextrendering++;
 }
 
 void Draw_EndColoredTextRendering()
 {
-	Draw_EndTextRendering();
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-	fontcolour.ui = 0xffffffff;
+	colouredtextrendering--;
+
+	if (!colouredtextrendering)
+		fontcolour.ui = 0xffffffff;
+
+	Draw_EndBatch();
 }
 
 static int crosshairtexnum;
@@ -791,6 +733,8 @@ void Draw_Crosshair(void)
 		if (!gl_crosshairalpha.value)
 			return;
 
+		Draw_FlushBatch();
+
 		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
 		GL_Bind(crosshairtexnum);
@@ -823,6 +767,8 @@ void Draw_AlphaFillRGB(int x, int y, int w, int h, float r, float g, float b, fl
 	if (!alpha)
 		return;
 
+	Draw_FlushBatch();
+
 	glDisable(GL_TEXTURE_2D);
 	GL_SetAlphaTestBlend(0, alpha < 1);
 	if (alpha < 1)
@@ -893,6 +839,8 @@ void Draw_Line(int x1, int y1, int x2, int y2, float width, float r, float g, fl
 	colours[4 + 2] = b;
 	colours[4 + 3] = a;
 
+	Draw_FlushBatch();
+
 	GL_SetAlphaTestBlend(0, 1);
 	glDisable(GL_TEXTURE_2D);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -918,6 +866,8 @@ void Draw_FadeScreen(void)
 	if (!alpha)
 		return;
 
+	Draw_FlushBatch();
+
 	if (alpha < 1)
 	{
 		GL_SetAlphaTestBlend(0, 1);
@@ -954,6 +904,8 @@ void Draw_FadeScreen(void)
 
 void Draw_SetSize(unsigned int width, unsigned int height)
 {
+	Draw_FlushBatch();
+
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
 	glOrtho(0, width, height, 0, -99999, 99999);
@@ -963,6 +915,8 @@ void Draw_SetSize(unsigned int width, unsigned int height)
 
 void GL_Set2D(void)
 {
+	Draw_FlushBatch();
+
 	glViewport(0, 0, glwidth, glheight);
 
 	glMatrixMode(GL_PROJECTION);
@@ -1329,6 +1283,9 @@ void Draw_FreePicture(struct Picture *picture)
 {
 	if (picture != dummypicture)
 	{
+		if (batchnumvertices && batchtexnum == picture->texnum)
+			Draw_FlushBatch();
+
 		glDeleteTextures(1, (GLuint *)&picture->texnum);
 
 		free(picture);
@@ -1347,30 +1304,11 @@ unsigned int Draw_GetPictureHeight(struct Picture *picture)
 
 void Draw_DrawPicture(struct Picture *picture, int x, int y, unsigned int width, unsigned int height)
 {
-	float coords[4*2];
-
-	GL_Bind(picture->texnum);
-
-	coords[0*2 + 0] = x;
-	coords[0*2 + 1] = y;
-	coords[1*2 + 0] = x + width;
-	coords[1*2 + 1] = y;
-	coords[2*2 + 0] = x + width;
-	coords[2*2 + 1] = y + height;
-	coords[3*2 + 0] = x;
-	coords[3*2 + 1] = y + height;
-
-	GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
-	GL_VertexPointer(2, GL_FLOAT, 0, coords);
-	GL_TexCoordPointer(0, 2, GL_FLOAT, 0, picture->texcoords);
-
-	glDrawArrays(GL_QUADS, 0, 4);
+	Draw_BatchQuad(picture->texnum, DRAWBATCH_INHERIT, x, y, width, height, picture->texcoords, 0xffffffff);
 }
 
 void Draw_DrawPictureModulated(struct Picture *picture, int x, int y, unsigned int width, unsigned int height, float r, float g, float b, float alpha)
 {
-	float coords[4*2];
-	unsigned int colours[4];
 	union
 	{
 		unsigned char uc[4];
@@ -1388,53 +1326,13 @@ void Draw_DrawPictureModulated(struct Picture *picture, int x, int y, unsigned i
 	col.uc[2] = b*255;
 	col.uc[3] = alpha*255;
 
-	GL_SetAlphaTestBlend(0, 1);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-	GL_Bind(picture->texnum);
-
-	coords[0*2 + 0] = x;
-	coords[0*2 + 1] = y;
-	coords[1*2 + 0] = x + width;
-	coords[1*2 + 1] = y;
-	coords[2*2 + 0] = x + width;
-	coords[2*2 + 1] = y + height;
-	coords[3*2 + 0] = x;
-	coords[3*2 + 1] = y + height;
-
-	colours[0] = col.ui;
-	colours[1] = col.ui;
-	colours[2] = col.ui;
-	colours[3] = col.ui;
-
-	GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_COLOR_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
-	GL_VertexPointer(2, GL_FLOAT, 0, coords);
-	GL_ColorPointer(4, GL_UNSIGNED_BYTE, 0, colours);
-	GL_TexCoordPointer(0, 2, GL_FLOAT, 0, picture->texcoords);
-
-	glDrawArrays(GL_QUADS, 0, 4);
-
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	Draw_BatchQuad(picture->texnum, DRAWBATCH_BLEND, x, y, width, height, picture->texcoords, col.ui);
 }
 
 void Draw_DrawSubPicture(struct Picture *picture, float sx, float sy, float swidth, float sheight, int x, int y, unsigned int width, unsigned int height)
 {
-	float coords[4*2];
 	float texcoords[4*2];
 
-	GL_Bind(picture->texnum);
-
-	coords[0*2 + 0] = x;
-	coords[0*2 + 1] = y;
-	coords[1*2 + 0] = x + width;
-	coords[1*2 + 1] = y;
-	coords[2*2 + 0] = x + width;
-	coords[2*2 + 1] = y + height;
-	coords[3*2 + 0] = x;
-	coords[3*2 + 1] = y + height;
-
 	texcoords[0*2 + 0] = (sx) * picture->glwidthscale;
 	texcoords[0*2 + 1] = (sy) * picture->glheightscale;
 	texcoords[1*2 + 0] = (sx + swidth) * picture->glwidthscale;
@@ -1444,10 +1342,5 @@ void Draw_DrawSubPicture(struct Picture *picture, float sx, float sy, float swid
 	texcoords[3*2 + 0] = (sx) * picture->glwidthscale;
 	texcoords[3*2 + 1] = (sy + sheight) * picture->glheightscale;
 
-	GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
-	GL_VertexPointer(2, GL_FLOAT, 0, coords);
-	GL_TexCoordPointer(0, 2, GL_FLOAT, 0, texcoords);
-
-	glDrawArrays(GL_QUADS, 0, 4);
+	Draw_BatchQuad(picture->texnum, DRAWBATCH_INHERIT, x, y, width, height, texcoords, 0xffffffff);
 }
-
@@ -106,7 +106,7 @@ extern	entity_t	*currententity;
 extern	int			r_visframecount;
 extern	int			r_framecount;
 extern	mplane_t	frustum[4];
-extern	int			c_brush_polys, c_alias_polys;
+extern	int			c_brush_polys, c_alias_polys, c_particles, c_particle_draws, c_dlights, c_lightmap_texels;
 
 // view origin
 extern	vec3_t	vup;
@@ -142,7 +142,7 @@ void GL_SubdivideSurface(model_t *model, msurface_t *fa);
 void EmitBothSkyLayers (msurface_t *fa);
 void EmitWaterPolys(model_t *model, msurface_t *fa);
 void EmitCausticsPolys (void);
-void R_DrawSkyChain (void);
+void R_DrawSkyChain (model_t *model);
 void R_LoadSky_f(void);
 void R_DrawSkyBox (void);
 extern qboolean	r_skyboxloaded;
@@ -159,10 +159,12 @@ void R_BrightenScreen (void);
 void R_DrawEntitiesOnList (visentlist_t *vislist);
 
 // gl_rlight.c
-void R_MarkLights(model_t *model, dlight_t *light, int bit, unsigned int nodenum);
+void R_MarkLights(model_t *model, unsigned long long lightbits, unsigned int nodenum);
 void R_AnimateLight (void);
 void R_RenderDlights (void);
 int R_LightPoint (vec3_t p);
+extern unsigned int lightpointcalls;
+extern double lightpointtime;
 
 // gl_refrag.c
 void R_StoreEfrags (efrag_t **ppefrag);
@@ -173,6 +175,7 @@ void GL_MakeAliasModelDisplayLists (model_t *m, aliashdr_t *hdr);
 // gl_rsurf.c
 void R_DrawBrushModel (entity_t *e);
 void R_DrawWorld (void);
+void R_WalkProfile_f(void);
 void R_DrawWaterSurfaces (void);
 void GL_BuildLightmaps (void);
 
@@ -205,6 +208,7 @@ void R_InitOtherTextures(void);
 /* GL_ARB_vertex_buffer_object */
 #define GL_ARRAY_BUFFER_ARB                             0x8892
 #define GL_STATIC_DRAW_ARB                              0x88E4
+#define GL_STREAM_DRAW_ARB                              0x88E0
 
 #ifdef _WIN32
 #define GL_CLAMP_TO_EDGE 0x812F
@@ -265,6 +269,7 @@ extern void (APIENTRY *qglLinkProgram)(GLuint program);
 extern void (APIENTRY *qglShaderSource)(GLuint shader, GLsizei count, const GLchar **string, const GLint *length);
 extern void (APIENTRY *qglUniform1f)(GLint location, GLfloat v0);
 extern void (APIENTRY *qglUniform1i)(GLint location, GLint v0);
+extern void (APIENTRY *qglUniform4fv)(GLint location, GLsizei count, const GLfloat *value);
 extern void (APIENTRY *qglUniformMatrix4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
 extern void (APIENTRY *qglUseProgram)(GLuint program);
 
@@ -202,7 +202,9 @@ static int MakeVBO(aliashdr_t *hdr)
 
 	totalverts = hdr->totalverts;
 
-	vboverts = malloc(hdr->numposes * totalverts * 3 * sizeof(*vboverts));
+	/* x, y, z and the light normal index, which the alias vertex program
+	 * in gl_rmain.c needs for lighting on the GPU */
+	vboverts = malloc(hdr->numposes * totalverts * 4 * sizeof(*vboverts));
 	vertposes = malloc(hdr->numposes*sizeof(*vertposes));
 
 	if (vboverts && vertposes)
@@ -211,16 +213,18 @@ static int MakeVBO(aliashdr_t *hdr)
 		{
 			for(vert=0;vert<hdr->numverts;vert++)
 			{
-				vboverts[pose*totalverts*3 + vert*3 + 0] = poseverts[pose][vert].v[0];
-				vboverts[pose*totalverts*3 + vert*3 + 1] = poseverts[pose][vert].v[1];
-				vboverts[pose*totalverts*3 + vert*3 + 2] = poseverts[pose][vert].v[2];
+				vboverts[pose*totalverts*4 + vert*4 + 0] = poseverts[pose][vert].v[0];
+				vboverts[pose*totalverts*4 + vert*4 + 1] = poseverts[pose][vert].v[1];
+				vboverts[pose*totalverts*4 + vert*4 + 2] = poseverts[pose][vert].v[2];
+				vboverts[pose*totalverts*4 + vert*4 + 3] = poseverts[pose][vert].lightnormalindex;
 			}
 
 			for(;vert<totalverts;vert++)
 			{
-				vboverts[pose*totalverts*3 + vert*3 + 0] = poseverts[pose][hdr->collisionmap[vert-hdr->numverts]].v[0];
-				vboverts[pose*totalverts*3 + vert*3 + 1] = poseverts[pose][hdr->collisionmap[vert-hdr->numverts]].v[1];
-				vboverts[pose*totalverts*3 + vert*3 + 2] = poseverts[pose][hdr->collisionmap[vert-hdr->numverts]].v[2];
+				vboverts[pose*totalverts*4 + vert*4 + 0] = poseverts[pose][hdr->collisionmap[vert-hdr->numverts]].v[0];
+				vboverts[pose*totalverts*4 + vert*4 + 1] = poseverts[pose][hdr->collisionmap[vert-hdr->numverts]].v[1];
+				vboverts[pose*totalverts*4 + vert*4 + 2] = poseverts[pose][hdr->collisionmap[vert-hdr->numverts]].v[2];
+				vboverts[pose*totalverts*4 + vert*4 + 3] = poseverts[pose][hdr->collisionmap[vert-hdr->numverts]].lightnormalindex;
 			}
 		}
 
@@ -232,7 +236,7 @@ static int MakeVBO(aliashdr_t *hdr)
 			hdr->vert_vbo_number[i] = vbo_number++;
 
 			qglBindBufferARB(GL_ARRAY_BUFFER_ARB, hdr->vert_vbo_number[i]);
-			qglBufferDataARB(GL_ARRAY_BUFFER_ARB, totalverts*3*sizeof(*vboverts), vboverts + totalverts*3*i, GL_STATIC_DRAW_ARB);
+			qglBufferDataARB(GL_ARRAY_BUFFER_ARB, totalverts*4*sizeof(*vboverts), vboverts + totalverts*4*i, GL_STATIC_DRAW_ARB);
 		}
 
 		hdr->texcoord_vbo_number = vbo_number++;
@@ -38,12 +38,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "fmod.h"
+#include "pvscache.h"
 
 static void Mod_LoadSpriteModel (model_t *mod, void *buffer);
 static void Mod_LoadBrushModel (model_t *mod, void *buffer);
 static void Mod_LoadAliasModel (model_t *mod, void *buffer);
 
-byte	mod_novis[MAX_MAP_LEAFS/8];
+byte	mod_novis[PVSCACHE_ROWBYTES(MAX_MAP_LEAFS)] __attribute__((aligned(16)));
 
 static model_t *firstmodel;
 
@@ -58,74 +59,36 @@ void *Mod_Extradata(model_t *mod)
 	return mod->extradata;
 }
 
+model_t *Mod_GetFirstModel(void)
+{
+	return firstmodel;
+}
+
 mleaf_t *Mod_PointInLeaf (vec3_t p, model_t *model)
 {
-	mnode_t *node;
+	mflatnode_t *node;
 	unsigned int nodenum;
 	float d;
-	mplane_t *plane;
 
 	if (!model || !model->nodes)
 		Sys_Error ("Mod_PointInLeaf: bad model");
 
 	nodenum = 0;
-	while (1)
+	while (nodenum < model->numnodes)
 	{
-		node = NODENUM_TO_NODE(model, nodenum);
-		if (nodenum >= model->numnodes)
-			return (mleaf_t *)node;
-		plane = model->planes + node->planenum;
-		d = PlaneDiff(p, plane);
-		nodenum = (d > 0) ? node->childrennum[0] : node->childrennum[1];
+		node = model->flatnodes + nodenum;
+		d = DotProduct(p, node->normal) - node->dist;
+		nodenum = node->childrennum[!(d > 0)];
 	}
 
-	return NULL;	// never reached
-}
-
-static byte *Mod_DecompressVis(byte *in, model_t *model)
-{
-	static byte	decompressed[MAX_MAP_LEAFS / 8];
-	int c, row;
-	byte *out;
-
-	row = (model->numleafs + 7) >> 3;
-	out = decompressed;
-
-	if (!in)
-	{	// no vis info, so make all visible
-		while (row)
-		{
-			*out++ = 0xff;
-			row--;
-		}
-		return decompressed;
-	}
-
-	do
-	{
-		if (*in)
-		{
-			*out++ = *in++;
-			continue;
-		}
-
-		c = in[1];
-		in += 2;
-		while (c)
-		{
-			*out++ = 0;
-			c--;
-		}
-	} while (out - decompressed < row);
-
-	return decompressed;
+	return model->leafs + (nodenum - model->numnodes);
 }
 
 byte *Mod_LeafPVS (mleaf_t *leaf, model_t *model)
 {
 	if (leaf == model->leafs)
 		return mod_novis;
-	return Mod_DecompressVis (leaf->compressed_vis, model);
+	return PVSCache_Get(model->pvscache, leaf - model->leafs - 1, leaf->compressed_vis, model->numleafs);
 }
 
 static void Mod_FreeAliasData(model_t *model)
@@ -218,6 +181,10 @@ static void Mod_FreeBrushData(model_t *model)
 	free(model->visdata);
 	model->visdata = 0;
 
+	if (model->pvscache)
+		PVSCache_Delete(model->pvscache);
+	model->pvscache = 0;
+
 	free(model->entities);
 	model->entities = 0;
 
@@ -245,6 +212,12 @@ static void Mod_FreeBrushData(model_t *model)
 	free(model->nodes);
 	model->nodes = 0;
 
+	free(model->flatnodes);
+	model->flatnodes = 0;
+
+	free(model->nodevisible);
+	model->nodevisible = 0;
+
 	free(model->leafsolidunaligned);
 	model->leafsolidunaligned = 0;
 	model->leafsolid = 0;
@@ -1376,6 +1349,158 @@ static void Mod_LoadNodes(model_t *model, lump_t *l)
 				out->childrennum[j] = model->numnodes + (-1 - p);
 		}
 	}
+}
+
+#define FLATTEN_UNSEEN 0xffffffff
+#define FLATTEN_CHILD 0xfffffffe
+
+// renumbers the nodes depth first, front side first, so traversals mostly
+// walk forwards through memory, and builds the flat copy of the tree
+static void Mod_FlattenNodes(model_t *model, dmodel_t *submodels)
+{
+	mnode_t *nodes;
+	mflatnode_t *flatnodes, *flatnode;
+	mplane_t *plane;
+	unsigned int *remap, *order, *stack;
+	unsigned int i, j, k, sp, count, nodenum, child, depth;
+	const char *error;
+
+	count = model->numnodes;
+	if (count == 0)
+		Host_Error("Mod_FlattenNodes: %s has no nodes", model->name);
+
+	remap = malloc(count * sizeof(*remap));
+	order = malloc(count * sizeof(*order));
+	stack = malloc(count * sizeof(*stack));
+	nodes = malloc(count * sizeof(*nodes));
+	flatnodes = malloc(count * sizeof(*flatnodes));
+	model->nodevisible = malloc(((count+31)/32) * sizeof(*model->nodevisible));
+	if (remap == 0 || order == 0 || stack == 0 || nodes == 0 || flatnodes == 0 || model->nodevisible == 0)
+		Sys_Error("Mod_FlattenNodes: Out of memory\n");
+
+	memset(remap, 0xff, count * sizeof(*remap));
+	memset(model->nodevisible, 0, ((count+31)/32) * sizeof(*model->nodevisible));
+
+	error = 0;
+	model->nodedepth = 0;
+
+	for (i = 0; i < count && !error; i++)
+	{
+		if (model->nodes[i].planenum >= model->numplanes)
+			error = "bad plane number";
+
+		for (j = 0; j < 2; j++)
+		{
+			child = model->nodes[i].childrennum[j];
+			if (child >= count)
+				continue;
+
+			if (child == 0)
+				error = "world head node is a child";
+			else if (remap[child] != FLATTEN_UNSEEN)
+				error = "node reached twice";
+
+			remap[child] = FLATTEN_CHILD;
+		}
+	}
+
+	// every node that isn't a child is the head node of a (sub)model, the
+	// world's being node 0
+	k = 0;
+	for (i = 0; i < count && !error; i++)
+	{
+		if (remap[i] != FLATTEN_UNSEEN)
+			continue;
+
+		// entries are the node number and its depth
+		stack[0] = i | (1 << 16);
+		sp = 1;
+
+		while (sp)
+		{
+			sp--;
+			nodenum = stack[sp] & 0xffff;
+			depth = stack[sp] >> 16;
+
+			remap[nodenum] = k;
+			order[k] = nodenum;
+			k++;
+
+			if (depth > model->nodedepth)
+				model->nodedepth = depth;
+
+			// push the back side first so the front side follows its parent
+			for (j = 2; j--; )
+			{
+				child = model->nodes[nodenum].childrennum[j];
+				if (child < count)
+					stack[sp++] = child | ((depth + 1) << 16);
+			}
+		}
+	}
+
+	// anything left over is part of a loop
+	if (k != count && !error)
+		error = "node loop";
+
+	if (error)
+	{
+		free(remap);
+		free(order);
+		free(stack);
+		free(nodes);
+		free(flatnodes);
+
+		Host_Error("Mod_FlattenNodes: %s in %s", error, model->name);
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		nodes[i] = model->nodes[order[i]];
+		for (j = 0; j < 2; j++)
+		{
+			if (nodes[i].childrennum[j] < count)
+				nodes[i].childrennum[j] = remap[nodes[i].childrennum[j]];
+		}
+
+		flatnode = flatnodes + i;
+		plane = model->planes + nodes[i].planenum;
+
+		// PlaneDiff() only looks at one coordinate for axial planes
+		if (plane->type < 3)
+		{
+			VectorClear(flatnode->normal);
+			flatnode->normal[plane->type] = 1;
+		}
+		else
+		{
+			VectorCopy(plane->normal, flatnode->normal);
+		}
+		flatnode->dist = plane->dist;
+
+		for (j = 0; j < 3; j++)
+		{
+			flatnode->minmaxs[j] = floor(nodes[i].minmaxs[j]);
+			flatnode->minmaxs[3 + j] = ceil(nodes[i].minmaxs[3 + j]);
+		}
+
+		flatnode->childrennum[0] = nodes[i].childrennum[0];
+		flatnode->childrennum[1] = nodes[i].childrennum[1];
+	}
+
+	for (i = 0; i < model->numsubmodels; i++)
+	{
+		if (submodels[i].headnode[0] >= 0 && submodels[i].headnode[0] < count)
+			submodels[i].headnode[0] = remap[submodels[i].headnode[0]];
+	}
+
+	free(remap);
+	free(order);
+	free(stack);
+
+	free(model->nodes);
+	model->nodes = nodes;
+	model->flatnodes = flatnodes;
 
 	Mod_SetParent(model, 0, 0xffff);	// sets nodes and leafs
 }
@@ -1730,6 +1855,7 @@ static void Mod_LoadBrushModel (model_t *mod, void *buffer)
 	Mod_LoadNodes(mod, &header->lumps[LUMP_NODES]);
 	Mod_LoadClipnodes(mod, &header->lumps[LUMP_CLIPNODES]);
 	subdmodels = Mod_LoadSubmodels(mod, &header->lumps[LUMP_MODELS]);
+	Mod_FlattenNodes(mod, subdmodels);
 
 	Mod_MakeHull0(mod);
 
@@ -1780,6 +1906,9 @@ static void Mod_LoadBrushModel (model_t *mod, void *buffer)
 				mod = nextmodel;
 			}
 		}
+
+		// only the world has visibility data, and its leaf count is only known now
+		mainmodel->pvscache = PVSCache_Create(mainmodel->numleafs);
 	}
 
 	free(subdmodels);
@@ -152,7 +152,7 @@ typedef struct msurface_s {
 	
 // lighting info
 	int			dlightframe;
-	int			dlightbits;
+	unsigned long long dlightbits;	// one bit per cl_dlights entry
 
 	int			lightmaptexturenum;
 	byte		styles[MAXLIGHTMAPS];
@@ -196,6 +196,17 @@ typedef struct mleaf_s {
 	byte		ambient_sound_level[NUM_AMBIENTS];
 } mleaf_t;
 
+// the part of a node the traversals touch, kept in an array of its own in
+// the same depth first order as the nodes
+typedef struct mflatnode_s {
+	vec3_t		normal;			// axial planes get a unit normal
+	float		dist;
+
+	short		minmaxs[6];		// for bounding box culling
+
+	unsigned short childrennum[2];	// as for mnode_t
+} mflatnode_t;
+
 // !!! if this is changed, it must be changed in asm_i386.h too !!!
 typedef struct {
 	dclipnode_t	*clipnodes;
@@ -370,6 +381,8 @@ typedef struct model_s
 
 	int			numnodes;
 	mnode_t		*nodes;
+	mflatnode_t	*flatnodes;
+	unsigned int nodedepth;		// most nodes on any path from a head node to a leaf
 
 	int			numtexinfo;
 	mtexinfo_t	*texinfo;
@@ -392,6 +405,7 @@ typedef struct model_s
 	texture_t	**textures;
 
 	byte		*visdata;
+	struct PVSCache	*pvscache;
 	byte		*lightdata;
 	char		*entities;
 
@@ -408,6 +422,8 @@ typedef struct model_s
 	unsigned int *leafsolidunaligned;
 	unsigned int *leafsolid;
 
+	unsigned int *nodevisible;
+
 	// additional model data
 	void *extradata;
 
@@ -435,6 +451,7 @@ void	Mod_Shutdown(void);
 void	Mod_ClearAll(void);
 model_t *Mod_ForName (char *name, qboolean crash);
 void	*Mod_Extradata (model_t *mod);	// handles caching
+model_t *Mod_GetFirstModel(void);
 model_t *Mod_LoadModel (model_t *mod, qboolean crash);
 
 mleaf_t *Mod_PointInLeaf (float *p, model_t *model);
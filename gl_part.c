@@ -1,45 +1,16 @@
 
 #include <math.h>
+#include <string.h>
 
 #include "gl_local.h"
 #include "gl_state.h"
+#include "gl_stream.h"
 
 #include "particles.h"
 
 static float r_partscale;
 static vec3_t up, right;
 
-#define NUMBUFFEREDPARTVERTICES 60
-#if (NUMBUFFEREDPARTVERTICES%3) != 0
-#error Fail.
-#endif
-
-static float particlevertices[3*NUMBUFFEREDPARTVERTICES] __attribute__((aligned(64)));
-static unsigned int particlecolours[NUMBUFFEREDPARTVERTICES] __attribute__((aligned(64)));
-static int particleindex;
-
-static const float particletexcoords[2*NUMBUFFEREDPARTVERTICES] __attribute__((aligned(64))) =
-{
-	0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1,
-	0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1,
-	0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1,
-	0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1,
-	0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1,
-};
-
-int particletexcoords_vbo_number;
-
-void GL_DrawParticleInit()
-{
-	if (gl_vbo)
-	{
-		particletexcoords_vbo_number = vbo_number++;
-		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, particletexcoords_vbo_number);
-		qglBufferDataARB(GL_ARRAY_BUFFER_ARB, sizeof(particletexcoords), particletexcoords, GL_STATIC_DRAW_ARB);
-		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
-	}
-}
-
 void GL_DrawParticleBegin()
 {
 	r_partscale = 0.004 * tan(r_refdef.fov_x * (M_PI / 180) * 0.5f);
@@ -49,19 +20,7 @@ void GL_DrawParticleBegin()
 	GL_SetAlphaTestBlend(0, 1);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
-	GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_COLOR_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
-	GL_VertexPointer(3, GL_FLOAT, 0, particlevertices);
-	if (gl_vbo)
-	{
-		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, particletexcoords_vbo_number);
-		GL_TexCoordPointer(0, 2, GL_FLOAT, 0, 0);
-		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
-	}
-	else
-		GL_TexCoordPointer(0, 2, GL_FLOAT, 0, particletexcoords);
-	GL_ColorPointer(4, GL_UNSIGNED_BYTE, 0, particlecolours);
-
-	particleindex = 0;
+	GL_Stream_Begin(GL_TRIANGLES, 1);
 
 	VectorScale(vup, 1.5, up);
 	VectorScale(vright, 1.5, right);
@@ -69,8 +28,7 @@ void GL_DrawParticleBegin()
 
 void GL_DrawParticleEnd()
 {
-	if (particleindex)
-		glDrawArrays(GL_TRIANGLES, 0, particleindex);
+	c_particle_draws += GL_Stream_End();
 
 	glDepthMask(GL_TRUE);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
@@ -79,8 +37,7 @@ void GL_DrawParticleEnd()
 
 void GL_DrawParticle(particle_t *p)
 {
-	float *pv;
-	unsigned int *pc;
+	struct StreamVertex *sv;
 	unsigned char *at, theAlpha;
 	float dist, scale;
 	float *lup;
@@ -91,12 +48,7 @@ void GL_DrawParticle(particle_t *p)
 	float lright0;
 	float lright1;
 	float lright2;
-	unsigned int i;
-	union
-	{
-		unsigned char uc[4];
-		unsigned int ui;
-	} col;
+	unsigned char col[4];
 
 	// hack a scale up to keep particles from disapearing
 	dist = (p->org[0] - r_origin[0]) * vpn[0] + (p->org[1] - r_origin[1]) * vpn[1] + (p->org[2] - r_origin[2]) * vpn[2];
@@ -108,14 +60,12 @@ void GL_DrawParticle(particle_t *p)
 	else
 		theAlpha = 255;
 
-	col.uc[0] = at[0];
-	col.uc[1] = at[1];
-	col.uc[2] = at[2];
-	col.uc[3] = theAlpha;
-
-	i = particleindex;
+	col[0] = at[0];
+	col[1] = at[1];
+	col[2] = at[2];
+	col[3] = theAlpha;
 
-	pv = particlevertices + i * 3;
+	sv = GL_Stream_GetVertices(3);
 
 	lup = up;
 	lup0 = lup[0] * scale;
@@ -127,30 +77,28 @@ void GL_DrawParticle(particle_t *p)
 	lright1 = lright[1] * scale;
 	lright2 = lright[2] * scale;
 
-	pv[0] = p->org[0];
-	pv[1] = p->org[1];
-	pv[2] = p->org[2];
-
-	pv[3] = p->org[0] + lup0;
-	pv[4] = p->org[1] + lup1;
-	pv[5] = p->org[2] + lup2;
-
-	pv[6] = p->org[0] + lright0;
-	pv[7] = p->org[1] + lright1;
-	pv[8] = p->org[2] + lright2;
-
-	pc = particlecolours + i;
-
-	pc[0] = col.ui;
-	pc[1] = col.ui;
-	pc[2] = col.ui;
-
-	particleindex = i + 3;
-
-	if (particleindex == NUMBUFFEREDPARTVERTICES)
-	{
-		glDrawArrays(GL_TRIANGLES, 0, particleindex);
-		particleindex = 0;
-	}
+	sv[0].xyz[0] = p->org[0];
+	sv[0].xyz[1] = p->org[1];
+	sv[0].xyz[2] = p->org[2];
+	sv[0].st[0] = 0;
+	sv[0].st[1] = 0;
+
+	sv[1].xyz[0] = p->org[0] + lup0;
+	sv[1].xyz[1] = p->org[1] + lup1;
+	sv[1].xyz[2] = p->org[2] + lup2;
+	sv[1].st[0] = 1;
+	sv[1].st[1] = 0;
+
+	sv[2].xyz[0] = p->org[0] + lright0;
+	sv[2].xyz[1] = p->org[1] + lright1;
+	sv[2].xyz[2] = p->org[2] + lright2;
+	sv[2].st[0] = 0;
+	sv[2].st[1] = 1;
+
+	memcpy(sv[0].colour, col, 4);
+	memcpy(sv[1].colour, col, 4);
+	memcpy(sv[2].colour, col, 4);
+
+	c_particles++;
 }
 
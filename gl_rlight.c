@@ -19,10 +19,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "quakedef.h"
 #include "gl_local.h"
 #include "gl_state.h"
+#include "gl_stream.h"
 
 int	r_dlightframecount;
 
@@ -85,6 +88,9 @@ static void R_RenderDlight (dlight_t *light)
 	int i, j;
 	vec3_t v, v_right, v_up;
 	float length, rad, *bub_sin, *bub_cos;
+	struct StreamVertex *sv;
+	vec3_t rim[17];
+	byte colour[4];
 
 	// don't draw our own powerup glow and muzzleflashes
 	if (light->key == (cl.viewplayernum + 1) ||
@@ -102,8 +108,9 @@ static void R_RenderDlight (dlight_t *light)
 		return;
 	}
 
-	glBegin (GL_TRIANGLE_FAN);
-	glColor3fv (bubblecolor[light->type]);
+	for (j = 0; j < 3; j++)
+		colour[j] = bubblecolor[light->type][j] * 255 + 0.5f;
+	colour[3] = 255;
 
 	VectorVectors(v, v_right, v_up);
 
@@ -119,27 +126,34 @@ static void R_RenderDlight (dlight_t *light)
 
 	VectorSubtract (light->origin, v, v);
 
-	glVertex3fv (v);
-	glColor3ubv (color_black);
-
 	bub_sin = bubble_sintable;
 	bub_cos = bubble_costable;
 
-	for (i = 16; i >= 0; i--)
+	for (i = 0; i < 17; i++)
 	{
 		for (j = 0; j < 3; j++)
-			v[j] = light->origin[j] + (v_right[j]*(*bub_cos) +
+			rim[i][j] = light->origin[j] + (v_right[j]*(*bub_cos) +
 				+ v_up[j]*(*bub_sin)) * rad;
 		bub_sin++;
 		bub_cos++;
-		glVertex3fv (v);
 	}
 
-	glEnd ();
+	// the bubble is a fan around v, drawn as separate triangles so all bubbles go in one batch
+	sv = GL_Stream_GetVertices(16 * 3);
+	for (i = 0; i < 16; i++, sv += 3)
+	{
+		VectorCopy (v, sv[0].xyz);
+		memcpy (sv[0].colour, colour, 4);
+		VectorCopy (rim[i], sv[1].xyz);
+		memcpy (sv[1].colour, color_black, 4);
+		VectorCopy (rim[i + 1], sv[2].xyz);
+		memcpy (sv[2].colour, color_black, 4);
+	}
 }
 
 void R_RenderDlights (void)
 {
+	unsigned long long lightbits;
 	unsigned int i;
 	unsigned int j;
 	dlight_t *l;
@@ -148,12 +162,15 @@ void R_RenderDlights (void)
 		return;
 
 	r_dlightframecount = r_framecount + 1;	// because the count hasn't advanced yet for this frame
+	lightbits = 0;
 	glDepthMask (GL_FALSE);
 	glDisable (GL_TEXTURE_2D);
 	glShadeModel (GL_SMOOTH);
 	GL_SetAlphaTestBlend(0, 1);
 	glBlendFunc (GL_ONE, GL_ONE);
 
+	GL_Stream_Begin(GL_TRIANGLES, 0);
+
 	for(i=0;i<MAX_DLIGHTS/32;i++)
 	{
 		if (cl_dlight_active[i])
@@ -165,7 +182,7 @@ void R_RenderDlights (void)
 					l = cl_dlights + i*32 + j;
 
 					if (l->bubble && ((int) gl_flashblend.value != 2))
-						R_MarkLights(cl.worldmodel, l, 1 << (i*32 + j), 0);
+						lightbits |= 1ULL << (i*32 + j);
 					else
 						R_RenderDlight(l);
 				}
@@ -173,6 +190,14 @@ void R_RenderDlights (void)
 		}
 	}
 
+	GL_Stream_End();
+
+	if (lightbits)
+	{
+		c_dlights += __builtin_popcountll(lightbits);
+		R_MarkLights(cl.worldmodel, lightbits, 0);
+	}
+
 	glColor3ubv (color_white);
 	glEnable (GL_TEXTURE_2D);
 	glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -180,57 +205,112 @@ void R_RenderDlights (void)
 }
 
 
-void R_MarkLights(model_t *model, dlight_t *light, int bit, unsigned int nodenum)
+struct marklightsstackentry
 {
-	mnode_t *node;
-	mplane_t *splitplane;
+	unsigned long long lightbits;
+	unsigned int nodenum;
+};
+
+static struct marklightsstackentry *marklightsstack;
+static unsigned int marklightsstacksize;
+
+// marks the surfaces touched by any of the given lights in a single walk,
+// each node sorting the lights still left into the ones entirely on one side
+// of it and the ones that reach its surfaces
+void R_MarkLights(model_t *model, unsigned long long lightbits, unsigned int nodenum)
+{
+	mflatnode_t *node;
+	mnode_t *surfnode;
+	dlight_t *light;
 	float dist;
 	msurface_t *surf;
 	int i;
+	unsigned int lnum, sp;
+	unsigned long long bits, frontbits, backbits;
 	unsigned dlightframecount;
 
-	if (nodenum >= model->numnodes)
-		return;
-
-	node = model->nodes + nodenum;
-
-	splitplane = model->planes + node->planenum;
-	dist = PlaneDiff(light->origin, splitplane);
-
-	if (dist > light->radius)
-	{
-		R_MarkLights(model, light, bit, node->childrennum[0]);
-		return;
-	}
-	if (dist < -light->radius)
+	if (marklightsstacksize < model->nodedepth)
 	{
-		R_MarkLights(model, light, bit, node->childrennum[1]);
-		return;
+		free(marklightsstack);
+		marklightsstack = malloc(model->nodedepth * sizeof(*marklightsstack));
+		if (marklightsstack == 0)
+			Sys_Error("R_MarkLights: Out of memory\n");
+
+		marklightsstacksize = model->nodedepth;
 	}
 
 	dlightframecount = r_dlightframecount;
 
-	// mark the polygons
-	surf = cl.worldmodel->surfaces + node->firstsurface;
-	for (i = 0; i < node->numsurfaces; i++, surf++)
+	// the stack holds the back sides still to be visited
+	sp = 0;
+	while(1)
 	{
-		if (surf->dlightframe != dlightframecount)
+		if (nodenum >= model->numnodes || !lightbits)
 		{
-			surf->dlightbits = 0;
-			surf->dlightframe = dlightframecount;
+			if (sp == 0)
+				break;
+
+			sp--;
+			nodenum = marklightsstack[sp].nodenum;
+			lightbits = marklightsstack[sp].lightbits;
+			continue;
 		}
-		surf->dlightbits |= bit;
-	}
 
-	R_MarkLights(model, light, bit, node->childrennum[0]);
-	R_MarkLights(model, light, bit, node->childrennum[1]);
+		node = model->flatnodes + nodenum;
+
+		frontbits = 0;
+		backbits = 0;
+
+		bits = lightbits;
+		while (bits)
+		{
+			lnum = __builtin_ctzll(bits);
+			bits &= bits - 1;
+
+			light = cl_dlights + lnum;
+			dist = DotProduct(light->origin, node->normal) - node->dist;
+
+			if (dist > light->radius)
+				frontbits |= 1ULL << lnum;
+			else if (dist < -light->radius)
+				backbits |= 1ULL << lnum;
+		}
+
+		// mark the polygons
+		bits = lightbits & ~(frontbits | backbits);
+		if (bits)
+		{
+			surfnode = model->nodes + nodenum;
+			surf = cl.worldmodel->surfaces + surfnode->firstsurface;
+			for (i = 0; i < surfnode->numsurfaces; i++, surf++)
+			{
+				if (surf->dlightframe != dlightframecount)
+				{
+					surf->dlightbits = 0;
+					surf->dlightframe = dlightframecount;
+				}
+				surf->dlightbits |= bits;
+			}
+		}
+
+		if ((lightbits & ~frontbits) && node->childrennum[1] < model->numnodes)
+		{
+			marklightsstack[sp].nodenum = node->childrennum[1];
+			marklightsstack[sp].lightbits = lightbits & ~frontbits;
+			sp++;
+		}
+
+		nodenum = node->childrennum[0];
+		lightbits &= ~backbits;
+	}
 }
 
 void R_PushDlights (void)
 {
+	unsigned long long lightbits;
 	unsigned int i;
-	unsigned int j;
-	dlight_t *l;
+
+	c_dlights = 0;
 
 	if (gl_flashblend.value)
 		return;
@@ -238,21 +318,14 @@ void R_PushDlights (void)
 	r_dlightframecount = r_framecount + 1;	// because the count hasn't
 											//  advanced yet for this frame
 
+	lightbits = 0;
 	for(i=0;i<MAX_DLIGHTS/32;i++)
-	{
-		if (cl_dlight_active[i])
-		{
-			for(j=0;j<32;j++)
-			{
-				if ((cl_dlight_active[i]&(1<<j)) && i*32+j < MAX_DLIGHTS)
-				{
-					l = cl_dlights + i*32 + j;
+		lightbits |= (unsigned long long)cl_dlight_active[i] << (i*32);
 
-					R_MarkLights(cl.worldmodel, l, 1<<(i*32 + j), 0);
-				}
-			}
-		}
-	}
+	c_dlights = __builtin_popcountll(lightbits);
+
+	if (lightbits)
+		R_MarkLights(cl.worldmodel, lightbits, 0);
 }
 
 
@@ -260,122 +333,169 @@ static mplane_t	*lightplane;
 static vec3_t		lightspot;
 static vec3_t		lightcolor;
 
-static int RecursiveLightPoint(model_t *model, vec3_t color, unsigned int nodenum, vec3_t start, vec3_t end)
+// samples the lightmaps of the node's surfaces where the trace crosses it
+static int LightPointNode(model_t *model, vec3_t color, unsigned int nodenum, vec3_t mid)
 {
 	mnode_t *node;
-	mplane_t *plane;
-	float front, back, frac;
-	vec3_t mid;
-
-loc0:
-	if (nodenum >= model->numnodes)
-		return false;		// didn't hit anything
+	msurface_t *surf;
+	int i, ds, dt;
 
 	node = model->nodes + nodenum;
 
-	plane = model->planes + node->planenum;
-
-	// calculate mid point
-	if (plane->type < 3)
-	{
-		front = start[plane->type] - plane->dist;
-		back = end[plane->type] - plane->dist;
-	}
-	else
-	{
-		front = DotProduct(start, plane->normal) - plane->dist;
-		back = DotProduct(end, plane->normal) - plane->dist;
-	}
-	// optimized recursion
-	if ((back < 0) == (front < 0))
+	// check for impact on this node
+	VectorCopy (mid, lightspot);
+	lightplane = model->planes + node->planenum;
+	surf = cl.worldmodel->surfaces + node->firstsurface;
+	for (i = 0; i < node->numsurfaces; i++, surf++)
 	{
-		nodenum = node->childrennum[front < 0];
-		goto loc0;
+		if (cl.worldmodel->surfflags[node->firstsurface + i] & SURF_DRAWTILED)
+			continue;	// no lightmaps
+		ds = (int) ((float) DotProduct (mid, surf->texinfo->vecs[0]) + surf->texinfo->vecs[0][3]);
+		dt = (int) ((float) DotProduct (mid, surf->texinfo->vecs[1]) + surf->texinfo->vecs[1][3]);
+		if (ds < surf->texturemins[0] || dt < surf->texturemins[1])
+			continue;
+
+		ds -= surf->texturemins[0];
+		dt -= surf->texturemins[1];
+
+		if (ds > surf->extents[0] || dt > surf->extents[1])
+			continue;
+
+		if (surf->samples)
+		{
+			//enhanced to interpolate lighting
+			byte *lightmap;
+			int maps, line3, dsfrac = ds & 15, dtfrac = dt & 15, r00 = 0, g00 = 0, b00 = 0, r01 = 0, g01 = 0, b01 = 0, r10 = 0, g10 = 0, b10 = 0, r11 = 0, g11 = 0, b11 = 0;
+			float scale;
+			line3 = ((surf->extents[0] >> 4) + 1) * 3;
+			lightmap = surf->samples + ((dt >> 4) * ((surf->extents[0] >> 4) + 1) + (ds >> 4)) * 3; // LordHavoc: *3 for color
+
+			for (maps = 0;maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++)
+			{
+				scale = (float) d_lightstylevalue[surf->styles[maps]] * 1.0 / 256.0;
+				r00 += (float) lightmap[0] * scale;
+				g00 += (float) lightmap[1] * scale;
+				b00 += (float) lightmap[2] * scale;
+
+				r01 += (float) lightmap[3] * scale;
+				g01 += (float) lightmap[4] * scale;
+				b01 += (float) lightmap[5] * scale;
+
+				r10 += (float) lightmap[line3 + 0] * scale;
+				g10 += (float) lightmap[line3 + 1] * scale;
+				b10 += (float) lightmap[line3 + 2] * scale;
+
+				r11 += (float) lightmap[line3 + 3] * scale;
+				g11 += (float) lightmap[line3 + 4] * scale;
+				b11 += (float) lightmap[line3 + 5] * scale;
+
+				lightmap += ((surf->extents[0] >> 4) + 1) * ((surf->extents[1] >> 4) + 1) * 3; // LordHavoc: *3 for colored lighting
+			}
+			color[0] += (float) ((int) ((((((((r11 - r10) * dsfrac) >> 4) + r10)
+				- ((((r01 - r00) * dsfrac) >> 4) + r00)) * dtfrac) >> 4)
+				+ ((((r01 - r00) * dsfrac) >> 4) + r00)));
+			color[1] += (float) ((int) ((((((((g11 - g10) * dsfrac) >> 4) + g10)
+				- ((((g01 - g00) * dsfrac) >> 4) + g00)) * dtfrac) >> 4)
+				+ ((((g01 - g00) * dsfrac) >> 4) + g00)));
+			color[2] += (float) ((int) ((((((((b11 - b10) * dsfrac) >> 4) + b10)
+				- ((((b01 - b00) * dsfrac) >> 4) + b00)) * dtfrac) >> 4)
+				+ ((((b01 - b00) * dsfrac) >> 4) + b00)));
+		}
+		return true; // success
 	}
 
-	frac = front / (front-back);
-	mid[0] = start[0] + (end[0] - start[0]) * frac;
-	mid[1] = start[1] + (end[1] - start[1]) * frac;
-	mid[2] = start[2] + (end[2] - start[2]) * frac;
+	return false;
+}
+
+struct lightpointstackentry
+{
+	vec3_t mid;
+	vec3_t end;
+	unsigned short nodenum;
+	unsigned short backside;
+};
+
+static struct lightpointstackentry *lightpointstack;
+static unsigned int lightpointstacksize;
 
-	// go down front side
-	if (RecursiveLightPoint(model, color, node->childrennum[front < 0], start, mid))
+// finds the first surface below start, the stack holds the nodes the trace
+// crosses whose front side is being walked
+static int TraceLightPoint(model_t *model, vec3_t color, vec3_t p, vec3_t pend)
+{
+	struct lightpointstackentry *entry;
+	mflatnode_t *node;
+	vec3_t start, end;
+	float front, back, frac;
+	unsigned int nodenum, sp;
+
+	if (lightpointstacksize < model->nodedepth)
 	{
-		return true;	// hit something
+		free(lightpointstack);
+		lightpointstack = malloc(model->nodedepth * sizeof(*lightpointstack));
+		if (lightpointstack == 0)
+			Sys_Error("TraceLightPoint: Out of memory\n");
+
+		lightpointstacksize = model->nodedepth;
 	}
-	else
+
+	VectorCopy(p, start);
+	VectorCopy(pend, end);
+
+	nodenum = 0;
+	sp = 0;
+	while(1)
 	{
-		int i, ds, dt;
-		msurface_t *surf;
-		// check for impact on this node
-		VectorCopy (mid, lightspot);
-		lightplane = plane;
-		surf = cl.worldmodel->surfaces + node->firstsurface;
-		for (i = 0; i < node->numsurfaces; i++, surf++)
+		if (nodenum < model->numnodes)
 		{
-			if (cl.worldmodel->surfflags[node->firstsurface + i] & SURF_DRAWTILED)
-				continue;	// no lightmaps
-			ds = (int) ((float) DotProduct (mid, surf->texinfo->vecs[0]) + surf->texinfo->vecs[0][3]);
-			dt = (int) ((float) DotProduct (mid, surf->texinfo->vecs[1]) + surf->texinfo->vecs[1][3]);
-			if (ds < surf->texturemins[0] || dt < surf->texturemins[1])
-				continue;
+			node = model->flatnodes + nodenum;
 
-			ds -= surf->texturemins[0];
-			dt -= surf->texturemins[1];
+			front = DotProduct(start, node->normal) - node->dist;
+			back = DotProduct(end, node->normal) - node->dist;
 
-			if (ds > surf->extents[0] || dt > surf->extents[1])
+			if ((back < 0) == (front < 0))
+			{
+				nodenum = node->childrennum[front < 0];
 				continue;
+			}
 
-			if (surf->samples)
-			{
-				//enhanced to interpolate lighting
-				byte *lightmap;
-				int maps, line3, dsfrac = ds & 15, dtfrac = dt & 15, r00 = 0, g00 = 0, b00 = 0, r01 = 0, g01 = 0, b01 = 0, r10 = 0, g10 = 0, b10 = 0, r11 = 0, g11 = 0, b11 = 0;
-				float scale;
-				line3 = ((surf->extents[0] >> 4) + 1) * 3;
-				lightmap = surf->samples + ((dt >> 4) * ((surf->extents[0] >> 4) + 1) + (ds >> 4)) * 3; // LordHavoc: *3 for color
-
-				for (maps = 0;maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++)
-				{
-					scale = (float) d_lightstylevalue[surf->styles[maps]] * 1.0 / 256.0;
-					r00 += (float) lightmap[0] * scale;
-					g00 += (float) lightmap[1] * scale;
-					b00 += (float) lightmap[2] * scale;
+			// go down front side to the mid point first
+			frac = front / (front-back);
 
-					r01 += (float) lightmap[3] * scale;
-					g01 += (float) lightmap[4] * scale;
-					b01 += (float) lightmap[5] * scale;
+			entry = lightpointstack + sp++;
+			entry->mid[0] = start[0] + (end[0] - start[0]) * frac;
+			entry->mid[1] = start[1] + (end[1] - start[1]) * frac;
+			entry->mid[2] = start[2] + (end[2] - start[2]) * frac;
+			VectorCopy(end, entry->end);
+			entry->nodenum = nodenum;
+			entry->backside = front >= 0;
 
-					r10 += (float) lightmap[line3 + 0] * scale;
-					g10 += (float) lightmap[line3 + 1] * scale;
-					b10 += (float) lightmap[line3 + 2] * scale;
+			VectorCopy(entry->mid, end);
+			nodenum = node->childrennum[front < 0];
+			continue;
+		}
 
-					r11 += (float) lightmap[line3 + 3] * scale;
-					g11 += (float) lightmap[line3 + 4] * scale;
-					b11 += (float) lightmap[line3 + 5] * scale;
+		// didn't hit anything on this side
+		if (sp == 0)
+			return false;
+
+		entry = lightpointstack + --sp;
+		if (LightPointNode(model, color, entry->nodenum, entry->mid))
+			return true;	// hit something
 
-					lightmap += ((surf->extents[0] >> 4) + 1) * ((surf->extents[1] >> 4) + 1) * 3; // LordHavoc: *3 for colored lighting
-				}
-				color[0] += (float) ((int) ((((((((r11 - r10) * dsfrac) >> 4) + r10)
-					- ((((r01 - r00) * dsfrac) >> 4) + r00)) * dtfrac) >> 4)
-					+ ((((r01 - r00) * dsfrac) >> 4) + r00)));
-				color[1] += (float) ((int) ((((((((g11 - g10) * dsfrac) >> 4) + g10)
-					- ((((g01 - g00) * dsfrac) >> 4) + g00)) * dtfrac) >> 4)
-					+ ((((g01 - g00) * dsfrac) >> 4) + g00)));
-				color[2] += (float) ((int) ((((((((b11 - b10) * dsfrac) >> 4) + b10)
-					- ((((b01 - b00) * dsfrac) >> 4) + b00)) * dtfrac) >> 4)
-					+ ((((b01 - b00) * dsfrac) >> 4) + b00)));
-			}
-			return true; // success
-		}
 		// go down back side
-		return RecursiveLightPoint(model, color, node->childrennum[front >= 0], mid, end);
+		VectorCopy(entry->mid, start);
+		VectorCopy(entry->end, end);
+		nodenum = model->flatnodes[entry->nodenum].childrennum[entry->backside];
 	}
 }
 
+unsigned int lightpointcalls;
+double lightpointtime;
+
 int R_LightPoint (vec3_t p)
 {
 	vec3_t end;
+	double starttime;
 
 	if (!cl.worldmodel->lightdata)
 		return 255;
@@ -385,6 +505,9 @@ int R_LightPoint (vec3_t p)
 	end[2] = p[2] - 2048;
 
 	lightcolor[0] = lightcolor[1] = lightcolor[2] = 0;
-	RecursiveLightPoint(cl.worldmodel, lightcolor, 0, p, end);
+	starttime = Sys_DoubleTime();
+	TraceLightPoint(cl.worldmodel, lightcolor, p, end);
+	lightpointtime += Sys_DoubleTime() - starttime;
+	lightpointcalls++;
 	return (lightcolor[0] + lightcolor[1] + lightcolor[2]) / 3.0;
 }
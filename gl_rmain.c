@@ -26,12 +26,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <altivec.h>
 #endif
 
+#if defined(__i386__) || defined(__x86_64__)
+#define FOD_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "quakedef.h"
 #include "gl_local.h"
 #include "gl_state.h"
 #include "gl_warp.h"
 #include "gl_rsurf.h"
 #include "gl_shader.h"
+#include "gl_stream.h"
 #include "gl_skinimp.h"
 #include "skin.h"
 #include "sound.h"
@@ -55,7 +61,7 @@ int			r_framecount;		// used for dlight push checking
 
 mplane_t	frustum[4];
 
-int			c_brush_polys, c_alias_polys;
+int			c_brush_polys, c_alias_polys, c_particles, c_particle_draws, c_dlights, c_lightmap_texels;
 
 int			particletexture;	// little dot for particles
 int			playertextures;		// up to 16 color translated skins
@@ -106,6 +112,7 @@ cvar_t	gl_clearColor = {"gl_clearColor", "0 0 0", 0, OnChange_gl_clearColor};
 cvar_t	gl_cull = {"gl_cull", "1"};
 cvar_t	gl_ztrick = {"gl_ztrick", "0"};
 cvar_t	gl_smoothmodels = {"gl_smoothmodels", "1"};
+cvar_t	gl_alias_program = {"gl_alias_program", "1"};
 cvar_t	gl_polyblend = {"gl_polyblend", "1"};
 cvar_t	gl_flashblend = {"gl_flashblend", "0"};
 cvar_t	gl_playermip = {"gl_playermip", "0"};
@@ -114,6 +121,7 @@ cvar_t	gl_fb_bmodels = {"gl_fb_bmodels", "1"};
 cvar_t	gl_fb_models = {"gl_fb_models", "1"};
 cvar_t	gl_lightmode = {"gl_lightmode", "2"};
 cvar_t	gl_loadlitfiles = {"gl_loadlitfiles", "1"};
+cvar_t	gl_lightmapcache = {"gl_lightmapcache", "1"};
 
 
 cvar_t gl_part_explosions = {"gl_part_explosions", "0"};
@@ -317,6 +325,10 @@ float	r_framelerp;
 float	r_modelalpha;
 float	r_lerpdistance;
 
+#ifdef FOD_SSE2
+static int sse2_available;
+#endif
+
 static void InterpolatePoses_Scalar(float *posedest, unsigned int *lightdest, trivertx_t *src1, trivertx_t *src2, float lerpfrac, unsigned int count, unsigned char modelalpha)
 {
 	unsigned int i;
@@ -589,20 +601,448 @@ static void __attribute__ ((__noinline__)) InterpolatePoses_Altivec(float *posed
 }
 #endif
 
+#ifdef FOD_SSE2
+/* Four vertices per iteration. Every step mirrors the scalar code
+ * operation for operation (no reciprocals, no fused multiply-add), so the
+ * output is bit-identical to InterpolatePoses_Scalar/_LimitLerp. */
+static void __attribute__ ((__noinline__, __target__("sse2"))) InterpolatePoses_SSE2(float *posedest, unsigned int *lightdest, trivertx_t *src1, trivertx_t *src2, float lerpfrac, unsigned int count, unsigned char modelalpha, int limitlerp)
+{
+	__m128i zero, t1, t2, i1[4], i2[4], shade1, shade2, vlight, vmodelalpha;
+	__m128 v1[4], vdiff[4], p[4], sq[4], vlerpfrac, vframelerp, vone, vlerpdistance, mask;
+	__m128 v127, v255, v0, vshadelight, vambientlight, l;
+	unsigned int i;
+
+	zero = _mm_setzero_si128();
+	vmodelalpha = _mm_set1_epi32(((unsigned int)modelalpha) << 24);
+	vlerpfrac = _mm_set1_ps(lerpfrac);
+	vframelerp = _mm_set1_ps(r_framelerp);
+	vone = _mm_set1_ps(1);
+	vlerpdistance = _mm_set1_ps(r_lerpdistance * r_lerpdistance);
+	v127 = _mm_set1_ps(127);
+	v255 = _mm_set1_ps(255);
+	v0 = _mm_setzero_ps();
+	vshadelight = _mm_set1_ps(shadelight);
+	vambientlight = _mm_set1_ps(ambientlight);
+
+	for(i=0;i+4<=count;i+=4)
+	{
+		// Unpack 4 trivertx_ts from each source to one vector of 32 bit ints per vertex.
+
+		t1 = _mm_loadu_si128((__m128i *)(src1 + i));
+		t2 = _mm_loadu_si128((__m128i *)(src2 + i));
+
+		i1[0] = _mm_unpacklo_epi8(t1, zero);
+		i1[2] = _mm_unpackhi_epi8(t1, zero);
+		i1[1] = _mm_unpackhi_epi16(i1[0], zero);
+		i1[0] = _mm_unpacklo_epi16(i1[0], zero);
+		i1[3] = _mm_unpackhi_epi16(i1[2], zero);
+		i1[2] = _mm_unpacklo_epi16(i1[2], zero);
+
+		i2[0] = _mm_unpacklo_epi8(t2, zero);
+		i2[2] = _mm_unpackhi_epi8(t2, zero);
+		i2[1] = _mm_unpackhi_epi16(i2[0], zero);
+		i2[0] = _mm_unpacklo_epi16(i2[0], zero);
+		i2[3] = _mm_unpackhi_epi16(i2[2], zero);
+		i2[2] = _mm_unpacklo_epi16(i2[2], zero);
+
+		v1[0] = _mm_cvtepi32_ps(i1[0]);
+		v1[1] = _mm_cvtepi32_ps(i1[1]);
+		v1[2] = _mm_cvtepi32_ps(i1[2]);
+		v1[3] = _mm_cvtepi32_ps(i1[3]);
+
+		vdiff[0] = _mm_cvtepi32_ps(_mm_sub_epi32(i2[0], i1[0]));
+		vdiff[1] = _mm_cvtepi32_ps(_mm_sub_epi32(i2[1], i1[1]));
+		vdiff[2] = _mm_cvtepi32_ps(_mm_sub_epi32(i2[2], i1[2]));
+		vdiff[3] = _mm_cvtepi32_ps(_mm_sub_epi32(i2[3], i1[3]));
+
+		// Per vertex lerp fraction, vertices that moved too far snap to the new pose.
+
+		if (limitlerp)
+		{
+			sq[0] = _mm_mul_ps(vdiff[0], vdiff[0]);
+			sq[1] = _mm_mul_ps(vdiff[1], vdiff[1]);
+			sq[2] = _mm_mul_ps(vdiff[2], vdiff[2]);
+			sq[3] = _mm_mul_ps(vdiff[3], vdiff[3]);
+
+			_MM_TRANSPOSE4_PS(sq[0], sq[1], sq[2], sq[3]);
+
+			mask = _mm_cmplt_ps(_mm_add_ps(_mm_add_ps(sq[0], sq[1]), sq[2]), vlerpdistance);
+			vlerpfrac = _mm_or_ps(_mm_and_ps(mask, vframelerp), _mm_andnot_ps(mask, vone));
+		}
+
+		// Interpolate the positions and pack 4 xyz triplets into 3 vectors.
+
+		p[0] = _mm_add_ps(v1[0], _mm_mul_ps(_mm_shuffle_ps(vlerpfrac, vlerpfrac, _MM_SHUFFLE(0, 0, 0, 0)), vdiff[0]));
+		p[1] = _mm_add_ps(v1[1], _mm_mul_ps(_mm_shuffle_ps(vlerpfrac, vlerpfrac, _MM_SHUFFLE(1, 1, 1, 1)), vdiff[1]));
+		p[2] = _mm_add_ps(v1[2], _mm_mul_ps(_mm_shuffle_ps(vlerpfrac, vlerpfrac, _MM_SHUFFLE(2, 2, 2, 2)), vdiff[2]));
+		p[3] = _mm_add_ps(v1[3], _mm_mul_ps(_mm_shuffle_ps(vlerpfrac, vlerpfrac, _MM_SHUFFLE(3, 3, 3, 3)), vdiff[3]));
+
+		_mm_storeu_ps(posedest + i*3 + 0, _mm_shuffle_ps(p[0], _mm_shuffle_ps(p[0], p[1], _MM_SHUFFLE(0, 0, 2, 2)), _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(posedest + i*3 + 4, _mm_shuffle_ps(p[1], p[2], _MM_SHUFFLE(1, 0, 2, 1)));
+		_mm_storeu_ps(posedest + i*3 + 8, _mm_shuffle_ps(_mm_shuffle_ps(p[2], p[3], _MM_SHUFFLE(0, 0, 2, 2)), p[3], _MM_SHUFFLE(2, 1, 2, 0)));
+
+		// Shade dot lookup stays scalar, the rest is interpolation, light scale and saturation.
+
+		shade1 = _mm_setr_epi32(shadedots[src1[i+0].lightnormalindex], shadedots[src1[i+1].lightnormalindex], shadedots[src1[i+2].lightnormalindex], shadedots[src1[i+3].lightnormalindex]);
+		shade2 = _mm_setr_epi32(shadedots[src2[i+0].lightnormalindex], shadedots[src2[i+1].lightnormalindex], shadedots[src2[i+2].lightnormalindex], shadedots[src2[i+3].lightnormalindex]);
+
+		l = _mm_add_ps(_mm_cvtepi32_ps(shade1), _mm_mul_ps(vlerpfrac, _mm_cvtepi32_ps(_mm_sub_epi32(shade2, shade1))));
+		l = _mm_div_ps(l, v127);
+		l = _mm_add_ps(_mm_mul_ps(l, vshadelight), vambientlight);
+		l = _mm_min_ps(l, v255);
+		l = _mm_max_ps(l, v0);
+
+		// Replicate to RGB and merge with the model alpha.
+
+		vlight = _mm_cvttps_epi32(l);
+		vlight = _mm_or_si128(_mm_or_si128(vlight, _mm_slli_epi32(vlight, 8)), _mm_or_si128(_mm_slli_epi32(vlight, 16), vmodelalpha));
+
+		_mm_storeu_si128((__m128i *)(lightdest + i), vlight);
+	}
+
+	if (i < count)
+	{
+		if (limitlerp)
+			InterpolatePoses_LimitLerp(posedest + i*3, lightdest + i, src1 + i, src2 + i, lerpfrac, count - i, modelalpha);
+		else
+			InterpolatePoses_Scalar(posedest + i*3, lightdest + i, src1 + i, src2 + i, lerpfrac, count - i, modelalpha);
+	}
+}
+
+static void __attribute__ ((__noinline__, __target__("sse2"))) CalcColours_SSE2(unsigned int *lightdest, trivertx_t *src, unsigned int count, unsigned char modelalpha)
+{
+	__m128i vlight, vmodelalpha;
+	__m128 v127, v255, v0, vshadelight, vambientlight, l;
+	unsigned int i;
+
+	vmodelalpha = _mm_set1_epi32(((unsigned int)modelalpha) << 24);
+	v127 = _mm_set1_ps(127);
+	v255 = _mm_set1_ps(255);
+	v0 = _mm_setzero_ps();
+	vshadelight = _mm_set1_ps(shadelight);
+	vambientlight = _mm_set1_ps(ambientlight);
+
+	for(i=0;i+4<=count;i+=4)
+	{
+		l = _mm_cvtepi32_ps(_mm_setr_epi32(shadedots[src[i+0].lightnormalindex], shadedots[src[i+1].lightnormalindex], shadedots[src[i+2].lightnormalindex], shadedots[src[i+3].lightnormalindex]));
+		l = _mm_div_ps(l, v127);
+		l = _mm_add_ps(_mm_mul_ps(l, vshadelight), vambientlight);
+		l = _mm_min_ps(l, v255);
+		l = _mm_max_ps(l, v0);
+
+		vlight = _mm_cvttps_epi32(l);
+		vlight = _mm_or_si128(_mm_or_si128(vlight, _mm_slli_epi32(vlight, 8)), _mm_or_si128(_mm_slli_epi32(vlight, 16), vmodelalpha));
+
+		_mm_storeu_si128((__m128i *)(lightdest + i), vlight);
+	}
+
+	if (i < count)
+		CalcColours(lightdest + i, src + i, count - i, modelalpha);
+}
+#endif
+
 static void InterpolatePoses(float *posedest, unsigned int *lightdest, trivertx_t *src1, trivertx_t *src2, float lerpfrac, unsigned int count, unsigned char modelalpha)
 {
 #ifdef FOD_PPC
 	if (altivec_available)
 		InterpolatePoses_Altivec(posedest, lightdest, src1, src2, lerpfrac, count, modelalpha);
 	else
+#endif
+#ifdef FOD_SSE2
+	if (sse2_available)
+		InterpolatePoses_SSE2(posedest, lightdest, src1, src2, lerpfrac, count, modelalpha, 0);
+	else
 #endif
 		InterpolatePoses_Scalar(posedest, lightdest, src1, src2, lerpfrac, count, modelalpha);
 }
 
+static void InterpolatePosesLimitLerp(float *posedest, unsigned int *lightdest, trivertx_t *src1, trivertx_t *src2, float lerpfrac, unsigned int count, unsigned char modelalpha)
+{
+#ifdef FOD_SSE2
+	if (sse2_available)
+		InterpolatePoses_SSE2(posedest, lightdest, src1, src2, lerpfrac, count, modelalpha, 1);
+	else
+#endif
+		InterpolatePoses_LimitLerp(posedest, lightdest, src1, src2, lerpfrac, count, modelalpha);
+}
+
+#ifdef FOD_SSE2
+static unsigned int R_AliasCheckCompare(const char *what, model_t *mod, unsigned int pose, unsigned int numverts, float *posedest1, unsigned int *lightdest1, float *posedest2, unsigned int *lightdest2, unsigned int nummismatches)
+{
+	if ((posedest1 == 0 || memcmp(posedest1, posedest2, numverts * 3 * sizeof(*posedest1)) == 0)
+	 && memcmp(lightdest1, lightdest2, numverts * sizeof(*lightdest1)) == 0)
+		return 0;
+
+	if (nummismatches < 10)
+		Com_Printf("%s: %s differs for pose %u (lerpfrac %.3f)\n", mod->name, what, pose, r_framelerp);
+
+	return 1;
+}
+
+/* Runs every pose of the loaded alias models through both the SSE2 and the
+ * scalar vertex setup and reports any difference in the resulting buffers. */
+static void R_AliasSSE2Check_f(void)
+{
+	static const float lerpfracs[] = { 0, 0.25, 0.5, 0.999, 1 };
+	static const float lerpdistances[] = { 135, 8 };
+	model_t *mod;
+	aliashdr_t *paliashdr;
+	trivertx_t *verts1;
+	trivertx_t *verts2;
+	float *posedest1;
+	float *posedest2;
+	unsigned int *lightdest1;
+	unsigned int *lightdest2;
+	unsigned int numverts;
+	unsigned int pose;
+	unsigned int i;
+	unsigned int j;
+	unsigned int numchecked;
+	unsigned int nummismatches;
+	unsigned char modelalpha;
+	byte *oldshadedots;
+	float oldshadelight;
+	float oldambientlight;
+	float oldframelerp;
+	float oldlerpdistance;
+
+	if (!sse2_available)
+	{
+		Com_Printf("SSE2 is not available\n");
+		return;
+	}
+
+	oldshadedots = shadedots;
+	oldshadelight = shadelight;
+	oldambientlight = ambientlight;
+	oldframelerp = r_framelerp;
+	oldlerpdistance = r_lerpdistance;
+
+	numchecked = 0;
+	nummismatches = 0;
+
+	for(mod = Mod_GetFirstModel(); mod; mod = mod->next)
+	{
+		if (mod->type != mod_alias || mod->extradata == 0)
+			continue;
+
+		paliashdr = mod->extradata;
+		numverts = paliashdr->numverts;
+
+		posedest1 = malloc(numverts * 3 * sizeof(*posedest1));
+		posedest2 = malloc(numverts * 3 * sizeof(*posedest2));
+		lightdest1 = malloc(numverts * sizeof(*lightdest1));
+		lightdest2 = malloc(numverts * sizeof(*lightdest2));
+		if (posedest1 && posedest2 && lightdest1 && lightdest2)
+		{
+			for(pose=0;pose<paliashdr->numposes;pose++)
+			{
+				verts1 = paliashdr->realposeverts + pose * numverts;
+				verts2 = paliashdr->realposeverts + ((pose + 1) % paliashdr->numposes) * numverts;
+
+				shadedots = r_avertexnormal_dots[pose % SHADEDOT_QUANT];
+				shadelight = 40 + (pose * 37) % 200;
+				ambientlight = (pose * 13) % 128;
+				modelalpha = (pose & 1) ? 255 : 128;
+
+				for(i=0;i<sizeof(lerpfracs)/sizeof(*lerpfracs);i++)
+				{
+					r_framelerp = lerpfracs[i];
+
+					memset(posedest1, 0, numverts * 3 * sizeof(*posedest1));
+					memset(lightdest1, 0, numverts * sizeof(*lightdest1));
+					memset(posedest2, 0xff, numverts * 3 * sizeof(*posedest2));
+					memset(lightdest2, 0xff, numverts * sizeof(*lightdest2));
+					InterpolatePoses_Scalar(posedest1, lightdest1, verts1, verts2, r_framelerp, numverts, modelalpha);
+					InterpolatePoses_SSE2(posedest2, lightdest2, verts1, verts2, r_framelerp, numverts, modelalpha, 0);
+					nummismatches += R_AliasCheckCompare("lerp", mod, pose, numverts, posedest1, lightdest1, posedest2, lightdest2, nummismatches);
+
+					for(j=0;j<sizeof(lerpdistances)/sizeof(*lerpdistances);j++)
+					{
+						r_lerpdistance = lerpdistances[j];
+
+						memset(posedest1, 0, numverts * 3 * sizeof(*posedest1));
+						memset(lightdest1, 0, numverts * sizeof(*lightdest1));
+						memset(posedest2, 0xff, numverts * 3 * sizeof(*posedest2));
+						memset(lightdest2, 0xff, numverts * sizeof(*lightdest2));
+						InterpolatePoses_LimitLerp(posedest1, lightdest1, verts1, verts2, r_framelerp, numverts, modelalpha);
+						InterpolatePoses_SSE2(posedest2, lightdest2, verts1, verts2, r_framelerp, numverts, modelalpha, 1);
+						nummismatches += R_AliasCheckCompare("limit lerp", mod, pose, numverts, posedest1, lightdest1, posedest2, lightdest2, nummismatches);
+					}
+
+					numchecked++;
+				}
+
+				r_framelerp = 0;
+
+				memset(posedest1, 0, numverts * 3 * sizeof(*posedest1));
+				memset(lightdest1, 0, numverts * sizeof(*lightdest1));
+				memset(posedest2, 0xff, numverts * 3 * sizeof(*posedest2));
+				memset(lightdest2, 0xff, numverts * sizeof(*lightdest2));
+				CopyPoses(posedest1, lightdest1, verts1, numverts, modelalpha);
+				InterpolatePoses_SSE2(posedest2, lightdest2, verts1, verts1, 0, numverts, modelalpha, 0);
+				nummismatches += R_AliasCheckCompare("copy", mod, pose, numverts, posedest1, lightdest1, posedest2, lightdest2, nummismatches);
+
+				memset(lightdest1, 0, numverts * sizeof(*lightdest1));
+				memset(lightdest2, 0xff, numverts * sizeof(*lightdest2));
+				CalcColours(lightdest1, verts1, numverts, modelalpha);
+				CalcColours_SSE2(lightdest2, verts1, numverts, modelalpha);
+				nummismatches += R_AliasCheckCompare("colours", mod, pose, numverts, 0, lightdest1, 0, lightdest2, nummismatches);
+			}
+		}
+		else
+			Com_Printf("%s: out of memory\n", mod->name);
+
+		free(posedest1);
+		free(posedest2);
+		free(lightdest1);
+		free(lightdest2);
+	}
+
+	shadedots = oldshadedots;
+	shadelight = oldshadelight;
+	ambientlight = oldambientlight;
+	r_framelerp = oldframelerp;
+	r_lerpdistance = oldlerpdistance;
+
+	Com_Printf("%u pose pairs checked, %u mismatches\n", numchecked, nummismatches);
+}
+#endif
+
 static float *posedest;
 static unsigned int *lightdest;
 static unsigned int posedestsize;
 
+/* Vertex program doing the pose lerp and shadedots lighting on the GPU,
+ * straight from the per pose VBOs built by MakeVBO(). */
+static int aliasprogram;
+static int aliasprogram_lerpfrac;
+static int aliasprogram_limitlerp;
+static int aliasprogram_lerpdistance;
+static int aliasprogram_shadedots;
+static int aliasprogram_shadelight;
+static int aliasprogram_ambientlight;
+static int aliasprogram_modelalpha;
+static byte *aliasprogram_currentshadedots;
+
+static void GL_InitAliasProgram()
+{
+	static const char * const attributes[] = { "pose1", "pose2", 0 };
+	const char *prog = "#version 120\n"
+	"attribute vec4 pose1;\n"
+	"attribute vec4 pose2;\n"
+	"uniform float lerpfrac;\n"
+	"uniform float limitlerp;\n"
+	"uniform float lerpdistance;\n"
+	"uniform vec4 shadedots[41];\n"
+	"uniform float shadelight;\n"
+	"uniform float ambientlight;\n"
+	"uniform float modelalpha;\n"
+	"float shadedot(float index)\n"
+	"{\n"
+	"float i = floor(index / 4.0);\n"
+	"return dot(shadedots[int(i)], vec4(equal(vec4(index - i * 4.0), vec4(0.0, 1.0, 2.0, 3.0))));\n"
+	"}\n"
+	"void main(void)\n"
+	"{\n"
+	"vec3 diff = pose2.xyz - pose1.xyz;\n"
+	"float frac = lerpfrac;\n"
+	"float l;\n"
+	"if (limitlerp != 0.0 && dot(diff, diff) >= lerpdistance)\n"
+	"frac = 1.0;\n"
+	"l = mix(shadedot(pose1.w), shadedot(pose2.w), frac) / 127.0;\n"
+	"l = floor(clamp(l * shadelight + ambientlight, 0.0, 255.0));\n"
+	"gl_FrontColor = vec4(vec3(l / 255.0), modelalpha);\n"
+	"gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+	"gl_TexCoord[1] = gl_MultiTexCoord1;\n"
+	"gl_Position = gl_ModelViewProjectionMatrix * vec4(pose1.xyz + frac * diff, 1.0);\n"
+	"}\n";
+
+	/* Built even with gl_alias_program off so the cvar can be toggled at any time */
+	if (!gl_vs || !gl_vbo)
+		return;
+
+	aliasprogram = GL_SetupShaderProgram(0, prog, 0, 0, attributes);
+	if (aliasprogram)
+	{
+		aliasprogram_lerpfrac = qglGetUniformLocation(aliasprogram, "lerpfrac");
+		aliasprogram_limitlerp = qglGetUniformLocation(aliasprogram, "limitlerp");
+		aliasprogram_lerpdistance = qglGetUniformLocation(aliasprogram, "lerpdistance");
+		aliasprogram_shadedots = qglGetUniformLocation(aliasprogram, "shadedots");
+		aliasprogram_shadelight = qglGetUniformLocation(aliasprogram, "shadelight");
+		aliasprogram_ambientlight = qglGetUniformLocation(aliasprogram, "ambientlight");
+		aliasprogram_modelalpha = qglGetUniformLocation(aliasprogram, "modelalpha");
+		aliasprogram_currentshadedots = 0;
+	}
+}
+
+static void GL_ShutdownAliasProgram()
+{
+	if (aliasprogram)
+	{
+		qglDeleteProgram(aliasprogram);
+		aliasprogram = 0;
+	}
+}
+
+static void GL_DrawAliasFrameProgram(aliashdr_t *paliashdr, int pose1, int pose2, qboolean mtex, qboolean dolerp)
+{
+	float shadedotsf[41*4];
+	unsigned int i;
+
+	qglUseProgram(aliasprogram);
+
+	if (shadedots != aliasprogram_currentshadedots)
+	{
+		for(i=0;i<NUMVERTEXNORMALS;i++)
+			shadedotsf[i] = shadedots[i];
+
+		for(;i<41*4;i++)
+			shadedotsf[i] = 0;
+
+		qglUniform4fv(aliasprogram_shadedots, 41, shadedotsf);
+		aliasprogram_currentshadedots = shadedots;
+	}
+
+	qglUniform1f(aliasprogram_lerpfrac, dolerp ? r_framelerp : 0);
+	qglUniform1f(aliasprogram_limitlerp, dolerp && (currententity->flags & RF_LIMITLERP));
+	qglUniform1f(aliasprogram_lerpdistance, r_lerpdistance * r_lerpdistance);
+	qglUniform1f(aliasprogram_shadelight, shadelight);
+	qglUniform1f(aliasprogram_ambientlight, ambientlight);
+	qglUniform1f(aliasprogram_modelalpha, ((unsigned char)bound(0, r_modelalpha*255, 255)) / 255.0);
+
+	if (mtex)
+		GL_SetArrays(FQ_GL_TEXTURE_COORD_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY_1);
+	else
+		GL_SetArrays(FQ_GL_TEXTURE_COORD_ARRAY);
+
+	qglBindBufferARB(GL_ARRAY_BUFFER_ARB, paliashdr->vert_vbo_number[pose1]);
+	qglVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	qglBindBufferARB(GL_ARRAY_BUFFER_ARB, paliashdr->vert_vbo_number[pose2]);
+	qglVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, 0);
+
+	qglBindBufferARB(GL_ARRAY_BUFFER_ARB, paliashdr->texcoord_vbo_number);
+
+	if (mtex)
+	{
+		GL_TexCoordPointer(1, 2, GL_FLOAT, 0, 0);
+	}
+
+	GL_TexCoordPointer(0, 2, GL_FLOAT, 0, 0);
+
+	qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+
+	qglEnableVertexAttribArray(0);
+	qglEnableVertexAttribArray(1);
+
+	glDrawRangeElements(GL_TRIANGLES, paliashdr->indexmin, paliashdr->indexmax, paliashdr->numtris*3, GL_UNSIGNED_SHORT, paliashdr->indices);
+
+	qglDisableVertexAttribArray(0);
+	qglDisableVertexAttribArray(1);
+
+	qglUseProgram(0);
+}
+
 static void GL_DrawAliasFrame2(aliashdr_t *paliashdr, int pose1, int pose2, qboolean mtex, qboolean dolerp)
 {
 	float lerpfrac;
@@ -610,6 +1050,12 @@ static void GL_DrawAliasFrame2(aliashdr_t *paliashdr, int pose1, int pose2, qboo
 
 	GL_SetAlphaTestBlend(0, r_modelalpha<1);
 
+	if (aliasprogram && gl_alias_program.value)
+	{
+		GL_DrawAliasFrameProgram(paliashdr, pose1, pose2, mtex, dolerp);
+		return;
+	}
+
 	if (paliashdr->totalverts > posedestsize)
 	{
 		float *newposedest;
@@ -643,12 +1089,23 @@ static void GL_DrawAliasFrame2(aliashdr_t *paliashdr, int pose1, int pose2, qboo
 		lerpfrac = r_framelerp;
 
 		if ((currententity->flags & RF_LIMITLERP))
-			InterpolatePoses_LimitLerp(posedest, lightdest, verts1, verts2, lerpfrac, paliashdr->numverts, bound(0, r_modelalpha*255, 255));
+			InterpolatePosesLimitLerp(posedest, lightdest, verts1, verts2, lerpfrac, paliashdr->numverts, bound(0, r_modelalpha*255, 255));
 		else
 			InterpolatePoses(posedest, lightdest, verts1, verts2, lerpfrac, paliashdr->numverts, bound(0, r_modelalpha*255, 255));
 	}
 	else
 	{
+#ifdef FOD_SSE2
+		if (sse2_available)
+		{
+			/* A lerp fraction of 0 reproduces CopyPoses() exactly */
+			if (gl_vbo)
+				CalcColours_SSE2(lightdest, verts1, paliashdr->numverts, bound(0, r_modelalpha*255, 255));
+			else
+				InterpolatePoses_SSE2(posedest, lightdest, verts1, verts1, 0, paliashdr->numverts, bound(0, r_modelalpha*255, 255), 0);
+		}
+		else
+#endif
 		if (gl_vbo)
 			CalcColours(lightdest, verts1, paliashdr->numverts, bound(0, r_modelalpha*255, 255));
 		else
@@ -670,7 +1127,7 @@ static void GL_DrawAliasFrame2(aliashdr_t *paliashdr, int pose1, int pose2, qboo
 	if (gl_vbo && !dolerp)
 	{
 		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, paliashdr->vert_vbo_number[pose1]);
-		GL_VertexPointer(3, GL_FLOAT, 0, 0);
+		GL_VertexPointer(3, GL_FLOAT, 4*sizeof(float), 0);
 	}
 	else
 		GL_VertexPointer(3, GL_FLOAT, 0, posedest);
@@ -1550,6 +2007,10 @@ void R_CvarInit(void)
 {
 	Cmd_AddCommand ("loadsky", R_LoadSky_f);
 	Cmd_AddCommand ("timerefresh", R_TimeRefresh_f);
+	Cmd_AddCommand ("r_walkprofile", R_WalkProfile_f);
+#ifdef FOD_SSE2
+	Cmd_AddCommand ("gl_alias_sse2check", R_AliasSSE2Check_f);
+#endif
 #ifndef CLIENTONLY
 	Cmd_AddCommand ("pointfile", R_ReadPointFile_f);
 #endif
@@ -1596,6 +2057,7 @@ void R_CvarInit(void)
 	Cvar_Register (&r_lightmap);
 	Cvar_Register (&gl_shaftlight);
 	Cvar_Register (&gl_loadlitfiles);
+	Cvar_Register (&gl_lightmapcache);
 	Cvar_Register (&gl_colorlights);
 
 	Cvar_SetCurrentGroup(CVAR_GROUP_TEXTURES);
@@ -1605,6 +2067,7 @@ void R_CvarInit(void)
 	Cvar_SetCurrentGroup(CVAR_GROUP_OPENGL);
 	Cvar_Register (&r_farclip);
 	Cvar_Register (&gl_smoothmodels);
+	Cvar_Register (&gl_alias_program);
 	Cvar_Register (&gl_clear);
 	Cvar_Register (&gl_clearColor);
 	Cvar_Register (&gl_cull);
@@ -1639,6 +2102,10 @@ int R_Init(void)
 
 	GL_Warp_Init();
 
+	GL_InitAliasProgram();
+
+	GL_Stream_Init();
+
 	if (R_InitTextures())
 	{
 		R_InitBubble();
@@ -1673,6 +2140,7 @@ void R_Shutdown()
 	R_ShutdownTextures();
 	GL_RSurf_Shutdown();
 	GL_Warp_Shutdown();
+	GL_ShutdownAliasProgram();
 	GL_Texture_Shutdown();
 	GL_Shader_Shutdown();
 }
@@ -1681,6 +2149,10 @@ void R_InitGL(void)
 {
 	byte *clearColor;
 
+#ifdef FOD_SSE2
+	sse2_available = __builtin_cpu_supports("sse2");
+#endif
+
 	Classic_LoadParticleTextures();
 
 	R_InitOtherTextures ();
@@ -1782,6 +2254,9 @@ void R_RenderView(void)
 		time1 = Sys_DoubleTime();
 		c_brush_polys = 0;
 		c_alias_polys = 0;
+		c_particles = 0;
+		c_particle_draws = 0;
+		c_lightmap_texels = 0;
 	}
 
 	if (gl_finish.value)
@@ -1798,7 +2273,7 @@ void R_RenderView(void)
 	if (r_speeds.value)
 	{
 		time2 = Sys_DoubleTime();
-		Com_Printf("%3i ms  %4i wpoly %4i epoly\n", (int)((time2 - time1) * 1000), c_brush_polys, c_alias_polys);
+		Com_Printf("%3i ms  %4i wpoly %4i epoly %5i part %3i pdraw %2i dlight %6i lmtexel\n", (int)((time2 - time1) * 1000), c_brush_polys, c_alias_polys, c_particles, c_particle_draws, c_dlights, c_lightmap_texels);
 	}
 }
 
@@ -22,14 +22,20 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <string.h>
 #include <math.h>
 
+#if defined(__i386__) || defined(__x86_64__)
+#define FOD_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "quakedef.h"
 #include "pmove.h"
 #include "gl_local.h"
 #include "gl_state.h"
+#include "gl_stream.h"
 
 #define DEFAULT_NUM_PARTICLES				4096
 #define ABSOLUTE_MIN_PARTICLES				256
-#define ABSOLUTE_MAX_PARTICLES				32768
+#define ABSOLUTE_MAX_PARTICLES				262144
 
 typedef byte col_t[4];
 
@@ -54,8 +60,8 @@ typedef enum {
 	pd_spark, pd_sparkray, pd_billboard, pd_billboard_vel,
 } part_draw_t;
 
+/* Only used to build a new particle before it is stored in its type's arrays */
 typedef struct particle_s {
-	struct particle_s *next;
 	vec3_t		org, endorg;
 	col_t		color;
 	float		growth;		
@@ -71,7 +77,6 @@ typedef struct particle_s {
 } particle_t;
 
 typedef struct particle_tree_s {
-	particle_t	*start;
 	part_type_t	id;
 	part_draw_t	drawtype;
 	int			SrcBlend;
@@ -82,8 +87,31 @@ typedef struct particle_tree_s {
 	float		accel;
 	part_move_t	move;
 	float		custom;		
+
+	/* The live particles of this type as parallel arrays, kept dense by
+	 * moving the last particle into the slot of a dead one. */
+	unsigned int	count;
+	unsigned int	allocated;
+	void		*storage;
+	float		*org[3];
+	float		*vel[3];
+	float		*size;
+	float		*growth;
+	float		*rotangle;
+	float		*rotspeed;
+	float		*starttime;
+	float		*dietime;
+	float		*alpha;
+	vec3_t		*endorg;
+	col_t		*color;
+	byte		*hit;
+	byte		*texindex;
+	byte		*bounces;
 } particle_type_t;
 
+/* Number of bytes one particle occupies across all the arrays above */
+#define PARTICLE_STORAGE_SIZE (14 * sizeof(float) + sizeof(vec3_t) + sizeof(col_t) + 3)
+
 
 #define	MAX_PTEX_COMPONENTS		8
 typedef struct particle_texture_s {
@@ -96,12 +124,24 @@ typedef struct particle_texture_s {
 static float sint[7] = {0.000000, 0.781832, 0.974928, 0.433884, -0.433884, -0.974928, -0.781832};
 static float cost[7] = {1.000000, 0.623490, -0.222521, -0.900969, -0.900969, -0.222521, 0.623490};
 
-static particle_t *particles, *free_particles;
 static particle_type_t particle_types[num_particletypes];
 static int particle_type_index[num_particletypes];	
 static particle_texture_t particle_textures[num_particletextures];
 
 static int r_numparticles;		
+static int numparticles;
+
+/* Per update scratch space, large enough for the largest particle type */
+static unsigned int scratchallocated;
+static void *scratchstorage;
+static float *scratch_oldorg[3];
+static float *scratch_point[3];
+static unsigned int *scratch_indices;
+static int *scratch_contents;
+
+#ifdef FOD_SSE2
+static int sse2_available;
+#endif
 static vec3_t zerodir = {22, 22, 22};
 static float particle_time;		
 static vec3_t trail_stop;
@@ -276,6 +316,179 @@ void GL_Particles_TextureInit(void)
 	ADD_PARTICLE_TYPE(p_staticbubble, pd_billboard, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, ptex_bubble, 204, 0, 0, pm_static, 0);
 }
 
+static void QMB_SetupParticleArrays(particle_type_t *pt, void *storage, unsigned int allocated)
+{
+	float *f;
+	byte *b;
+	int i;
+
+	pt->storage = storage;
+	pt->allocated = allocated;
+
+	/* The float arrays come first so that, with allocated a multiple of 4,
+	 * every one of them starts on a 16 byte boundary of the block. */
+	f = storage;
+	for (i = 0; i < 3; i++)
+	{
+		pt->org[i] = f;
+		f += allocated;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		pt->vel[i] = f;
+		f += allocated;
+	}
+	pt->size = f; f += allocated;
+	pt->growth = f; f += allocated;
+	pt->rotangle = f; f += allocated;
+	pt->rotspeed = f; f += allocated;
+	pt->starttime = f; f += allocated;
+	pt->dietime = f; f += allocated;
+	pt->alpha = f; f += allocated;
+	pt->endorg = (vec3_t *)f;
+	b = (byte *)(pt->endorg + allocated);
+	pt->color = (col_t *)b;
+	b += allocated * sizeof(col_t);
+	pt->hit = b; b += allocated;
+	pt->texindex = b; b += allocated;
+	pt->bounces = b;
+}
+
+static int QMB_GrowScratch(unsigned int allocated)
+{
+	void *storage;
+	float *f;
+	int i;
+
+	storage = malloc(allocated * (9 * sizeof(float) + sizeof(unsigned int) + sizeof(int)));
+	if (storage == 0)
+		return 0;
+
+	free(scratchstorage);
+	scratchstorage = storage;
+	scratchallocated = allocated;
+
+	f = storage;
+	for (i = 0; i < 3; i++)
+	{
+		scratch_oldorg[i] = f;
+		f += allocated;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		scratch_point[i] = f;
+		f += allocated;
+	}
+	scratch_indices = (unsigned int *)f;
+	scratch_contents = (int *)(scratch_indices + allocated);
+
+	return 1;
+}
+
+static int QMB_GrowParticleType(particle_type_t *pt)
+{
+	particle_type_t old;
+	unsigned int allocated;
+	unsigned int maxallocated;
+	void *storage;
+	int i;
+
+	maxallocated = (r_numparticles + 3) & ~3;
+	if (pt->allocated >= maxallocated)
+		return 0;
+
+	allocated = pt->allocated ? pt->allocated * 2 : 256;
+	if (allocated > maxallocated)
+		allocated = maxallocated;
+
+	if (allocated > scratchallocated && !QMB_GrowScratch(allocated))
+		return 0;
+
+	storage = malloc(allocated * PARTICLE_STORAGE_SIZE);
+	if (storage == 0)
+		return 0;
+
+	old = *pt;
+	QMB_SetupParticleArrays(pt, storage, allocated);
+
+	if (old.storage)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			memcpy(pt->org[i], old.org[i], pt->count * sizeof(float));
+			memcpy(pt->vel[i], old.vel[i], pt->count * sizeof(float));
+		}
+		memcpy(pt->size, old.size, pt->count * sizeof(float));
+		memcpy(pt->growth, old.growth, pt->count * sizeof(float));
+		memcpy(pt->rotangle, old.rotangle, pt->count * sizeof(float));
+		memcpy(pt->rotspeed, old.rotspeed, pt->count * sizeof(float));
+		memcpy(pt->starttime, old.starttime, pt->count * sizeof(float));
+		memcpy(pt->dietime, old.dietime, pt->count * sizeof(float));
+		memcpy(pt->alpha, old.alpha, pt->count * sizeof(float));
+		memcpy(pt->endorg, old.endorg, pt->count * sizeof(vec3_t));
+		memcpy(pt->color, old.color, pt->count * sizeof(col_t));
+		memcpy(pt->hit, old.hit, pt->count);
+		memcpy(pt->texindex, old.texindex, pt->count);
+		memcpy(pt->bounces, old.bounces, pt->count);
+
+		free(old.storage);
+	}
+
+	return 1;
+}
+
+static void QMB_StoreParticle(particle_type_t *pt, const particle_t *p)
+{
+	unsigned int i;
+
+	if (pt->count == pt->allocated && !QMB_GrowParticleType(pt))
+		return;
+
+	i = pt->count++;
+	numparticles++;
+
+	pt->org[0][i] = p->org[0];
+	pt->org[1][i] = p->org[1];
+	pt->org[2][i] = p->org[2];
+	pt->vel[0][i] = p->vel[0];
+	pt->vel[1][i] = p->vel[1];
+	pt->vel[2][i] = p->vel[2];
+	pt->size[i] = p->size;
+	pt->growth[i] = p->growth;
+	pt->rotangle[i] = p->rotangle;
+	pt->rotspeed[i] = p->rotspeed;
+	pt->starttime[i] = p->start;
+	pt->dietime[i] = p->die;
+	pt->alpha[i] = 0;
+	VectorCopy(p->endorg, pt->endorg[i]);
+	memcpy(pt->color[i], p->color, sizeof(col_t));
+	pt->hit[i] = p->hit;
+	pt->texindex[i] = p->texindex;
+	pt->bounces[i] = p->bounces;
+}
+
+static void QMB_MoveParticle(particle_type_t *pt, unsigned int dest, unsigned int src)
+{
+	pt->org[0][dest] = pt->org[0][src];
+	pt->org[1][dest] = pt->org[1][src];
+	pt->org[2][dest] = pt->org[2][src];
+	pt->vel[0][dest] = pt->vel[0][src];
+	pt->vel[1][dest] = pt->vel[1][src];
+	pt->vel[2][dest] = pt->vel[2][src];
+	pt->size[dest] = pt->size[src];
+	pt->growth[dest] = pt->growth[src];
+	pt->rotangle[dest] = pt->rotangle[src];
+	pt->rotspeed[dest] = pt->rotspeed[src];
+	pt->starttime[dest] = pt->starttime[src];
+	pt->dietime[dest] = pt->dietime[src];
+	pt->alpha[dest] = pt->alpha[src];
+	VectorCopy(pt->endorg[src], pt->endorg[dest]);
+	memcpy(pt->color[dest], pt->color[src], sizeof(col_t));
+	pt->hit[dest] = pt->hit[src];
+	pt->texindex[dest] = pt->texindex[src];
+	pt->bounces[dest] = pt->bounces[src];
+}
+
 int QMB_InitParticles(void)
 {
 	int i;
@@ -290,16 +503,32 @@ int QMB_InitParticles(void)
 		r_numparticles = DEFAULT_NUM_PARTICLES;
 	}
 
-	particles = malloc(r_numparticles * sizeof(particle_t));
-	if (particles)
-		return 1;
+#ifdef FOD_SSE2
+	sse2_available = __builtin_cpu_supports("sse2");
+#endif
 
-	return 0;
+	/* The per type arrays are allocated as particles of that type are
+	 * spawned, so a high -particles limit costs nothing until it is used. */
+	return 1;
 }
 
 void QMB_ShutdownParticles()
 {
-	free(particles);
+	int i;
+
+	for (i = 0; i < num_particletypes; i++)
+	{
+		free(particle_types[i].storage);
+		particle_types[i].storage = 0;
+		particle_types[i].allocated = 0;
+		particle_types[i].count = 0;
+	}
+
+	free(scratchstorage);
+	scratchstorage = 0;
+	scratchallocated = 0;
+
+	numparticles = 0;
 }
 
 void QMB_ClearParticles (void) {
@@ -308,113 +537,261 @@ void QMB_ClearParticles (void) {
 	if (!qmb_initialized)
 		return;
 
-	memset(particles, 0, r_numparticles * sizeof(particle_t));
-	free_particles = &particles[0];
+	for (i = 0; i < num_particletypes; i++)
+		particle_types[i].count = 0;
 
-	for (i = 0; i + 1 < r_numparticles; i++)
-		particles[i].next = &particles[i + 1];
-	particles[r_numparticles - 1].next = NULL;
+	numparticles = 0;
+}
 
-	for (i = 0; i < num_particletypes; i++)
-		particle_types[i].start = NULL;
+/* Advances particles [first, last) of a type by one frame: growth, fade,
+ * rotation, gravity, acceleration and, unless the type is static, the
+ * position. The position before the move is left in scratch_oldorg. */
+static void QMB_IntegrateParticles_Scalar(particle_type_t *pt, unsigned int first, unsigned int last, float frametime, float gravity, float velscale)
+{
+	unsigned int i;
+	float size;
+	int moves;
+
+	moves = pt->move != pm_static;
+
+	for (i = first; i < last; i++)
+	{
+		scratch_oldorg[0][i] = pt->org[0][i];
+		scratch_oldorg[1][i] = pt->org[1][i];
+		scratch_oldorg[2][i] = pt->org[2][i];
+
+		if (particle_time < pt->starttime[i])
+			continue;
+
+		size = pt->size[i] + pt->growth[i] * frametime;
+		pt->size[i] = size;
+
+		if (size <= 0)
+		{
+			pt->dietime[i] = 0;
+			continue;
+		}
+
+		pt->alpha[i] = pt->startalpha * ((pt->dietime[i] - particle_time) / (pt->dietime[i] - pt->starttime[i]));
+
+		pt->rotangle[i] = pt->rotangle[i] + pt->rotspeed[i] * frametime;
+
+		if (pt->hit[i])
+			continue;
+
+		pt->vel[0][i] = pt->vel[0][i] * velscale;
+		pt->vel[1][i] = pt->vel[1][i] * velscale;
+		pt->vel[2][i] = (pt->vel[2][i] + gravity) * velscale;
+
+		if (moves)
+		{
+			pt->org[0][i] = pt->org[0][i] + frametime * pt->vel[0][i];
+			pt->org[1][i] = pt->org[1][i] + frametime * pt->vel[1][i];
+			pt->org[2][i] = pt->org[2][i] + frametime * pt->vel[2][i];
+		}
+	}
 }
 
+#ifdef FOD_SSE2
+/* Four particles per iteration with the per particle branches of the
+ * scalar version turned into masks. The arithmetic is the same operation
+ * for operation, so both versions produce identical results. */
+static void __attribute__ ((__noinline__, __target__("sse2"))) QMB_IntegrateParticles_SSE2(particle_type_t *pt, unsigned int count, float frametime, float gravity, float velscale)
+{
+	__m128 vtime, vframetime, vgravity, vvelscale, vstartalpha, vzero;
+	__m128 start, die, size, alpha, rotangle, vel[3], org[3];
+	__m128 active, alive, killed, moving;
+	__m128i hit;
+	unsigned int i;
+	unsigned int hits;
+	int moves;
+	int j;
+
+	moves = pt->move != pm_static;
+
+	vtime = _mm_set1_ps(particle_time);
+	vframetime = _mm_set1_ps(frametime);
+	vgravity = _mm_set1_ps(gravity);
+	vvelscale = _mm_set1_ps(velscale);
+	vstartalpha = _mm_set1_ps(pt->startalpha);
+	vzero = _mm_setzero_ps();
+
+	for(i=0;i+4<=count;i+=4)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			org[j] = _mm_loadu_ps(pt->org[j] + i);
+			_mm_storeu_ps(scratch_oldorg[j] + i, org[j]);
+		}
+
+		start = _mm_loadu_ps(pt->starttime + i);
+		active = _mm_cmple_ps(start, vtime);
+		if (_mm_movemask_ps(active) == 0)
+			continue;
+
+		size = _mm_add_ps(_mm_loadu_ps(pt->size + i), _mm_mul_ps(_mm_loadu_ps(pt->growth + i), vframetime));
+		_mm_storeu_ps(pt->size + i, _mm_or_ps(_mm_and_ps(active, size), _mm_andnot_ps(active, _mm_loadu_ps(pt->size + i))));
+
+		alive = _mm_and_ps(active, _mm_cmpgt_ps(size, vzero));
+		killed = _mm_andnot_ps(alive, active);
+
+		die = _mm_loadu_ps(pt->dietime + i);
+		_mm_storeu_ps(pt->dietime + i, _mm_andnot_ps(killed, die));
+
+		alpha = _mm_mul_ps(vstartalpha, _mm_div_ps(_mm_sub_ps(die, vtime), _mm_sub_ps(die, start)));
+		_mm_storeu_ps(pt->alpha + i, _mm_or_ps(_mm_and_ps(alive, alpha), _mm_andnot_ps(alive, _mm_loadu_ps(pt->alpha + i))));
+
+		rotangle = _mm_loadu_ps(pt->rotangle + i);
+		rotangle = _mm_or_ps(_mm_and_ps(alive, _mm_add_ps(rotangle, _mm_mul_ps(_mm_loadu_ps(pt->rotspeed + i), vframetime))), _mm_andnot_ps(alive, rotangle));
+		_mm_storeu_ps(pt->rotangle + i, rotangle);
+
+		memcpy(&hits, pt->hit + i, sizeof(hits));
+		hit = _mm_cmpeq_epi32(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(hits), _mm_setzero_si128()), _mm_setzero_si128()), _mm_setzero_si128());
+		moving = _mm_and_ps(alive, _mm_castsi128_ps(hit));
+		if (_mm_movemask_ps(moving) == 0)
+			continue;
+
+		for (j = 0; j < 3; j++)
+			vel[j] = _mm_loadu_ps(pt->vel[j] + i);
+
+		vel[2] = _mm_add_ps(vel[2], vgravity);
+
+		for (j = 0; j < 3; j++)
+		{
+			vel[j] = _mm_mul_ps(vel[j], vvelscale);
+			vel[j] = _mm_or_ps(_mm_and_ps(moving, vel[j]), _mm_andnot_ps(moving, _mm_loadu_ps(pt->vel[j] + i)));
+			_mm_storeu_ps(pt->vel[j] + i, vel[j]);
+
+			if (moves)
+				_mm_storeu_ps(pt->org[j] + i, _mm_or_ps(_mm_and_ps(moving, _mm_add_ps(org[j], _mm_mul_ps(vframetime, vel[j]))), _mm_andnot_ps(moving, org[j])));
+		}
+	}
+
+	if (i < count)
+		QMB_IntegrateParticles_Scalar(pt, i, count, frametime, gravity, velscale);
+}
+#endif
+
 static void QMB_UpdateParticles(void) {
 	int i, contents;
-	float grav, bounce;
-	vec3_t oldorg, stop, normal;
+	unsigned int j, k, numindices;
+	float grav, frametime, bounce;
+	vec3_t oldorg, org, stop, normal;
 	particle_type_t *pt;
-	particle_t *p;
-	particle_t *prevp;
-	particle_t *nextp;
+	float *points[3];
+	hull_t *hull;
 
 	grav = movevars.gravity / 800.0;
+	frametime = cls.frametime;
+	hull = &cl.worldmodel->hulls[0];
 
 	for (i = 0; i < num_particletypes; i++) {
 		pt = &particle_types[i];
 
-		prevp = ((void *)pt) + (((void*)&((particle_type_t *)0)->start) - ((void *)&((particle_t *)0)->next)) ;
-		nextp = pt->start;
-		while((p = nextp))
+		j = 0;
+		while (j < pt->count)
 		{
-			nextp = p->next;
-
-			if (p->die <= particle_time)
+			if (pt->dietime[j] <= particle_time)
 			{
-				prevp->next = p->next;
-				p->next = free_particles;
-				free_particles = p;
-
-				continue;
+				pt->count--;
+				numparticles--;
+				if (j != pt->count)
+					QMB_MoveParticle(pt, j, pt->count);
 			}
 			else
-				prevp = p;
+				j++;
+		}
 
-			if (particle_time < p->start)
-				continue;
-			
-			p->size += p->growth * cls.frametime;
-			
-			if (p->size <= 0) {
-				p->die = 0;
+		if (pt->count == 0)
+			continue;
+
+#ifdef FOD_SSE2
+		if (sse2_available)
+			QMB_IntegrateParticles_SSE2(pt, pt->count, frametime, pt->grav * grav * frametime, 1 + pt->accel * frametime);
+		else
+#endif
+			QMB_IntegrateParticles_Scalar(pt, 0, pt->count, frametime, pt->grav * grav * frametime, 1 + pt->accel * frametime);
+
+		if (pt->move == pm_static || pt->move == pm_nophysics)
+			continue;
+
+		/* Collect the particles that moved this frame and classify all of
+		 * them against the world in one walk of the BSP tree. */
+		numindices = 0;
+		for (j = 0; j < pt->count; j++)
+		{
+			if (particle_time < pt->starttime[j] || pt->dietime[j] <= particle_time || pt->hit[j])
 				continue;
+
+			scratch_indices[numindices++] = j;
+		}
+
+		if (numindices == 0)
+			continue;
+
+		points[0] = pt->org[0];
+		points[1] = pt->org[1];
+		points[2] = pt->org[2];
+
+		if (pt->move == pm_float)
+		{
+			/* Bubbles pop when their top leaves the water */
+			for (k = 0; k < numindices; k++)
+			{
+				j = scratch_indices[k];
+				scratch_point[2][j] = pt->org[2][j] + (pt->size[j] + 1);
 			}
-			
-			p->color[3] = pt->startalpha * ((p->die - particle_time) / (p->die - p->start));
-			
-			p->rotangle += p->rotspeed * cls.frametime;
-			
-			if (p->hit)
-				continue;
-			
-			p->vel[2] += pt->grav * grav * cls.frametime;
-			
-			VectorScale(p->vel, 1 + pt->accel * cls.frametime, p->vel)
-			
+
+			points[2] = scratch_point[2];
+		}
+
+		PM_HullPointContentsBatch(hull, 0, (const float * const *)points, scratch_indices, numindices, scratch_contents);
+
+		for (k = 0; k < numindices; k++)
+		{
+			j = scratch_indices[k];
+			contents = scratch_contents[j];
+
 			switch (pt->move) {
-			case pm_static:
-				break;
 			case pm_normal:
-				VectorCopy(p->org, oldorg);
-				VectorMA(p->org, cls.frametime, p->vel, p->org);
-				if (CONTENTS_SOLID == TruePointContents (p->org)) {
-					p->hit = 1;
-					VectorCopy(oldorg, p->org);
-					VectorClear(p->vel);
+				if (contents == CONTENTS_SOLID) {
+					pt->hit[j] = 1;
+					pt->org[0][j] = scratch_oldorg[0][j];
+					pt->org[1][j] = scratch_oldorg[1][j];
+					pt->org[2][j] = scratch_oldorg[2][j];
+					pt->vel[0][j] = pt->vel[1][j] = pt->vel[2][j] = 0;
 				}
 				break;
 			case pm_float:
-				VectorMA(p->org, cls.frametime, p->vel, p->org);
-				p->org[2] += p->size + 1;		
-				contents = TruePointContents(p->org);
 				if (!ISUNDERWATER(contents))
-					p->die = 0;
-				p->org[2] -= p->size + 1;
-				break;
-			case pm_nophysics:
-				VectorMA(p->org, cls.frametime, p->vel, p->org);
+					pt->dietime[j] = 0;
 				break;
 			case pm_die:
-				VectorMA(p->org, cls.frametime, p->vel, p->org);
-				if (CONTENTS_SOLID == TruePointContents (p->org))
-					p->die = 0;
+				if (contents == CONTENTS_SOLID)
+					pt->dietime[j] = 0;
 				break;
 			case pm_bounce:
-				
-				if (!gl_bounceparticles.value || p->bounces) {
-					VectorMA(p->org, cls.frametime, p->vel, p->org);
-					if (CONTENTS_SOLID == TruePointContents (p->org))
-						p->die = 0;
+				if (contents != CONTENTS_SOLID)
+					break;
+
+				if (!gl_bounceparticles.value || pt->bounces[j]) {
+					pt->dietime[j] = 0;
 				} else {
-					VectorCopy(p->org, oldorg);
-					VectorMA(p->org, cls.frametime, p->vel, p->org);
-					if (CONTENTS_SOLID == TruePointContents (p->org)) {
-						if (TraceLineN(oldorg, p->org, stop, normal)) {
-							VectorCopy(stop, p->org);
-							bounce = -pt->custom * DotProduct(p->vel, normal);
-							VectorMA(p->vel, bounce, normal, p->vel);
-							p->bounces++;
-						}
+					oldorg[0] = scratch_oldorg[0][j];
+					oldorg[1] = scratch_oldorg[1][j];
+					oldorg[2] = scratch_oldorg[2][j];
+					org[0] = pt->org[0][j];
+					org[1] = pt->org[1][j];
+					org[2] = pt->org[2][j];
+					if (TraceLineN(oldorg, org, stop, normal)) {
+						pt->org[0][j] = stop[0];
+						pt->org[1][j] = stop[1];
+						pt->org[2][j] = stop[2];
+						bounce = -pt->custom * (pt->vel[0][j] * normal[0] + pt->vel[1][j] * normal[1] + pt->vel[2][j] * normal[2]);
+						pt->vel[0][j] += bounce * normal[0];
+						pt->vel[1][j] += bounce * normal[1];
+						pt->vel[2][j] += bounce * normal[2];
+						pt->bounces[j]++;
 					}
 				}
 				break;
@@ -427,75 +804,100 @@ static void QMB_UpdateParticles(void) {
 }
 
 
-static void QWB_DrawBillboardParticle(particle_texture_t *ptex, particle_t *p, vec3_t *coord)
+static void QWB_DrawBillboardParticle(particle_texture_t *ptex, particle_type_t *pt, unsigned int i, vec3_t *coord)
 {
-	vec3_t newcoord[4];
-
-	newcoord[0][0] = coord[0][0]*p->size+p->org[0];
-	newcoord[0][1] = coord[0][1]*p->size+p->org[1];
-	newcoord[0][2] = coord[0][2]*p->size+p->org[2];
-
-	newcoord[1][0] = coord[1][0]*p->size+p->org[0];
-	newcoord[1][1] = coord[1][1]*p->size+p->org[1];
-	newcoord[1][2] = coord[1][2]*p->size+p->org[2];
-
-	newcoord[2][0] = coord[2][0]*p->size+p->org[0];
-	newcoord[2][1] = coord[2][1]*p->size+p->org[1];
-	newcoord[2][2] = coord[2][2]*p->size+p->org[2];
-
-	newcoord[3][0] = coord[3][0]*p->size+p->org[0];
-	newcoord[3][1] = coord[3][1]*p->size+p->org[1];
-	newcoord[3][2] = coord[3][2]*p->size+p->org[2];
-
-	glColor4ubv(p->color);
-	glBegin(GL_QUADS);
-
-	glTexCoord2f(ptex->coords[p->texindex][0], ptex->coords[p->texindex][3]);
-	glVertex3fv(newcoord[0]);
+	struct StreamVertex *sv;
+	float size;
+	float *texcoords;
+	int j;
 
-	glTexCoord2f(ptex->coords[p->texindex][0], ptex->coords[p->texindex][1]);
-	glVertex3fv(newcoord[1]);
+	size = pt->size[i];
+	texcoords = ptex->coords[pt->texindex[i]];
 
-	glTexCoord2f(ptex->coords[p->texindex][2], ptex->coords[p->texindex][1]);
-	glVertex3fv(newcoord[2]);
+	sv = GL_Stream_GetVertices(4);
 
-	glTexCoord2f(ptex->coords[p->texindex][2], ptex->coords[p->texindex][3]);
-	glVertex3fv(newcoord[3]);
+	for (j = 0; j < 4; j++)
+	{
+		sv[j].xyz[0] = coord[j][0]*size+pt->org[0][i];
+		sv[j].xyz[1] = coord[j][1]*size+pt->org[1][i];
+		sv[j].xyz[2] = coord[j][2]*size+pt->org[2][i];
+		sv[j].colour[0] = pt->color[i][0];
+		sv[j].colour[1] = pt->color[i][1];
+		sv[j].colour[2] = pt->color[i][2];
+		sv[j].colour[3] = pt->alpha[i];
+	}
 
-	glEnd();
+	sv[0].st[0] = texcoords[0];
+	sv[0].st[1] = texcoords[3];
+	sv[1].st[0] = texcoords[0];
+	sv[1].st[1] = texcoords[1];
+	sv[2].st[0] = texcoords[2];
+	sv[2].st[1] = texcoords[1];
+	sv[3].st[0] = texcoords[2];
+	sv[3].st[1] = texcoords[3];
 }
 
-static void QWB_DrawBillboardParticleRotate(particle_texture_t *ptex, particle_t *p, vec3_t *coord, vec3_t vpn)
+/* coordcross is vpn crossed with coord. As coord is perpendicular to vpn,
+ * rotating it around vpn is just a mix of the two. */
+static void QWB_DrawBillboardParticleRotate(particle_texture_t *ptex, particle_type_t *pt, unsigned int i, vec3_t *coord, vec3_t *coordcross)
 {
-	glPushMatrix();
-	glTranslatef(p->org[0], p->org[1], p->org[2]);
-	glScalef(p->size, p->size, p->size);
-	glRotatef(p->rotangle, vpn[0], vpn[1], vpn[2]);
-
-	glColor4ubv(p->color);
-	glBegin(GL_QUADS);
+	vec3_t rotated[4];
+	float angle, s, c;
+	int j;
 
-	glTexCoord2f(ptex->coords[p->texindex][0], ptex->coords[p->texindex][3]);
-	glVertex3fv(coord[0]);
+	angle = pt->rotangle[i] * (M_PI / 180);
+	s = sin(angle);
+	c = cos(angle);
 
-	glTexCoord2f(ptex->coords[p->texindex][0], ptex->coords[p->texindex][1]);
-	glVertex3fv(coord[1]);
-
-	glTexCoord2f(ptex->coords[p->texindex][2], ptex->coords[p->texindex][1]);
-	glVertex3fv(coord[2]);
+	for (j = 0; j < 4; j++)
+	{
+		rotated[j][0] = coord[j][0] * c + coordcross[j][0] * s;
+		rotated[j][1] = coord[j][1] * c + coordcross[j][1] * s;
+		rotated[j][2] = coord[j][2] * c + coordcross[j][2] * s;
+	}
 
-	glTexCoord2f(ptex->coords[p->texindex][2], ptex->coords[p->texindex][3]);
-	glVertex3fv(coord[3]);
+	QWB_DrawBillboardParticle(ptex, pt, i, rotated);
+}
 
-	glEnd();
+/* A triangle fan from centre out to 8 points on a circle of radius size
+ * around rimorigin, drawn as separate triangles so it can be batched. */
+static void QWB_DrawSparkParticle(particle_type_t *pt, unsigned int i, const vec3_t centre, const vec3_t rimorigin)
+{
+	struct StreamVertex *sv;
+	vec3_t rim[8];
+	byte rimcolour[4];
+	byte colour[4];
+	int j, k;
+
+	for (j = 7; j >= 0; j--) {
+		for (k = 0; k < 3; k++)
+			rim[7 - j][k] = rimorigin[k] + vright[k] * cost[j % 7] * pt->size[i] + vup[k] * sint[j % 7] * pt->size[i];
+	}
 
-	glPopMatrix();
+	colour[0] = pt->color[i][0];
+	colour[1] = pt->color[i][1];
+	colour[2] = pt->color[i][2];
+	colour[3] = pt->alpha[i];
+	rimcolour[0] = colour[0] >> 1;
+	rimcolour[1] = colour[1] >> 1;
+	rimcolour[2] = colour[2] >> 1;
+	rimcolour[3] = 0;
+
+	sv = GL_Stream_GetVertices(7 * 3);
+	for (j = 0; j < 7; j++, sv += 3) {
+		VectorCopy(centre, sv[0].xyz);
+		memcpy(sv[0].colour, colour, 4);
+		VectorCopy(rim[j], sv[1].xyz);
+		memcpy(sv[1].colour, rimcolour, 4);
+		VectorCopy(rim[j + 1], sv[2].xyz);
+		memcpy(sv[2].colour, rimcolour, 4);
+	}
 }
 
 void QMB_DrawParticles (void) {
-	int	i, j, k, drawncount;
-	vec3_t v, up, right, billboard[4], velcoord[4], neworg;
-	particle_t *p;
+	int	i, j, drawncount;
+	unsigned int l;
+	vec3_t up, right, billboard[4], billboardcross[4], velcoord[4], org, rimorg, neworg;
 	particle_type_t *pt;
 	particle_texture_t *ptex;
 
@@ -509,14 +911,19 @@ void QMB_DrawParticles (void) {
 	VectorNegate(billboard[2], billboard[0]);
 	VectorNegate(billboard[3], billboard[1]);
 
+	for (j = 0; j < 4; j++)
+		CrossProduct(vpn, billboard[j], billboardcross[j]);
+
 	glDepthMask(GL_FALSE);
 	GL_SetAlphaTestBlend(0, 1);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 	glShadeModel(GL_SMOOTH);
 
+	/* Every type has its own texture and blend mode, so each one is
+	 * submitted as a single batch. */
 	for (i = 0; i < num_particletypes; i++) {
 		pt = &particle_types[i];
-		if (!pt->start)
+		if (!pt->count)
 			continue;
 
 		glBlendFunc(pt->SrcBlend, pt->DstBlend);
@@ -524,69 +931,78 @@ void QMB_DrawParticles (void) {
 		switch(pt->drawtype) {
 		case pd_spark:
 			glDisable(GL_TEXTURE_2D);
-			for (p = pt->start; p; p = p->next) {
-				if (particle_time < p->start || particle_time >= p->die)
+			GL_Stream_Begin(GL_TRIANGLES, 0);
+			for (l = 0; l < pt->count; l++) {
+				if (particle_time < pt->starttime[l] || particle_time >= pt->dietime[l])
 					continue;
 
-				glBegin(GL_TRIANGLE_FAN);
-				glColor4ubv(p->color);
-				glVertex3fv(p->org);
-				glColor4ub(p->color[0] >> 1, p->color[1] >> 1, p->color[2] >> 1, 0);
-				for (j = 7; j >= 0; j--) {
-					for (k = 0; k < 3; k++)
-						v[k] = p->org[k] - p->vel[k] / 8 + vright[k] * cost[j % 7] * p->size + vup[k] * sint[j % 7] * p->size;
-					glVertex3fv(v);
-				}
-				glEnd();
+				org[0] = pt->org[0][l];
+				org[1] = pt->org[1][l];
+				org[2] = pt->org[2][l];
+
+				rimorg[0] = org[0] - pt->vel[0][l] / 8;
+				rimorg[1] = org[1] - pt->vel[1][l] / 8;
+				rimorg[2] = org[2] - pt->vel[2][l] / 8;
+
+				QWB_DrawSparkParticle(pt, l, org, rimorg);
+				c_particles++;
 			}
+			c_particle_draws += GL_Stream_End();
 			break;
 		case pd_sparkray:
 			glDisable(GL_TEXTURE_2D);
-			for (p = pt->start; p; p = p->next) {
-				if (particle_time < p->start || particle_time >= p->die)
+			GL_Stream_Begin(GL_TRIANGLES, 0);
+			for (l = 0; l < pt->count; l++) {
+				if (particle_time < pt->starttime[l] || particle_time >= pt->dietime[l])
 					continue;
 
-				if (!TraceLineN(p->endorg, p->org, neworg, NULL)) 
-					VectorCopy(p->org, neworg);
-
-				glBegin (GL_TRIANGLE_FAN);
-				glColor4ubv(p->color);
-				glVertex3fv(p->endorg);
-				glColor4ub(p->color[0] >> 1, p->color[1] >> 1, p->color[2] >> 1, 0);
-				for (j = 7; j >= 0; j--) {
-					for (k = 0; k < 3; k++)
-						v[k] = neworg[k] + vright[k] * cost[j % 7] * p->size + vup[k] * sint[j % 7] * p->size;
-					glVertex3fv (v);
-				}
-				glEnd();
+				org[0] = pt->org[0][l];
+				org[1] = pt->org[1][l];
+				org[2] = pt->org[2][l];
+
+				if (!TraceLineN(pt->endorg[l], org, neworg, NULL)) 
+					VectorCopy(org, neworg);
+
+				QWB_DrawSparkParticle(pt, l, pt->endorg[l], neworg);
+				c_particles++;
 			}
+			c_particle_draws += GL_Stream_End();
 			break;
 		case pd_billboard:
 			ptex = &particle_textures[pt->texture];
 			glEnable(GL_TEXTURE_2D);
 			GL_Bind(ptex->texnum);
+			GL_Stream_Begin(GL_QUADS, 1);
 			drawncount = 0;
-			for (p = pt->start; p; p = p->next) {
-				if (particle_time < p->start || particle_time >= p->die)
+			for (l = 0; l < pt->count; l++) {
+				if (particle_time < pt->starttime[l] || particle_time >= pt->dietime[l])
 					continue;
 
 				if (gl_clipparticles.value) {
-					if (drawncount >= 3 && VectorSupCompare(p->org, r_origin, 30))
+					org[0] = pt->org[0][l];
+					org[1] = pt->org[1][l];
+					org[2] = pt->org[2][l];
+					if (drawncount >= 3 && VectorSupCompare(org, r_origin, 30))
 						continue;
 					drawncount++;
 				}
-				QWB_DrawBillboardParticle(ptex, p, billboard);
+				QWB_DrawBillboardParticle(ptex, pt, l, billboard);
+				c_particles++;
 			}
+			c_particle_draws += GL_Stream_End();
 			break;
 		case pd_billboard_vel:
 			ptex = &particle_textures[pt->texture];
 			glEnable(GL_TEXTURE_2D);
 			GL_Bind(ptex->texnum);
-			for (p = pt->start; p; p = p->next) {
-				if (particle_time < p->start || particle_time >= p->die)
+			GL_Stream_Begin(GL_QUADS, 1);
+			for (l = 0; l < pt->count; l++) {
+				if (particle_time < pt->starttime[l] || particle_time >= pt->dietime[l])
 					continue;
 
-				VectorCopy (p->vel, up);
+				up[0] = pt->vel[0][l];
+				up[1] = pt->vel[1][l];
+				up[2] = pt->vel[2][l];
 				CrossProduct(vpn, up, right);
 				VectorNormalizeFast(right);
 				VectorScale(up, pt->custom, up);
@@ -596,11 +1012,13 @@ void QMB_DrawParticles (void) {
 				VectorNegate(velcoord[2], velcoord[0]);
 				VectorNegate(velcoord[3], velcoord[1]);
 
-				if (p->rotspeed)
-					QWB_DrawBillboardParticleRotate(ptex, p, billboard, vpn);
+				if (pt->rotspeed[l])
+					QWB_DrawBillboardParticleRotate(ptex, pt, l, billboard, billboardcross);
 				else
-					QWB_DrawBillboardParticle(ptex, p, billboard);
+					QWB_DrawBillboardParticle(ptex, pt, l, billboard);
+				c_particles++;
 			}
+			c_particle_draws += GL_Stream_End();
 			break;
 		default:
 			Sys_Error("QMB_DrawParticles: unexpected drawtype");
@@ -612,13 +1030,12 @@ void QMB_DrawParticles (void) {
 	glDepthMask(GL_TRUE);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glColor3ubv(color_white);
 }
 
 #define	INIT_NEW_PARTICLE(_pt, _p, _color, _size, _time)	\
-		_p = free_particles;								\
-		free_particles = _p->next;							\
-		_p->next = _pt->start;								\
-		_pt->start = _p;									\
+		_p = &newparticle;									\
+		memset(_p, 0, sizeof(*_p));							\
 		_p->size = _size;									\
 		_p->hit = 0;										\
 		_p->start = cl.time;								\
@@ -634,7 +1051,7 @@ __inline static void AddParticle(part_type_t type, const vec3_t org, int count,
 	byte *color;
 	int i, j;
 	float tempSize;
-	particle_t *p;
+	particle_t newparticle, *p;
 	particle_type_t *pt;
 
 	if (!qmb_initialized)
@@ -651,7 +1068,7 @@ __inline static void AddParticle(part_type_t type, const vec3_t org, int count,
 
 	pt = &particle_types[particle_type_index[type]];
 
-	for (i = 0; i < count && free_particles; i++) {
+	for (i = 0; i < count && numparticles < r_numparticles; i++) {
 		color = col ? col : ColorForParticle(type);
 		INIT_NEW_PARTICLE(pt, p, color, size, time);
 
@@ -748,6 +1165,8 @@ __inline static void AddParticle(part_type_t type, const vec3_t org, int count,
 			Sys_Error("AddParticle: unexpected type");
 			break;
 		}
+
+		QMB_StoreParticle(pt, p);
 	}
 }
 
@@ -756,7 +1175,7 @@ __inline static void AddParticleTrail(part_type_t type, vec3_t start, vec3_t end
 	int i, j,  num_particles;
 	float count, length;
 	vec3_t point, delta;
-	particle_t *p;
+	particle_t newparticle, *p;
 	particle_type_t *pt;
 
 	if (!qmb_initialized)
@@ -804,7 +1223,7 @@ __inline static void AddParticleTrail(part_type_t type, vec3_t start, vec3_t end
 
 	VectorScale(delta, 1.0 / num_particles, delta);
 
-	for (i = 0; i < num_particles && free_particles; i++) {
+	for (i = 0; i < num_particles && numparticles < r_numparticles; i++) {
 		color = col ? col : ColorForParticle(type);
 		INIT_NEW_PARTICLE(pt, p, color, size, time);
 
@@ -849,6 +1268,8 @@ __inline static void AddParticleTrail(part_type_t type, vec3_t start, vec3_t end
 			break;
 		}
 
+		QMB_StoreParticle(pt, p);
+
 		VectorAdd(point, delta, point);
 	}
 done:
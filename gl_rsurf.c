@@ -20,6 +20,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // r_surf.c: surface-related refresh code
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -27,6 +28,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "gl_local.h"
 #include "gl_state.h"
+#include "pvscache.h"
+#include "sys_io.h"
 
 #define	BLOCK_WIDTH		128
 #define	BLOCK_HEIGHT	128
@@ -35,6 +38,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	MAX_LIGHTMAPS		64
 
 extern cvar_t r_drawflat_enable;
+extern cvar_t gl_lightmapcache;
 
 static int lightmap_textures;
 static unsigned int blocklights[MAX_LIGHTMAP_SIZE * 3];
@@ -230,7 +234,7 @@ static int R_BuildDlightList (msurface_t *surf)
 	mtexinfo_t *tex;
 	int lnum, i, smax, tmax, irad, iminlight, local[2], tdmin, sdmin, distmin;
 	dlightinfo_t *light;
-	unsigned int dlightbits;
+	unsigned long long dlightbits;
 	int numdlights;
 
 	numdlights = 0;
@@ -241,12 +245,10 @@ static int R_BuildDlightList (msurface_t *surf)
 
 	dlightbits = surf->dlightbits;
 
-	for (lnum = 0; lnum < MAX_DLIGHTS && dlightbits; lnum++)
+	while (dlightbits)
 	{
-		if ( !(dlightbits & (1 << lnum) ) )
-			continue;		// not lit by this light
-
-		dlightbits &= ~(1<<lnum);
+		lnum = __builtin_ctzll(dlightbits);
+		dlightbits &= dlightbits - 1;
 
 		dist = PlaneDiff(cl_dlights[lnum].origin, surf->plane);
 		irad = (cl_dlights[lnum].radius - fabs(dist)) * 256;
@@ -650,6 +652,8 @@ static void R_RenderDynamicLightmaps (msurface_t *fa)
 	base = lightmaps + fa->lightmaptexturenum * BLOCK_WIDTH * BLOCK_HEIGHT * 3;
 	base += (fa->light_t * BLOCK_WIDTH + fa->light_s) * 3;
 	R_BuildLightMap(fa, base, BLOCK_WIDTH * 3, numdlights);
+
+	c_lightmap_texels += smax * tmax;
 }
 
 static void R_RenderAllDynamicLightmaps(model_t *model)
@@ -1283,6 +1287,7 @@ static void R_DrawFlat (model_t *model)
 void R_DrawBrushModel (entity_t *e)
 {
 	int i, k, underwater;
+	unsigned long long lightbits;
 	unsigned int li;
 	unsigned int lj;
 	vec3_t mins, maxs;
@@ -1332,6 +1337,7 @@ void R_DrawBrushModel (entity_t *e)
 	// calculate dynamic lighting for bmodel if it's not an instanced model
 	if (clmodel->firstmodelsurface)
 	{
+		lightbits = 0;
 		for(li=0;li<MAX_DLIGHTS/32;li++)
 		{
 			if (cl_dlight_active[li])
@@ -1342,13 +1348,15 @@ void R_DrawBrushModel (entity_t *e)
 					{
 						k = li*32 + lj;
 
-						/* This will fail for k >= 32 */
 						if (!gl_flashblend.value || (cl_dlights[k].bubble && gl_flashblend.value != 2))
-							R_MarkLights(clmodel, &cl_dlights[k], 1 << k, clmodel->hulls[0].firstclipnode);
+							lightbits |= 1ULL << k;
 					}
 				}
 			}
 		}
+
+		if (lightbits)
+			R_MarkLights(clmodel, lightbits, clmodel->hulls[0].firstclipnode);
 	}
 
 	glPushMatrix ();
@@ -1401,151 +1409,226 @@ void R_DrawBrushModel (entity_t *e)
 	R_UpdateFlatColours(clmodel);
 	DrawTextureChains(clmodel);
 	R_DrawFlat(clmodel);
-	R_DrawSkyChain();
+	R_DrawSkyChain(clmodel);
 	R_DrawAlphaChain ();
 
 	glPopMatrix ();
 }
 
-static void R_RecursiveWorldNode(model_t *model, unsigned int nodenum, int clipflags)
+// returns -1 if the box is outside the frustum, otherwise the frustum planes
+// its children still need to be clipped against
+static int R_ClipFlags(float *mins, float *maxs, int clipflags)
+{
+	mplane_t *clipplane;
+	int c, clipped;
+
+	for (c = 0, clipplane = frustum; c < 4; c++, clipplane++)
+	{
+		if (!(clipflags & (1 << c)))
+			continue;	// don't need to clip against it
+
+		clipped = BOX_ON_PLANE_SIDE (mins, maxs, clipplane);
+		if (clipped == 2)
+			return -1;
+		else if (clipped == 1)
+			clipflags &= ~(1<<c);	// node is entirely on screen
+	}
+
+	return clipflags;
+}
+
+static void R_ChainNodeSurfaces(model_t *model, unsigned int nodenum, float dot)
 {
 	mnode_t *node;
-	int c, side, clipped, underwater;
-	mplane_t *plane, *clipplane;
 	msurface_t *surf;
 	unsigned int surfnum;
-	unsigned short *mark;
 	unsigned char flags;
-	mleaf_t *pleaf;
-	float dot;
-	unsigned int leafnum;
-	int isleaf;
+	int c, underwater;
 
-	if (nodenum >= model->numnodes)
-	{
-		isleaf = 1;
-		leafnum = nodenum - model->numnodes;
+	node = model->nodes + nodenum;
 
-		if ((model->leafsolid[leafnum/32] & (1<<(leafnum%32))))
-			return; // solid
+	c = node->numsurfaces;
+	if (!c)
+		return;
 
-		node = (mnode_t *)(model->leafs + leafnum);
-	}
-	else
+	surf = cl.worldmodel->surfaces + node->firstsurface;
+	surfnum = node->firstsurface;
+
+	for ( ; c; c--, surf++, surfnum++)
 	{
-		isleaf = 0;
-		node = model->nodes + nodenum;
-	}
+		if (!(cl.worldmodel->surfvisible[surfnum/32]&(1<<(surfnum%32))))
+			continue;
 
-	if (node->visframe != r_visframecount)
-		return;
+		flags = cl.worldmodel->surfflags[surfnum];
 
-	if (clipflags)
-	{
-		for (c = 0, clipplane = frustum; c < 4; c++, clipplane++)
+		if ((dot < 0) ^ !!(flags & SURF_PLANEBACK))
+			continue;		// wrong side
+
+		// add surf to the right chain
+		if (flags & SURF_DRAWSKY)
+		{
+			CHAIN_SURF_F2B(surf, skychain_tail);
+		}
+		else if (flags & SURF_DRAWTURB)
+		{
+			CHAIN_SURF_F2B(surf, waterchain_tail);
+		}
+		else if (flags & SURF_DRAWALPHA)
+		{
+			CHAIN_SURF_B2F(surf, alphachain);
+		}
+		else if (r_drawflat_enable.value == 1 && surf->is_drawflat)
 		{
-			if (!(clipflags & (1 << c)))
-				continue;	// don't need to clip against it
-
-			clipped = BOX_ON_PLANE_SIDE (node->minmaxs, node->minmaxs + 3, clipplane);
-			if (clipped == 2)
-				return;
-			else if (clipped == 1)
-				clipflags &= ~(1<<c);	// node is entirely on screen
+			CHAIN_SURF_F2B(surf, drawflatchain_tail);
+		}
+		else
+		{
+			underwater = (flags & SURF_UNDERWATER) ? 1 : 0;
+			CHAIN_SURF_F2B(surf, surf->texinfo->texture->texturechain_tail[underwater]);
 		}
 	}
+}
 
-	// if a leaf node, draw stuff
-	if (isleaf)
-	{
-		pleaf = (mleaf_t *)node;
+struct worldnodestackentry
+{
+	float dot;
+	unsigned short nodenum;
+	unsigned short clipflags;
+};
 
-		mark = model->marksurfaces + pleaf->firstmarksurfacenum;
-		c = pleaf->nummarksurfaces;
+static struct worldnodestackentry *worldnodestack;
+static unsigned int worldnodestacksize;
 
-		if (c)
-		{
-			do
-			{
-				surfnum = *mark;
-				cl.worldmodel->surfvisible[surfnum/32] |= (1<<(surfnum%32));
-				mark++;
-			} while(--c);
-		}
+// walks the visible part of the tree front to back without recursing, the
+// stack holds the nodes whose front side is being walked
+static void R_WalkWorldNodes(model_t *model)
+{
+	struct worldnodestackentry *stack;
+	mflatnode_t *node;
+	mleaf_t *pleaf;
+	unsigned short *mark;
+	unsigned int nodenum, leafnum, surfnum, sp;
+	vec3_t mins, maxs;
+	int c, clipflags;
+	float dot;
 
-		// deal with model fragments in this leaf
-		if (pleaf->efrags)
-			R_StoreEfrags(&pleaf->efrags);
-	}
-	else
+	if (worldnodestacksize < model->nodedepth)
 	{
-		// node is just a decision point, so go down the apropriate sides
+		free(worldnodestack);
+		worldnodestack = malloc(model->nodedepth * sizeof(*worldnodestack));
+		if (worldnodestack == 0)
+			Sys_Error("R_WalkWorldNodes: Out of memory\n");
 
-		// find which side of the node we are on
-		plane = model->planes + node->planenum;
-
-		dot = PlaneDiff(modelorg, plane);
-		side = (dot >= 0) ? 0 : 1;
+		worldnodestacksize = model->nodedepth;
+	}
 
-		// recurse down the children, front side first
-		R_RecursiveWorldNode(model, node->childrennum[side], clipflags);
+	stack = worldnodestack;
+	sp = 0;
 
-		// draw stuff
-		c = node->numsurfaces;
+	nodenum = 0;
+	clipflags = 15;
 
-		if (c)
+	while(1)
+	{
+		if (nodenum >= model->numnodes)
 		{
-			surf = cl.worldmodel->surfaces + node->firstsurface;
-			surfnum = node->firstsurface;
+			leafnum = nodenum - model->numnodes;
+			pleaf = model->leafs + leafnum;
 
-			if (dot < -BACKFACE_EPSILON)
-				side = SURF_PLANEBACK;
-			else if (dot > BACKFACE_EPSILON)
-				side = 0;
+			// if a visible leaf, draw stuff
+			if (!(model->leafsolid[leafnum/32] & (1<<(leafnum%32)))
+			 && pleaf->visframe == r_visframecount
+			 && (!clipflags || R_ClipFlags(pleaf->minmaxs, pleaf->minmaxs + 3, clipflags) >= 0))
+			{
+				mark = model->marksurfaces + pleaf->firstmarksurfacenum;
+				c = pleaf->nummarksurfaces;
+
+				if (c)
+				{
+					do
+					{
+						surfnum = *mark;
+						cl.worldmodel->surfvisible[surfnum/32] |= (1<<(surfnum%32));
+						mark++;
+					} while(--c);
+				}
+
+				// deal with model fragments in this leaf
+				if (pleaf->efrags)
+					R_StoreEfrags(&pleaf->efrags);
+			}
+		}
+		else if ((model->nodevisible[nodenum/32] & (1<<(nodenum%32))))
+		{
+			node = model->flatnodes + nodenum;
 
-			for ( ; c; c--, surf++, surfnum++)
+			if (clipflags)
 			{
-				if (!(cl.worldmodel->surfvisible[surfnum/32]&(1<<(surfnum%32))))
-					continue;
+				VectorSet(mins, node->minmaxs[0], node->minmaxs[1], node->minmaxs[2]);
+				VectorSet(maxs, node->minmaxs[3], node->minmaxs[4], node->minmaxs[5]);
+				clipflags = R_ClipFlags(mins, maxs, clipflags);
+			}
 
-				flags = cl.worldmodel->surfflags[surfnum];
+			if (clipflags >= 0)
+			{
+				// go down the front side first
+				dot = DotProduct(modelorg, node->normal) - node->dist;
 
-				if ((dot < 0) ^ !!(flags & SURF_PLANEBACK))
-					continue;		// wrong side
+				stack[sp].dot = dot;
+				stack[sp].nodenum = nodenum;
+				stack[sp].clipflags = clipflags;
+				sp++;
 
-				// add surf to the right chain
-				if (flags & SURF_DRAWSKY)
-				{
-					CHAIN_SURF_F2B(surf, skychain_tail);
-				}
-				else if (flags & SURF_DRAWTURB)
-				{
-					CHAIN_SURF_F2B(surf, waterchain_tail);
-				}
-				else if (flags & SURF_DRAWALPHA)
-				{
-					CHAIN_SURF_B2F(surf, alphachain);
-				}
-				else if (r_drawflat_enable.value == 1 && surf->is_drawflat)
-				{
-					CHAIN_SURF_F2B(surf, drawflatchain_tail);
-				}
-				else
-				{
-					underwater = (flags & SURF_UNDERWATER) ? 1 : 0;
-					CHAIN_SURF_F2B(surf, surf->texinfo->texture->texturechain_tail[underwater]);
-				}
+				nodenum = node->childrennum[!(dot >= 0)];
+				continue;
 			}
 		}
 
-		// recurse down the back side
-		R_RecursiveWorldNode(model, node->childrennum[!side], clipflags);
+		if (sp == 0)
+			break;
+
+		// the front side of the node on top of the stack is done, draw its
+		// surfaces and go down the back side
+		sp--;
+		nodenum = stack[sp].nodenum;
+		clipflags = stack[sp].clipflags;
+		dot = stack[sp].dot;
+
+		R_ChainNodeSurfaces(model, nodenum, dot);
+
+		nodenum = model->flatnodes[nodenum].childrennum[dot >= 0];
+	}
+}
+
+static unsigned int walkcalls;
+static double walktime;
+
+void R_WalkProfile_f(void)
+{
+	if (Cmd_Argc() == 2 && strcmp(Cmd_Argv(1), "reset") == 0)
+	{
+		walkcalls = 0;
+		walktime = 0;
+		lightpointcalls = 0;
+		lightpointtime = 0;
+
+		return;
 	}
+	else if (Cmd_Argc() != 1)
+	{
+		Com_Printf("%s [reset] : show how long the world walk and the light point traces took, e.g. over a timedemo\n", Cmd_Argv(0));
+		return;
+	}
+
+	Com_Printf("\x02%-12s %8s %10s %10s\n", "", "calls", "total ms", "avg us");
+	Com_Printf("%-12s %8u %10.3f %10.2f\n", "world walk", walkcalls, walktime * 1000, walkcalls ? walktime * 1000000 / walkcalls : 0);
+	Com_Printf("%-12s %8u %10.3f %10.2f\n", "light point", lightpointcalls, lightpointtime * 1000, lightpointcalls ? lightpointtime * 1000000 / lightpointcalls : 0);
 }
 
 void R_DrawWorld (void)
 {
 	entity_t ent;
+	double starttime;
 
 	memset (&ent, 0, sizeof(ent));
 	ent.model = cl.worldmodel;
@@ -1559,13 +1642,16 @@ void R_DrawWorld (void)
 
 	//set up texture chains for the world
 	memset(cl.worldmodel->surfvisible, 0, ((cl.worldmodel->numsurfaces+31)/32)*sizeof(*cl.worldmodel->surfvisible));
-	R_RecursiveWorldNode(cl.worldmodel, 0, 15);
+	starttime = Sys_DoubleTime();
+	R_WalkWorldNodes(cl.worldmodel);
+	walktime += Sys_DoubleTime() - starttime;
+	walkcalls++;
 
 	//draw the world sky
 	if (r_skyboxloaded)
 		R_DrawSkyBox ();
 	else
-		R_DrawSkyChain ();
+		R_DrawSkyChain (cl.worldmodel);
 
 	R_DrawEntitiesOnList (&cl_firstpassents);
 
@@ -1581,58 +1667,77 @@ void R_DrawWorld (void)
 
 void R_MarkLeaves (void)
 {
-	byte *vis;
-	mnode_t *node;
-	int i;
-	byte solid[MAX_MAP_LEAFS/8];
+	static unsigned long solid[PVSCACHE_ROWBYTES(MAX_MAP_LEAFS) / sizeof(unsigned long)];
+	static unsigned long lastvis[PVSCACHE_ROWBYTES(MAX_MAP_LEAFS) / sizeof(unsigned long)];
+	static model_t *lastvismodel;
+	const unsigned long *vis, *vis2;
+	unsigned long bits;
+	mleaf_t *leaf;
+	unsigned int *nodevisible;
+	unsigned int i, numwords, leafnum, nodenum;
+	int samemap;
 
 	if (!r_novis.value && r_oldviewleaf == r_viewleaf
 		&& r_oldviewleaf2 == r_viewleaf2)	// watervis hack
 		return;
 
-	r_visframecount++;
+	// r_oldviewleaf is cleared by R_NewMap
+	samemap = r_oldviewleaf && lastvismodel == cl.worldmodel;
 	r_oldviewleaf = r_viewleaf;
 
+	numwords = PVSCACHE_ROWBYTES(cl.worldmodel->numleafs) / sizeof(unsigned long);
+
 	if (r_novis.value)
 	{
 		vis = solid;
-		memset (solid, 0xff, (cl.worldmodel->numleafs + 7) >> 3);
+		memset (solid, 0xff, numwords * sizeof(*solid));
 	}
 	else
 	{
-		vis = Mod_LeafPVS (r_viewleaf, cl.worldmodel);
+		vis = (unsigned long *)Mod_LeafPVS (r_viewleaf, cl.worldmodel);
 
 		if (r_viewleaf2)
 		{
-			int			i, count;
-			unsigned	*src, *dest;
-
 			// merge visibility data for two leafs
-			count = (cl.worldmodel->numleafs + 7) >> 3;
-			memcpy (solid, vis, count);
-			src = (unsigned *) Mod_LeafPVS (r_viewleaf2, cl.worldmodel);
-			dest = (unsigned *) solid;
-			count = (count + 3) >> 2;
-			for (i = 0; i < count; i++)
-				*dest++ |= *src++;
+			vis2 = (unsigned long *)Mod_LeafPVS (r_viewleaf2, cl.worldmodel);
+			for (i = 0; i < numwords; i++)
+				solid[i] = vis[i] | vis2[i];
 			vis = solid;
 		}
 	}
 
-	for (i = 0; i < cl.worldmodel->numleafs; i++)
+	// neighbouring leafs often see exactly the same set of leafs
+	if (samemap && memcmp(vis, lastvis, numwords * sizeof(*vis)) == 0)
+		return;
+
+	memcpy(lastvis, vis, numwords * sizeof(*vis));
+	lastvismodel = cl.worldmodel;
+
+	r_visframecount++;
+
+	nodevisible = cl.worldmodel->nodevisible;
+	memset(nodevisible, 0, ((cl.worldmodel->numnodes+31)/32) * sizeof(*nodevisible));
+
+	// only visit the set bits, a word at a time
+	for (i = 0; i < numwords; i++)
 	{
-		if (vis[i >> 3] & (1 << (i & 7)))
+		bits = vis[i];
+		while (bits)
 		{
-			node = (mnode_t *)&cl.worldmodel->leafs[i + 1];
-			while(1)
-			{
-				if (node->visframe == r_visframecount)
-					break;
-				node->visframe = r_visframecount;
-				if (node->parentnum == 0xffff)
-					break;
+			leafnum = i * (sizeof(bits) * 8) + __builtin_ctzl(bits);
+			bits &= bits - 1;
+
+			if (leafnum >= cl.worldmodel->numleafs)
+				break;
 
-				node = NODENUM_TO_NODE(cl.worldmodel, node->parentnum);
+			leaf = &cl.worldmodel->leafs[leafnum + 1];
+			leaf->visframe = r_visframecount;
+
+			nodenum = leaf->parentnum;
+			while (nodenum != 0xffff && !(nodevisible[nodenum/32] & (1<<(nodenum%32))))
+			{
+				nodevisible[nodenum/32] |= 1<<(nodenum%32);
+				nodenum = cl.worldmodel->nodes[nodenum].parentnum;
 			}
 		}
 	}
@@ -1762,22 +1867,37 @@ static void BuildSurfaceDisplayList(model_t *model, msurface_t *fa)
 	poly->numverts = lnumverts;
 }
 
-static void GL_CreateSurfaceLightmap (msurface_t *surf)
+static int GL_SurfaceHasLightmap(model_t *model, unsigned int surfnum)
+{
+	if (model->surfflags[surfnum] & (SURF_DRAWTURB | SURF_DRAWSKY))
+		return 0;
+	if (model->surfaces[surfnum].texinfo->flags & TEX_SPECIAL)
+		return 0;
+
+	return 1;
+}
+
+static void GL_AllocSurfaceLightmap(msurface_t *surf)
 {
 	int smax, tmax;
-	byte *base;
 
 	smax = (surf->extents[0] >> 4) + 1;
 	tmax = (surf->extents[1] >> 4) + 1;
 
 	if (smax > BLOCK_WIDTH)
-		Host_Error("GL_CreateSurfaceLightmap: smax = %d > BLOCK_WIDTH", smax);
+		Host_Error("GL_AllocSurfaceLightmap: smax = %d > BLOCK_WIDTH", smax);
 	if (tmax > BLOCK_HEIGHT)
-		Host_Error("GL_CreateSurfaceLightmap: tmax = %d > BLOCK_HEIGHT", tmax);
+		Host_Error("GL_AllocSurfaceLightmap: tmax = %d > BLOCK_HEIGHT", tmax);
 	if (smax * tmax > MAX_LIGHTMAP_SIZE)
-		Host_Error("GL_CreateSurfaceLightmap: smax * tmax = %d > MAX_LIGHTMAP_SIZE", smax * tmax);
+		Host_Error("GL_AllocSurfaceLightmap: smax * tmax = %d > MAX_LIGHTMAP_SIZE", smax * tmax);
 
 	surf->lightmaptexturenum = AllocBlock (smax, tmax, &surf->light_s, &surf->light_t);
+}
+
+static void GL_CreateSurfaceLightmap (msurface_t *surf)
+{
+	byte *base;
+
 	base = lightmaps + surf->lightmaptexturenum * BLOCK_WIDTH * BLOCK_HEIGHT * 3;
 	base += (surf->light_t * BLOCK_WIDTH + surf->light_s) * 3;
 	R_BuildLightMap(surf, base, BLOCK_WIDTH * 3, 0);
@@ -1951,16 +2071,254 @@ static void BuildWarpVBOArrays(model_t *model)
 	}
 }
 
+/*
+ * Packing the surfaces into the lightmap textures is the slow part of
+ * building them, so the resulting layout for a set of brush models is kept
+ * in a file. It holds a header, an entry per model, the allocated heights of
+ * every lightmap texture and an entry per surface, in native byte order.
+ */
+
+#define LIGHTMAPLAYOUT_VERSION 1
+
+struct lightmaplayoutheader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned int blockwidth;
+	unsigned int blockheight;
+	unsigned int maxlightmaps;
+	unsigned int nummodels;
+};
+
+struct lightmaplayoutmodel
+{
+	unsigned int checksum;
+	unsigned int numsurfaces;
+};
+
+struct lightmaplayoutsurface
+{
+	unsigned char texnum;	// 0xff for surfaces without a lightmap
+	unsigned char s;
+	unsigned char t;
+	unsigned char pad;
+};
+
+static unsigned int GL_LightmapLayoutSize(model_t **models, unsigned int nummodels)
+{
+	unsigned int i;
+	unsigned int size;
+
+	size = sizeof(struct lightmaplayoutheader);
+	size += nummodels * sizeof(struct lightmaplayoutmodel);
+	size += MAX_LIGHTMAPS * BLOCK_WIDTH;
+
+	for (i = 0; i < nummodels; i++)
+		size += models[i]->numsurfaces * sizeof(struct lightmaplayoutsurface);
+
+	return size;
+}
+
+static int GL_ApplyLightmapLayout(unsigned char *data, unsigned int size, model_t **models, unsigned int nummodels)
+{
+	struct lightmaplayoutheader *header;
+	struct lightmaplayoutmodel *layoutmodel;
+	struct lightmaplayoutsurface *layoutsurface;
+	unsigned char *layoutallocated;
+	msurface_t *surf;
+	unsigned int i, j;
+	int smax, tmax;
+
+	header = (struct lightmaplayoutheader *)data;
+	if (size < sizeof(*header)
+	 || memcmp(header->magic, "FQLL", 4) != 0
+	 || header->version != LIGHTMAPLAYOUT_VERSION
+	 || header->blockwidth != BLOCK_WIDTH
+	 || header->blockheight != BLOCK_HEIGHT
+	 || header->maxlightmaps != MAX_LIGHTMAPS
+	 || header->nummodels != nummodels
+	 || size != GL_LightmapLayoutSize(models, nummodels))
+		return 0;
+
+	layoutmodel = (struct lightmaplayoutmodel *)(header + 1);
+	for (i = 0; i < nummodels; i++)
+	{
+		if (layoutmodel[i].checksum != models[i]->checksum || layoutmodel[i].numsurfaces != models[i]->numsurfaces)
+			return 0;
+	}
+
+	layoutallocated = (unsigned char *)(layoutmodel + nummodels);
+	for (i = 0; i < MAX_LIGHTMAPS * BLOCK_WIDTH; i++)
+	{
+		if (layoutallocated[i] > BLOCK_HEIGHT)
+			return 0;
+	}
+
+	// check everything before touching any surface
+	layoutsurface = (struct lightmaplayoutsurface *)(layoutallocated + MAX_LIGHTMAPS * BLOCK_WIDTH);
+	for (i = 0; i < nummodels; i++)
+	{
+		for (j = 0; j < models[i]->numsurfaces; j++, layoutsurface++)
+		{
+			if (!GL_SurfaceHasLightmap(models[i], j))
+			{
+				if (layoutsurface->texnum != 0xff)
+					return 0;
+
+				continue;
+			}
+
+			surf = models[i]->surfaces + j;
+			smax = (surf->extents[0] >> 4) + 1;
+			tmax = (surf->extents[1] >> 4) + 1;
+
+			if (layoutsurface->texnum >= MAX_LIGHTMAPS
+			 || smax * tmax > MAX_LIGHTMAP_SIZE
+			 || layoutsurface->s + smax > BLOCK_WIDTH
+			 || layoutsurface->t + tmax > BLOCK_HEIGHT)
+				return 0;
+		}
+	}
+
+	for (i = 0; i < MAX_LIGHTMAPS; i++)
+	{
+		for (j = 0; j < BLOCK_WIDTH; j++)
+			allocated[i][j] = layoutallocated[i * BLOCK_WIDTH + j];
+	}
+
+	layoutsurface = (struct lightmaplayoutsurface *)(layoutallocated + MAX_LIGHTMAPS * BLOCK_WIDTH);
+	for (i = 0; i < nummodels; i++)
+	{
+		for (j = 0; j < models[i]->numsurfaces; j++, layoutsurface++)
+		{
+			if (layoutsurface->texnum == 0xff)
+				continue;
+
+			surf = models[i]->surfaces + j;
+			surf->lightmaptexturenum = layoutsurface->texnum;
+			surf->light_s = layoutsurface->s;
+			surf->light_t = layoutsurface->t;
+		}
+	}
+
+	return 1;
+}
+
+static int GL_LoadLightmapLayout(const char *filename, model_t **models, unsigned int nummodels)
+{
+	unsigned char *data;
+	long size;
+	FILE *f;
+	int ret;
+
+	f = fopen(filename, "rb");
+	if (f == 0)
+		return 0;
+
+	ret = 0;
+	data = 0;
+
+	if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0 && size == GL_LightmapLayoutSize(models, nummodels) && fseek(f, 0, SEEK_SET) == 0)
+	{
+		data = malloc(size);
+		if (data && fread(data, 1, size, f) == size)
+			ret = GL_ApplyLightmapLayout(data, size, models, nummodels);
+	}
+
+	fclose(f);
+	free(data);
+
+	return ret;
+}
+
+static void GL_SaveLightmapLayout(const char *filename, model_t **models, unsigned int nummodels)
+{
+	struct lightmaplayoutheader *header;
+	struct lightmaplayoutmodel *layoutmodel;
+	struct lightmaplayoutsurface *layoutsurface;
+	unsigned char *layoutallocated;
+	unsigned char *data;
+	msurface_t *surf;
+	unsigned int i, j, size;
+	FILE *f;
+
+	size = GL_LightmapLayoutSize(models, nummodels);
+	data = malloc(size);
+	if (data == 0)
+		return;
+
+	header = (struct lightmaplayoutheader *)data;
+	memcpy(header->magic, "FQLL", 4);
+	header->version = LIGHTMAPLAYOUT_VERSION;
+	header->blockwidth = BLOCK_WIDTH;
+	header->blockheight = BLOCK_HEIGHT;
+	header->maxlightmaps = MAX_LIGHTMAPS;
+	header->nummodels = nummodels;
+
+	layoutmodel = (struct lightmaplayoutmodel *)(header + 1);
+	for (i = 0; i < nummodels; i++)
+	{
+		layoutmodel[i].checksum = models[i]->checksum;
+		layoutmodel[i].numsurfaces = models[i]->numsurfaces;
+	}
+
+	layoutallocated = (unsigned char *)(layoutmodel + nummodels);
+	for (i = 0; i < MAX_LIGHTMAPS; i++)
+	{
+		for (j = 0; j < BLOCK_WIDTH; j++)
+			layoutallocated[i * BLOCK_WIDTH + j] = allocated[i][j];
+	}
+
+	layoutsurface = (struct lightmaplayoutsurface *)(layoutallocated + MAX_LIGHTMAPS * BLOCK_WIDTH);
+	for (i = 0; i < nummodels; i++)
+	{
+		for (j = 0; j < models[i]->numsurfaces; j++, layoutsurface++)
+		{
+			surf = models[i]->surfaces + j;
+
+			if (GL_SurfaceHasLightmap(models[i], j))
+			{
+				layoutsurface->texnum = surf->lightmaptexturenum;
+				layoutsurface->s = surf->light_s;
+				layoutsurface->t = surf->light_t;
+			}
+			else
+			{
+				layoutsurface->texnum = 0xff;
+				layoutsurface->s = 0;
+				layoutsurface->t = 0;
+			}
+			layoutsurface->pad = 0;
+		}
+	}
+
+	Sys_IO_Create_Directory(va("%s/fodquake/lightmaps", com_basedir));
+
+	f = fopen(filename, "wb");
+	if (f)
+	{
+		if (fwrite(data, 1, size, f) != size)
+			Com_Printf("Failed to write %s\n", filename);
+
+		fclose(f);
+	}
+
+	free(data);
+}
+
 //Builds the lightmap texture with all the surfaces from all brush models
 void GL_BuildLightmaps (void)
 {
+	model_t *models[MAX_MODELS];
+	unsigned int nummodels;
+	char mapname[MAX_QPATH];
+	char filename[MAX_OSPATH + MAX_QPATH + 32];
 	int i, j;
 	model_t	*m;
 
-	memset (allocated, 0, sizeof(allocated));
-
 	r_framecount = 1;		// no dlightcache
 
+	nummodels = 0;
 	for (j = 1; j < MAX_MODELS; j++)
 	{
 		if (!(m = cl.model_precache[j]))
@@ -1970,11 +2328,40 @@ void GL_BuildLightmaps (void)
 		if (m->type != mod_brush)
 			continue;
 
+		models[nummodels++] = m;
+	}
+
+	filename[0] = 0;
+	if (gl_lightmapcache.value && nummodels)
+	{
+		COM_CopyAndStripExtension(COM_SkipPath(models[0]->name), mapname, sizeof(mapname));
+		snprintf(filename, sizeof(filename), "%s/fodquake/lightmaps/%s.layout", com_basedir, mapname);
+	}
+
+	if (!filename[0] || !GL_LoadLightmapLayout(filename, models, nummodels))
+	{
+		memset (allocated, 0, sizeof(allocated));
+
+		for (j = 0; j < nummodels; j++)
+		{
+			m = models[j];
+			for (i = 0; i < m->numsurfaces; i++)
+			{
+				if (GL_SurfaceHasLightmap(m, i))
+					GL_AllocSurfaceLightmap(m->surfaces + i);
+			}
+		}
+
+		if (filename[0])
+			GL_SaveLightmapLayout(filename, models, nummodels);
+	}
+
+	for (j = 0; j < nummodels; j++)
+	{
+		m = models[j];
 		for (i = 0; i < m->numsurfaces; i++)
 		{
-			if (m->surfflags[i] & (SURF_DRAWTURB | SURF_DRAWSKY))
-				continue;
-			if (m->surfaces[i].texinfo->flags & TEX_SPECIAL)
+			if (!GL_SurfaceHasLightmap(m, i))
 				continue;
 			GL_CreateSurfaceLightmap(m->surfaces + i);
 			BuildSurfaceDisplayList(m, m->surfaces + i);
@@ -41,10 +41,11 @@ static int GL_CompileShader(GLenum type, const char *shader)
 	return object;
 }
 
-int GL_SetupShaderProgram(int vertexobject, const char *vertexshader, int fragmentobject, const char *fragmentshader)
+int GL_SetupShaderProgram(int vertexobject, const char *vertexshader, int fragmentobject, const char *fragmentshader, const char * const *attributes)
 {
 	int programobject;
 	int linked;
+	unsigned int i;
 
 	if ((vertexobject && vertexshader) || (fragmentobject && fragmentshader))
 		return 0;
@@ -81,6 +82,12 @@ int GL_SetupShaderProgram(int vertexobject, const char *vertexshader, int fragme
 	if (!programobject)
 		return 0;
 
+	if (attributes)
+	{
+		for(i=0;attributes[i];i++)
+			qglBindAttribLocation(programobject, i, attributes[i]);
+	}
+
 	qglLinkProgram(programobject);
 	qglGetProgramiv(programobject, GL_LINK_STATUS, &linked);
 
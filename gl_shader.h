@@ -2,5 +2,7 @@
 int GL_Shader_Init(void);
 void GL_Shader_Shutdown(void);
 
-int GL_SetupShaderProgram(int vertexobject, const char *vertexshader, int fragmentobject, const char *fragmentshader);
+/* attributes is an optional 0 terminated list of vertex attribute names,
+ * bound to generic attribute 0, 1, 2... in that order. */
+int GL_SetupShaderProgram(int vertexobject, const char *vertexshader, int fragmentobject, const char *fragmentshader, const char * const *attributes);
 
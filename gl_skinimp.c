@@ -49,16 +49,27 @@ struct SkinImp *SkinImp_CreateSolidColour(float *colours)
 
 #define ISPOT(x) (((x) & -(x)) == (x))
 
-struct SkinImp *SkinImp_CreateTexturePaletted(void *data, unsigned int width, unsigned int height, unsigned int modulo)
+struct SkinImpData
 {
-	struct SkinImp *skinimp;
-	unsigned int *skinmem;
+	unsigned int width;
+	unsigned int height;
+	unsigned int *pixels;
+	unsigned int *fbpixels;
+};
+
+struct SkinImpData *SkinImp_PrepareTexturePaletted(void *data, unsigned int width, unsigned int height, unsigned int modulo)
+{
+	struct SkinImpData *skinimpdata;
 	unsigned char *src;
 	unsigned int *dst;
+	unsigned int *fbdst;
 	unsigned int x;
 	unsigned int y;
 	unsigned int dofullbright;
 
+	if (!gl_npot && !(ISPOT(width) && ISPOT(height)))
+		return 0;
+
 	dofullbright = 0;
 	src = data;
 	for(y=0;y<height;y++)
@@ -78,69 +89,103 @@ struct SkinImp *SkinImp_CreateTexturePaletted(void *data, unsigned int width, un
 		src += modulo;
 	}
 
-	skinimp = malloc(sizeof(*skinimp));
-	if (skinimp)
+	skinimpdata = malloc(sizeof(*skinimpdata));
+	if (skinimpdata)
 	{
-		if (gl_npot || (ISPOT(width) && ISPOT(height)))
+		skinimpdata->width = width;
+		skinimpdata->height = height;
+		skinimpdata->fbpixels = 0;
+
+		skinimpdata->pixels = malloc(width*height*4*(dofullbright?2:1));
+		if (skinimpdata->pixels)
 		{
-			skinmem = malloc(width*height*4);
-			if (skinmem)
+			if (dofullbright)
+				skinimpdata->fbpixels = skinimpdata->pixels + width*height;
+
+			src = data;
+			dst = skinimpdata->pixels;
+			fbdst = skinimpdata->fbpixels;
+
+			for(y=0;y<height;y++)
 			{
-				src = data;
-				dst = skinmem;
+				for(x=0;x<width;x++)
+				{
+					dst[x] = d_8to24table[src[x]];
+				}
 
-				for(y=0;y<height;y++)
+				if (fbdst)
 				{
 					for(x=0;x<width;x++)
 					{
-						dst[x] = d_8to24table[src[x]];
+						fbdst[x] = src[x] >= 224 ? dst[x] : 0;
 					}
 
-					src += modulo;
-					dst += width;
+					fbdst += width;
 				}
 
-				skinimp->texid = texture_extension_number++;
+				src += modulo;
+				dst += width;
+			}
 
-				GL_Bind(skinimp->texid);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, skinmem);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			return skinimpdata;
+		}
 
-				if (dofullbright)
-				{
-					src = data;
-					dst = skinmem;
+		free(skinimpdata);
+	}
 
-					for(y=0;y<height;y++)
-					{
-						for(x=0;x<width;x++)
-						{
-							if (src[x] < 224)
-								dst[x] = 0;
-						}
-
-						src += modulo;
-						dst += width;
-					}
+	return 0;
+}
 
-					skinimp->fbtexid = texture_extension_number++;
+struct SkinImp *SkinImp_CreateFromData(struct SkinImpData *skinimpdata)
+{
+	struct SkinImp *skinimp;
 
-					GL_Bind(skinimp->fbtexid);
-					glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, skinmem);
-					glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-					glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-				}
-				else
-					skinimp->fbtexid = 0;
+	skinimp = malloc(sizeof(*skinimp));
+	if (skinimp)
+	{
+		skinimp->texid = texture_extension_number++;
 
-				free(skinmem);
+		GL_Bind(skinimp->texid);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, skinimpdata->width, skinimpdata->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, skinimpdata->pixels);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-				return skinimp;
-			}
+		if (skinimpdata->fbpixels)
+		{
+			skinimp->fbtexid = texture_extension_number++;
+
+			GL_Bind(skinimp->fbtexid);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, skinimpdata->width, skinimpdata->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, skinimpdata->fbpixels);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		}
+		else
+			skinimp->fbtexid = 0;
 
-		free(skinimp);
+		return skinimp;
+	}
+
+	return 0;
+}
+
+void SkinImp_FreeData(struct SkinImpData *skinimpdata)
+{
+	free(skinimpdata->pixels);
+	free(skinimpdata);
+}
+
+struct SkinImp *SkinImp_CreateTexturePaletted(void *data, unsigned int width, unsigned int height, unsigned int modulo)
+{
+	struct SkinImpData *skinimpdata;
+	struct SkinImp *skinimp;
+
+	skinimpdata = SkinImp_PrepareTexturePaletted(data, width, height, modulo);
+	if (skinimpdata)
+	{
+		skinimp = SkinImp_CreateFromData(skinimpdata);
+		SkinImp_FreeData(skinimpdata);
+
+		return skinimp;
 	}
 
 	return 0;
@@ -175,6 +220,8 @@ struct SkinImp *SkinImp_CreateTextureTruecolour(void *data, unsigned int width,
 void SkinImp_Destroy(struct SkinImp *skinimp)
 {
 	glDeleteTextures(1, &skinimp->texid);
+	if (skinimp->fbtexid)
+		glDeleteTextures(1, &skinimp->fbtexid);
 	free(skinimp);
 }
 
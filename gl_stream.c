@@ -0,0 +1,107 @@
+/*
+Copyright (C) 2026 Fodquake developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include <stddef.h>
+
+#include "gl_local.h"
+#include "gl_state.h"
+#include "gl_stream.h"
+
+static struct StreamVertex streamvertices[STREAMVERTICES] __attribute__((aligned(64)));
+static unsigned int numstreamvertices;
+static GLenum streammode;
+static int streamtextured;
+static int stream_vbo_number;
+static unsigned int streamdraws;
+
+void GL_Stream_Init(void)
+{
+	numstreamvertices = 0;
+
+	if (gl_vbo)
+		stream_vbo_number = vbo_number++;
+	else
+		stream_vbo_number = 0;
+}
+
+static void GL_Stream_Flush(void)
+{
+	const char *base;
+
+	if (numstreamvertices == 0)
+		return;
+
+	if (stream_vbo_number)
+	{
+		/* Respecifying the buffer lets the driver hand out fresh storage
+		 * instead of waiting for the previous draw from it to finish. */
+		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, stream_vbo_number);
+		qglBufferDataARB(GL_ARRAY_BUFFER_ARB, numstreamvertices * sizeof(*streamvertices), streamvertices, GL_STREAM_DRAW_ARB);
+		base = 0;
+	}
+	else
+		base = (const char *)streamvertices;
+
+	GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_COLOR_ARRAY | (streamtextured ? FQ_GL_TEXTURE_COORD_ARRAY : 0));
+	GL_VertexPointer(3, GL_FLOAT, sizeof(*streamvertices), base + offsetof(struct StreamVertex, xyz));
+	GL_ColorPointer(4, GL_UNSIGNED_BYTE, sizeof(*streamvertices), base + offsetof(struct StreamVertex, colour));
+	if (streamtextured)
+		GL_TexCoordPointer(0, 2, GL_FLOAT, sizeof(*streamvertices), base + offsetof(struct StreamVertex, st));
+
+	if (stream_vbo_number)
+		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+
+	glDrawArrays(streammode, 0, numstreamvertices);
+
+	streamdraws++;
+
+	numstreamvertices = 0;
+}
+
+void GL_Stream_Begin(GLenum mode, int textured)
+{
+	streammode = mode;
+	streamtextured = textured;
+	numstreamvertices = 0;
+	streamdraws = 0;
+}
+
+struct StreamVertex *GL_Stream_GetVertices(unsigned int count)
+{
+	struct StreamVertex *ret;
+
+	if (numstreamvertices + count > STREAMVERTICES)
+		GL_Stream_Flush();
+
+	ret = streamvertices + numstreamvertices;
+	numstreamvertices += count;
+
+	return ret;
+}
+
+unsigned int GL_Stream_End(void)
+{
+	GL_Stream_Flush();
+
+	/* Leave the colour array off so later glColor calls take effect */
+	GL_SetArrays(FQ_GL_VERTEX_ARRAY);
+
+	return streamdraws;
+}
+
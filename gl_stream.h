@@ -0,0 +1,22 @@
+/* Vertices for geometry that is rebuilt every frame, such as particles.
+ * Between GL_Stream_Begin() and GL_Stream_End() the caller fills the
+ * vertices returned by GL_Stream_GetVertices(), and everything is drawn
+ * with as few draw calls as the buffer size allows. Any GL state the
+ * geometry depends on must not be changed between Begin and End. */
+
+struct StreamVertex
+{
+	float xyz[3];
+	float st[2];
+	unsigned char colour[4];
+};
+
+#define STREAMVERTICES 8192
+
+void GL_Stream_Init(void);
+void GL_Stream_Begin(GLenum mode, int textured);
+/* count must be a whole number of primitives and no more than STREAMVERTICES */
+struct StreamVertex *GL_Stream_GetVertices(unsigned int count);
+/* Returns the number of draw calls made since GL_Stream_Begin() */
+unsigned int GL_Stream_End(void);
+
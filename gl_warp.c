@@ -32,6 +32,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "utils.h"
 
 static int waterprogram;
+static int waterprogram_cltime;
+static int skyprogram;
+static int skyprogram_origin;
+static int skyprogram_speedscale;
+static int causticsprogram;
+static int causticsprogram_cltime;
 
 static char sky_initialised;
 
@@ -48,6 +54,7 @@ qboolean r_skyboxloaded;
 static qboolean OnChange_r_skyname(cvar_t *v, char *s);
 cvar_t r_skyname = { "r_skyname", "", 0, OnChange_r_skyname };
 cvar_t gl_water_program = { "gl_water_program", "1" };
+cvar_t gl_sky_program = { "gl_sky_program", "1" };
 
 static void BoundPoly(int numverts, float *verts, vec3_t mins, vec3_t maxs)
 {
@@ -253,7 +260,6 @@ void EmitWaterPolys(model_t *model, msurface_t *fa)
 {
 	struct glwarppoly *p;
 	float *v, s, t, os, ot;
-	int cltimeloc;
 	int i;
 
 	GL_DisableMultitexture();
@@ -275,8 +281,7 @@ void EmitWaterPolys(model_t *model, msurface_t *fa)
 	{
 		GL_Bind (fa->texinfo->texture->gl_texturenum);
 		qglUseProgram(waterprogram);
-		cltimeloc = qglGetUniformLocation(waterprogram, "cltime");
-		qglUniform1f(cltimeloc, cl.time * (20.0/64.0));
+		qglUniform1f(waterprogram_cltime, cl.time * (20.0/64.0));
 
 		if (model->warp_vbo_number)
 			EmitShaderVBOPoly(model, fa);
@@ -311,6 +316,26 @@ void EmitWaterPolys(model_t *model, msurface_t *fa)
 	}
 }
 
+/* The sky program works out the sky texture coordinates per pixel from the
+ * world position, which is passed in as the texture coordinate. */
+static void EmitSkyShaderPoly(msurface_t *fa)
+{
+	GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
+	GL_VertexPointer(3, GL_FLOAT, 0, fa->fastpolys);
+	GL_TexCoordPointer(0, 3, GL_FLOAT, 0, fa->fastpolys);
+	glDrawArrays(GL_POLYGON, 0, fa->numedges);
+}
+
+static void EmitSkyShaderVBOPoly(model_t *model, msurface_t *fa)
+{
+	GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
+	qglBindBufferARB(GL_ARRAY_BUFFER_ARB, model->warp_vbo_number);
+	GL_VertexPointer(3, GL_FLOAT, 0, (void *)(intptr_t)(fa->fastpolyfirstindex*3*4));
+	GL_TexCoordPointer(0, 3, GL_FLOAT, 0, (void *)(intptr_t)(fa->fastpolyfirstindex*3*4));
+	glDrawArrays(GL_TRIANGLE_FAN, 0, fa->numedges);
+	qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+}
+
 static void EmitSkyPolys(msurface_t *fa, qboolean mtex)
 {
 	struct glwarppoly *p;
@@ -363,10 +388,12 @@ static void EmitSkyPolys(msurface_t *fa, qboolean mtex)
 }
 
 
-void R_DrawSkyChain(void)
+void R_DrawSkyChain(model_t *model)
 {
 	msurface_t *fa;
 	byte *col;
+	float origin[4];
+	float speedscales[4];
 
 	if (!skychain)
 		return;
@@ -386,6 +413,40 @@ void R_DrawSkyChain(void)
 		glEnable (GL_TEXTURE_2D);
 		glColor3ubv (color_white);
 	}
+	else if (skyprogram && gl_mtexable)
+	{
+		GL_Bind (solidskytexture);
+		GL_EnableMultitexture();
+		GL_Bind (alphaskytexture);
+
+		origin[0] = r_origin[0];
+		origin[1] = r_origin[1];
+		origin[2] = r_origin[2];
+		origin[3] = 0;
+
+		speedscales[0] = cl.time * 8;
+		speedscales[0] -= (int) speedscales[0] & ~127;
+		speedscales[1] = cl.time * 16;
+		speedscales[1] -= (int) speedscales[1] & ~127;
+		speedscales[2] = 0;
+		speedscales[3] = 0;
+
+		qglUseProgram(skyprogram);
+		qglUniform4fv(skyprogram_origin, 1, origin);
+		qglUniform4fv(skyprogram_speedscale, 1, speedscales);
+
+		for (fa = skychain; fa; fa = fa->texturechain)
+		{
+			if (model->warp_vbo_number)
+				EmitSkyShaderVBOPoly(model, fa);
+			else
+				EmitSkyShaderPoly(fa);
+		}
+
+		qglUseProgram(0);
+
+		GL_DisableMultitexture();
+	}
 	else
 	{
 		if (gl_mtexable)
@@ -744,6 +805,17 @@ static void R_AddSkyBoxSurface(msurface_t *fa)
 	vec3_t verts[MAX_CLIP_VERTS];
 	struct glwarppoly *p;
 
+	// The bounds only depend on the outline of the surface, so clip the
+	// unsubdivided polygon when it leaves room for the 6 clip planes to
+	// add a vertex each.
+	if (fa->numedges <= MAX_CLIP_VERTS - 2 - 6)
+	{
+		for (i = 0; i < fa->numedges; i++)
+			VectorSubtract (fa->fastpolys + i * 3, r_origin, verts[i]);
+		ClipSkyPolygon (fa->numedges, verts[0], 0);
+		return;
+	}
+
 	// calculate vertex values for sky box
 	for (p = fa->warppolys; p; p = p->next)
 	{
@@ -869,17 +941,35 @@ void EmitCausticsPolys(void)
 	glBlendFunc(GL_DST_COLOR, GL_SRC_COLOR);
 	GL_SetAlphaTestBlend(0, 1);
 
-	for (p = caustics_polys; p; p = p->caustics_chain)
+	if (causticsprogram)
+	{
+		qglUseProgram(causticsprogram);
+		qglUniform1f(causticsprogram_cltime, cl.time);
+
+		GL_SetArrays(FQ_GL_VERTEX_ARRAY | FQ_GL_TEXTURE_COORD_ARRAY);
+		for (p = caustics_polys; p; p = p->caustics_chain)
+		{
+			GL_VertexPointer(3, GL_FLOAT, VERTEXSIZE * sizeof(float), p->verts[0]);
+			GL_TexCoordPointer(0, 2, GL_FLOAT, VERTEXSIZE * sizeof(float), p->verts[0] + 3);
+			glDrawArrays(GL_POLYGON, 0, p->numverts);
+		}
+
+		qglUseProgram(0);
+	}
+	else
 	{
-		glBegin(GL_POLYGON);
-		for (i = 0, v = p->verts[0]; i < p->numverts; i++, v += VERTEXSIZE)
+		for (p = caustics_polys; p; p = p->caustics_chain)
 		{
-			CalcCausticTexCoords(v, &s, &t);
+			glBegin(GL_POLYGON);
+			for (i = 0, v = p->verts[0]; i < p->numverts; i++, v += VERTEXSIZE)
+			{
+				CalcCausticTexCoords(v, &s, &t);
 
-			glTexCoord2f(s, t);
-			glVertex3fv(v);
+				glTexCoord2f(s, t);
+				glVertex3fv(v);
+			}
+			glEnd();
 		}
-		glEnd();
 	}
 
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
@@ -893,6 +983,7 @@ void GL_Warp_CvarInit()
 	Cvar_SetCurrentGroup(CVAR_GROUP_TURB);
 	Cvar_Register(&r_skyname);
 	Cvar_Register(&gl_water_program);
+	Cvar_Register(&gl_sky_program);
 	Cvar_ResetCurrentGroup();
 }
 
@@ -922,7 +1013,67 @@ void GL_Warp_Init()
 		"gl_FragColor = texture2D(mytex, vec2(s, t));\n"
 		"}\n";
 
-		waterprogram = GL_SetupShaderProgram(0, 0, 0, prog);
+		waterprogram = GL_SetupShaderProgram(0, 0, 0, prog, 0);
+		if (waterprogram)
+			waterprogram_cltime = qglGetUniformLocation(waterprogram, "cltime");
+	}
+
+	/* Same warp as CalcCausticTexCoords(), SINTABLE_APPROX(x) being 8 * sin(x) */
+	if (gl_fs && gl_water_program.value)
+	{
+		const char *prog = "#version 120\n"
+		"uniform sampler2D mytex;\n"
+		"uniform float cltime;\n"
+		"void main(void)\n"
+		"{\n"
+		"vec2 mycoords;\n"
+		"vec4 colour;\n"
+		"float s;\n"
+		"float t;\n"
+		"mycoords = vec2(gl_TexCoord[0]);\n"
+		"s = (mycoords[0] + 8.0 * sin(0.465 * (cltime + mycoords[1]))) * (-3.0 * 0.5 / 64.0);\n"
+		"t = (mycoords[1] + 8.0 * sin(0.465 * (cltime + mycoords[0]))) * (-3.0 * 0.5 / 64.0);\n"
+		"colour = texture2D(mytex, vec2(s, t));\n"
+		"gl_FragColor = vec4(mix(gl_Color.rgb, colour.rgb, colour.a), gl_Color.a);\n"
+		"}\n";
+
+		causticsprogram = GL_SetupShaderProgram(0, 0, 0, prog, 0);
+		if (causticsprogram)
+			causticsprogram_cltime = qglGetUniformLocation(causticsprogram, "cltime");
+	}
+
+	/* Same projection as EmitSkyPolys(), with the alpha layer decaled on top */
+	if (gl_fs && gl_sky_program.value)
+	{
+		const char *prog = "#version 120\n"
+		"uniform sampler2D solidtex;\n"
+		"uniform sampler2D alphatex;\n"
+		"uniform vec4 origin;\n"
+		"uniform vec4 speedscale;\n"
+		"void main(void)\n"
+		"{\n"
+		"vec3 dir;\n"
+		"vec4 solid;\n"
+		"vec4 alpha;\n"
+		"dir = vec3(gl_TexCoord[0]) - vec3(origin);\n"
+		"dir.z *= 3.0;\n"
+		"dir.xy *= (6.0 * 63.0) / length(dir);\n"
+		"solid = texture2D(solidtex, (speedscale[0] + dir.xy) * (1.0 / 128.0));\n"
+		"alpha = texture2D(alphatex, (speedscale[1] + dir.xy) * (1.0 / 128.0));\n"
+		"gl_FragColor = vec4(mix(solid.rgb, alpha.rgb, alpha.a), 1.0);\n"
+		"}\n";
+
+		skyprogram = GL_SetupShaderProgram(0, 0, 0, prog, 0);
+		if (skyprogram)
+		{
+			skyprogram_origin = qglGetUniformLocation(skyprogram, "origin");
+			skyprogram_speedscale = qglGetUniformLocation(skyprogram, "speedscale");
+
+			qglUseProgram(skyprogram);
+			qglUniform1i(qglGetUniformLocation(skyprogram, "solidtex"), 0);
+			qglUniform1i(qglGetUniformLocation(skyprogram, "alphatex"), 1);
+			qglUseProgram(0);
+		}
 	}
 }
 
@@ -933,5 +1084,17 @@ void GL_Warp_Shutdown()
 		qglDeleteProgram(waterprogram);
 		waterprogram = 0;
 	}
+
+	if (causticsprogram)
+	{
+		qglDeleteProgram(causticsprogram);
+		causticsprogram = 0;
+	}
+
+	if (skyprogram)
+	{
+		qglDeleteProgram(skyprogram);
+		skyprogram = 0;
+	}
 }
 
@@ -26,6 +26,7 @@ qboolean Log_IsLogging(void);
 void Log_CvarInit(void);
 void Log_Shutdown(void);
 void Log_Write(const char *s);
+void Log_Frame(void);
 
 void Log_AutoLogging_StopMatch(void);
 void Log_AutoLogging_CancelMatch(void);
@@ -7,6 +7,7 @@
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -17,6 +18,31 @@
 
 #define LUAF_PLAYER_STATS (1 << 0)
 
+/* The budget hook runs every this many VM instructions */
+#define LUA_HOOK_INSTRUCTIONS 1000
+
+#define LUA_PROFILE_HASHSIZE 64
+#define LUA_PROFILE_MAXDEPTH 64
+
+struct lua_profile_entry
+{
+	struct lua_profile_entry *next;
+	const void *source;
+	const char *cname;
+	int linedefined;
+	char *label;
+	unsigned int calls;
+	double time;
+	unsigned int allocs;
+	size_t allocbytes;
+};
+
+struct lua_profile_frame
+{
+	struct lua_profile_entry *entry;
+	double start;
+};
+
 struct L_lua_states
 {
 	lua_State *L;
@@ -26,6 +52,35 @@ struct L_lua_states
 	int flags;
 	int player_update_frame;
 	struct L_lua_states *next, *prev;
+
+	/* Budget accounting, reset every frame */
+	int budget_frame;
+	unsigned int calldepth;
+	unsigned int instructions;
+	double timeused;
+	double callstart;
+	double deadline;
+
+	/* Profiling */
+	lua_Alloc allocf;
+	void *allocud;
+	unsigned int allocs;
+	size_t allocbytes;
+	struct lua_profile_entry *profile[LUA_PROFILE_HASHSIZE];
+	struct lua_profile_frame profilestack[LUA_PROFILE_MAXDEPTH];
+	unsigned int profiledepth;
+	unsigned int profilebase;
+	unsigned int profileoverflow;
+};
+
+struct lua_task
+{
+	struct lua_task *next;
+	struct L_lua_states *l;
+	lua_State *thread;
+	int ref;
+	int nargs;
+	double wakeup;
 };
 
 struct lua_rmf
@@ -33,6 +88,7 @@ struct lua_rmf
 	lua_State *L;
 	char *function;
 	struct L_lua_states *l;
+	int removed;
 };
 
 static const char * const lua_helpers[] = {"keys", "macro", "split", "ui", "variables", NULL};
@@ -53,8 +109,34 @@ static int lua_frame_function_list_count;
 
 static struct lua_rmf lua_key_function;
 
+enum
+{
+	LUA_EVENT_STAT,
+	LUA_EVENT_PLAYER_ENTER,
+	LUA_EVENT_PLAYER_LEAVE,
+	LUA_EVENT_FRAG,
+	LUA_EVENT_MAP_CHANGE,
+	LUA_EVENT_DEMO_SEEK,
+	LUA_NUM_EVENTS
+};
+
+static const char * const lua_event_names[LUA_NUM_EVENTS] = {"stat", "player_enter", "player_leave", "frag", "map_change", "demo_seek"};
+
+static struct lua_rmf **lua_event_function_lists[LUA_NUM_EVENTS];
+static int lua_event_function_list_counts[LUA_NUM_EVENTS];
+/* Event functions are only marked as removed while events are being delivered */
+static int lua_event_dispatch_depth;
+
 static struct L_lua_states *L_lua_states = NULL;
 
+static struct L_lua_states *lua_current_state;
+static struct lua_task *lua_tasks;
+static struct lua_task *lua_current_task;
+static int lua_profiling;
+
+cvar_t lua_instruction_budget = {"lua_instruction_budget", "10000000"};
+cvar_t lua_time_budget = {"lua_time_budget", "100"};
+
 #define lua_getglobal(L,s) lua_getfield(L, LUA_GLOBALSINDEX, (s))
 #define lua_tostring(L,i) lua_tolstring(L, (i), NULL)
 #define lua_open() luaL_newstate()
@@ -88,6 +170,301 @@ static struct L_lua_states *Lua_FindStateLS(lua_State *L)
 	return NULL;
 }
 
+/*************************************
+ * Budgets, profiling and scheduling *
+ *************************************/
+
+static struct lua_profile_entry *Lua_ProfileEntry(struct L_lua_states *ls, lua_Debug *ar)
+{
+	struct lua_profile_entry *entry;
+	const void *source;
+	const char *cname;
+	unsigned int hash;
+	char label[256];
+
+	source = ar->source;
+	cname = ar->linedefined < 0 ? ar->name : NULL;
+	hash = ((unsigned int)(size_t)source ^ (unsigned int)(size_t)cname ^ (unsigned int)ar->linedefined * 31) % LUA_PROFILE_HASHSIZE;
+
+	for (entry = ls->profile[hash]; entry; entry = entry->next)
+	{
+		if (entry->source == source && entry->cname == cname && entry->linedefined == ar->linedefined)
+			return entry;
+	}
+
+	entry = malloc(sizeof(*entry));
+	if (entry == NULL)
+		return NULL;
+
+	if (ar->linedefined < 0)
+		snprintf(label, sizeof(label), "%s [C]", ar->name ? ar->name : "?");
+	else
+		snprintf(label, sizeof(label), "%s %s:%d", ar->name ? ar->name : "?", ar->short_src, ar->linedefined);
+
+	memset(entry, 0, sizeof(*entry));
+	entry->source = source;
+	entry->cname = cname;
+	entry->linedefined = ar->linedefined;
+	entry->label = strdup(label);
+	if (entry->label == NULL)
+	{
+		free(entry);
+		return NULL;
+	}
+
+	entry->next = ls->profile[hash];
+	ls->profile[hash] = entry;
+
+	return entry;
+}
+
+static void Lua_FreeProfile(struct L_lua_states *ls)
+{
+	struct lua_profile_entry *entry, *next;
+	int i;
+
+	for (i = 0; i < LUA_PROFILE_HASHSIZE; i++)
+	{
+		for (entry = ls->profile[i]; entry; entry = next)
+		{
+			next = entry->next;
+			free(entry->label);
+			free(entry);
+		}
+
+		ls->profile[i] = NULL;
+	}
+
+	ls->allocs = 0;
+	ls->allocbytes = 0;
+}
+
+static void Lua_ProfileHook(struct L_lua_states *ls, lua_State *L, lua_Debug *ar)
+{
+	struct lua_profile_frame *frame;
+
+	if (ar->event == LUA_HOOKCALL)
+	{
+		if (ls->profiledepth == LUA_PROFILE_MAXDEPTH)
+		{
+			ls->profileoverflow++;
+			return;
+		}
+
+		lua_getinfo(L, "Sn", ar);
+
+		frame = &ls->profilestack[ls->profiledepth++];
+		frame->entry = Lua_ProfileEntry(ls, ar);
+		frame->start = Sys_DoubleTime();
+		if (frame->entry)
+			frame->entry->calls++;
+	}
+	else if (ar->event == LUA_HOOKRET || ar->event == LUA_HOOKTAILRET)
+	{
+		if (ls->profileoverflow)
+		{
+			ls->profileoverflow--;
+			return;
+		}
+
+		/* Returns from frames entered before profiling or before a coroutine was resumed */
+		if (ls->profiledepth <= ls->profilebase)
+			return;
+
+		frame = &ls->profilestack[--ls->profiledepth];
+		if (frame->entry)
+			frame->entry->time += Sys_DoubleTime() - frame->start;
+	}
+}
+
+static void Lua_Hook(lua_State *L, lua_Debug *ar)
+{
+	struct L_lua_states *ls;
+
+	ls = lua_current_state;
+	if (ls == NULL)
+		return;
+
+	if (ar->event == LUA_HOOKCOUNT)
+	{
+		ls->instructions += LUA_HOOK_INSTRUCTIONS;
+
+		if (lua_instruction_budget.value > 0 && ls->instructions > lua_instruction_budget.value)
+			luaL_error(L, "instruction budget of %d exceeded", (int)lua_instruction_budget.value);
+
+		if (lua_time_budget.value > 0 && Sys_DoubleTime() > ls->deadline)
+			luaL_error(L, "time budget of %gms exceeded", lua_time_budget.value);
+	}
+	else if (lua_profiling)
+	{
+		Lua_ProfileHook(ls, L, ar);
+	}
+}
+
+static void Lua_SetHook(lua_State *L)
+{
+	lua_sethook(L, Lua_Hook, LUA_MASKCOUNT | (lua_profiling ? LUA_MASKCALL | LUA_MASKRET : 0), LUA_HOOK_INSTRUCTIONS);
+}
+
+static void *Lua_Alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	struct L_lua_states *ls;
+	struct lua_profile_entry *entry;
+
+	ls = ud;
+
+	if (lua_profiling && nsize > osize)
+	{
+		ls->allocs++;
+		ls->allocbytes += nsize - osize;
+
+		if (ls->profiledepth && ls->profiledepth > ls->profilebase)
+		{
+			entry = ls->profilestack[ls->profiledepth - 1].entry;
+			if (entry)
+			{
+				entry->allocs++;
+				entry->allocbytes += nsize - osize;
+			}
+		}
+	}
+
+	return ls->allocf(ls->allocud, ptr, osize, nsize);
+}
+
+/* Starts budget accounting for a call into the state, budgets are per state and per frame */
+static struct L_lua_states *Lua_EnterState(struct L_lua_states *ls, unsigned int *profilebase)
+{
+	struct L_lua_states *old;
+
+	old = lua_current_state;
+	lua_current_state = ls;
+
+	if (ls == NULL)
+		return old;
+
+	if (ls->calldepth++ == 0)
+	{
+		if (ls->budget_frame != cls.framecount)
+		{
+			ls->budget_frame = cls.framecount;
+			ls->instructions = 0;
+			ls->timeused = 0;
+		}
+
+		ls->callstart = Sys_DoubleTime();
+		ls->deadline = ls->callstart + lua_time_budget.value / 1000.0 - ls->timeused;
+	}
+
+	*profilebase = ls->profilebase;
+	ls->profilebase = ls->profiledepth;
+
+	return old;
+}
+
+static void Lua_LeaveState(struct L_lua_states *ls, struct L_lua_states *old, unsigned int profilebase)
+{
+	lua_current_state = old;
+
+	if (ls == NULL)
+		return;
+
+	/* Drop frames left behind by errors or yields */
+	ls->profiledepth = ls->profilebase;
+	ls->profilebase = profilebase;
+	if (ls->calldepth == 1)
+		ls->profileoverflow = 0;
+
+	if (--ls->calldepth == 0)
+		ls->timeused += Sys_DoubleTime() - ls->callstart;
+}
+
+static int Lua_PCall(lua_State *L, int nargs, int nresults)
+{
+	struct L_lua_states *ls, *old;
+	unsigned int profilebase;
+	int r;
+
+	ls = Lua_FindStateLS(L);
+
+	old = Lua_EnterState(ls, &profilebase);
+	r = lua_pcall(L, nargs, nresults, 0);
+	Lua_LeaveState(ls, old, profilebase);
+
+	return r;
+}
+
+static void Lua_FreeTask(struct lua_task *task)
+{
+	luaL_unref(task->l->L, LUA_REGISTRYINDEX, task->ref);
+	free(task);
+}
+
+static void Lua_RemoveTasks(struct L_lua_states *ls)
+{
+	struct lua_task *task, **prev;
+
+	prev = &lua_tasks;
+	while ((task = *prev))
+	{
+		if (task->l == ls)
+		{
+			*prev = task->next;
+			Lua_FreeTask(task);
+		}
+		else
+			prev = &task->next;
+	}
+}
+
+static void Lua_RunTasks(void)
+{
+	struct lua_task *task, **prev;
+	struct L_lua_states *old;
+	unsigned int profilebase;
+	int r;
+
+	prev = &lua_tasks;
+	while ((task = *prev))
+	{
+		if (task->l->buggy || task->wakeup > cls.realtime)
+		{
+			prev = &task->next;
+			continue;
+		}
+
+		Lua_SetHook(task->thread);
+
+		old = Lua_EnterState(task->l, &profilebase);
+		lua_current_task = task;
+		r = lua_resume(task->thread, task->nargs);
+		lua_current_task = NULL;
+		Lua_LeaveState(task->l, old, profilebase);
+
+		task->nargs = 0;
+
+		if (r == LUA_YIELD)
+		{
+			task->wakeup = cls.realtime;
+			if (lua_gettop(task->thread) && lua_isnumber(task->thread, -1))
+				task->wakeup += lua_tonumber(task->thread, -1);
+			lua_settop(task->thread, 0);
+
+			prev = &task->next;
+			continue;
+		}
+
+		if (r != 0)
+		{
+			Com_Printf("lua error: %s\n", lua_tostring(task->thread, -1));
+			task->l->buggy = 1;
+		}
+
+		*prev = task->next;
+		Lua_FreeTask(task);
+	}
+}
+
 static int add_rmf_to_list(lua_State *L, char *function, struct lua_rmf ***rmflist, int *lua_rmf_count)
 {
 	struct lua_rmf **tmprmflist;
@@ -103,10 +480,18 @@ static int add_rmf_to_list(lua_State *L, char *function, struct lua_rmf ***rmfli
 			while(*tmprmflist)
 			{
 				if ((*tmprmflist)->L == L && strcmp((*tmprmflist)->function, function) == 0)
+				{
+					if ((*tmprmflist)->removed)
+					{
+						(*tmprmflist)->removed = 0;
+						return 0;
+					}
+
 					return 1;
-			}
+				}
 
-			tmprmflist++;
+				tmprmflist++;
+			}
 		}
 
 		rmf = malloc(sizeof(*rmf));
@@ -117,6 +502,7 @@ static int add_rmf_to_list(lua_State *L, char *function, struct lua_rmf ***rmfli
 			{
 				rmf->L = L;
 				rmf->l = Lua_FindStateLS(L);
+				rmf->removed = 0;
 
 				i = *lua_rmf_count;
 				tmprmflist = realloc(*rmflist, sizeof(*tmprmflist) * (i + 2));
@@ -181,7 +567,7 @@ static void call_function_skeleton (void)
 	for (i=1; i<Cmd_Argc();i++)
 		lua_pushstring((*f)->L, Cmd_Argv(i));
 
-	if (lua_pcall((*f)->L, i-1, 0, 0) != 0)
+	if (Lua_PCall((*f)->L, i-1, 0) != 0)
 	{
 		Com_Printf("lua error: %s\n", lua_tostring((*f)->L, -1));
 		(*f)->l->buggy = 1;
@@ -202,6 +588,127 @@ static int add_frame_function(lua_State *L, char *function)
 	return 0;
 }
 
+static void Lua_CompactEventList(int event)
+{
+	struct lua_rmf **list;
+	int i, j;
+
+	list = lua_event_function_lists[event];
+	if (list == NULL)
+		return;
+
+	for (i = 0, j = 0; list[i]; i++)
+	{
+		if (list[i]->removed)
+		{
+			free(list[i]->function);
+			free(list[i]);
+		}
+		else
+			list[j++] = list[i];
+	}
+
+	list[j] = NULL;
+	lua_event_function_list_counts[event] = j;
+}
+
+/* function == NULL removes all event functions of the state */
+static void Lua_RemoveEventFunctions(lua_State *L, int event, const char *function)
+{
+	struct lua_rmf **l;
+	int i;
+
+	for (i = 0; i < LUA_NUM_EVENTS; i++)
+	{
+		if (event >= 0 && event != i)
+			continue;
+
+		l = lua_event_function_lists[i];
+		while (l && *l)
+		{
+			if ((*l)->L == L && (function == NULL || strcmp((*l)->function, function) == 0))
+				(*l)->removed = 1;
+			l++;
+		}
+
+		if (lua_event_dispatch_depth == 0)
+			Lua_CompactEventList(i);
+	}
+}
+
+static int Lua_FindEvent(const char *name)
+{
+	int i;
+
+	for (i = 0; i < LUA_NUM_EVENTS; i++)
+	{
+		if (strcmp(lua_event_names[i], name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/* format: 'i' integer, 'p' player slot (nil if negative), 'n' number, 's' string */
+static void Lua_CallEventFunctions(int event, const char *format, ...)
+{
+	struct lua_rmf *rmf;
+	const char *f;
+	va_list args;
+	int i, n, slot;
+
+	if (lua_event_function_list_counts[event] == 0)
+		return;
+
+	lua_event_dispatch_depth++;
+
+	/* Functions registered while delivering are appended and called as well */
+	for (i = 0; i < lua_event_function_list_counts[event]; i++)
+	{
+		rmf = lua_event_function_lists[event][i];
+		if (rmf->removed || rmf->l == NULL || rmf->l->buggy)
+			continue;
+
+		lua_getglobal(rmf->L, rmf->function);
+
+		va_start(args, format);
+		for (f = format, n = 0; *f; f++, n++)
+		{
+			switch (*f)
+			{
+				case 'i':
+					lua_pushinteger(rmf->L, va_arg(args, int));
+					break;
+				case 'p':
+					slot = va_arg(args, int);
+					if (slot >= 0)
+						lua_pushinteger(rmf->L, slot);
+					else
+						lua_pushnil(rmf->L);
+					break;
+				case 'n':
+					lua_pushnumber(rmf->L, va_arg(args, double));
+					break;
+				case 's':
+					lua_pushstring(rmf->L, va_arg(args, const char *));
+					break;
+			}
+		}
+		va_end(args);
+
+		if (Lua_PCall(rmf->L, n, 0) != 0)
+		{
+			Com_Printf("lua error: %s\n", lua_tostring(rmf->L, -1));
+			rmf->l->buggy = 1;
+		}
+	}
+
+	lua_event_dispatch_depth--;
+
+	if (lua_event_dispatch_depth == 0)
+		Lua_CompactEventList(event);
+}
+
 static void Lua_Clear_State(struct L_lua_states *ls)
 {
 	if (!ls)
@@ -210,13 +717,18 @@ static void Lua_Clear_State(struct L_lua_states *ls)
 	ls->buggy = 1;
 
 	lua_getglobal(ls->L, "__shutdown");
-	lua_pcall(ls->L, 0, 0, 0);
+	Lua_PCall(ls->L, 0, 0);
+
+	Lua_RemoveEventFunctions(ls->L, -1, NULL);
+	Lua_RemoveTasks(ls);
 
 	free(ls->name);
 	free(ls->script);
 
 	if (ls->L)
 		lua_close(ls->L);
+
+	Lua_FreeProfile(ls);
 }
 
 static void Lua_Remove_State(struct L_lua_states *ls)
@@ -403,6 +915,40 @@ static int LF_Register_Frame_Function(lua_State *L)
 	return 0;
 }
 
+static int LF_Register_Event_Function(lua_State *L)
+{
+	const char *event, *function;
+	int i;
+
+	event = luaL_checkstring(L, 1);
+	function = luaL_checkstring(L, 2);
+
+	i = Lua_FindEvent(event);
+	if (i < 0)
+		return luaL_error(L, "unknown event \"%s\"", event);
+
+	add_rmf_to_list(L, (char *)function, &lua_event_function_lists[i], &lua_event_function_list_counts[i]);
+
+	return 0;
+}
+
+static int LF_Unregister_Event_Function(lua_State *L)
+{
+	const char *event, *function;
+	int i;
+
+	event = luaL_checkstring(L, 1);
+	function = luaL_checkstring(L, 2);
+
+	i = Lua_FindEvent(event);
+	if (i < 0)
+		return luaL_error(L, "unknown event \"%s\"", event);
+
+	Lua_RemoveEventFunctions(L, i, function);
+
+	return 0;
+}
+
 static int LF_Set_Key_Function(lua_State *L)
 {
 	const char *string;
@@ -497,6 +1043,55 @@ static int LF_Request_Player_Stats(lua_State *L)
 	return 0;
 }
 
+static int LF_Spawn(lua_State *L)
+{
+	struct L_lua_states *l;
+	struct lua_task *task, **prev;
+	int nargs;
+
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+
+	l = lua_current_state;
+	if (l == NULL)
+		return luaL_error(L, "spawn called outside of a script");
+
+	task = malloc(sizeof(*task));
+	if (task == NULL)
+		return luaL_error(L, "out of memory");
+
+	nargs = lua_gettop(L);
+
+	task->next = NULL;
+	task->l = l;
+	task->thread = lua_newthread(L);
+	task->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	task->nargs = nargs - 1;
+	task->wakeup = 0;
+
+	lua_xmove(L, task->thread, nargs);
+
+	prev = &lua_tasks;
+	while (*prev)
+		prev = &(*prev)->next;
+
+	*prev = task;
+
+	return 0;
+}
+
+static int LF_Yield(lua_State *L)
+{
+	if (lua_current_task == NULL)
+		return luaL_error(L, "yield called outside of a spawned function");
+
+	if (lua_gettop(L) == 0)
+		return lua_yield(L, 0);
+
+	lua_settop(L, 1);
+
+	return lua_yield(L, 1);
+}
+
 static luaL_reg Basic_Functions_Methods[] =
 {
 	{"print", LF_Com_Printf},
@@ -506,12 +1101,16 @@ static luaL_reg Basic_Functions_Methods[] =
 	{"register_draw_2d_function", LF_Register_Draw_2D_Function},
 	{"register_callable_function", LF_Register_Callable_Function},
 	{"register_frame_function", LF_Register_Frame_Function},
+	{"register_event_function", LF_Register_Event_Function},
+	{"unregister_event_function", LF_Unregister_Event_Function},
 	{"set_key_function", LF_Set_Key_Function},
 	{"unset_key_function", LF_Unset_Key_Function},
 	{"keydown", LF_Keydown},
 	{"macro", LF_Macro},
 	{"play", LF_Play_Sound},
 	{"request_player_stats", LF_Request_Player_Stats},
+	{"spawn", LF_Spawn},
+	{"yield", LF_Yield},
 	{0, 0}
 };
 
@@ -690,6 +1289,138 @@ static luaL_reg Variables_Meta[] =
 	{0, 0}
 };
 
+/* Views read cl.players and cl.stats when they are indexed instead of copying them into tables */
+
+static int LPV_Index(lua_State *L)
+{
+	player_info_t *p;
+	const char *key;
+	int slot, stats[4];
+
+	slot = *(int *)luaL_checkudata(L, 1, "fodquake.player");
+	key = luaL_checkstring(L, 2);
+
+	p = &cl.players[slot];
+	if (p->name[0] == '\0')
+		lua_pushnil(L);
+	else if (strcmp(key, "slot") == 0)
+		lua_pushinteger(L, slot);
+	else if (strcmp(key, "name") == 0)
+		lua_pushstring(L, p->name);
+	else if (strcmp(key, "team") == 0)
+		lua_pushstring(L, p->team);
+	else if (strcmp(key, "userid") == 0)
+		lua_pushinteger(L, p->userid);
+	else if (strcmp(key, "ping") == 0)
+		lua_pushnumber(L, p->ping);
+	else if (strcmp(key, "pl") == 0)
+		lua_pushnumber(L, p->pl);
+	else if (strcmp(key, "frags") == 0)
+		lua_pushnumber(L, p->frags);
+	else if (strcmp(key, "topcolor") == 0)
+		lua_pushnumber(L, p->topcolor);
+	else if (strcmp(key, "bottomcolor") == 0)
+		lua_pushnumber(L, p->bottomcolor);
+	else if (strcmp(key, "spectator") == 0)
+		lua_pushboolean(L, p->spectator == 1);
+	else if (strncmp(key, "total", 5) == 0)
+	{
+		Stats_GetBasicStats(slot, stats);
+
+		if (strcmp(key, "totalfrags") == 0)
+			lua_pushinteger(L, stats[0]);
+		else if (strcmp(key, "totaldeaths") == 0)
+			lua_pushinteger(L, stats[1]);
+		else if (strcmp(key, "totalteamkills") == 0)
+			lua_pushinteger(L, stats[2]);
+		else if (strcmp(key, "totalsuicides") == 0)
+			lua_pushinteger(L, stats[3]);
+		else
+			lua_pushnil(L);
+	}
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int LPL_Index(lua_State *L)
+{
+	int slot, *view;
+
+	luaL_checkudata(L, 1, "fodquake.players");
+	slot = luaL_checkinteger(L, 2);
+
+	if (slot < 0 || slot >= MAX_CLIENTS || cl.players[slot].name[0] == '\0')
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	view = lua_newuserdata(L, sizeof(*view));
+	*view = slot;
+	luaL_getmetatable(L, "fodquake.player");
+	lua_setmetatable(L, -2);
+
+	return 1;
+}
+
+static int LPL_Len(lua_State *L)
+{
+	lua_pushinteger(L, MAX_CLIENTS);
+	return 1;
+}
+
+static int LST_Index(lua_State *L)
+{
+	int stat;
+
+	luaL_checkudata(L, 1, "fodquake.stats");
+	stat = luaL_checkinteger(L, 2);
+
+	if (stat < 0 || stat >= MAX_CL_STATS)
+		lua_pushnil(L);
+	else
+		lua_pushinteger(L, cl.stats[stat]);
+
+	return 1;
+}
+
+static int LST_Len(lua_State *L)
+{
+	lua_pushinteger(L, MAX_CL_STATS);
+	return 1;
+}
+
+static void Lua_PushView(lua_State *L, const char *name, lua_CFunction index, lua_CFunction len)
+{
+	lua_newuserdata(L, 1);
+	luaL_newmetatable(L, name);
+	lua_pushcfunction(L, index);
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, len);
+	lua_setfield(L, -2, "__len");
+	lua_setmetatable(L, -2);
+}
+
+static void Lua_CreateViews(lua_State *L)
+{
+	luaL_newmetatable(L, "fodquake.player");
+	lua_pushcfunction(L, LPV_Index);
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1);
+
+	lua_getglobal(L, "fodquake");
+
+	Lua_PushView(L, "fodquake.players", LPL_Index, LPL_Len);
+	lua_setfield(L, -2, "players");
+
+	Lua_PushView(L, "fodquake.stats", LST_Index, LST_Len);
+	lua_setfield(L, -2, "stats");
+
+	lua_pop(L, 1);
+}
+
 static struct L_lua_states *Lua_CreateState(char *script, char *name)
 {
 	struct L_lua_states *ls;
@@ -708,6 +1439,10 @@ static struct L_lua_states *Lua_CreateState(char *script, char *name)
 		return NULL;
 	}
 
+	ls->allocf = lua_getallocf(ls->L, &ls->allocud);
+	lua_setallocf(ls->L, Lua_Alloc, ls);
+	Lua_SetHook(ls->L);
+
 	/* lets try and restrict this
 	   luaL_openlibs(ls->L);
 	   */
@@ -734,6 +1469,7 @@ static struct L_lua_states *Lua_CreateState(char *script, char *name)
 	Lua_RegisterFunctions("fodquake", ls->L, Basic_Functions_Methods, Functions_Meta);
 	Lua_RegisterFunctions("draw", ls->L, Draw_Functions_Methods, Functions_Meta);
 	Lua_RegisterFunctions("variables", ls->L, Variables_Methods, Variables_Meta);
+	Lua_CreateViews(ls->L);
 
 	// load all existing helpers
 	s = lua_helpers;
@@ -755,7 +1491,7 @@ static struct L_lua_states *Lua_CreateState(char *script, char *name)
 		return NULL;
 	}
 
-	if (lua_pcall(ls->L, 0, LUA_MULTRET, 0) != 0)
+	if (Lua_PCall(ls->L, 0, LUA_MULTRET) != 0)
 	{
 		Com_Printf("lua error in script \"%s\": %s\n", script, lua_tostring(ls->L, -1));
 		Lua_Remove_State(ls);
@@ -763,7 +1499,7 @@ static struct L_lua_states *Lua_CreateState(char *script, char *name)
 	}
 
 	lua_getglobal(ls->L, "__init");
-	if (lua_pcall(ls->L, 0, 0, 0) != 0)
+	if (Lua_PCall(ls->L, 0, 0) != 0)
 	{
 		Com_Printf("lua script \"%s\" has no __init function: %s\n", script, lua_tostring(ls->L, -1));
 		Lua_Remove_State(ls);
@@ -836,7 +1572,7 @@ static void Lua_CallFunction_f(void)
 	for (i=2; i<Cmd_Argc();i++)
 		lua_pushstring((*list)->L, Cmd_Argv(i));
 
-	if (lua_pcall((*list)->L, i-2, 0, 0) != 0)
+	if (Lua_PCall((*list)->L, i-2, 0) != 0)
 	{
 		Com_Printf("lua error: %s\n", lua_tostring((*list)->L, -1));
 		(*list)->l->buggy = 1;
@@ -880,6 +1616,90 @@ static void Lua_List_CFunctions(void)
 	}
 }
 
+static int Lua_ProfileCompare(const void *a, const void *b)
+{
+	const struct lua_profile_entry *ea = *(const struct lua_profile_entry **)a;
+	const struct lua_profile_entry *eb = *(const struct lua_profile_entry **)b;
+
+	if (ea->time > eb->time)
+		return -1;
+	if (ea->time < eb->time)
+		return 1;
+
+	return 0;
+}
+
+static void Lua_ProfileReport(struct L_lua_states *ls)
+{
+	struct lua_profile_entry *entry, **sorted;
+	unsigned int count, i;
+
+	Com_Printf("%s (%s): %u allocs, %u kB\n", ls->name, ls->script, ls->allocs, (unsigned int)(ls->allocbytes / 1024));
+
+	count = 0;
+	for (i = 0; i < LUA_PROFILE_HASHSIZE; i++)
+		for (entry = ls->profile[i]; entry; entry = entry->next)
+			count++;
+
+	if (count == 0)
+		return;
+
+	sorted = malloc(count * sizeof(*sorted));
+	if (sorted == NULL)
+		return;
+
+	count = 0;
+	for (i = 0; i < LUA_PROFILE_HASHSIZE; i++)
+		for (entry = ls->profile[i]; entry; entry = entry->next)
+			sorted[count++] = entry;
+
+	qsort(sorted, count, sizeof(*sorted), Lua_ProfileCompare);
+
+	Com_Printf("    calls   time ms   allocs  function\n");
+	for (i = 0; i < count; i++)
+		Com_Printf("%9u %9.3f %8u  %s\n", sorted[i]->calls, sorted[i]->time * 1000, sorted[i]->allocs, sorted[i]->label);
+
+	free(sorted);
+}
+
+static void Lua_Profile_f(void)
+{
+	struct L_lua_states *ls;
+	struct lua_task *task;
+	const char *arg;
+
+	arg = Cmd_Argc() > 1 ? Cmd_Argv(1) : "";
+
+	if (strcmp(arg, "start") == 0 || strcmp(arg, "stop") == 0)
+	{
+		lua_profiling = arg[2] == 'a';
+
+		for (ls = L_lua_states; ls; ls = ls->next)
+			if (ls->L)
+				Lua_SetHook(ls->L);
+
+		for (task = lua_tasks; task; task = task->next)
+			Lua_SetHook(task->thread);
+	}
+	else if (strcmp(arg, "reset") == 0)
+	{
+		for (ls = L_lua_states; ls; ls = ls->next)
+			Lua_FreeProfile(ls);
+	}
+	else if (*arg == 0)
+	{
+		if (!lua_profiling)
+			Com_Printf("Profiling is stopped.\n");
+
+		for (ls = L_lua_states; ls; ls = ls->next)
+			Lua_ProfileReport(ls);
+	}
+	else
+	{
+		Com_Printf("Usage: %s [start|stop|reset]\n", Cmd_Argv(0));
+	}
+}
+
 static void Lua_Load(void)
 {
 	if (Cmd_Argc() < 2)
@@ -1016,6 +1836,8 @@ void Lua_Frame(void)
 {
 	struct lua_rmf **l;
 
+	Lua_RunTasks();
+
 	if (lua_frame_function_list == NULL)
 		return;
 
@@ -1030,7 +1852,7 @@ void Lua_Frame(void)
 					Lua_PushPlayerStats((*l)->l);
 			lua_getglobal((*l)->L, (*l)->function);
 			lua_pushnumber((*l)->L, cls.realtime);
-			if (lua_pcall((*l)->L, 1, 0, 0) != 0)
+			if (Lua_PCall((*l)->L, 1, 0) != 0)
 			{
 				Com_Printf("lua error: %s\n", lua_tostring((*l)->L, -1));
 				(*l)->l->buggy = 1;
@@ -1062,7 +1884,7 @@ void Lua_Frame_2D(void)
 			lua_pushnumber((*l)->L, vid.conwidth);
 			lua_pushnumber((*l)->L, vid.conheight);
 
-			if (lua_pcall((*l)->L, 3, 0, 0) != 0)
+			if (Lua_PCall((*l)->L, 3, 0) != 0)
 			{
 				Com_Printf("lua error: %s\n", lua_tostring((*l)->L, -1));
 				(*l)->l->buggy = 1;
@@ -1080,7 +1902,7 @@ void Lua_Key(int key)
 	lua_getglobal(lua_key_function.L, lua_key_function.function);
 	lua_pushnumber(lua_key_function.L, key);
 
-	if (lua_pcall(lua_key_function.L, 1, 0, 0) != 0)
+	if (Lua_PCall(lua_key_function.L, 1, 0) != 0)
 		Com_Printf("lua error: %s\n", lua_tostring(lua_key_function.L, -1));
 
 	if (key == K_ESCAPE)
@@ -1225,6 +2047,36 @@ static void Lua_ClearRMF(struct lua_rmf **list)
 	free(list);
 }
 
+void Lua_StatChanged(int stat, int value, int oldvalue)
+{
+	Lua_CallEventFunctions(LUA_EVENT_STAT, "iii", stat, value, oldvalue);
+}
+
+void Lua_PlayerEnter(int slot)
+{
+	Lua_CallEventFunctions(LUA_EVENT_PLAYER_ENTER, "i", slot);
+}
+
+void Lua_PlayerLeave(int slot)
+{
+	Lua_CallEventFunctions(LUA_EVENT_PLAYER_LEAVE, "i", slot);
+}
+
+void Lua_Frag(int killer, int victim, const char *weapon, const char *type)
+{
+	Lua_CallEventFunctions(LUA_EVENT_FRAG, "ppss", killer, victim, weapon, type);
+}
+
+void Lua_MapChange(void)
+{
+	Lua_CallEventFunctions(LUA_EVENT_MAP_CHANGE, "s", TP_MapName());
+}
+
+void Lua_DemoSeek(double demotime)
+{
+	Lua_CallEventFunctions(LUA_EVENT_DEMO_SEEK, "n", demotime);
+}
+
 void Lua_MessageFunctions(int level, const char *message)
 {
 	struct lua_rmf **l;
@@ -1240,7 +2092,7 @@ void Lua_MessageFunctions(int level, const char *message)
 			lua_getglobal((*l)->L, (*l)->function);
 			lua_pushnumber((*l)->L, level);
 			lua_pushstring((*l)->L, message);
-			if (lua_pcall((*l)->L, 2, 0, 0) != 0)
+			if (Lua_PCall((*l)->L, 2, 0) != 0)
 			{
 				Com_Printf("lua error: %s\n", lua_tostring((*l)->L, -1));
 				(*l)->l->buggy = 1;
@@ -1254,6 +2106,7 @@ void Lua_Shutdown(void)
 {
 	struct L_lua_states *ls, *lsc;
 	struct lua_rmf **lo;
+	int i;
 
 	ls = L_lua_states;
 
@@ -1292,6 +2145,14 @@ void Lua_Shutdown(void)
 	lua_frame_function_list = NULL;
 	lua_frame_function_list_count = 0;
 	Lua_ClearRMF(lo);
+
+	for (i = 0; i < LUA_NUM_EVENTS; i++)
+	{
+		lo = lua_event_function_lists[i];
+		lua_event_function_lists[i] = NULL;
+		lua_event_function_list_counts[i] = 0;
+		Lua_ClearRMF(lo);
+	}
 }
 
 static void Lua_Restart(void)
@@ -1305,6 +2166,9 @@ void Lua_CvarInit(void)
 	Cmd_AddCommand("lua_list_cfunctions", Lua_List_CFunctions);
 	Cmd_AddCommand("lua_restart", Lua_Restart);
 	Cmd_AddCommand("lua_load", Lua_Load);
+	Cmd_AddCommand("lua_profile", Lua_Profile_f);
+	Cvar_Register(&lua_instruction_budget);
+	Cvar_Register(&lua_time_budget);
 	CSTC_Add("lua_load", NULL, &cstc_lua_load_get_results, &cstc_lua_load_get_data, NULL, CSTC_EXECUTE, "arrow up/down to navigate");
 }
 #else
@@ -1316,6 +2180,30 @@ void Lua_MessageFunctions(int level, const char *message)
 {
 }
 
+void Lua_StatChanged(int stat, int value, int oldvalue)
+{
+}
+
+void Lua_PlayerEnter(int slot)
+{
+}
+
+void Lua_PlayerLeave(int slot)
+{
+}
+
+void Lua_Frag(int killer, int victim, const char *weapon, const char *type)
+{
+}
+
+void Lua_MapChange(void)
+{
+}
+
+void Lua_DemoSeek(double demotime)
+{
+}
+
 void Lua_Key(int key)
 {
 }
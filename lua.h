@@ -3,5 +3,11 @@ void Lua_Frame_2D(void);
 void Lua_Frame(void);
 void Lua_Key(int key);
 void Lua_MessageFunctions(int level, const char *message);
+void Lua_StatChanged(int stat, int value, int oldvalue);
+void Lua_PlayerEnter(int slot);
+void Lua_PlayerLeave(int slot);
+void Lua_Frag(int killer, int victim, const char *weapon, const char *type);
+void Lua_MapChange(void);
+void Lua_DemoSeek(double demotime);
 void Lua_Shutdown(void);
 void Lua_CvarInit(void);
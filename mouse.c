@@ -27,17 +27,16 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "sys_thread.h"
 #include "mouse.h"
 
-static qboolean mouse_cvar_callback(cvar_t *var, char *string);
-
-cvar_t sensitivity = { "sensitivity", "3", CVAR_ARCHIVE, mouse_cvar_callback };
-cvar_t m_pitch = { "m_pitch", "0.022", CVAR_ARCHIVE, mouse_cvar_callback };
-cvar_t m_yaw = { "m_yaw", "0.022", 0, mouse_cvar_callback };
-cvar_t m_accel = { "m_accel", "0", 0, mouse_cvar_callback };
-cvar_t m_filter = { "m_filter", "0", 0, mouse_cvar_callback };
+cvar_t sensitivity = { "sensitivity", "3", CVAR_ARCHIVE };
+cvar_t m_pitch = { "m_pitch", "0.022", CVAR_ARCHIVE };
+cvar_t m_yaw = { "m_yaw", "0.022" };
+cvar_t m_accel = { "m_accel", "0" };
+cvar_t m_filter = { "m_filter", "0" };
 
 struct Mouse
 {
 	struct SysMutex *mutex;
+	struct CvarSubscription *cvarsubscription;
 	vec3_t viewangles;
 	int oldmousex, oldmousey;
 	short forwardmove;
@@ -53,29 +52,21 @@ struct Mouse
 
 static struct Mouse *mouse_global;
 
-static qboolean mouse_cvar_callback(cvar_t *var, char *string)
+static void Mouse_CvarsChanged(void *userdata)
 {
-	Cvar_Set(var, string);
+	struct Mouse *mouse;
 
-	if (mouse_global)
-	{
-		Sys_Thread_LockMutex(mouse_global->mutex);
-
-		if (var == &sensitivity)
-			mouse_global->sensitivity = sensitivity.value;
-		else if (var == &m_pitch)
-			mouse_global->m_pitch = m_pitch.value;
-		else if (var == &m_yaw)
-			mouse_global->m_yaw = m_yaw.value;
-		else if (var == &m_accel)
-			mouse_global->m_accel = m_accel.value;
-		else if (var == &m_filter)
-			mouse_global->m_filter = m_filter.value;
-
-		Sys_Thread_UnlockMutex(mouse_global->mutex);
-	}
+	mouse = userdata;
+
+	Sys_Thread_LockMutex(mouse->mutex);
 
-	return 1;
+	mouse->sensitivity = sensitivity.value;
+	mouse->m_pitch = m_pitch.value;
+	mouse->m_yaw = m_yaw.value;
+	mouse->m_accel = m_accel.value;
+	mouse->m_filter = m_filter.value;
+
+	Sys_Thread_UnlockMutex(mouse->mutex);
 }
 
 static void Mouse_UpdateValues(struct Mouse *mouse)
@@ -164,20 +155,28 @@ int Mouse_Init()
 		mouse_global->mutex = Sys_Thread_CreateMutex();
 		if (mouse_global->mutex)
 		{
-			Sys_Thread_LockMutex(mouse_global->mutex);
-
-			mouse_global->sensitivity = sensitivity.value;
-			mouse_global->m_pitch = m_pitch.value;
-			mouse_global->m_yaw = m_yaw.value;
-			mouse_global->m_accel = m_accel.value;
-			mouse_global->m_filter = m_filter.value;
-
-			Sys_Thread_UnlockMutex(mouse_global->mutex);
-
-			return 1;
+			mouse_global->cvarsubscription = Cvar_Subscribe(Mouse_CvarsChanged, mouse_global);
+			if (mouse_global->cvarsubscription)
+			{
+				if (Cvar_SubscribeCvar(mouse_global->cvarsubscription, &sensitivity)
+				 && Cvar_SubscribeCvar(mouse_global->cvarsubscription, &m_pitch)
+				 && Cvar_SubscribeCvar(mouse_global->cvarsubscription, &m_yaw)
+				 && Cvar_SubscribeCvar(mouse_global->cvarsubscription, &m_accel)
+				 && Cvar_SubscribeCvar(mouse_global->cvarsubscription, &m_filter))
+				{
+					Mouse_CvarsChanged(mouse_global);
+
+					return 1;
+				}
+
+				Cvar_Unsubscribe(mouse_global->cvarsubscription);
+			}
+
+			Sys_Thread_DeleteMutex(mouse_global->mutex);
 		}
 
 		free(mouse_global);
+		mouse_global = 0;
 	}
 
 	return 0;
@@ -188,6 +187,7 @@ void Mouse_Shutdown()
 	if (!mouse_global)
 		return;
 
+	Cvar_Unsubscribe(mouse_global->cvarsubscription);
 	Sys_Thread_DeleteMutex(mouse_global->mutex);
 	free(mouse_global);
 	mouse_global = 0;
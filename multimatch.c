@@ -0,0 +1,263 @@
+/*
+Copyright (C) 2026 Fodquake developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "multimatch.h"
+
+struct mmedge
+{
+	unsigned char c;
+	unsigned int state;
+};
+
+struct mmstate
+{
+	unsigned int firstedge;
+	unsigned int numedges;
+	unsigned int fail;
+	unsigned int output; /* Closest state in the fail chain, including this one, that ends a pattern. 0 if none */
+	int firstpattern; /* -1 if no pattern ends here */
+};
+
+struct MultiMatch
+{
+	struct mmstate *states;
+	struct mmedge *edges;
+	int *nextpattern;
+	unsigned int rootedges[256]; /* The root has a full table, 0 means stay at the root */
+};
+
+/* Trie used while building, children are kept as sorted sibling lists */
+struct mmbuildnode
+{
+	struct mmbuildnode *children;
+	struct mmbuildnode *next;
+	unsigned int state;
+	unsigned char c;
+};
+
+static void MultiMatch_FreeBuildNodes(struct mmbuildnode *node)
+{
+	struct mmbuildnode *child;
+
+	while((child = node->children))
+	{
+		node->children = child->next;
+		MultiMatch_FreeBuildNodes(child);
+		free(child);
+	}
+}
+
+static unsigned int MultiMatch_Goto(const struct MultiMatch *multimatch, unsigned int state, unsigned char c)
+{
+	const struct mmedge *edge;
+	unsigned int low, high, mid;
+
+	if (state == 0)
+		return multimatch->rootedges[c];
+
+	edge = multimatch->edges + multimatch->states[state].firstedge;
+	low = 0;
+	high = multimatch->states[state].numedges;
+	while(low < high)
+	{
+		mid = (low + high) / 2;
+		if (edge[mid].c == c)
+			return edge[mid].state;
+		else if (edge[mid].c < c)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return 0;
+}
+
+struct MultiMatch *MultiMatch_Create(const char **patterns, unsigned int numpatterns)
+{
+	struct MultiMatch *multimatch;
+	struct mmbuildnode root, *node, *child, **link, **queue;
+	struct mmstate *state;
+	unsigned int i, maxstates, numstates, numedges, queuehead, queuetail, fail;
+	const unsigned char *p;
+
+	maxstates = 1;
+	for(i=0;i<numpatterns;i++)
+		maxstates += strlen(patterns[i]);
+
+	multimatch = malloc(sizeof(*multimatch));
+	if (multimatch)
+	{
+		memset(multimatch->rootedges, 0, sizeof(multimatch->rootedges));
+		multimatch->states = malloc(maxstates * sizeof(*multimatch->states));
+		multimatch->edges = malloc(maxstates * sizeof(*multimatch->edges));
+		multimatch->nextpattern = malloc((numpatterns ? numpatterns : 1) * sizeof(*multimatch->nextpattern));
+		queue = malloc(maxstates * sizeof(*queue));
+		if (multimatch->states && multimatch->edges && multimatch->nextpattern && queue)
+		{
+			root.children = 0;
+			root.next = 0;
+			root.state = 0;
+			root.c = 0;
+
+			multimatch->states[0].firstpattern = -1;
+			numstates = 1;
+
+			for(i=0;i<numpatterns;i++)
+			{
+				multimatch->nextpattern[i] = -1;
+
+				if (patterns[i][0] == 0)
+					continue;
+
+				node = &root;
+				for(p=(const unsigned char *)patterns[i];*p;p++)
+				{
+					for(link=&node->children;*link && (*link)->c < *p;link=&(*link)->next);
+
+					if (*link == 0 || (*link)->c != *p)
+					{
+						child = malloc(sizeof(*child));
+						if (child == 0)
+							break;
+
+						child->children = 0;
+						child->next = *link;
+						child->state = numstates;
+						child->c = *p;
+						*link = child;
+
+						multimatch->states[numstates].firstpattern = -1;
+						numstates++;
+					}
+
+					node = *link;
+				}
+
+				if (*p)
+					break;
+
+				multimatch->nextpattern[i] = multimatch->states[node->state].firstpattern;
+				multimatch->states[node->state].firstpattern = i;
+			}
+
+			if (i == numpatterns)
+			{
+				/* Breadth first, so every state's fail target is complete before its children need it */
+				numedges = 0;
+				queuehead = 0;
+				queuetail = 0;
+				queue[queuetail++] = &root;
+
+				multimatch->states[0].fail = 0;
+				multimatch->states[0].output = 0;
+
+				while(queuehead < queuetail)
+				{
+					node = queue[queuehead++];
+					state = &multimatch->states[node->state];
+
+					state->firstedge = numedges;
+					state->numedges = 0;
+					for(child=node->children;child;child=child->next)
+					{
+						multimatch->edges[numedges].c = child->c;
+						multimatch->edges[numedges].state = child->state;
+						numedges++;
+						state->numedges++;
+
+						if (node == &root)
+						{
+							multimatch->rootedges[child->c] = child->state;
+							fail = 0;
+						}
+						else
+						{
+							fail = state->fail;
+							while(fail && MultiMatch_Goto(multimatch, fail, child->c) == 0)
+								fail = multimatch->states[fail].fail;
+
+							fail = MultiMatch_Goto(multimatch, fail, child->c);
+						}
+
+						multimatch->states[child->state].fail = fail;
+						if (multimatch->states[child->state].firstpattern >= 0)
+							multimatch->states[child->state].output = child->state;
+						else
+							multimatch->states[child->state].output = multimatch->states[fail].output;
+
+						queue[queuetail++] = child;
+					}
+				}
+
+				MultiMatch_FreeBuildNodes(&root);
+				free(queue);
+
+				return multimatch;
+			}
+
+			MultiMatch_FreeBuildNodes(&root);
+		}
+
+		free(queue);
+		free(multimatch->nextpattern);
+		free(multimatch->edges);
+		free(multimatch->states);
+		free(multimatch);
+	}
+
+	return 0;
+}
+
+void MultiMatch_Delete(struct MultiMatch *multimatch)
+{
+	free(multimatch->nextpattern);
+	free(multimatch->edges);
+	free(multimatch->states);
+	free(multimatch);
+}
+
+void MultiMatch_Search(struct MultiMatch *multimatch, const char *text, unsigned char *found)
+{
+	const unsigned char *p;
+	unsigned int state, next, output;
+	int pattern;
+
+	state = 0;
+	next = 0;
+	for(p=(const unsigned char *)text;*p;p++)
+	{
+		while(state && (next = MultiMatch_Goto(multimatch, state, *p)) == 0)
+			state = multimatch->states[state].fail;
+
+		if (state == 0)
+			next = multimatch->rootedges[*p];
+
+		state = next;
+
+		for(output=multimatch->states[state].output;output;output=multimatch->states[multimatch->states[output].fail].output)
+		{
+			for(pattern=multimatch->states[output].firstpattern;pattern>=0;pattern=multimatch->nextpattern[pattern])
+				found[pattern] = 1;
+		}
+	}
+}
+
@@ -0,0 +1,31 @@
+/*
+Copyright (C) 2026 Fodquake developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* Aho-Corasick automaton that finds any number of fixed substrings in a
+ * single pass over the text. */
+
+struct MultiMatch;
+
+struct MultiMatch *MultiMatch_Create(const char **patterns, unsigned int numpatterns);
+void MultiMatch_Delete(struct MultiMatch *multimatch);
+
+/* Sets found[i] to 1 for every pattern i that occurs in text. found must hold
+ * numpatterns entries and is not cleared first. Empty patterns never match. */
+void MultiMatch_Search(struct MultiMatch *multimatch, const char *text, unsigned char *found);
+
@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include <math.h>
+#include <string.h>
 
 #include "quakedef.h"
 #include "pmove.h"
@@ -26,9 +27,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 movevars_t		movevars;
 playermove_t	pmove;
 
-float		frametime;
-
-vec3_t		forward, right, up;
+struct PMoveContext pmove_context;
 
 vec3_t	player_mins = {-16, -16, -24};
 vec3_t	player_maxs = {16, 16, 32};
@@ -45,10 +44,18 @@ vec3_t	player_maxs = {16, 16, 32};
 #define BLOCKED_ANY		7 
 
 
-void PM_InitBoxHull (void);
+void PM_InitBoxHull (struct PMoveContext *ctx);
+
+//Sets up a context that moves the given player using the given movevars
+void PM_InitContext (struct PMoveContext *ctx, playermove_t *pm, movevars_t *mv) {
+	memset (ctx, 0, sizeof(*ctx));
+	ctx->pmove = pm;
+	ctx->movevars = mv;
+	PM_InitBoxHull (ctx);
+}
 
 void PM_Init (void) {
-	PM_InitBoxHull ();
+	PM_InitContext (&pmove_context, &pmove, &movevars);
 }
 
 //Slide off of the impacting object
@@ -77,7 +84,8 @@ int PM_ClipVelocity (vec3_t in, vec3_t normal, vec3_t out, float overbounce) {
 
 #define	MAX_CLIP_PLANES	5
 //The basic solid body movement clip that slides along multiple planes
-int PM_SlideMove (void) {
+int PM_SlideMove (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
 	int bumpcount, numbumps, i, j, blocked, numplanes;
 	vec3_t dir, planes[MAX_CLIP_PLANES], primal_velocity, original_velocity, end;
 	float d, time_left;
@@ -86,25 +94,25 @@ int PM_SlideMove (void) {
 	numbumps = 4;
 
 	blocked = 0;
-	VectorCopy (pmove.velocity, original_velocity);
-	VectorCopy (pmove.velocity, primal_velocity);
+	VectorCopy (pm->velocity, original_velocity);
+	VectorCopy (pm->velocity, primal_velocity);
 	numplanes = 0;
 
-	time_left = frametime;
+	time_left = ctx->frametime;
 
 	for (bumpcount = 0; bumpcount < numbumps; bumpcount++) {
-		VectorMA(pmove.origin, time_left, pmove.velocity, end);
-		trace = PM_PlayerTrace (pmove.origin, end);
+		VectorMA(pm->origin, time_left, pm->velocity, end);
+		trace = PM_PlayerTraceEx (ctx, pm->origin, end);
 
 		if (trace.startsolid || trace.allsolid) {
 			// entity is trapped in another solid
-			VectorClear (pmove.velocity);
+			VectorClear (pm->velocity);
 			return 3;
 		}
 
 		if (trace.fraction > 0) {	
 			// actually covered some distance
-			VectorCopy (trace.endpos, pmove.origin);
+			VectorCopy (trace.endpos, pm->origin);
 			numplanes = 0;
 		}
 
@@ -112,9 +120,9 @@ int PM_SlideMove (void) {
 			 break;		// moved the entire distance
 
 		// save entity for contact
-		if (pmove.numtouch < MAX_PHYSENTS) {
-			pmove.touchindex[pmove.numtouch] = trace.ent;
-			pmove.numtouch++;
+		if (pm->numtouch < MAX_PHYSENTS) {
+			pm->touchindex[pm->numtouch] = trace.ent;
+			pm->numtouch++;
 		}
 
 		if (trace.plane.normal[2] >= MIN_STEP_NORMAL)
@@ -129,7 +137,7 @@ int PM_SlideMove (void) {
 		// cliped to another plane
 		if (numplanes >= MAX_CLIP_PLANES) {	
 			// this shouldn't really happen
-			VectorClear (pmove.velocity);
+			VectorClear (pm->velocity);
 			break;
 		}
 
@@ -138,10 +146,10 @@ int PM_SlideMove (void) {
 
 		// modify original_velocity so it parallels all of the clip planes
 		for (i = 0; i < numplanes; i++) {
-			PM_ClipVelocity (original_velocity, planes[i], pmove.velocity, 1);
+			PM_ClipVelocity (original_velocity, planes[i], pm->velocity, 1);
 			for (j = 0; j < numplanes; j++) {
 				if (j != i) {
-					if (DotProduct (pmove.velocity, planes[j]) < 0)
+					if (DotProduct (pm->velocity, planes[j]) < 0)
 						break;	// not ok
 				}
 			}
@@ -154,28 +162,29 @@ int PM_SlideMove (void) {
 		} else {	
 			// go along the crease
 			if (numplanes != 2) {
-				VectorClear (pmove.velocity);
+				VectorClear (pm->velocity);
 				break;
 			}
 			CrossProduct (planes[0], planes[1], dir);
-			d = DotProduct (dir, pmove.velocity);
-			VectorScale (dir, d, pmove.velocity);
+			d = DotProduct (dir, pm->velocity);
+			VectorScale (dir, d, pm->velocity);
 		}
 
 		// if velocity is against the original velocity, stop dead to avoid tiny occilations in sloping corners
-		if (DotProduct (pmove.velocity, primal_velocity) <= 0) {
-			VectorClear (pmove.velocity);
+		if (DotProduct (pm->velocity, primal_velocity) <= 0) {
+			VectorClear (pm->velocity);
 			break;
 		}
 	}
 
-	if (pmove.waterjumptime)
-		VectorCopy (primal_velocity, pmove.velocity);
+	if (pm->waterjumptime)
+		VectorCopy (primal_velocity, pm->velocity);
 	return blocked;
 }
 
 //Each intersection will try to step over the obstruction instead of sliding along it.
-void PM_StepSlideMove (void) {
+void PM_StepSlideMove (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
 	vec3_t dest;
 	pmtrace_t trace;
 	vec3_t original, originalvel, down, up, downvel;
@@ -183,40 +192,40 @@ void PM_StepSlideMove (void) {
 
 	// try sliding forward both on ground and up 16 pixels
 	// take the move that goes farthest
-	VectorCopy (pmove.origin, original);
-	VectorCopy (pmove.velocity, originalvel);
+	VectorCopy (pm->origin, original);
+	VectorCopy (pm->velocity, originalvel);
 
-	if (!PM_SlideMove())
+	if (!PM_SlideMove (ctx))
 		return;		// moved the entire distance
 
-	VectorCopy (pmove.origin, down);
-	VectorCopy (pmove.velocity, downvel);
+	VectorCopy (pm->origin, down);
+	VectorCopy (pm->velocity, downvel);
 
-	VectorCopy (original, pmove.origin);
-	VectorCopy (originalvel, pmove.velocity);
+	VectorCopy (original, pm->origin);
+	VectorCopy (originalvel, pm->velocity);
 
 	// move up a stair height
-	VectorCopy (pmove.origin, dest);
+	VectorCopy (pm->origin, dest);
 	dest[2] += STEPSIZE;
-	trace = PM_PlayerTrace (pmove.origin, dest);
+	trace = PM_PlayerTraceEx (ctx, pm->origin, dest);
 	if (!trace.startsolid && !trace.allsolid)
-		VectorCopy (trace.endpos, pmove.origin);
+		VectorCopy (trace.endpos, pm->origin);
 
-	PM_SlideMove ();
+	PM_SlideMove (ctx);
 
 	// press down the stepheight
-	VectorCopy (pmove.origin, dest);
+	VectorCopy (pm->origin, dest);
 	dest[2] -= STEPSIZE;
-	trace = PM_PlayerTrace (pmove.origin, dest);
+	trace = PM_PlayerTraceEx (ctx, pm->origin, dest);
 	if (trace.fraction != 1 && trace.plane.normal[2] < MIN_STEP_NORMAL)
 		goto usedown;
 	if (!trace.startsolid && !trace.allsolid)
-		VectorCopy (trace.endpos, pmove.origin);
+		VectorCopy (trace.endpos, pm->origin);
 
-	if (pmove.origin[2] < original[2])
+	if (pm->origin[2] < original[2])
 		goto usedown;
 
-	VectorCopy (pmove.origin, up);
+	VectorCopy (pm->origin, up);
 
 	// decide which one went farther
 	downdist = (down[0] - original[0]) * (down[0] - original[0]) + (down[1] - original[1]) * (down[1] - original[1]);
@@ -224,58 +233,60 @@ void PM_StepSlideMove (void) {
 
 	if (downdist >= updist) {
 usedown:
-		VectorCopy (down, pmove.origin);
-		VectorCopy (downvel, pmove.velocity);
+		VectorCopy (down, pm->origin);
+		VectorCopy (downvel, pm->velocity);
 	} else { // copy z value from slide move
-		pmove.velocity[2] = downvel[2];
+		pm->velocity[2] = downvel[2];
 	}
 	// if at a dead stop, retry the move with nudges to get around lips
 }
 
 //Handles both ground friction and water friction
-void PM_Friction (void) {
+void PM_Friction (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
+	movevars_t *mv = ctx->movevars;
 	float	speed, newspeed, control;
 	float	friction;
 	float	drop;
 	vec3_t	start, stop;
 	pmtrace_t	trace;
 	
-	if (pmove.waterjumptime)
+	if (pm->waterjumptime)
 		return;
 
-	speed = VectorLength(pmove.velocity);
+	speed = VectorLength(pm->velocity);
 	if (speed < 1) {
-		pmove.velocity[0] = pmove.velocity[1] = 0;
-		if (pmove.pm_type == PM_FLY)
-			pmove.velocity[2] = 0;
+		pm->velocity[0] = pm->velocity[1] = 0;
+		if (pm->pm_type == PM_FLY)
+			pm->velocity[2] = 0;
 		return;
 	}
 
-	if (pmove.waterlevel >= 2) {
+	if (pm->waterlevel >= 2) {
 		// apply water friction, even if in fly mode
-		drop = speed * movevars.waterfriction * pmove.waterlevel * frametime;
-	} else if (pmove.pm_type == PM_FLY) {
+		drop = speed * mv->waterfriction * pm->waterlevel * ctx->frametime;
+	} else if (pm->pm_type == PM_FLY) {
 		// apply flymode friction
-		drop = speed * pm_flyfriction * frametime;
-	} else if (pmove.onground) {
+		drop = speed * pm_flyfriction * ctx->frametime;
+	} else if (pm->onground) {
 		// apply ground friction
-		friction = movevars.friction;
+		friction = mv->friction;
 
 		// if the leading edge is over a dropoff, increase friction
-		if (pmove.onground) {
-			start[0] = stop[0] = pmove.origin[0] + pmove.velocity[0]/speed*16;
-			start[1] = stop[1] = pmove.origin[1] + pmove.velocity[1]/speed*16;
-			start[2] = pmove.origin[2] + player_mins[2];
+		if (pm->onground) {
+			start[0] = stop[0] = pm->origin[0] + pm->velocity[0]/speed*16;
+			start[1] = stop[1] = pm->origin[1] + pm->velocity[1]/speed*16;
+			start[2] = pm->origin[2] + player_mins[2];
 			stop[2] = start[2] - 34;
 
-			trace = PM_PlayerTrace (start, stop);
+			trace = PM_PlayerTraceEx (ctx, start, stop);
 
 			if (trace.fraction == 1)
 				friction *= 2;
 		}
 
-		control = speed < movevars.stopspeed ? movevars.stopspeed : speed;
-		drop = control * friction * frametime;
+		control = speed < mv->stopspeed ? mv->stopspeed : speed;
+		drop = control * friction * ctx->frametime;
 	}
 	else
 		return;		// in air, no friction
@@ -286,171 +297,178 @@ void PM_Friction (void) {
 	newspeed = max(newspeed, 0);
 	newspeed /= speed;
 
-	VectorScale (pmove.velocity, newspeed, pmove.velocity);
+	VectorScale (pm->velocity, newspeed, pm->velocity);
 }
 
-void PM_Accelerate (vec3_t wishdir, float wishspeed, float accel) {
+void PM_Accelerate (struct PMoveContext *ctx, vec3_t wishdir, float wishspeed, float accel) {
+	playermove_t *pm = ctx->pmove;
 	float addspeed, accelspeed, currentspeed;
 
-	if (pmove.pm_type == PM_DEAD)
+	if (pm->pm_type == PM_DEAD)
 		return;
-	if (pmove.waterjumptime)
+	if (pm->waterjumptime)
 		return;
 
-	currentspeed = DotProduct (pmove.velocity, wishdir);
+	currentspeed = DotProduct (pm->velocity, wishdir);
 	addspeed = wishspeed - currentspeed;
 	if (addspeed <= 0)
 		return;
-	accelspeed = accel * frametime * wishspeed;
+	accelspeed = accel * ctx->frametime * wishspeed;
 	if (accelspeed > addspeed)
 		accelspeed = addspeed;
 	
-	VectorMA(pmove.velocity, accelspeed, wishdir, pmove.velocity);
+	VectorMA(pm->velocity, accelspeed, wishdir, pm->velocity);
 }
 
-void PM_AirAccelerate (vec3_t wishdir, float wishspeed, float accel) {
-	float addspeed, accelspeed, currentspeed, wishspd = wishspeed, originalspeed, newspeed, speedcap;
+void PM_AirAccelerate (struct PMoveContext *ctx, vec3_t wishdir, float wishspeed, float accel) {
+	playermove_t *pm = ctx->pmove;
+	movevars_t *mv = ctx->movevars;
+	float addspeed, accelspeed, currentspeed, wishspd = wishspeed, originalspeed = 0, newspeed, speedcap;
 		
-	if (pmove.pm_type == PM_DEAD)
+	if (pm->pm_type == PM_DEAD)
 		return;
-	if (pmove.waterjumptime)
+	if (pm->waterjumptime)
 		return;
 
-	if (movevars.bunnyspeedcap > 0)
-		originalspeed = sqrt(pmove.velocity[0] * pmove.velocity[0] + pmove.velocity[1] * pmove.velocity[1]);
+	if (mv->bunnyspeedcap > 0)
+		originalspeed = sqrt(pm->velocity[0] * pm->velocity[0] + pm->velocity[1] * pm->velocity[1]);
 
 	wishspd = min(wishspd, 30);
-	currentspeed = DotProduct (pmove.velocity, wishdir);
+	currentspeed = DotProduct (pm->velocity, wishdir);
 	addspeed = wishspd - currentspeed;
 	if (addspeed <= 0)
 		return;
-	accelspeed = accel * wishspeed * frametime;
+	accelspeed = accel * wishspeed * ctx->frametime;
 	accelspeed = min(accelspeed, addspeed);
 	
-	VectorMA(pmove.velocity, accelspeed, wishdir, pmove.velocity);
+	VectorMA(pm->velocity, accelspeed, wishdir, pm->velocity);
 
-	if (movevars.bunnyspeedcap > 0) {
-		newspeed = sqrt(pmove.velocity[0] * pmove.velocity[0] + pmove.velocity[1] * pmove.velocity[1]);
+	if (mv->bunnyspeedcap > 0) {
+		newspeed = sqrt(pm->velocity[0] * pm->velocity[0] + pm->velocity[1] * pm->velocity[1]);
 		if (newspeed > originalspeed) {
-			speedcap = movevars.maxspeed * movevars.bunnyspeedcap;
+			speedcap = mv->maxspeed * mv->bunnyspeedcap;
 			if (newspeed > speedcap) {
 				if (originalspeed < speedcap)
 					originalspeed = speedcap;
-				pmove.velocity[0] *= originalspeed / newspeed;
-				pmove.velocity[1] *= originalspeed / newspeed;
+				pm->velocity[0] *= originalspeed / newspeed;
+				pm->velocity[1] *= originalspeed / newspeed;
 			}
 		}
 	}
 }
 
-void PM_WaterMove (void) {
+void PM_WaterMove (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
+	movevars_t *mv = ctx->movevars;
 	int i;
 	vec3_t wishvel, wishdir;
 	float wishspeed;
 
 	// user intentions
 	for (i = 0; i < 3; i++)
-		wishvel[i] = forward[i] * pmove.cmd.forwardmove + right[i] * pmove.cmd.sidemove;
+		wishvel[i] = ctx->forward[i] * pm->cmd.forwardmove + ctx->right[i] * pm->cmd.sidemove;
 
-	if (pmove.pm_type != PM_FLY && !pmove.cmd.forwardmove && !pmove.cmd.sidemove && !pmove.cmd.upmove)
+	if (pm->pm_type != PM_FLY && !pm->cmd.forwardmove && !pm->cmd.sidemove && !pm->cmd.upmove)
 		wishvel[2] -= 60;		// drift towards bottom
 	else
-		wishvel[2] += pmove.cmd.upmove;
+		wishvel[2] += pm->cmd.upmove;
 
 	VectorCopy (wishvel, wishdir);
 	wishspeed = VectorNormalize(wishdir);
 
-	if (wishspeed > movevars.maxspeed) {
-		VectorScale (wishvel, movevars.maxspeed/wishspeed, wishvel);
-		wishspeed = movevars.maxspeed;
+	if (wishspeed > mv->maxspeed) {
+		VectorScale (wishvel, mv->maxspeed/wishspeed, wishvel);
+		wishspeed = mv->maxspeed;
 	}
 	wishspeed *= 0.7;
 
 	// water acceleration
-	PM_Accelerate (wishdir, wishspeed, movevars.wateraccelerate);
+	PM_Accelerate (ctx, wishdir, wishspeed, mv->wateraccelerate);
 
-	PM_StepSlideMove ();
+	PM_StepSlideMove (ctx);
 }
 
-void PM_FlyMove (void) {
+void PM_FlyMove (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
+	movevars_t *mv = ctx->movevars;
 	int		i;
 	vec3_t	wishvel, wishdir;
 	float	wishspeed;
 
 	for (i = 0; i < 3; i++)
-		wishvel[i] = forward[i] * pmove.cmd.forwardmove + right[i] * pmove.cmd.sidemove;
+		wishvel[i] = ctx->forward[i] * pm->cmd.forwardmove + ctx->right[i] * pm->cmd.sidemove;
 	
-	wishvel[2] += pmove.cmd.upmove;
+	wishvel[2] += pm->cmd.upmove;
 
 	VectorCopy (wishvel, wishdir);
 	wishspeed = VectorNormalize(wishdir);
 	
-	if (wishspeed > movevars.maxspeed) {
-		VectorScale (wishvel, movevars.maxspeed/wishspeed, wishvel);
-		wishspeed = movevars.maxspeed;
+	if (wishspeed > mv->maxspeed) {
+		VectorScale (wishvel, mv->maxspeed/wishspeed, wishvel);
+		wishspeed = mv->maxspeed;
 	}
 	
-	PM_Accelerate (wishdir, wishspeed, movevars.accelerate);
+	PM_Accelerate (ctx, wishdir, wishspeed, mv->accelerate);
 	
-	PM_StepSlideMove ();
+	PM_StepSlideMove (ctx);
 }
 
-void PM_AirMove (void) {
+void PM_AirMove (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
+	movevars_t *mv = ctx->movevars;
 	int i;
 	vec3_t wishvel, wishdir;
 	float fmove, smove, wishspeed;
 
-	fmove = pmove.cmd.forwardmove;
-	smove = pmove.cmd.sidemove;
+	fmove = pm->cmd.forwardmove;
+	smove = pm->cmd.sidemove;
 	
-	forward[2] = 0;
-	right[2] = 0;
-	VectorNormalize (forward);
-	VectorNormalize (right);
+	ctx->forward[2] = 0;
+	ctx->right[2] = 0;
+	VectorNormalize (ctx->forward);
+	VectorNormalize (ctx->right);
 
 	for (i = 0; i < 2; i++)
-		wishvel[i] = forward[i] * fmove + right[i] * smove;
+		wishvel[i] = ctx->forward[i] * fmove + ctx->right[i] * smove;
 	wishvel[2] = 0;
 
 	VectorCopy (wishvel, wishdir);
 	wishspeed = VectorNormalize(wishdir);
 
 	// clamp to server defined max speed
-	if (wishspeed > movevars.maxspeed) {
-		VectorScale (wishvel, movevars.maxspeed/wishspeed, wishvel);
-		wishspeed = movevars.maxspeed;
+	if (wishspeed > mv->maxspeed) {
+		VectorScale (wishvel, mv->maxspeed/wishspeed, wishvel);
+		wishspeed = mv->maxspeed;
 	}
 	
-	if (pmove.onground) {
-		if (pmove.velocity[2] > 0 || !movevars.slidefix)
-			pmove.velocity[2] = 0;
-		PM_Accelerate (wishdir, wishspeed, movevars.accelerate);
-		pmove.velocity[2] -= movevars.entgravity * movevars.gravity * frametime;
+	if (pm->onground) {
+		if (pm->velocity[2] > 0 || !mv->slidefix)
+			pm->velocity[2] = 0;
+		PM_Accelerate (ctx, wishdir, wishspeed, mv->accelerate);
+		pm->velocity[2] -= mv->entgravity * mv->gravity * ctx->frametime;
 
-		if (!movevars.slidefix)
-			pmove.velocity[2] = 0;
+		if (!mv->slidefix)
+			pm->velocity[2] = 0;
 
-		if (!pmove.velocity[0] && !pmove.velocity[1]) {
-			pmove.velocity[2] = 0;
+		if (!pm->velocity[0] && !pm->velocity[1]) {
+			pm->velocity[2] = 0;
 			return;
 		}
 
-		PM_StepSlideMove ();
+		PM_StepSlideMove (ctx);
 	} else {	
 		// not on ground, so little effect on velocity
-		PM_AirAccelerate (wishdir, wishspeed, movevars.accelerate);
+		PM_AirAccelerate (ctx, wishdir, wishspeed, mv->accelerate);
 
 		// add gravity
-		pmove.velocity[2] -= movevars.entgravity * movevars.gravity * frametime;
+		pm->velocity[2] -= mv->entgravity * mv->gravity * ctx->frametime;
 
-		PM_SlideMove ();
+		PM_SlideMove (ctx);
 	}
 }
 
-
-pmplane_t	groundplane;
-
-void PM_CategorizePosition (void) {
+void PM_CategorizePositionEx (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
 	vec3_t point;
 	int cont;
 	pmtrace_t trace;
@@ -458,196 +476,203 @@ void PM_CategorizePosition (void) {
 	// if the player hull point one unit down is solid, the player is on ground
 
 	// see if standing on something solid
-	point[0] = pmove.origin[0];
-	point[1] = pmove.origin[1];
-	point[2] = pmove.origin[2] - 1;
-	if (pmove.velocity[2] > 180) {
-		pmove.onground = false;
+	point[0] = pm->origin[0];
+	point[1] = pm->origin[1];
+	point[2] = pm->origin[2] - 1;
+	if (pm->velocity[2] > 180) {
+		pm->onground = false;
 	} else {
-		trace = PM_PlayerTrace (pmove.origin, point);
+		trace = PM_PlayerTraceEx (ctx, pm->origin, point);
 		if (trace.fraction == 1 || trace.plane.normal[2] < MIN_STEP_NORMAL) {
-			pmove.onground = false;
+			pm->onground = false;
 		} else {
-			pmove.onground = true;
-			pmove.groundent = trace.ent;
-			groundplane = trace.plane;
-			pmove.waterjumptime = 0;
+			pm->onground = true;
+			pm->groundent = trace.ent;
+			ctx->groundplane = trace.plane;
+			pm->waterjumptime = 0;
 		}
 
 		// standing on an entity other than the world
 		if (trace.ent > 0) {
-			if (pmove.numtouch < MAX_PHYSENTS) {
-				pmove.touchindex[pmove.numtouch] = trace.ent;
-				pmove.numtouch++;
+			if (pm->numtouch < MAX_PHYSENTS) {
+				pm->touchindex[pm->numtouch] = trace.ent;
+				pm->numtouch++;
 			}
 		}
 	}
 
 	// get waterlevel
-	pmove.waterlevel = 0;
-	pmove.watertype = CONTENTS_EMPTY;
+	pm->waterlevel = 0;
+	pm->watertype = CONTENTS_EMPTY;
 
-	point[2] = pmove.origin[2] + player_mins[2] + 1;
-	cont = PM_PointContents (point);
+	point[2] = pm->origin[2] + player_mins[2] + 1;
+	cont = PM_PointContentsEx (ctx, point);
 
 	if (cont <= CONTENTS_WATER) {
-		pmove.watertype = cont;
-		pmove.waterlevel = 1;
-		point[2] = pmove.origin[2] + (player_mins[2] + player_maxs[2]) * 0.5;
-		cont = PM_PointContents (point);
+		pm->watertype = cont;
+		pm->waterlevel = 1;
+		point[2] = pm->origin[2] + (player_mins[2] + player_maxs[2]) * 0.5;
+		cont = PM_PointContentsEx (ctx, point);
 		if (cont <= CONTENTS_WATER) {
-			pmove.waterlevel = 2;
-			point[2] = pmove.origin[2] + 22;
-			cont = PM_PointContents (point);
+			pm->waterlevel = 2;
+			point[2] = pm->origin[2] + 22;
+			cont = PM_PointContentsEx (ctx, point);
 			if (cont <= CONTENTS_WATER)
-				pmove.waterlevel = 3;
+				pm->waterlevel = 3;
 		}
 	}
 
 	// snap to ground unless in fly mode or underwater
-	if (pmove.onground && pmove.pm_type != PM_FLY && pmove.waterlevel < 2) {
+	if (pm->onground && pm->pm_type != PM_FLY && pm->waterlevel < 2) {
 		if (!trace.startsolid && !trace.allsolid)
-			VectorCopy (trace.endpos, pmove.origin);
+			VectorCopy (trace.endpos, pm->origin);
 	}
 }
 
-void PM_CheckJump (void) {
-	if (pmove.pm_type == PM_FLY)
+void PM_CheckJump (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
+	movevars_t *mv = ctx->movevars;
+	float ktjump;
+
+	if (pm->pm_type == PM_FLY)
 		return;
 
-	if (pmove.pm_type == PM_DEAD) {
-		pmove.jump_held = true;	// don't jump on respawn
+	if (pm->pm_type == PM_DEAD) {
+		pm->jump_held = true;	// don't jump on respawn
 		return;
 	}
 
-	if (!(pmove.cmd.buttons & BUTTON_JUMP)) {
-		pmove.jump_held = false;
+	if (!(pm->cmd.buttons & BUTTON_JUMP)) {
+		pm->jump_held = false;
 		return;
 	}
 
-	if (pmove.waterjumptime)
+	if (pm->waterjumptime)
 		return;
 
-	if (pmove.waterlevel >= 2) {	
+	if (pm->waterlevel >= 2) {	
 		// swimming, not jumping
-		pmove.onground = false;
+		pm->onground = false;
 
-		if (pmove.watertype == CONTENTS_WATER)
-			pmove.velocity[2] = 100;
-		else if (pmove.watertype == CONTENTS_SLIME)
-			pmove.velocity[2] = 80;
+		if (pm->watertype == CONTENTS_WATER)
+			pm->velocity[2] = 100;
+		else if (pm->watertype == CONTENTS_SLIME)
+			pm->velocity[2] = 80;
 		else
-			pmove.velocity[2] = 50;
+			pm->velocity[2] = 50;
 		return;
 	}
 
-	if (!pmove.onground)
+	if (!pm->onground)
 		return;		// in air, so no effect
 
 #ifdef SERVERONLY
-	if (pmove.jump_held)
+	if (pm->jump_held)
 		return;		// don't pogo stick
 #else
-	if (pmove.jump_held && !pmove.jump_msec)
+	if (pm->jump_held && !pm->jump_msec)
 		return;		// don't pogo stick
 #endif
 
 	// check for jump bug
-	// groundplane normal was set in the call to PM_CategorizePosition
-	if (pmove.velocity[2] < 0 && DotProduct(pmove.velocity, groundplane.normal) < -0.1) {
-		// pmove.velocity is pointing into the ground, clip it
-		PM_ClipVelocity (pmove.velocity, groundplane.normal, pmove.velocity, 1);
+	// ctx->groundplane normal was set in the call to PM_CategorizePosition
+	if (pm->velocity[2] < 0 && DotProduct(pm->velocity, ctx->groundplane.normal) < -0.1) {
+		// pm->velocity is pointing into the ground, clip it
+		PM_ClipVelocity (pm->velocity, ctx->groundplane.normal, pm->velocity, 1);
 	}
 
-	pmove.onground = false;
-	pmove.velocity[2] += 270;
+	pm->onground = false;
+	pm->velocity[2] += 270;
 
-	if (movevars.ktjump > 0) {
-		if (movevars.ktjump > 1)
-			movevars.ktjump = 1;
-		if (pmove.velocity[2] < 270)
-			pmove.velocity[2] = pmove.velocity[2] * (1 - movevars.ktjump) + 270 * movevars.ktjump;
+	if (mv->ktjump > 0) {
+		ktjump = min(mv->ktjump, 1);
+		if (pm->velocity[2] < 270)
+			pm->velocity[2] = pm->velocity[2] * (1 - ktjump) + 270 * ktjump;
 	}
 
-	pmove.jump_held = true;	// don't jump again until released
+	pm->jump_held = true;	// don't jump again until released
 
 #ifndef SERVERONLY
-	pmove.jump_msec = pmove.cmd.msec;
+	pm->jump_msec = pm->cmd.msec;
 #endif
 }
 
-void PM_CheckWaterJump (void) {
+void PM_CheckWaterJump (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
 	vec3_t spot;
 	int cont;
 	vec3_t flatforward;
 
-	if (pmove.waterjumptime)
+	if (pm->waterjumptime)
 		return;
 
 	// don't hop out if we just jumped in
-	if (pmove.velocity[2] < -180)
+	if (pm->velocity[2] < -180)
 		return;
 
 	// see if near an edge
-	flatforward[0] = forward[0];
-	flatforward[1] = forward[1];
+	flatforward[0] = ctx->forward[0];
+	flatforward[1] = ctx->forward[1];
 	flatforward[2] = 0;
 	VectorNormalize (flatforward);
 
-	VectorMA (pmove.origin, 24, flatforward, spot);
+	VectorMA (pm->origin, 24, flatforward, spot);
 	spot[2] += 8;
-	cont = PM_PointContents (spot);
+	cont = PM_PointContentsEx (ctx, spot);
 	if (cont != CONTENTS_SOLID)
 		return;
 	spot[2] += 24;
-	cont = PM_PointContents (spot);
+	cont = PM_PointContentsEx (ctx, spot);
 	if (cont != CONTENTS_EMPTY)
 		return;
 	// jump out of water
-	VectorScale (flatforward, 50, pmove.velocity);
-	pmove.velocity[2] = 310;
-	pmove.waterjumptime = 2;	// safety net
-	pmove.jump_held = true;	// don't jump again until released
+	VectorScale (flatforward, 50, pm->velocity);
+	pm->velocity[2] = 310;
+	pm->waterjumptime = 2;	// safety net
+	pm->jump_held = true;	// don't jump again until released
 }
 
-//If pmove.origin is in a solid position, try nudging slightly on all axis to allow for the cut precision of the net coordinates
-void PM_NudgePosition (void) {
+//If pm->origin is in a solid position, try nudging slightly on all axis to allow for the cut precision of the net coordinates
+void PM_NudgePosition (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
 	vec3_t base;
 	int x, y, z, i;
 	static int sign[3] = {0, -1, 1};
 
-	VectorCopy (pmove.origin, base);
+	VectorCopy (pm->origin, base);
 
 	for (i = 0; i < 3; i++)
-		pmove.origin[i] = ((int) (pmove.origin[i] * 8)) * 0.125;
+		pm->origin[i] = ((int) (pm->origin[i] * 8)) * 0.125;
 
 	for (z = 0; z <= 2; z++) {
 		for (y = 0; y <= 2; y++) {
 			for (x = 0; x <= 2; x++) {
-				pmove.origin[0] = base[0] + (sign[x] * 0.125);
-				pmove.origin[1] = base[1] + (sign[y] * 0.125);
-				pmove.origin[2] = base[2] + (sign[z] * 0.125);
-				if (PM_TestPlayerPosition (pmove.origin))
+				pm->origin[0] = base[0] + (sign[x] * 0.125);
+				pm->origin[1] = base[1] + (sign[y] * 0.125);
+				pm->origin[2] = base[2] + (sign[z] * 0.125);
+				if (PM_TestPlayerPositionEx (ctx, pm->origin))
 					return;
 			}
 		}
 	}
-	VectorCopy (base, pmove.origin);
+	VectorCopy (base, pm->origin);
 }
 
-void PM_SpectatorMove (void) {
+void PM_SpectatorMove (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
+	movevars_t *mv = ctx->movevars;
 	float speed, drop, friction, control, newspeed, currentspeed, addspeed, accelspeed, fmove, smove, wishspeed;
 	int i;
 	vec3_t wishvel, wishdir;
 
 	// friction
-	speed = VectorLength (pmove.velocity);
+	speed = VectorLength (pm->velocity);
 	if (speed < 1) {
-		VectorClear (pmove.velocity);
+		VectorClear (pm->velocity);
 	} else {
-		friction = movevars.friction * 1.5;	// extra friction
-		control = speed < movevars.stopspeed ? movevars.stopspeed : speed;
-		drop = control * friction * frametime;
+		friction = mv->friction * 1.5;	// extra friction
+		control = speed < mv->stopspeed ? mv->stopspeed : speed;
+		drop = control * friction * ctx->frametime;
 
 		// scale the velocity
 		newspeed = speed - drop;
@@ -655,105 +680,131 @@ void PM_SpectatorMove (void) {
 			newspeed = 0;
 		newspeed /= speed;
 
-		VectorScale (pmove.velocity, newspeed, pmove.velocity);
+		VectorScale (pm->velocity, newspeed, pm->velocity);
 	}
 
 	// accelerate
-	fmove = pmove.cmd.forwardmove;
-	smove = pmove.cmd.sidemove;
+	fmove = pm->cmd.forwardmove;
+	smove = pm->cmd.sidemove;
 
-	VectorNormalize (forward);
-	VectorNormalize (right);
+	VectorNormalize (ctx->forward);
+	VectorNormalize (ctx->right);
 
 	for (i = 0; i < 3; i++)
-		wishvel[i] = forward[i] * fmove + right[i] * smove;
-	wishvel[2] += pmove.cmd.upmove;
+		wishvel[i] = ctx->forward[i] * fmove + ctx->right[i] * smove;
+	wishvel[2] += pm->cmd.upmove;
 
 	VectorCopy (wishvel, wishdir);
 	wishspeed = VectorNormalize(wishdir);
 
 	// clamp to server defined max speed
-	if (wishspeed > movevars.spectatormaxspeed)	{
-		VectorScale (wishvel, movevars.spectatormaxspeed / wishspeed, wishvel);
-		wishspeed = movevars.spectatormaxspeed;
+	if (wishspeed > mv->spectatormaxspeed)	{
+		VectorScale (wishvel, mv->spectatormaxspeed / wishspeed, wishvel);
+		wishspeed = mv->spectatormaxspeed;
 	}
 
-	currentspeed = DotProduct(pmove.velocity, wishdir);
+	currentspeed = DotProduct(pm->velocity, wishdir);
 	addspeed = wishspeed - currentspeed;
 
 	// Buggy QW spectator mode, kept for compatibility
-	if (pmove.pm_type == PM_OLD_SPECTATOR) {
+	if (pm->pm_type == PM_OLD_SPECTATOR) {
 		if (addspeed <= 0)
 			return;
 	}
 
 	if (addspeed > 0) {
-		accelspeed = movevars.accelerate * frametime * wishspeed;
+		accelspeed = mv->accelerate * ctx->frametime * wishspeed;
 		accelspeed = min(accelspeed, addspeed);
-		VectorMA(pmove.velocity, accelspeed, wishdir, pmove.velocity);
+		VectorMA(pm->velocity, accelspeed, wishdir, pm->velocity);
 	}
 
 	// move
-	VectorMA (pmove.origin, frametime, pmove.velocity, pmove.origin);
+	VectorMA (pm->origin, ctx->frametime, pm->velocity, pm->origin);
 }
 
 //Returns with origin, angles, and velocity modified in place.
 //Numtouch and touchindex[] will be set if any of the physents were contacted during the move.
-void PM_PlayerMove (void) {
-	frametime = pmove.cmd.msec * 0.001;
-	pmove.numtouch = 0;
+void PM_PlayerMoveEx (struct PMoveContext *ctx) {
+	playermove_t *pm = ctx->pmove;
+
+	ctx->frametime = pm->cmd.msec * 0.001;
+	pm->numtouch = 0;
 
 	// take angles directly from command
-	VectorCopy (pmove.cmd.angles, pmove.angles);
-	AngleVectors (pmove.angles, forward, right, up);
+	VectorCopy (pm->cmd.angles, pm->angles);
+	AngleVectors (pm->angles, ctx->forward, ctx->right, ctx->up);
 
-	if (pmove.pm_type == PM_SPECTATOR || pmove.pm_type == PM_OLD_SPECTATOR) {
-		PM_SpectatorMove ();
-		pmove.onground = false;
+	if (pm->pm_type == PM_SPECTATOR || pm->pm_type == PM_OLD_SPECTATOR) {
+		PM_SpectatorMove (ctx);
+		pm->onground = false;
 		return;
 	}
 
-	PM_NudgePosition ();
+	PM_NudgePosition (ctx);
 
 	// set onground, watertype, and waterlevel
-	PM_CategorizePosition ();
+	PM_CategorizePositionEx (ctx);
 
-	if (pmove.waterlevel == 2 && pmove.pm_type != PM_FLY)
-		PM_CheckWaterJump ();
+	if (pm->waterlevel == 2 && pm->pm_type != PM_FLY)
+		PM_CheckWaterJump (ctx);
 
-	if (pmove.velocity[2] < 0 || pmove.pm_type == PM_DEAD)
-		pmove.waterjumptime = 0;
+	if (pm->velocity[2] < 0 || pm->pm_type == PM_DEAD)
+		pm->waterjumptime = 0;
 
-	if (pmove.waterjumptime) {
-		pmove.waterjumptime -= frametime;
-		if (pmove.waterjumptime < 0)
-			pmove.waterjumptime = 0;
+	if (pm->waterjumptime) {
+		pm->waterjumptime -= ctx->frametime;
+		if (pm->waterjumptime < 0)
+			pm->waterjumptime = 0;
 	}
 
 #ifndef SERVERONLY
-	if (pmove.jump_msec) {
-		pmove.jump_msec += pmove.cmd.msec;
-		if (pmove.jump_msec > 50)
-			pmove.jump_msec = 0;
+	if (pm->jump_msec) {
+		pm->jump_msec += pm->cmd.msec;
+		if (pm->jump_msec > 50)
+			pm->jump_msec = 0;
 	}
 #endif
 
-	PM_CheckJump ();
+	PM_CheckJump (ctx);
 
-	PM_Friction ();
+	PM_Friction (ctx);
 
-	if (pmove.waterlevel >= 2)
-		PM_WaterMove ();
-	else if (pmove.pm_type == PM_FLY)
-		PM_FlyMove ();
+	if (pm->waterlevel >= 2)
+		PM_WaterMove (ctx);
+	else if (pm->pm_type == PM_FLY)
+		PM_FlyMove (ctx);
 	else
-		PM_AirMove ();
+		PM_AirMove (ctx);
 
 	// set onground, watertype, and waterlevel for final spot
-	PM_CategorizePosition ();
+	PM_CategorizePositionEx (ctx);
 
 	// this is to make sure landing sound is not played twice
 	// and falling damage is calculated correctly
-	if (pmove.onground && pmove.velocity[2] < -300 && DotProduct(pmove.velocity, groundplane.normal) < -0.1)
-		PM_ClipVelocity (pmove.velocity, groundplane.normal, pmove.velocity, 1);
+	if (pm->onground && pm->velocity[2] < -300 && DotProduct(pm->velocity, ctx->groundplane.normal) < -0.1)
+		PM_ClipVelocity (pm->velocity, ctx->groundplane.normal, pm->velocity, 1);
+}
+
+void PM_PlayerMove (void) {
+	PM_PlayerMoveEx (&pmove_context);
+}
+
+void PM_CategorizePosition (void) {
+	PM_CategorizePositionEx (&pmove_context);
+}
+
+qboolean PM_TestPlayerPosition (vec3_t pos) {
+	return PM_TestPlayerPositionEx (&pmove_context, pos);
+}
+
+int PM_PointContents (vec3_t p) {
+	return PM_PointContentsEx (&pmove_context, p);
+}
+
+pmtrace_t PM_PlayerTrace (vec3_t start, vec3_t end) {
+	return PM_PlayerTraceEx (&pmove_context, start, end);
+}
+
+pmtrace_t PM_TraceLine (vec3_t start, vec3_t end) {
+	return PM_TraceLineEx (&pmove_context, start, end);
 }
@@ -98,16 +98,40 @@ typedef struct {
 	int		slidefix;
 } movevars_t;
 
+//Everything a single player move needs, so that several moves can run at once
+struct PMoveContext
+{
+	playermove_t	*pmove;
+	movevars_t		*movevars;
+
+	float		frametime;
+	vec3_t		forward, right, up;
+	pmplane_t	groundplane;
+
+	hull_t		box_hull;
+	dclipnode_t	box_clipnodes[6];
+	mplane_t	box_planes[6];
+};
+
 extern	movevars_t		movevars;
 extern	playermove_t	pmove;
+extern	struct PMoveContext	pmove_context;	// wraps pmove and movevars
 
 void PM_PlayerMove (void);
 void PM_Init (void);
+void PM_InitContext (struct PMoveContext *ctx, playermove_t *pm, movevars_t *mv);
+void PM_PlayerMoveEx (struct PMoveContext *ctx);
 
 qboolean PM_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, pmtrace_t *trace);
 int PM_HullPointContents (hull_t *hull, int num, vec3_t p);
+void PM_HullPointContentsBatch (hull_t *hull, int num, const float * const *points, unsigned int *indices, unsigned int count, int *contents);
 int PM_PointContents (vec3_t point);
+int PM_PointContentsEx (struct PMoveContext *ctx, vec3_t point);
 void PM_CategorizePosition (void);
+void PM_CategorizePositionEx (struct PMoveContext *ctx);
 qboolean PM_TestPlayerPosition (vec3_t point);
+qboolean PM_TestPlayerPositionEx (struct PMoveContext *ctx, vec3_t point);
 pmtrace_t PM_PlayerTrace (vec3_t start, vec3_t end);
+pmtrace_t PM_PlayerTraceEx (struct PMoveContext *ctx, vec3_t start, vec3_t end);
 pmtrace_t PM_TraceLine (vec3_t start, vec3_t end);
+pmtrace_t PM_TraceLineEx (struct PMoveContext *ctx, vec3_t start, vec3_t end);
@@ -23,50 +23,46 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "pmove.h"
 
-static	hull_t		box_hull;
-static	dclipnode_t	box_clipnodes[6];
-static	mplane_t	box_planes[6];
-
 extern	vec3_t player_mins;
 extern	vec3_t player_maxs;
 
 //Set up the planes and clipnodes so that the six floats of a bounding box can just be stored out and get a proper hull_t structure.
-void PM_InitBoxHull (void) {
+void PM_InitBoxHull (struct PMoveContext *ctx) {
 	int i, side;
 
-	box_hull.clipnodes = box_clipnodes;
-	box_hull.planes = box_planes;
-	box_hull.firstclipnode = 0;
-	box_hull.lastclipnode = 5;
+	ctx->box_hull.clipnodes = ctx->box_clipnodes;
+	ctx->box_hull.planes = ctx->box_planes;
+	ctx->box_hull.firstclipnode = 0;
+	ctx->box_hull.lastclipnode = 5;
 
 	for (i = 0; i < 6; i++) {
-		box_clipnodes[i].planenum = i;
+		ctx->box_clipnodes[i].planenum = i;
 
 		side = i & 1;
 
-		box_clipnodes[i].children[side] = CONTENTS_EMPTY;
+		ctx->box_clipnodes[i].children[side] = CONTENTS_EMPTY;
 		if (i != 5)
-			box_clipnodes[i].children[side^1] = i + 1;
+			ctx->box_clipnodes[i].children[side^1] = i + 1;
 		else
-			box_clipnodes[i].children[side^1] = CONTENTS_SOLID;
+			ctx->box_clipnodes[i].children[side^1] = CONTENTS_SOLID;
 
-		box_planes[i].type = i>>1;
-		box_planes[i].normal[i>>1] = 1;
+		ctx->box_planes[i].type = i>>1;
+		ctx->box_planes[i].normal[i>>1] = 1;
 	}
 	
 }
 
 //To keep everything totally uniform, bounding boxes are turned into small
 //BSP trees instead of being compared directly.
-hull_t	*PM_HullForBox (vec3_t mins, vec3_t maxs) {
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = mins[0];
-	box_planes[2].dist = maxs[1];
-	box_planes[3].dist = mins[1];
-	box_planes[4].dist = maxs[2];
-	box_planes[5].dist = mins[2];
-
-	return &box_hull;
+hull_t	*PM_HullForBox (struct PMoveContext *ctx, vec3_t mins, vec3_t maxs) {
+	ctx->box_planes[0].dist = maxs[0];
+	ctx->box_planes[1].dist = mins[0];
+	ctx->box_planes[2].dist = maxs[1];
+	ctx->box_planes[3].dist = mins[1];
+	ctx->box_planes[4].dist = maxs[2];
+	ctx->box_planes[5].dist = mins[2];
+
+	return &ctx->box_hull;
 }
 
 int PM_HullPointContents (hull_t *hull, int num, vec3_t p) {
@@ -88,14 +84,62 @@ int PM_HullPointContents (hull_t *hull, int num, vec3_t p) {
 	return num;
 }
 
-int PM_PointContents (vec3_t p) {
+//Classifies many points in one walk of the hull. At every node the index list is partitioned by side,
+//so points that share a path through the tree also share the node and plane loads.
+//points holds the x, y and z arrays, indices is reordered and contents is indexed like the points.
+void PM_HullPointContentsBatch (hull_t *hull, int num, const float * const *points, unsigned int *indices, unsigned int count, int *contents) {
+	unsigned int i, front, index;
+	vec3_t p;
+	dclipnode_t *node;
+	mplane_t *plane;
+
+	while (num >= 0 && count) {
+		if (num < hull->firstclipnode || num > hull->lastclipnode)
+			Sys_Error ("PM_HullPointContentsBatch: bad node number");
+
+		node = hull->clipnodes + num;
+		plane = hull->planes + node->planenum;
+
+		front = 0;
+		i = count;
+		while (front < i) {
+			index = indices[front];
+			p[0] = points[0][index];
+			p[1] = points[1][index];
+			p[2] = points[2][index];
+
+			if (PlaneDiff(p, plane) < 0) {
+				indices[front] = indices[--i];
+				indices[i] = index;
+			} else {
+				front++;
+			}
+		}
+
+		if (front == 0) {
+			num = node->children[1];
+		} else if (front == count) {
+			num = node->children[0];
+		} else {
+			PM_HullPointContentsBatch (hull, node->children[0], points, indices, front, contents);
+			indices += front;
+			count -= front;
+			num = node->children[1];
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		contents[indices[i]] = num;
+}
+
+int PM_PointContentsEx (struct PMoveContext *ctx, vec3_t p) {
 	float d;
 	dclipnode_t	*node;
 	mplane_t *plane;
 	hull_t *hull;
 	int num;
 
-	hull = &pmove.physents[0].model->hulls[0];
+	hull = &ctx->pmove->physents[0].model->hulls[0];
 
 	num = hull->firstclipnode;
 
@@ -225,24 +269,24 @@ qboolean PM_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 }
 
 //Returns false if the given player position is not valid (in solid)
-qboolean PM_TestPlayerPosition (vec3_t pos) {
+qboolean PM_TestPlayerPositionEx (struct PMoveContext *ctx, vec3_t pos) {
 	int i;
 	physent_t *pe;
 	vec3_t mins, maxs, pos_l, offset;
 	hull_t *hull;
 
-	for (i = 0; i < pmove.numphysent; i++) {
-		pe = &pmove.physents[i];
+	for (i = 0; i < ctx->pmove->numphysent; i++) {
+		pe = &ctx->pmove->physents[i];
 		// get the clipping hull
 		if (pe->model) {
-			hull = &pmove.physents[i].model->hulls[1];
+			hull = &ctx->pmove->physents[i].model->hulls[1];
 			VectorSubtract(hull->clip_mins, player_mins, offset);
 			VectorAdd(offset, pe->origin, offset);
 			VectorSubtract(pos, offset, pos_l);
 		} else{
 			VectorSubtract (pe->mins, player_maxs, mins);
 			VectorSubtract (pe->maxs, player_mins, maxs);
-			hull = PM_HullForBox (mins, maxs);
+			hull = PM_HullForBox (ctx, mins, maxs);
 			VectorSubtract(pos, pe->origin, pos_l);
 		}
 
@@ -253,7 +297,7 @@ qboolean PM_TestPlayerPosition (vec3_t pos) {
 	return true;
 }
 
-pmtrace_t PM_PlayerTrace (vec3_t start, vec3_t end) {
+pmtrace_t PM_PlayerTraceEx (struct PMoveContext *ctx, vec3_t start, vec3_t end) {
 	pmtrace_t trace, total;
 	vec3_t offset, start_l, end_l, mins, maxs;
 	hull_t *hull;
@@ -266,17 +310,17 @@ pmtrace_t PM_PlayerTrace (vec3_t start, vec3_t end) {
 	total.ent = -1;
 	VectorCopy (end, total.endpos);
 
-	for (i = 0; i < pmove.numphysent; i++) {
-		pe = &pmove.physents[i];
+	for (i = 0; i < ctx->pmove->numphysent; i++) {
+		pe = &ctx->pmove->physents[i];
 		// get the clipping hull
 		if (pe->model) {
-			hull = &pmove.physents[i].model->hulls[1];
+			hull = &ctx->pmove->physents[i].model->hulls[1];
 			VectorSubtract(hull->clip_mins, player_mins, offset);
 			VectorAdd(offset, pe->origin, offset);
 		} else {
 			VectorSubtract (pe->mins, player_maxs, mins);
 			VectorSubtract (pe->maxs, player_mins, maxs);
-			hull = PM_HullForBox (mins, maxs);
+			hull = PM_HullForBox (ctx, mins, maxs);
 			VectorCopy(pe->origin, offset);
 		}
 
@@ -312,7 +356,7 @@ pmtrace_t PM_PlayerTrace (vec3_t start, vec3_t end) {
 }
 
 //FIXME: merge with PM_PlayerTrace (PM_Move?)
-pmtrace_t PM_TraceLine (vec3_t start, vec3_t end) {
+pmtrace_t PM_TraceLineEx (struct PMoveContext *ctx, vec3_t start, vec3_t end) {
 	pmtrace_t trace, total;
 	vec3_t offset, start_l, end_l;
 	hull_t *hull;
@@ -325,13 +369,13 @@ pmtrace_t PM_TraceLine (vec3_t start, vec3_t end) {
 	total.ent = -1;
 	VectorCopy (end, total.endpos);
 
-	for (i = 0; i < pmove.numphysent; i++) {
-		pe = &pmove.physents[i];
+	for (i = 0; i < ctx->pmove->numphysent; i++) {
+		pe = &ctx->pmove->physents[i];
 	// get the clipping hull
 		if (pe->model)
-			hull = &pmove.physents[i].model->hulls[0];
+			hull = &ctx->pmove->physents[i].model->hulls[0];
 		else
-			hull = PM_HullForBox (pe->mins, pe->maxs);
+			hull = PM_HullForBox (ctx, pe->mins, pe->maxs);
 
 		// PM_HullForEntity (ent, mins, maxs, offset);
 		VectorCopy (pe->origin, offset);
@@ -313,7 +313,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define FTEX_CHUNKEDDOWNLOADS 0x20000000
 #define FTEX_CSQC             0x40000000
 
-#define FTEX_SUPPORTED (FTEX_FLOATCOORDS /*| FTEX_CHUNKEDDOWNLOADS*/)
+#define FTEX_SUPPORTED (FTEX_FLOATCOORDS | FTEX_CHUNKEDDOWNLOADS)
 
 /*
 ==========================================================
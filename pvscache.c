@@ -0,0 +1,192 @@
+/*
+Copyright (C) 2026 Fodquake developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bspfile.h"
+#include "pvscache.h"
+
+/* Maps whose rows all fit in this much memory get one slot per leaf, so
+ * every row is decompressed at most once. Larger maps keep the most
+ * recently used rows. */
+#define PVSCACHE_MAXBYTES (4*1024*1024)
+#define PVSCACHE_MINSLOTS 64
+
+#define PVSCACHE_NOSLOT 0xffff
+
+struct PVSCache
+{
+	unsigned int numleafs;
+	unsigned int rowbytes;
+	unsigned int numslots;
+	unsigned int usedslots;
+	unsigned int clock;
+	unsigned short *leafslot;
+	unsigned short *slotleaf;
+	unsigned int *slotlastused;
+	unsigned char *rows;
+};
+
+static void PVSCache_Decompress(const unsigned char *in, unsigned char *out, unsigned int numleafs, unsigned int rowbytes)
+{
+	unsigned int row;
+	unsigned int c;
+	unsigned char *start;
+
+	row = (numleafs + 7) >> 3;
+	start = out;
+
+	if (!in)
+	{
+		// no vis info, so make all visible
+		memset(out, 0xff, row);
+		out += row;
+	}
+	else
+	{
+		while (out - start < row)
+		{
+			if (*in)
+			{
+				*out++ = *in++;
+				continue;
+			}
+
+			c = in[1];
+			in += 2;
+			if (c > row - (out - start))
+				c = row - (out - start);
+			memset(out, 0, c);
+			out += c;
+		}
+	}
+
+	memset(out, 0, rowbytes - (out - start));
+}
+
+struct PVSCache *PVSCache_Create(unsigned int numleafs)
+{
+	struct PVSCache *pvscache;
+	unsigned int i;
+
+	if (numleafs == 0 || numleafs > MAX_MAP_LEAFS)
+		return 0;
+
+	pvscache = malloc(sizeof(*pvscache));
+	if (pvscache)
+	{
+		pvscache->numleafs = numleafs;
+		pvscache->rowbytes = PVSCACHE_ROWBYTES(numleafs);
+		pvscache->numslots = PVSCACHE_MAXBYTES / pvscache->rowbytes;
+		if (pvscache->numslots < PVSCACHE_MINSLOTS)
+			pvscache->numslots = PVSCACHE_MINSLOTS;
+		if (pvscache->numslots > numleafs)
+			pvscache->numslots = numleafs;
+		pvscache->usedslots = 0;
+		pvscache->clock = 0;
+
+		pvscache->leafslot = malloc(numleafs * sizeof(*pvscache->leafslot));
+		if (pvscache->leafslot)
+		{
+			for(i=0;i<numleafs;i++)
+				pvscache->leafslot[i] = PVSCACHE_NOSLOT;
+
+			pvscache->slotleaf = malloc(pvscache->numslots * sizeof(*pvscache->slotleaf));
+			if (pvscache->slotleaf)
+			{
+				pvscache->slotlastused = malloc(pvscache->numslots * sizeof(*pvscache->slotlastused));
+				if (pvscache->slotlastused)
+				{
+					pvscache->rows = malloc(pvscache->numslots * pvscache->rowbytes);
+					if (pvscache->rows)
+					{
+						return pvscache;
+					}
+
+					free(pvscache->slotlastused);
+				}
+
+				free(pvscache->slotleaf);
+			}
+
+			free(pvscache->leafslot);
+		}
+
+		free(pvscache);
+	}
+
+	return 0;
+}
+
+void PVSCache_Delete(struct PVSCache *pvscache)
+{
+	free(pvscache->rows);
+	free(pvscache->slotlastused);
+	free(pvscache->slotleaf);
+	free(pvscache->leafslot);
+	free(pvscache);
+}
+
+unsigned char *PVSCache_Get(struct PVSCache *pvscache, unsigned int leafnum, const unsigned char *compressed, unsigned int numleafs)
+{
+	static unsigned char decompressed[PVSCACHE_ROWBYTES(MAX_MAP_LEAFS)] __attribute__((aligned(16)));
+	unsigned int slot;
+	unsigned int i;
+
+	if (pvscache == 0 || leafnum >= pvscache->numleafs)
+	{
+		PVSCache_Decompress(compressed, decompressed, numleafs, PVSCACHE_ROWBYTES(numleafs));
+		return decompressed;
+	}
+
+	pvscache->clock++;
+
+	slot = pvscache->leafslot[leafnum];
+	if (slot != PVSCACHE_NOSLOT)
+	{
+		pvscache->slotlastused[slot] = pvscache->clock;
+		return pvscache->rows + slot * pvscache->rowbytes;
+	}
+
+	if (pvscache->usedslots < pvscache->numslots)
+	{
+		slot = pvscache->usedslots++;
+	}
+	else
+	{
+		slot = 0;
+		for(i=1;i<pvscache->numslots;i++)
+		{
+			if (pvscache->clock - pvscache->slotlastused[i] > pvscache->clock - pvscache->slotlastused[slot])
+				slot = i;
+		}
+
+		pvscache->leafslot[pvscache->slotleaf[slot]] = PVSCACHE_NOSLOT;
+	}
+
+	pvscache->leafslot[leafnum] = slot;
+	pvscache->slotleaf[slot] = leafnum;
+	pvscache->slotlastused[slot] = pvscache->clock;
+
+	PVSCache_Decompress(compressed, pvscache->rows + slot * pvscache->rowbytes, pvscache->numleafs, pvscache->rowbytes);
+
+	return pvscache->rows + slot * pvscache->rowbytes;
+}
+
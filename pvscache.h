@@ -0,0 +1,34 @@
+/*
+Copyright (C) 2026 Fodquake developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+struct PVSCache;
+
+/* Rows returned by the cache are padded with zeroes to a multiple of 16
+ * bytes, so they can be read a machine word at a time. */
+#define PVSCACHE_ROWBYTES(numleafs) ((((numleafs) + 127) >> 7) << 4)
+
+struct PVSCache *PVSCache_Create(unsigned int numleafs);
+void PVSCache_Delete(struct PVSCache *pvscache);
+
+/* Returns the decompressed PVS of leaf leafnum (counting from the first leaf
+ * after the solid leaf 0). pvscache may be 0, in which case the row is
+ * decompressed into a static buffer that the next call overwrites. Rows
+ * from a cache stay valid across at least the next 63 calls. */
+unsigned char *PVSCache_Get(struct PVSCache *pvscache, unsigned int leafnum, const unsigned char *compressed, unsigned int numleafs);
+
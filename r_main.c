@@ -25,6 +25,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "r_local.h"
 #include "sound.h"
+#include "pvscache.h"
 
 void		*colormap;
 float		r_time1;
@@ -503,23 +504,47 @@ void R_ViewChanged(vrect_t *pvrect, int lineadj, float aspect)
 
 static void R_MarkLeaves(void)
 {
-	byte *vis;
+	static unsigned long lastvis[PVSCACHE_ROWBYTES(MAX_MAP_LEAFS) / sizeof(unsigned long)];
+	static model_t *lastvismodel;
+	const unsigned long *vis;
+	unsigned long bits;
 	mnode_t *node;
-	int i;
+	unsigned int i, numwords, leafnum;
+	int samemap;
 
 	if (r_oldviewleaf == r_viewleaf)
 		return;
 
-	r_visframecount++;
+	// r_oldviewleaf is cleared by R_NewMap
+	samemap = r_oldviewleaf && lastvismodel == cl.worldmodel;
 	r_oldviewleaf = r_viewleaf;
 
-	vis = Mod_LeafPVS (r_viewleaf, cl.worldmodel);
+	numwords = PVSCACHE_ROWBYTES(cl.worldmodel->numleafs) / sizeof(unsigned long);
 
-	for (i = 0; i < cl.worldmodel->numleafs; i++)
+	vis = (unsigned long *)Mod_LeafPVS (r_viewleaf, cl.worldmodel);
+
+	// neighbouring leafs often see exactly the same set of leafs
+	if (samemap && memcmp(vis, lastvis, numwords * sizeof(*vis)) == 0)
+		return;
+
+	memcpy(lastvis, vis, numwords * sizeof(*vis));
+	lastvismodel = cl.worldmodel;
+
+	r_visframecount++;
+
+	// only visit the set bits, a word at a time
+	for (i = 0; i < numwords; i++)
 	{
-		if (vis[i >> 3] & (1 << (i & 7)))
+		bits = vis[i];
+		while (bits)
 		{
-			node = (mnode_t *) &cl.worldmodel->leafs[i+1];
+			leafnum = i * (sizeof(bits) * 8) + __builtin_ctzl(bits);
+			bits &= bits - 1;
+
+			if (leafnum >= cl.worldmodel->numleafs)
+				break;
+
+			node = (mnode_t *)&cl.worldmodel->leafs[leafnum + 1];
 			while(1)
 			{
 				if (node->visframe == r_visframecount)
@@ -527,6 +552,7 @@ static void R_MarkLeaves(void)
 				node->visframe = r_visframecount;
 				if (node->parentnum == 0xffff)
 					break;
+
 				node = NODENUM_TO_NODE(cl.worldmodel, node->parentnum);
 			}
 		}
@@ -37,12 +37,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "fmod.h"
+#include "pvscache.h"
 
 static void Mod_LoadSpriteModel(model_t *mod, void *buffer);
 static void Mod_LoadBrushModel(model_t *mod, void *buffer);
 static void Mod_LoadAliasModel(model_t *mod, void *buffer);
 
-byte	mod_novis[MAX_MAP_LEAFS/8];
+byte	mod_novis[PVSCACHE_ROWBYTES(MAX_MAP_LEAFS)] __attribute__((aligned(16)));
 
 static model_t *firstmodel;
 
@@ -81,51 +82,11 @@ mleaf_t *Mod_PointInLeaf (vec3_t p, model_t *model)
 	return NULL;	// never reached
 }
 
-static byte *Mod_DecompressVis (byte *in, model_t *model)
-{
-	static byte	decompressed[MAX_MAP_LEAFS/8];
-	int c, row;
-	byte *out;
-
-	row = (model->numleafs + 7) >> 3;
-	out = decompressed;
-
-	if (!in)
-	{
-		// no vis info, so make all visible
-		while (row)
-		{
-			*out++ = 0xff;
-			row--;
-		}
-		return decompressed;
-	}
-
-	do
-	{
-		if (*in)
-		{
-			*out++ = *in++;
-			continue;
-		}
-
-		c = in[1];
-		in += 2;
-		while (c)
-		{
-			*out++ = 0;
-			c--;
-		}
-	} while (out - decompressed < row);
-
-	return decompressed;
-}
-
 byte *Mod_LeafPVS (mleaf_t *leaf, model_t *model)
 {
 	if (leaf == model->leafs)
 		return mod_novis;
-	return Mod_DecompressVis (leaf->compressed_vis, model);
+	return PVSCache_Get(model->pvscache, leaf - model->leafs - 1, leaf->compressed_vis, model->numleafs);
 }
 
 static void Mod_FreeAliasData(model_t *model)
@@ -232,6 +193,10 @@ static void Mod_FreeBrushData(model_t *model)
 	free(model->visdata);
 	model->visdata = 0;
 
+	if (model->pvscache)
+		PVSCache_Delete(model->pvscache);
+	model->pvscache = 0;
+
 	free(model->entities);
 	model->entities = 0;
 
@@ -1555,6 +1520,9 @@ static void Mod_LoadBrushModel(model_t *mod, void *buffer)
 				mod = nextmodel;
 			}
 		}
+
+		// only the world has visibility data, and its leaf count is only known now
+		mainmodel->pvscache = PVSCache_Create(mainmodel->numleafs);
 	}
 
 	free(submodels);
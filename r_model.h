@@ -356,6 +356,7 @@ typedef struct model_s
 	texture_t	**textures;
 
 	byte		*visdata;
+	struct PVSCache	*pvscache;
 	byte		*lightdata;
 	char		*entities;
 
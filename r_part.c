@@ -600,8 +600,6 @@ int R_InitParticles(void)
 	{
 #ifdef GLQUAKE
 		QMB_InitParticles();
-
-		GL_DrawParticleInit();
 #endif
 
 		return 1;
@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define _GNU_SOURCE
 
+#include <ctype.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
@@ -64,6 +65,7 @@ static double qtv_connect_time;
 static cvar_t sb_masterserver = {"sb_masterserver", "qwmaster.fodquake.net:27000 master.quakeservers.net:27000 satan.idsoftware.com:27000"};
 static cvar_t sb_player_drawing = {"sb_player_drawing", "1"};
 static cvar_t sb_refresh_on_activate = {"sb_refresh_on_activate", "1"};
+static cvar_t sb_cache = {"sb_cache", "1"};
 
 static cvar_t sb_color_bg = {"sb_color_bg", "1"};
 static cvar_t sb_color_bg_free = {"sb_color_bg_free", "55"};
@@ -87,6 +89,20 @@ static int sb_default_settings = 1;
 static const struct QWServer **sb_qw_server;
 static unsigned int sb_qw_server_count = 0;
 
+// precomputed search keys, one per entry in sb_qw_server
+struct sb_search_keys
+{
+	const struct QWServer *server;
+	unsigned int changecount;
+	char *hostname;		// lowercased, NULL if the server has none
+	char *map;
+	char *gamedir;
+	char *players;		// colour stripped and lowercased player and spectator names, nul separated
+	unsigned int numplayers;
+};
+
+static struct sb_search_keys *sb_search_keys;
+
 static int sb_help_prev = -1;
 static int sb_active_help_window = 0;
 #define SB_HELP_WINDOWS 4
@@ -173,6 +189,10 @@ struct tab
 	int sort_dir;
 	struct server **servers;
 	int *server_index;
+	int server_index_size;
+	unsigned char *matches;		// one bit per entry in sb_qw_server
+	int (*check_function)(struct tab *tab, int server);
+	char *filter_key;		// lowercased player_filter or text_filter
 	char *player_filter;
 	char *text_filter;
 	struct linked_list *filters;
@@ -483,7 +503,9 @@ static void sb_del_tab(struct tab *tab)
 	free(tab->column_types);
 	free(tab->player_filter);
 	free(tab->text_filter);
+	free(tab->filter_key);
 	free(tab->server_index);
+	free(tab->matches);
 	free(tab);
 }
 
@@ -537,20 +559,135 @@ static void SB_Set_Statusbar (const char *format, ...)
 	va_end(args);
 }
 
+static char *remove_colors(char *new_string, const char *string, int size);
+
+static char *sb_lowercase(const char *string)
+{
+	char *new_string, *p;
+
+	if (string == NULL)
+		return NULL;
+
+	new_string = strdup(string);
+	if (new_string == NULL)
+		return NULL;
+
+	for (p = new_string; *p; p++)
+		*p = tolower((unsigned char)*p);
+
+	return new_string;
+}
+
+static void sb_free_search_keys(struct sb_search_keys *keys)
+{
+	free(keys->hostname);
+	free(keys->map);
+	free(keys->gamedir);
+	free(keys->players);
+}
+
+static void sb_build_search_keys(struct sb_search_keys *keys, const struct QWServer *server)
+{
+	int i, length;
+	const char *name;
+	char *p, *start;
+
+	keys->server = server;
+	keys->changecount = server->changecount;
+	keys->hostname = sb_lowercase(server->hostname);
+	keys->map = sb_lowercase(server->map);
+	keys->gamedir = sb_lowercase(server->gamedir);
+	keys->players = NULL;
+	keys->numplayers = 0;
+
+	length = 0;
+	for (i=0; i<server->numplayers; i++)
+		if (server->players[i].name)
+			length += strlen(server->players[i].name) + 1;
+	for (i=0; i<server->numspectators; i++)
+		if (server->spectators[i].name)
+			length += strlen(server->spectators[i].name) + 1;
+
+	if (length == 0)
+		return;
+
+	keys->players = malloc(length);
+	if (keys->players == NULL)
+		return;
+
+	p = keys->players;
+	for (i=0; i<server->numplayers + server->numspectators; i++)
+	{
+		if (i < server->numplayers)
+			name = server->players[i].name;
+		else
+			name = server->spectators[i - server->numplayers].name;
+
+		if (name == NULL)
+			continue;
+
+		start = p;
+		p = remove_colors(p, name, strlen(name));
+		for (; start < p; start++)
+			*start = tolower((unsigned char)*start);
+		p++;
+
+		keys->numplayers++;
+	}
+}
+
+static void SB_Clear_Servers(void)
+{
+	struct tab *tab;
+	unsigned int i;
+
+	if (sb_qw_server)
+		ServerScanner_FreeServers(serverscanner, sb_qw_server);
+
+	if (sb_search_keys)
+	{
+		for (i=0; i<sb_qw_server_count; i++)
+			sb_free_search_keys(&sb_search_keys[i]);
+
+		free(sb_search_keys);
+	}
+
+	sb_search_keys = NULL;
+	sb_qw_server = NULL;
+	sb_qw_server_count = 0;
+
+	for (tab = tab_first; tab; tab = tab->next)
+	{
+		free(tab->matches);
+		tab->matches = NULL;
+		tab->server_count = 0;
+	}
+}
+
+static const char *SB_Cache_Filename(void)
+{
+	return va("%s/qw/sbcache.dat", com_basedir);
+}
+
+static void SB_Save_Cache(void)
+{
+	if (serverscanner && sb_cache.value)
+		ServerScanner_SaveCache(serverscanner, SB_Cache_Filename());
+}
+
 static void SB_Refresh(void)
 {
 	struct tab *tab;
 
 	if (serverscanner)
 	{
-		ServerScanner_FreeServers(serverscanner, sb_qw_server);
+		SB_Save_Cache();
+		SB_Clear_Servers();
 		ServerScanner_Delete(serverscanner);
 	}
 	serverscanner = NULL;
-	sb_qw_server = NULL;
 	current_selected_server = NULL;
-	sb_qw_server_count = 0;
-	serverscanner = ServerScanner_Create(sb_masterserver.string);
+	serverscanner = ServerScanner_Create(sb_masterserver.string, sb_cache.value ? SB_Cache_Filename() : 0);
 	if (serverscanner == NULL)
 		SB_Set_Statusbar("error creating server scanner!");
 
@@ -628,14 +765,14 @@ static void handle_textbox(int key, char *string, int *position, int size)
 	*position += 1;
 }
 
-static int Check_Server_Against_Filter(struct tab *tab, const struct QWServer *server)
+static int Check_Server_Against_Filter(struct tab *tab, int server)
 {
 	struct filter *fe;
 
 	fe = (struct filter *) List_Get_Node(tab->filters, 0);
 	while (fe)
 	{
-		if (filter_types[fe->key].compare_function((struct QWServer *)server, fe) == 0)
+		if (filter_types[fe->key].compare_function((struct QWServer *)sb_qw_server[server], fe) == 0)
 			return 0;
 		
 		fe = (struct filter *)fe->node.next;
@@ -643,17 +780,13 @@ static int Check_Server_Against_Filter(struct tab *tab, const struct QWServer *s
 	return 1;
 }
 
-static char *remove_colors(const char *string, int size)
+// writes the colour stripped string to new_string, which must hold size + 1 chars, and returns a pointer to its terminator
+static char *remove_colors(char *new_string, const char *string, int size)
 {
 	const char *ptr;
-	char *ptr1, *new_string;
+	char *ptr1;
 	int x = 0;
 
-	new_string = calloc(size+1, sizeof(char));
-
-	if (new_string == NULL)
-		return NULL;
-
 	ptr = string;
 	ptr1 = new_string;
 
@@ -683,77 +816,56 @@ static char *remove_colors(const char *string, int size)
 		x++;
 	}
 
-	return new_string;
+	*ptr1 = '\0';
+
+	return ptr1;
 }
 
-static int check_player_name(char *name, const struct QWServer *server)
+// name has to be lowercased
+static int check_player_name(const char *name, int server)
 {
-	int i;
-	char *player;
-	char *player_uncolored;
+	const char *player;
+	unsigned int i;
 
-	player = name;
-
-	if (server->numplayers == 0 && server->numspectators == 0)
-		return 0;
+	player = sb_search_keys[server].players;
 
-	for (i=0; i<server->numplayers; i++)
+	for (i=0; i<sb_search_keys[server].numplayers; i++)
 	{
-		if (server->players[i].name)
-		{
+		if (strstr(player, name))
+			return 1;
 
-			player_uncolored = remove_colors(server->players[i].name , strlen(server->players[i].name));
-			if (player_uncolored == NULL)
-				continue;
-			if (Util_strcasestr(player_uncolored, player))
-			{
-				free(player_uncolored);
-				return 1;
-			}
-			free(player_uncolored);
-		}
+		player += strlen(player) + 1;
 	}
 
-	for (i=0; i<server->numspectators; i++)
-	{
-		if (server->spectators[i].name)
-		{
-			player_uncolored = remove_colors(server->spectators[i].name , strlen(server->spectators[i].name));
-			if (player_uncolored == NULL)
-				continue;
-			if (Util_strcasestr(player_uncolored, player))
-			{
-				free(player_uncolored);
-				return 1;
-			}
-			free(player_uncolored);
-		}
-	}
 	return 0;
 }
 
-static int check_player(struct tab *tab, const struct QWServer *server)
+static int check_player(struct tab *tab, int server)
 {
-	return check_player_name(tab->player_filter, server);
+	return check_player_name(tab->filter_key, server);
 }
 
-static int check_text_hm(char *text, const struct QWServer *server)
+static int check_text_hm(const char *text, int server)
 {
-	if (server->hostname)
-		if (Util_strcasestr(server->hostname, text))
+	struct sb_search_keys *keys;
+
+	keys = &sb_search_keys[server];
+
+	if (keys->hostname)
+		if (strstr(keys->hostname, text))
 			return 1;
-	if (server->map)
-		if (Util_strcasestr(server->map, text))
+	if (keys->map)
+		if (strstr(keys->map, text))
 			return 1;
-	if (server->gamedir)
-		if (Util_strcasestr(server->gamedir, text))
+	if (keys->gamedir)
+		if (strstr(keys->gamedir, text))
 			return 1;
 	return 0;
 }
 
-static int check_text (struct tab *tab, const struct QWServer *server)
+static int check_text (struct tab *tab, int server)
 {
-	return check_text_hm (tab->text_filter, server);
+	return check_text_hm (tab->filter_key, server);
 }
 
 static int hostname_compare(const void *a, const void *b);
@@ -860,13 +972,36 @@ static void sort_tab(struct tab *tab)
 	qsort(tab->server_index, tab->server_count, sizeof(int), compare_functions[tab->column_types[tab->sort].type]);
 }
 
-static int stubby (struct tab *tab, const struct QWServer *server)
+static int stubby (struct tab *tab, int server)
 {
 	return 1;
 }
 
+static void tab_set_check_function(struct tab *tab)
+{
+	free(tab->filter_key);
+	tab->filter_key = NULL;
 
-static void update_friends_tab(struct tab *tab)
+	if (List_Node_Count(tab->filters) && tab->player_filter == NULL)
+		tab->check_function = Check_Server_Against_Filter;
+	else if (tab->player_filter)
+		tab->check_function = check_player;
+	else if (tab->text_filter)
+		tab->check_function = check_text;
+	else
+		tab->check_function = stubby;
+
+	if (tab->check_function == check_player)
+		tab->filter_key = sb_lowercase(tab->player_filter);
+	else if (tab->check_function == check_text)
+		tab->filter_key = sb_lowercase(tab->text_filter);
+
+	if ((tab->check_function == check_player || tab->check_function == check_text) && tab->filter_key == NULL)
+		tab->check_function = stubby;
+}
+
+// names holds the lowercased name of every friend, in list order
+static void update_friends_tab_names(struct tab *tab, char **names)
 {
 	int count, i, x;
 	struct sb_friend *s;
@@ -877,14 +1012,19 @@ static void update_friends_tab(struct tab *tab)
 	s = friends;
 
 	count = 0;
+	i = 0;
 	while (s)
 	{
-		for (x = 0; x < sb_qw_server_count; x++)
+		if (names[i])
 		{
-			if (check_player_name(s->name, sb_qw_server[x]))
-				count++;
+			for (x = 0; x < sb_qw_server_count; x++)
+			{
+				if (check_player_name(names[i], x))
+					count++;
+			}
 		}
 		s = s->next;
+		i++;
 	}
 
 	if (tab->server_index)
@@ -922,6 +1062,7 @@ static void update_friends_tab(struct tab *tab)
 		tab->server_count = 0;
 		tab->sb_position = 0;
 		free(tab->server_index);
+		tab->server_index = NULL;
 		return;
 	}
 
@@ -930,84 +1071,187 @@ static void update_friends_tab(struct tab *tab)
 
 	s = friends;
 	i = 0;
+	count = 0;
 	while (s)
 	{
-		for (x=0;x<sb_qw_server_count; x++)
+		if (names[i])
 		{
-			if (check_player_name(s->name, sb_qw_server[x]))
+			for (x=0;x<sb_qw_server_count; x++)
 			{
-					tab->friend_links[i] = s;
-					tab->server_index[i++] = x;		
+				if (check_player_name(names[i], x))
+				{
+						tab->friend_links[count] = s;
+						tab->server_index[count++] = x;		
+				}
 			}
 		}
 		
 		s = s->next;
+		i++;
 	}
 }
 
-static void update_tab(struct tab *tab)
+static void update_friends_tab(struct tab *tab)
 {
-	int count, i, x, temp;
-	int (*cf)(struct tab *tab, const struct QWServer *server);
+	int count, i;
+	struct sb_friend *s;
+	char **names;
 
-	tab->max_hostname_length = 0;
-	count = 0;
+	for (s = friends, count = 0; s; s = s->next)
+		count++;
 
-	if (tab->friends)
+	names = calloc(count ? count : 1, sizeof(*names));
+	if (names == NULL)
 	{
-		update_friends_tab(tab);
+		tab->server_count = 0;
+		tab->sb_position = 0;
 		return;
 	}
 
-	if (List_Node_Count(tab->filters) && tab->player_filter == NULL)
-		cf = Check_Server_Against_Filter;
-	else if (tab->player_filter)
-		cf = check_player;
-	else if (tab->text_filter)
-		cf = check_text;
-	else
-		cf = stubby;
+	for (s = friends, i = 0; s; s = s->next)
+		names[i++] = sb_lowercase(s->name);
 
-	if (tab->server_index)
+	update_friends_tab_names(tab, names);
+
+	for (i=0; i<count; i++)
+		free(names[i]);
+
+	free(names);
+}
+
+static void tab_add_column_lengths(struct tab *tab, int server)
+{
+	int x, temp;
+
+	for (x=0; x<tab->columns; x++)
 	{
-		free(tab->server_index);
-		tab->server_index = NULL;
+		if (tab->column_types[x].type == SBCT_PING)
+		{
+			temp = snprintf(0, 0, "%d", sb_qw_server[server]->pingtime/1000);
+			if (temp < 4)
+				temp = 4;
+			if (temp > tab->column_types[x].length)
+				tab->column_types[x].length  = temp;
+		}
+		else if (tab->column_types[x].type == SBCT_PLAYERS)
+		{
+		/*
+			temp = snprintf(0, 0, "%d", sb_qw_server[server]->numplayers) + snprintf(0, 0, "%d", sb_qw_server[server]->maxclients) + 1;
+			if (temp > tab->column_types[x].length)
+				tab->column_types[x].length  = temp;
+		*/
+				tab->column_types[x].length  = 7;
+		}
+		else if (tab->column_types[x].type == SBCT_MAP)
+		{
+			if (sb_qw_server[server]->map)
+			{
+				temp = strlen(sb_qw_server[server]->map);
+				if (temp > tab->column_types[x].length)
+					tab->column_types[x].length  = temp;
+			}
+		}
+		else if (tab->column_types[x].type == SBCT_HOSTNAME)
+		{
+			if (sb_qw_server[server]->hostname)
+			{
+				temp = strlen(sb_qw_server[server]->hostname);
+				if (temp > tab->column_types[x].length)
+					tab->column_types[x].length  = temp;
+			}
+		}
+	}
+}
+
+static void update_tab_selection(struct tab *tab)
+{
+	int i;
+
+	if (tab->sb_position >= tab->server_count)
+		tab->sb_position = tab->server_count - 1;
+	if (tab->sb_position < 0)
+		tab->sb_position = 0;
+
+	if (tab->changed == 0 || tab->server_count == 0)
+		return;
+
+	if (tab == tab_active)
+	{
+		if (current_selected_server)
+		{
+			for (i=0; i< tab->server_count; i++)
+				if (current_selected_server == sb_qw_server[tab->server_index[i]])
+					break;
+			if (i == tab->server_count)
+			{
+				return;
+			}
+			tab->sb_position = i;
+		}
+		else
+		{
+			i = tab->server_index[tab->sb_position];
+			current_selected_server = sb_qw_server[i];
+		}
 	}
+}
 
-	for (count=0, x=0; x < sb_qw_server_count; x++)
+static void update_tab(struct tab *tab)
+{
+	int i, x;
+
+	tab->max_hostname_length = 0;
+
+	if (tab->friends)
 	{
-		if (cf(tab, sb_qw_server[x]))
-			count++;
+		update_friends_tab(tab);
+		return;
 	}
 
-	if (count > 10000 || count <= 0)
+	tab_set_check_function(tab);
+
+	free(tab->server_index);
+	free(tab->matches);
+	tab->server_index = NULL;
+	tab->matches = NULL;
+	tab->server_index_size = 0;
+	tab->server_count = 0;
+
+	if (sb_qw_server_count == 0 || sb_qw_server_count > 10000)
 	{
-		tab->server_count = 0;
 		tab->sb_position = 0;
 		return;
 	}
 
-	tab->server_index = calloc(count, sizeof(int));
+	tab->server_index = calloc(sb_qw_server_count, sizeof(int));
+	tab->matches = calloc((sb_qw_server_count + 7) / 8, 1);
 
-	if (tab->server_index == NULL)
+	if (tab->server_index == NULL || tab->matches == NULL)
 	{
-		tab->server_count = 0;
+		free(tab->server_index);
+		free(tab->matches);
+		tab->server_index = NULL;
+		tab->matches = NULL;
 		tab->sb_position = 0;
 		return;
 	}
 
-	tab->server_count = count;
+	tab->server_index_size = sb_qw_server_count;
 
-	for (x=0, i=0;x<sb_qw_server_count; x++)
+	for (x=0; x<sb_qw_server_count; x++)
 	{
-		if (cf(tab, sb_qw_server[x]))
-				tab->server_index[i++] = x;		
+		if (tab->check_function(tab, x))
+		{
+			tab->server_index[tab->server_count++] = x;
+			tab->matches[x / 8] |= 1 << (x & 7);
+		}
 	}
 
-	if (tab->sb_position >= tab->server_count)
-		tab->sb_position = tab->server_count - 1;
-	if (tab->sb_position < 0)
+	if (tab->server_count == 0)
+	{
 		tab->sb_position = 0;
+		return;
+	}
 
 	sort_tab(tab);
 
@@ -1017,69 +1261,106 @@ static void update_tab(struct tab *tab)
 	}
 
 	for (i=0; i<tab->server_count; i++)
+		tab_add_column_lengths(tab, tab->server_index[i]);
+
+	update_tab_selection(tab);
+}
+
+// remap holds the new index of every previous entry in sb_qw_server, -1 for removed ones
+// only servers flagged in changed are filtered again and (re)inserted into the sorted index
+static void update_tab_incremental(struct tab *tab, const int *remap, const unsigned char *changed)
+{
+	int (*compare)(const void *a, const void *b);
+	unsigned char *matches;
+	int *server_index;
+	int i, x, count, low, high, mid;
+
+	if (tab->friends || tab->matches == NULL || sb_qw_server_count > 10000)
+	{
+		update_tab(tab);
+		return;
+	}
+
+	if (tab->server_index_size < sb_qw_server_count)
 	{
-		for (x=0; x<tab->columns; x++)
+		server_index = realloc(tab->server_index, sb_qw_server_count * sizeof(int));
+		if (server_index == NULL)
 		{
-			if (tab->column_types[x].type == SBCT_PING)
-			{
-				temp = snprintf(0, 0, "%d", sb_qw_server[i]->pingtime/1000);
-				if (temp < 4)
-					temp = 4;
-				if (temp > tab->column_types[x].length)
-					tab->column_types[x].length  = temp;
-			}
-			else if (tab->column_types[x].type == SBCT_PLAYERS)
-			{
-			/*
-				temp = snprintf(0, 0, "%d", sb_qw_server[i]->numplayers) + snprintf(0, 0, "%d", sb_qw_server[i]->maxclients) + 1;
-				if (temp > tab->column_types[x].length)
-					tab->column_types[x].length  = temp;
-			*/
-					tab->column_types[x].length  = 7;
-			}
-			else if (tab->column_types[x].type == SBCT_MAP)
-			{
-				if (sb_qw_server[i]->map)
-				{
-					temp = strlen(sb_qw_server[i]->map);
-					if (temp > tab->column_types[x].length)
-						tab->column_types[x].length  = temp;
-				}
-			}
-			else if (tab->column_types[x].type == SBCT_HOSTNAME)
-			{
-				if (sb_qw_server[i]->hostname)
-				{
-					temp = strlen(sb_qw_server[i]->hostname);
-					if (temp > tab->column_types[x].length)
-						tab->column_types[x].length  = temp;
-				}
-			}
+			update_tab(tab);
+			return;
 		}
+
+		tab->server_index = server_index;
+		tab->server_index_size = sb_qw_server_count;
 	}
 
-	if (tab->changed == 0)
+	matches = calloc((sb_qw_server_count + 7) / 8, 1);
+	if (matches == NULL)
+	{
+		update_tab(tab);
 		return;
+	}
 
-	if (tab == tab_active)
+	for (i=0, count=0; i<tab->server_count; i++)
 	{
-		if (current_selected_server)
+		x = remap[tab->server_index[i]];
+		if (x < 0)
+			continue;
+
+		tab->server_index[count++] = x;
+		matches[x / 8] |= 1 << (x & 7);
+	}
+
+	tab->server_count = count;
+	free(tab->matches);
+	tab->matches = matches;
+
+	compare = compare_functions[tab->column_types[tab->sort].type];
+
+	for (x=0; x<sb_qw_server_count; x++)
+	{
+		if (!changed[x])
+			continue;
+
+		if (matches[x / 8] & (1 << (x & 7)))
 		{
-			for (i=0; i< tab->server_count; i++)
-				if (current_selected_server == sb_qw_server[tab->server_index[i]])
+			for (i=0; i<tab->server_count; i++)
+				if (tab->server_index[i] == x)
 					break;
-			if (i == tab->server_count)
+
+			if (i < tab->server_count)
 			{
-				return;
+				memmove(&tab->server_index[i], &tab->server_index[i + 1], (tab->server_count - i - 1) * sizeof(int));
+				tab->server_count--;
 			}
-			tab->sb_position = i;
+
+			matches[x / 8] &= ~(1 << (x & 7));
 		}
-		else
+
+		if (tab->check_function(tab, x))
 		{
-			i = tab->server_index[tab->sb_position];
-			current_selected_server = sb_qw_server[i];
+			low = 0;
+			high = tab->server_count;
+			while (low < high)
+			{
+				mid = (low + high) / 2;
+				if (compare(&x, &tab->server_index[mid]) < 0)
+					high = mid;
+				else
+					low = mid + 1;
+			}
+
+			memmove(&tab->server_index[low + 1], &tab->server_index[low], (tab->server_count - low) * sizeof(int));
+			tab->server_index[low] = x;
+			tab->server_count++;
+
+			matches[x / 8] |= 1 << (x & 7);
+
+			tab_add_column_lengths(tab, x);
 		}
 	}
+
+	update_tab_selection(tab);
 }
 
 static void SB_Update_Tabs(void)
@@ -1095,6 +1376,81 @@ static void SB_Update_Tabs(void)
 	}
 }
 
+// fetches the current server list from the scanner and updates the tabs for the servers that changed
+static void SB_Get_Servers(void)
+{
+	const struct QWServer **servers;
+	struct sb_search_keys *keys;
+	unsigned char *changed;
+	unsigned int count, i, j;
+	int *remap;
+	struct tab *tab;
+	int x;
+
+	servers = ServerScanner_GetServers(serverscanner, &count);
+	if (servers == NULL)
+		return;
+
+	keys = calloc(count ? count : 1, sizeof(*keys));
+	changed = calloc(count ? count : 1, 1);
+	remap = malloc((sb_qw_server_count ? sb_qw_server_count : 1) * sizeof(int));
+
+	if (keys == NULL || changed == NULL || remap == NULL)
+	{
+		free(keys);
+		free(changed);
+		free(remap);
+		ServerScanner_FreeServers(serverscanner, servers);
+		return;
+	}
+
+	// the scanner keeps its servers in a stable order and never hides one again, so the old list is a subsequence of the new one
+	// a server loaded from the cache is handed out as a new entry once it has been scanned, so match on the address
+	for (i=0, j=0; i<count; i++)
+	{
+		if (j < sb_qw_server_count && (sb_search_keys[j].server == servers[i] || NET_CompareAdr(&sb_search_keys[j].server->addr, &servers[i]->addr)))
+		{
+			if (current_selected_server == sb_search_keys[j].server)
+				current_selected_server = servers[i];
+
+			keys[i] = sb_search_keys[j];
+			remap[j++] = i;
+
+			if (keys[i].server == servers[i] && keys[i].changecount == servers[i]->changecount)
+				continue;
+
+			sb_free_search_keys(&keys[i]);
+		}
+
+		sb_build_search_keys(&keys[i], servers[i]);
+		changed[i] = 1;
+	}
+
+	for (; j<sb_qw_server_count; j++)
+	{
+		sb_free_search_keys(&sb_search_keys[j]);
+		remap[j] = -1;
+	}
+
+	if (sb_qw_server)
+		ServerScanner_FreeServers(serverscanner, sb_qw_server);
+	free(sb_search_keys);
+
+	sb_qw_server = servers;
+	sb_qw_server_count = count;
+	sb_search_keys = keys;
+
+	sb_server_count_width = 1;
+	x = sb_qw_server_count;
+	while((x/=10)) sb_server_count_width++;
+
+	for (tab = tab_first; tab; tab = tab->next)
+		update_tab_incremental(tab, remap, changed);
+
+	free(remap);
+	free(changed);
+}
+
 static void SB_Help_Handler(int key)
 {
 	if (key == K_ESCAPE)
@@ -2185,6 +2541,9 @@ static void SB_Draw_Server(void)
 
 		Draw_String(8, 24 + i * 8, string);
 
+		if (server->stale)
+			Draw_String(0, 24 + i * 8, "*");
+
 		y++;
 	}
 	Draw_String(0,24 + offset * 8,">");
@@ -2325,8 +2684,7 @@ static void SB_Draw_Help(void)
 void SB_Frame(void)
 {
 	enum ServerScannerStatus sss;
-	int count,todo;
-	int x;
+	struct ServerScannerProgress progress;
 	char *proxy_stream = NULL;
 
 	if (qtv_connect_pending)
@@ -2373,13 +2731,13 @@ void SB_Frame(void)
 		}
 		else if (sss == SSS_SCANNING)
 		{
-			todo = 0;//ServerScanner_ServersToScan(serverscanner);			
-			count = 0;//ServerScanner_Servers(serverscanner);
-			SB_Set_Statusbar("Scanning servers. Press \"ctrl + h\" for help");
+			ServerScanner_GetProgress(serverscanner, &progress);
+			SB_Set_Statusbar("Scanning servers %u/%u, %u in flight, %u/s. Press \"ctrl + h\" for help.", progress.numscanned, progress.numservers, progress.inflight, progress.repliespersecond);
 		}
 		else if (sss == SSS_PINGING)
 		{
-			SB_Set_Statusbar("Pinging servers. Press \"ctrl + h\" for help.");
+			ServerScanner_GetProgress(serverscanner, &progress);
+			SB_Set_Statusbar("Pinging servers %u/%u, %u in flight, %u/s. Press \"ctrl + h\" for help.", progress.numpinged, progress.numservers, progress.inflight, progress.repliespersecond);
 		}
 		else if (sss == SSS_ERROR)
 			SB_Set_Statusbar("Server scanner error. Press \"ctrl +h\" for help.\n");
@@ -2388,15 +2746,7 @@ void SB_Frame(void)
 	if (serverscanner)
 	{
 		if(ServerScanner_DataUpdated(serverscanner))
-		{
-			if (sb_qw_server)
-				ServerScanner_FreeServers(serverscanner, sb_qw_server);
-			sb_qw_server = ServerScanner_GetServers(serverscanner, &sb_qw_server_count);
-			sb_server_count_width = 1;
-			x = sb_qw_server_count;
-			while((x/=10)) sb_server_count_width++;
-			SB_Update_Tabs();
-		}
+			SB_Get_Servers();
 	}
 
 	if (!sb_open)
@@ -2422,7 +2772,8 @@ void SB_Quit(void)
 
 	if (serverscanner)
 	{
-		ServerScanner_FreeServers(serverscanner, sb_qw_server);
+		SB_Save_Cache();
+		SB_Clear_Servers();
 		ServerScanner_Delete(serverscanner);
 		serverscanner = 0;
 	}
@@ -2870,9 +3221,8 @@ static int cstc_connect_get_results(struct cst_info *self, int *results, int get
 	{
 		if (self->toggleables[2] || sb_qw_server == NULL)
 			SB_Refresh();
-		if (sb_qw_server)
-			ServerScanner_FreeServers(serverscanner, sb_qw_server);
-		sb_qw_server = ServerScanner_GetServers(serverscanner, &sb_qw_server_count);
+		if (serverscanner)
+			SB_Get_Servers();
 
 		if (data->checked)
 		{
@@ -3046,6 +3396,7 @@ void SB_CvarInit(void)
 	Cvar_Register(&sb_masterserver);
 	Cvar_Register(&sb_player_drawing);
 	Cvar_Register(&sb_refresh_on_activate);
+	Cvar_Register(&sb_cache);
 	Cvar_Register(&sb_color_bg);
 	Cvar_Register(&sb_color_bg_empty);
 	Cvar_Register(&sb_color_bg_free);
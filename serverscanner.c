@@ -17,6 +17,7 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -24,12 +25,21 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "sys_net.h"
 #include "serverscanner.h"
 
-#define MAXCONCURRENTSCANS 16
-#define MAXCONCURRENTPINGS 8
+#define INITIALCONCURRENTSCANS 16
+#define MINCONCURRENTSCANS 4
+#define MAXCONCURRENTSCANS 256
+#define INITIALCONCURRENTPINGS 8
+#define MINCONCURRENTPINGS 2
+#define MAXCONCURRENTPINGS 32
 #define PINGINTERVAL 20000
+#define MINPINGINTERVAL 2000
 #define QWSERVERTIMEOUT 750000
+#define MAXRETRIES 2
 
-#warning Needs to reattempt scan/ping
+#define QWSERVERHASHSIZE 1024
+
+#define CACHEVERSION 1
+#define MAXCACHESIZE (4*1024*1024)
 
 struct masterserver
 {
@@ -37,14 +47,33 @@ struct masterserver
 	struct netaddr addr;
 };
 
+/* Additive increase, multiplicative decrease of the number of requests in flight.
+ * The window grows by one per reply until the first loss, then by one per full
+ * window of replies, and is halved at most once per timeout period on loss. */
+struct ratecontrol
+{
+	unsigned int window;
+	unsigned int minwindow;
+	unsigned int maxwindow;
+	unsigned int successes;
+	unsigned int slowstart;
+	unsigned long long lastbackoff;
+};
+
 struct qwserverpriv
 {
 	struct qwserverpriv *next;
+	struct qwserverpriv *nexthash;
 	struct qwserverpriv *nextscaninprogress;
+	struct qwserverpriv *prevscaninprogress;
 	struct qwserverpriv *nextscanwaiting;
 	struct qwserverpriv *nextpinginprogress;
+	struct qwserverpriv *prevpinginprogress;
 	struct qwserverpriv *nextpingwaiting;
 	unsigned long long packetsendtime;
+	unsigned int retries;
+	unsigned int pinginprogress;
+	struct QWServer *cached; /* The server as loaded from the cache, with its players, spectators and strings in the same allocation. Never modified, and kept until the scanner is deleted */
 	struct QWServer pub;
 };
 
@@ -62,6 +91,7 @@ struct ServerScanner
 	struct qwserverpriv *qwserversscanwaiting;
 	struct qwserverpriv *qwserverspinginprogress;
 	struct qwserverpriv *qwserverspingwaiting;
+	struct qwserverpriv *qwserverhash[QWSERVERHASHSIZE];
 	volatile unsigned int quit;
 	unsigned int nummasterservers;
 	unsigned int numvalidmasterservers;
@@ -71,8 +101,157 @@ struct ServerScanner
 	unsigned long long lastpingtime;
 	volatile enum ServerScannerStatus status;
 	unsigned int updated;
+
+	struct ratecontrol scanrate;
+	struct ratecontrol pingrate;
+
+	/* Protected by the mutex */
+	unsigned int numscanned;
+	unsigned int numpinged;
+	unsigned int numreplies;
+	unsigned int replyrate;
+	unsigned long long ratestarttime;
 };
 
+static void RateControl_Init(struct ratecontrol *ratecontrol, unsigned int window, unsigned int minwindow, unsigned int maxwindow)
+{
+	ratecontrol->window = window;
+	ratecontrol->minwindow = minwindow;
+	ratecontrol->maxwindow = maxwindow;
+	ratecontrol->successes = 0;
+	ratecontrol->slowstart = 1;
+	ratecontrol->lastbackoff = 0;
+}
+
+static void RateControl_Success(struct ratecontrol *ratecontrol)
+{
+	if (ratecontrol->window >= ratecontrol->maxwindow)
+		return;
+
+	if (ratecontrol->slowstart)
+	{
+		ratecontrol->window++;
+	}
+	else if (++ratecontrol->successes >= ratecontrol->window)
+	{
+		ratecontrol->window++;
+		ratecontrol->successes = 0;
+	}
+}
+
+static void RateControl_Loss(struct ratecontrol *ratecontrol, unsigned long long curtime)
+{
+	ratecontrol->slowstart = 0;
+	ratecontrol->successes = 0;
+
+	if (ratecontrol->lastbackoff + QWSERVERTIMEOUT > curtime)
+		return;
+
+	ratecontrol->lastbackoff = curtime;
+	ratecontrol->window /= 2;
+	if (ratecontrol->window < ratecontrol->minwindow)
+		ratecontrol->window = ratecontrol->minwindow;
+}
+
+static unsigned int ServerScanner_HashAddress(const struct netaddr *addr)
+{
+	unsigned int hash;
+
+	if (addr->type != NA_IPV4)
+		return 0;
+
+	hash = (addr->addr.ipv4.address[0]<<24)|(addr->addr.ipv4.address[1]<<16)|(addr->addr.ipv4.address[2]<<8)|addr->addr.ipv4.address[3];
+	hash ^= addr->addr.ipv4.port * 2654435761U;
+	hash ^= hash>>16;
+
+	return hash % QWSERVERHASHSIZE;
+}
+
+static struct qwserverpriv *ServerScanner_Thread_FindQWServer(struct ServerScanner *serverscanner, const struct netaddr *addr)
+{
+	struct qwserverpriv *qwserver;
+
+	qwserver = serverscanner->qwserverhash[ServerScanner_HashAddress(addr)];
+	while(qwserver)
+	{
+		if (NET_CompareAdr(&qwserver->pub.addr, addr))
+			break;
+
+		qwserver = qwserver->nexthash;
+	}
+
+	return qwserver;
+}
+
+/* Called with the mutex held */
+/* Called with the mutex held. The cached copy is handed out until the server
+ * has been scanned, after that the live entry is. Neither is modified while
+ * it is visible to the reader, apart from the ping time and change count. */
+static const struct QWServer *ServerScanner_PublicServer(const struct qwserverpriv *qwserver)
+{
+	if (qwserver->pub.status >= QWSS_DONE || qwserver->cached == 0)
+		return &qwserver->pub;
+
+	return qwserver->cached;
+}
+
+/* Called with the mutex held */
+static void ServerScanner_Thread_RemoveScanInProgress(struct ServerScanner *serverscanner, struct qwserverpriv *qwserver)
+{
+	if (qwserver->prevscaninprogress)
+		qwserver->prevscaninprogress->nextscaninprogress = qwserver->nextscaninprogress;
+	else
+		serverscanner->qwserversscaninprogress = qwserver->nextscaninprogress;
+
+	if (qwserver->nextscaninprogress)
+		qwserver->nextscaninprogress->prevscaninprogress = qwserver->prevscaninprogress;
+
+	qwserver->nextscaninprogress = 0;
+	qwserver->prevscaninprogress = 0;
+	serverscanner->numqwserversscaninprogress--;
+}
+
+/* Called with the mutex held */
+static void ServerScanner_Thread_RemovePingInProgress(struct ServerScanner *serverscanner, struct qwserverpriv *qwserver)
+{
+	if (qwserver->prevpinginprogress)
+		qwserver->prevpinginprogress->nextpinginprogress = qwserver->nextpinginprogress;
+	else
+		serverscanner->qwserverspinginprogress = qwserver->nextpinginprogress;
+
+	if (qwserver->nextpinginprogress)
+		qwserver->nextpinginprogress->prevpinginprogress = qwserver->prevpinginprogress;
+
+	qwserver->nextpinginprogress = 0;
+	qwserver->prevpinginprogress = 0;
+	qwserver->pinginprogress = 0;
+	serverscanner->numqwserverspinginprogress--;
+}
+
+/* Called with the mutex held */
+static void ServerScanner_Thread_CountReply(struct ServerScanner *serverscanner, unsigned long long curtime)
+{
+	serverscanner->numreplies++;
+
+	if (curtime >= serverscanner->ratestarttime + 1000000)
+	{
+		serverscanner->replyrate = (unsigned long long)serverscanner->numreplies * 1000000 / (curtime - serverscanner->ratestarttime);
+		serverscanner->numreplies = 0;
+		serverscanner->ratestarttime = curtime;
+	}
+}
+
+static unsigned int ServerScanner_Thread_PingInterval(struct ServerScanner *serverscanner)
+{
+	unsigned int interval;
+
+	interval = PINGINTERVAL * INITIALCONCURRENTPINGS / serverscanner->pingrate.window;
+	if (interval < MINPINGINTERVAL)
+		interval = MINPINGINTERVAL;
+
+	return interval;
+}
+
 static int ServerScanner_Thread_Init(struct ServerScanner *serverscanner)
 {
 	serverscanner->netdata = Sys_Net_Init();
@@ -453,6 +632,7 @@ static void ServerScanner_Thread_ParseQWServerReply(struct ServerScanner *server
 	}
 }
 
+/* Called with the mutex held */
 static void ServerScanner_Thread_SendQWRequest(struct ServerScanner *serverscanner, struct qwserverpriv *qwserver)
 {
 	static const char querystring[] = "\xff\xff\xff\xff" "status 23\n";
@@ -464,10 +644,14 @@ static void ServerScanner_Thread_SendQWRequest(struct ServerScanner *serverscann
 		qwserver->pub.status = QWSS_REQUESTSENT;
 		serverscanner->numqwserversscaninprogress++;
 		qwserver->nextscaninprogress = serverscanner->qwserversscaninprogress;
+		qwserver->prevscaninprogress = 0;
+		if (qwserver->nextscaninprogress)
+			qwserver->nextscaninprogress->prevscaninprogress = qwserver;
 		serverscanner->qwserversscaninprogress = qwserver;
 	}
 }
 
+/* Called with the mutex held */
 static void ServerScanner_Thread_SendQWPingRequest(struct ServerScanner *serverscanner, struct qwserverpriv *qwserver)
 {
 	unsigned long long curtime;
@@ -479,7 +663,11 @@ static void ServerScanner_Thread_SendQWPingRequest(struct ServerScanner *servers
 	Sys_Net_Send(serverscanner->netdata, serverscanner->sockets[NA_IPV4], querystring, sizeof(querystring), &qwserver->pub.addr);
 
 	serverscanner->numqwserverspinginprogress++;
+	qwserver->pinginprogress = 1;
 	qwserver->nextpinginprogress = serverscanner->qwserverspinginprogress;
+	qwserver->prevpinginprogress = 0;
+	if (qwserver->nextpinginprogress)
+		qwserver->nextpinginprogress->prevpinginprogress = qwserver;
 	serverscanner->qwserverspinginprogress = qwserver;
 
 	serverscanner->lastpingtime = curtime;
@@ -488,39 +676,31 @@ static void ServerScanner_Thread_SendQWPingRequest(struct ServerScanner *servers
 static void ServerScanner_Thread_HandlePacket(struct ServerScanner *serverscanner, unsigned char *data, unsigned int datalen, struct netaddr *addr)
 {
 	struct qwserverpriv *qwserver;
-	struct qwserverpriv *prevqwserver;
+	unsigned long long curtime;
 	unsigned int i;
 	struct netaddr newaddr;
 
+	curtime = Sys_IntTime();
+
 	if (datalen && data[0] == 'l')
 	{
-		prevqwserver = 0;
-		qwserver = serverscanner->qwserverspinginprogress;
-		while(qwserver)
+		qwserver = ServerScanner_Thread_FindQWServer(serverscanner, addr);
+		if (qwserver && qwserver->pinginprogress)
 		{
-			if (NET_CompareAdr(&qwserver->pub.addr, addr))
-			{
-				Sys_Thread_LockMutex(serverscanner->mutex);
-
-				qwserver->pub.pingtime = Sys_IntTime() - qwserver->packetsendtime;
-
-				serverscanner->updated = 1;
+			Sys_Thread_LockMutex(serverscanner->mutex);
 
-				Sys_Thread_UnlockMutex(serverscanner->mutex);
+			qwserver->pub.pingtime = curtime - qwserver->packetsendtime;
+			qwserver->pub.changecount++;
 
-				if (prevqwserver)
-					prevqwserver->nextpinginprogress = qwserver->nextpinginprogress;
-				else
-					serverscanner->qwserverspinginprogress = qwserver->nextpinginprogress;
+			serverscanner->numpinged++;
+			ServerScanner_Thread_CountReply(serverscanner, curtime);
+			serverscanner->updated = 1;
 
-				qwserver->nextpinginprogress = 0;
-				serverscanner->numqwserverspinginprogress--;
+			ServerScanner_Thread_RemovePingInProgress(serverscanner, qwserver);
 
-				return;
-			}
+			Sys_Thread_UnlockMutex(serverscanner->mutex);
 
-			prevqwserver = qwserver;
-			qwserver = qwserver->nextpinginprogress;
+			RateControl_Success(&serverscanner->pingrate);
 		}
 
 		return;
@@ -557,20 +737,8 @@ static void ServerScanner_Thread_HandlePacket(struct ServerScanner *serverscanne
 				newaddr.addr.ipv4.address[3] = data[i + 3];
 				newaddr.addr.ipv4.port = (data[i + 4]<<8)|data[i + 5];
 
-#warning Slow as fucking hell.
-				qwserver = serverscanner->qwservers;
-				while(qwserver)
-				{
-					if (NET_CompareAdr(&newaddr, &qwserver->pub.addr))
-						break;
-
-					qwserver = qwserver->next;
-				}
-
-				if (qwserver && NET_CompareAdr(&newaddr, &qwserver->pub.addr))
-				{
+				if (ServerScanner_Thread_FindQWServer(serverscanner, &newaddr))
 					continue;
-				}
 
 				qwserver = malloc(sizeof(*qwserver));
 				if (qwserver == 0)
@@ -581,7 +749,12 @@ static void ServerScanner_Thread_HandlePacket(struct ServerScanner *serverscanne
 				qwserver->pub.addr = newaddr;
 				qwserver->pub.status = QWSS_WAITING;
 
-				if (serverscanner->numqwserversscaninprogress < MAXCONCURRENTSCANS)
+				qwserver->nexthash = serverscanner->qwserverhash[ServerScanner_HashAddress(&newaddr)];
+				serverscanner->qwserverhash[ServerScanner_HashAddress(&newaddr)] = qwserver;
+
+				Sys_Thread_LockMutex(serverscanner->mutex);
+
+				if (serverscanner->numqwserversscaninprogress < serverscanner->scanrate.window)
 				{
 					ServerScanner_Thread_SendQWRequest(serverscanner, qwserver);
 				}
@@ -591,8 +764,6 @@ static void ServerScanner_Thread_HandlePacket(struct ServerScanner *serverscanne
 					serverscanner->qwserversscanwaiting = qwserver;
 				}
 
-				Sys_Thread_LockMutex(serverscanner->mutex);
-
 				qwserver->next = serverscanner->qwservers;
 				serverscanner->qwservers = qwserver;
 				serverscanner->numqwservers++;
@@ -608,87 +779,95 @@ static void ServerScanner_Thread_HandlePacket(struct ServerScanner *serverscanne
 		}
 	}
 
-	prevqwserver = 0;
-	qwserver = serverscanner->qwserversscaninprogress;
-	while(qwserver)
+	qwserver = ServerScanner_Thread_FindQWServer(serverscanner, addr);
+	if (qwserver && qwserver->pub.status == QWSS_REQUESTSENT)
 	{
-		if (NET_CompareAdr(&qwserver->pub.addr, addr) && qwserver->pub.status == QWSS_REQUESTSENT)
-		{
-			Sys_Thread_LockMutex(serverscanner->mutex);
+		Sys_Thread_LockMutex(serverscanner->mutex);
 
-			serverscanner->updated = 1;
+		serverscanner->updated = 1;
 
-			ServerScanner_Thread_ParseQWServerReply(serverscanner, qwserver, data, datalen);
+		ServerScanner_Thread_ParseQWServerReply(serverscanner, qwserver, data, datalen);
+		qwserver->pub.changecount++;
 
-			Sys_Thread_UnlockMutex(serverscanner->mutex);
+		serverscanner->numscanned++;
+		ServerScanner_Thread_CountReply(serverscanner, curtime);
 
-			if (prevqwserver)
-				prevqwserver->nextscaninprogress = qwserver->nextscaninprogress;
-			else
-				serverscanner->qwserversscaninprogress = qwserver->nextscaninprogress;
+		ServerScanner_Thread_RemoveScanInProgress(serverscanner, qwserver);
 
-			qwserver->nextscaninprogress = 0;
-			serverscanner->numqwserversscaninprogress--;
+		Sys_Thread_UnlockMutex(serverscanner->mutex);
 
-			qwserver->nextpingwaiting = serverscanner->qwserverspingwaiting;
-			serverscanner->qwserverspingwaiting = qwserver;
+		RateControl_Success(&serverscanner->scanrate);
 
-			return;
-		}
-
-		prevqwserver = qwserver;
-		qwserver = qwserver->nextscaninprogress;
+		qwserver->retries = 0;
+		qwserver->nextpingwaiting = serverscanner->qwserverspingwaiting;
+		serverscanner->qwserverspingwaiting = qwserver;
 	}
 }
 
+/* Called with the mutex held */
 static void ServerScanner_Thread_CheckTimeout(struct ServerScanner *serverscanner)
 {
 	struct qwserverpriv *qwserver;
-	struct qwserverpriv *prevqwserver;
+	struct qwserverpriv *nextqwserver;
 	unsigned long long curtime;
 
 	curtime = Sys_IntTime();
 
-	prevqwserver = 0;
 	qwserver = serverscanner->qwserversscaninprogress;
 	while(qwserver)
 	{
+		nextqwserver = qwserver->nextscaninprogress;
+
 		if (qwserver->packetsendtime + QWSERVERTIMEOUT <= curtime)
 		{
-			qwserver->pub.status = QWSS_FAILED;
+			ServerScanner_Thread_RemoveScanInProgress(serverscanner, qwserver);
+			RateControl_Loss(&serverscanner->scanrate, curtime);
 
-			if (prevqwserver)
-				prevqwserver->nextscaninprogress = qwserver->nextscaninprogress;
+			if (qwserver->retries < MAXRETRIES)
+			{
+				qwserver->retries++;
+				qwserver->pub.status = QWSS_WAITING;
+				qwserver->nextscanwaiting = serverscanner->qwserversscanwaiting;
+				serverscanner->qwserversscanwaiting = qwserver;
+			}
 			else
-				serverscanner->qwserversscaninprogress = qwserver->nextscaninprogress;
-
-			serverscanner->numqwserversscaninprogress--;
+			{
+				qwserver->pub.status = QWSS_FAILED;
+				qwserver->pub.changecount++;
+				serverscanner->numscanned++;
+				serverscanner->updated = 1;
+			}
 		}
-		else
-			prevqwserver = qwserver;
 
-		qwserver = qwserver->nextscaninprogress;
+		qwserver = nextqwserver;
 	}
 
-	prevqwserver = 0;
 	qwserver = serverscanner->qwserverspinginprogress;
 	while(qwserver)
 	{
+		nextqwserver = qwserver->nextpinginprogress;
+
 		if (qwserver->packetsendtime + QWSERVERTIMEOUT <= curtime)
 		{
-			qwserver->pub.pingtime = 999999;
+			ServerScanner_Thread_RemovePingInProgress(serverscanner, qwserver);
+			RateControl_Loss(&serverscanner->pingrate, curtime);
 
-			if (prevqwserver)
-				prevqwserver->nextpinginprogress = qwserver->nextpinginprogress;
+			if (qwserver->retries < MAXRETRIES)
+			{
+				qwserver->retries++;
+				qwserver->nextpingwaiting = serverscanner->qwserverspingwaiting;
+				serverscanner->qwserverspingwaiting = qwserver;
+			}
 			else
-				serverscanner->qwserverspinginprogress = qwserver->nextpinginprogress;
-
-			serverscanner->numqwserverspinginprogress--;
+			{
+				qwserver->pub.pingtime = 999999;
+				qwserver->pub.changecount++;
+				serverscanner->numpinged++;
+				serverscanner->updated = 1;
+			}
 		}
-		else
-			prevqwserver = qwserver;
 
-		qwserver = qwserver->nextpinginprogress;
+		qwserver = nextqwserver;
 	}
 }
 
@@ -698,6 +877,7 @@ unsigned int ServerScanner_DoStuffInternal(struct ServerScanner *serverscanner)
 	unsigned int i;
 	unsigned long long curtime;
 	unsigned int timeout;
+	unsigned int pinginterval;
 	int r;
 	unsigned char buf[8192];
 	struct netaddr addr;
@@ -723,6 +903,7 @@ unsigned int ServerScanner_DoStuffInternal(struct ServerScanner *serverscanner)
 		}
 
 		serverscanner->starttime = Sys_IntTime();
+		serverscanner->ratestarttime = serverscanner->starttime;
 
 		ServerScanner_Thread_QueryMasters(serverscanner);
 
@@ -765,8 +946,7 @@ unsigned int ServerScanner_DoStuffInternal(struct ServerScanner *serverscanner)
 
 	curtime = Sys_IntTime();
 
-#warning Needs to schedule servers for scanning
-	while (serverscanner->status == SSS_SCANNING && serverscanner->numqwserversscaninprogress < MAXCONCURRENTSCANS && serverscanner->qwserversscanwaiting)
+	while (serverscanner->status == SSS_SCANNING && serverscanner->numqwserversscaninprogress < serverscanner->scanrate.window && serverscanner->qwserversscanwaiting)
 	{
 		qwserver = serverscanner->qwserversscanwaiting;
 		ServerScanner_Thread_SendQWRequest(serverscanner, qwserver);
@@ -774,7 +954,9 @@ unsigned int ServerScanner_DoStuffInternal(struct ServerScanner *serverscanner)
 		qwserver->nextscanwaiting = 0;
 	}
 			
-	while (serverscanner->status == SSS_PINGING && serverscanner->numqwserverspinginprogress < MAXCONCURRENTPINGS && serverscanner->qwserverspingwaiting && serverscanner->lastpingtime + PINGINTERVAL <= curtime)
+	pinginterval = ServerScanner_Thread_PingInterval(serverscanner);
+
+	while (serverscanner->status == SSS_PINGING && serverscanner->numqwserverspinginprogress < serverscanner->pingrate.window && serverscanner->qwserverspingwaiting && serverscanner->lastpingtime + pinginterval <= curtime)
 	{
 		qwserver = serverscanner->qwserverspingwaiting;
 		ServerScanner_Thread_SendQWPingRequest(serverscanner, qwserver);
@@ -809,11 +991,11 @@ unsigned int ServerScanner_DoStuffInternal(struct ServerScanner *serverscanner)
 			qwserver = qwserver->nextpinginprogress;
 		}
 
-		if (serverscanner->qwserverspingwaiting && serverscanner->lastpingtime + PINGINTERVAL >= curtime)
+		if (serverscanner->qwserverspingwaiting && serverscanner->lastpingtime + pinginterval >= curtime)
 		{
-			if (serverscanner->lastpingtime + PINGINTERVAL - curtime < timeout)
+			if (serverscanner->lastpingtime + pinginterval - curtime < timeout)
 			{
-				timeout = serverscanner->lastpingtime + PINGINTERVAL - curtime;
+				timeout = serverscanner->lastpingtime + pinginterval - curtime;
 			}
 		}
 	}
@@ -845,7 +1027,365 @@ static void ServerScanner_Thread(void *arg)
 	ServerScanner_Thread_Deinit(serverscanner);
 }
 
-struct ServerScanner *ServerScanner_Create(const char *masters)
+/* Cache file layout, all integers little endian:
+ *
+ * "FQSC", version (1 byte), then for each server:
+ *   address (4 bytes), port (2 bytes, big endian), pingtime (4), maxclients (2),
+ *   maxspectators (2), teamplay (2), numplayers (1), numspectators (1),
+ *   length of the string block (2),
+ *   per player: frags (4), time (4), ping (2), topcolor (1), bottomcolor (1),
+ *   per spectator: time (4), ping (2),
+ *   string block: hostname, gamedir, map, then name and team of each player
+ *   followed by name and team of each spectator, all nul terminated.
+ */
+
+static unsigned int Cache_Read(const unsigned char *data, unsigned int size)
+{
+	unsigned int value;
+
+	value = 0;
+	while(size--)
+		value = (value<<8)|data[size];
+
+	return value;
+}
+
+static unsigned char *Cache_Write(unsigned char *data, unsigned int value, unsigned int size)
+{
+	while(size--)
+	{
+		*data++ = value;
+		value >>= 8;
+	}
+
+	return data;
+}
+
+static unsigned char *Cache_WriteString(unsigned char *data, const char *string)
+{
+	unsigned int len;
+
+	if (string == 0)
+		string = "";
+
+	len = strlen(string) + 1;
+	memcpy(data, string, len);
+
+	return data + len;
+}
+
+static unsigned int Cache_StringLength(const char *string)
+{
+	return string ? strlen(string) + 1 : 1;
+}
+
+static unsigned int Cache_StringsLength(const struct QWServer *server)
+{
+	unsigned int length;
+	unsigned int i;
+
+	length = Cache_StringLength(server->hostname) + Cache_StringLength(server->gamedir) + Cache_StringLength(server->map);
+	for(i=0;i<server->numplayers;i++)
+		length += Cache_StringLength(server->players[i].name) + Cache_StringLength(server->players[i].team);
+	for(i=0;i<server->numspectators;i++)
+		length += Cache_StringLength(server->spectators[i].name) + Cache_StringLength(server->spectators[i].team);
+
+	return length;
+}
+
+static int Cache_ShouldSave(const struct QWServer *server)
+{
+	if (server->addr.type != NA_IPV4)
+		return 0;
+
+	if (server->status != QWSS_DONE && !server->stale)
+		return 0;
+
+	return Cache_StringsLength(server) <= 65535;
+}
+
+static const char *Cache_NextString(const char **p)
+{
+	const char *string;
+
+	string = *p;
+	*p += strlen(string) + 1;
+
+	return *string ? string : 0;
+}
+
+static struct qwserverpriv *ServerScanner_LoadCachedServer(const unsigned char *data, unsigned int datalen, unsigned int *pos)
+{
+	struct qwserverpriv *qwserver;
+	struct QWServer *cached;
+	struct QWPlayer *qwplayers;
+	struct QWSpectator *qwspectators;
+	const unsigned char *p;
+	const char *strings;
+	unsigned int numplayers;
+	unsigned int numspectators;
+	unsigned int stringslength;
+	unsigned int recordlength;
+	unsigned int numstrings;
+	unsigned int i;
+
+	if (datalen - *pos < 22)
+		return 0;
+
+	p = data + *pos;
+
+	numplayers = p[16];
+	numspectators = p[17];
+	stringslength = Cache_Read(p + 18, 2);
+
+	if (numplayers + numspectators > 32)
+		return 0;
+
+	recordlength = 20 + numplayers * 12 + numspectators * 6 + stringslength;
+	if (datalen - *pos < recordlength)
+		return 0;
+
+	strings = (const char *)(p + 20 + numplayers * 12 + numspectators * 6);
+
+	numstrings = 0;
+	for(i=0;i<stringslength;i++)
+	{
+		if (strings[i] == 0)
+			numstrings++;
+	}
+
+	if (stringslength == 0 || strings[stringslength - 1] != 0 || numstrings != 3 + (numplayers + numspectators) * 2)
+		return 0;
+
+	qwserver = malloc(sizeof(*qwserver));
+	if (qwserver)
+	{
+		memset(qwserver, 0, sizeof(*qwserver));
+
+		cached = malloc(sizeof(*cached) + sizeof(*qwplayers) * numplayers + sizeof(*qwspectators) * numspectators + stringslength);
+		if (cached)
+		{
+			memset(cached, 0, sizeof(*cached));
+
+			qwplayers = (struct QWPlayer *)(cached + 1);
+			qwspectators = (struct QWSpectator *)(qwplayers + numplayers);
+			memcpy(qwspectators + numspectators, strings, stringslength);
+			strings = (const char *)(qwspectators + numspectators);
+
+			cached->addr.type = NA_IPV4;
+			memcpy(cached->addr.addr.ipv4.address, p, 4);
+			cached->addr.addr.ipv4.port = (p[4]<<8)|p[5];
+			cached->status = QWSS_WAITING;
+			cached->stale = 1;
+			cached->pingtime = Cache_Read(p + 6, 4);
+			cached->maxclients = Cache_Read(p + 10, 2);
+			cached->maxspectators = Cache_Read(p + 12, 2);
+			cached->teamplay = Cache_Read(p + 14, 2);
+
+			cached->hostname = Cache_NextString(&strings);
+			cached->gamedir = Cache_NextString(&strings);
+			cached->map = Cache_NextString(&strings);
+
+			p += 20;
+			for(i=0;i<numplayers;i++)
+			{
+				qwplayers[i].frags = Cache_Read(p, 4);
+				qwplayers[i].time = Cache_Read(p + 4, 4);
+				qwplayers[i].ping = Cache_Read(p + 8, 2);
+				qwplayers[i].topcolor = p[10];
+				qwplayers[i].bottomcolor = p[11];
+				qwplayers[i].name = Cache_NextString(&strings);
+				qwplayers[i].team = Cache_NextString(&strings);
+				p += 12;
+			}
+
+			for(i=0;i<numspectators;i++)
+			{
+				qwspectators[i].time = Cache_Read(p, 4);
+				qwspectators[i].ping = Cache_Read(p + 4, 2);
+				qwspectators[i].name = Cache_NextString(&strings);
+				qwspectators[i].team = Cache_NextString(&strings);
+				p += 6;
+			}
+
+			cached->players = qwplayers;
+			cached->numplayers = numplayers;
+			cached->spectators = qwspectators;
+			cached->numspectators = numspectators;
+
+			qwserver->cached = cached;
+			qwserver->pub.addr = cached->addr;
+			qwserver->pub.status = QWSS_WAITING;
+
+			*pos += recordlength;
+
+			return qwserver;
+		}
+
+		free(qwserver);
+	}
+
+	return 0;
+}
+
+static void ServerScanner_LoadCache(struct ServerScanner *serverscanner, const char *filename)
+{
+	struct qwserverpriv *qwserver;
+	unsigned char *data;
+	unsigned int hash;
+	unsigned int pos;
+	long size;
+	FILE *f;
+
+	f = fopen(filename, "rb");
+	if (f == 0)
+		return;
+
+	data = 0;
+
+	if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 5 && size <= MAXCACHESIZE && fseek(f, 0, SEEK_SET) == 0)
+	{
+		data = malloc(size);
+		if (data && fread(data, 1, size, f) == size && memcmp(data, "FQSC", 4) == 0 && data[4] == CACHEVERSION)
+		{
+			pos = 5;
+			while(pos < size && serverscanner->numqwservers < 10000)
+			{
+				qwserver = ServerScanner_LoadCachedServer(data, size, &pos);
+				if (qwserver == 0)
+					break;
+
+				if (ServerScanner_Thread_FindQWServer(serverscanner, &qwserver->pub.addr))
+				{
+					free(qwserver->cached);
+					free(qwserver);
+					continue;
+				}
+
+				hash = ServerScanner_HashAddress(&qwserver->pub.addr);
+				qwserver->nexthash = serverscanner->qwserverhash[hash];
+				serverscanner->qwserverhash[hash] = qwserver;
+
+				qwserver->next = serverscanner->qwservers;
+				serverscanner->qwservers = qwserver;
+				serverscanner->numqwservers++;
+
+				qwserver->nextscanwaiting = serverscanner->qwserversscanwaiting;
+				serverscanner->qwserversscanwaiting = qwserver;
+			}
+
+			if (serverscanner->numqwservers)
+				serverscanner->updated = 1;
+		}
+	}
+
+	free(data);
+	fclose(f);
+}
+
+int ServerScanner_SaveCache(struct ServerScanner *serverscanner, const char *filename)
+{
+	struct qwserverpriv *qwserver;
+	const struct QWServer *server;
+	unsigned char *data;
+	unsigned char *p;
+	unsigned int size;
+	unsigned int stringslength;
+	unsigned int i;
+	int ret;
+	FILE *f;
+
+	ret = 0;
+
+	Sys_Thread_LockMutex(serverscanner->mutex);
+
+	size = 5;
+	for(qwserver=serverscanner->qwservers;qwserver;qwserver=qwserver->next)
+	{
+		server = ServerScanner_PublicServer(qwserver);
+		if (Cache_ShouldSave(server))
+			size += 20 + server->numplayers * 12 + server->numspectators * 6 + Cache_StringsLength(server);
+	}
+
+	p = 0;
+	data = malloc(size);
+	if (data)
+	{
+		p = data;
+		memcpy(p, "FQSC", 4);
+		p[4] = CACHEVERSION;
+		p += 5;
+
+		for(qwserver=serverscanner->qwservers;qwserver;qwserver=qwserver->next)
+		{
+			server = ServerScanner_PublicServer(qwserver);
+			if (!Cache_ShouldSave(server))
+				continue;
+
+			stringslength = Cache_StringsLength(server);
+
+			memcpy(p, server->addr.addr.ipv4.address, 4);
+			p[4] = server->addr.addr.ipv4.port>>8;
+			p[5] = server->addr.addr.ipv4.port;
+			p = Cache_Write(p + 6, server->pingtime, 4);
+			p = Cache_Write(p, server->maxclients, 2);
+			p = Cache_Write(p, server->maxspectators, 2);
+			p = Cache_Write(p, server->teamplay, 2);
+			p = Cache_Write(p, server->numplayers, 1);
+			p = Cache_Write(p, server->numspectators, 1);
+			p = Cache_Write(p, stringslength, 2);
+
+			for(i=0;i<server->numplayers;i++)
+			{
+				p = Cache_Write(p, server->players[i].frags, 4);
+				p = Cache_Write(p, server->players[i].time, 4);
+				p = Cache_Write(p, server->players[i].ping, 2);
+				p = Cache_Write(p, server->players[i].topcolor, 1);
+				p = Cache_Write(p, server->players[i].bottomcolor, 1);
+			}
+
+			for(i=0;i<server->numspectators;i++)
+			{
+				p = Cache_Write(p, server->spectators[i].time, 4);
+				p = Cache_Write(p, server->spectators[i].ping, 2);
+			}
+
+			p = Cache_WriteString(p, server->hostname);
+			p = Cache_WriteString(p, server->gamedir);
+			p = Cache_WriteString(p, server->map);
+			for(i=0;i<server->numplayers;i++)
+			{
+				p = Cache_WriteString(p, server->players[i].name);
+				p = Cache_WriteString(p, server->players[i].team);
+			}
+			for(i=0;i<server->numspectators;i++)
+			{
+				p = Cache_WriteString(p, server->spectators[i].name);
+				p = Cache_WriteString(p, server->spectators[i].team);
+			}
+		}
+	}
+
+	Sys_Thread_UnlockMutex(serverscanner->mutex);
+
+	if (data)
+	{
+		f = fopen(filename, "wb");
+		if (f)
+		{
+			if (fwrite(data, 1, p - data, f) == p - data)
+				ret = 1;
+
+			fclose(f);
+		}
+
+		free(data);
+	}
+
+	return ret;
+}
+
+struct ServerScanner *ServerScanner_Create(const char *masters, const char *cachefile)
 {
 	struct ServerScanner *serverscanner;
 	unsigned int nummasterservers;
@@ -916,8 +1456,13 @@ struct ServerScanner *ServerScanner_Create(const char *masters)
 				{
 					serverscanner->status = SSS_SCANNING;
 					serverscanner->nummasterservers = nummasterservers;
+					RateControl_Init(&serverscanner->scanrate, INITIALCONCURRENTSCANS, MINCONCURRENTSCANS, MAXCONCURRENTSCANS);
+					RateControl_Init(&serverscanner->pingrate, INITIALCONCURRENTPINGS, MINCONCURRENTPINGS, MAXCONCURRENTPINGS);
 					serverscanner->numvalidmasterservers = nummasterservers;
 
+					if (cachefile)
+						ServerScanner_LoadCache(serverscanner, cachefile);
+
 					serverscanner->thread = Sys_Thread_CreateThread(ServerScanner_Thread, serverscanner);
 #if 0
 					if (serverscanner->thread)
@@ -961,7 +1506,9 @@ void ServerScanner_Delete(struct ServerScanner *serverscanner)
 
 		free((void *)qwserver->pub.map);
 		free((void *)qwserver->pub.hostname);
+		free((void *)qwserver->pub.gamedir);
 		free((void *)qwserver->pub.players);
+		free(qwserver->cached);
 		free(qwserver);
 
 		qwserver = nextqwserver;
@@ -1018,9 +1565,9 @@ const struct QWServer **ServerScanner_GetServers(struct ServerScanner *serversca
 			count = 0;
 			for(i=0;i<serverscanner->numqwservers;i++)
 			{
-				if (qwserver->pub.status >= QWSS_DONE)
+				if (qwserver->pub.status >= QWSS_DONE || qwserver->cached)
 				{
-					servers[count++] = &qwserver->pub;
+					servers[count++] = ServerScanner_PublicServer(qwserver);
 				}
 
 				qwserver = qwserver->next;
@@ -1051,6 +1598,19 @@ enum ServerScannerStatus ServerScanner_GetStatus(struct ServerScanner *serversca
 	return serverscanner->status;
 }
 
+void ServerScanner_GetProgress(struct ServerScanner *serverscanner, struct ServerScannerProgress *progress)
+{
+	Sys_Thread_LockMutex(serverscanner->mutex);
+
+	progress->numservers = serverscanner->numqwservers;
+	progress->numscanned = serverscanner->numscanned;
+	progress->numpinged = serverscanner->numpinged;
+	progress->inflight = serverscanner->numqwserversscaninprogress + serverscanner->numqwserverspinginprogress;
+	progress->repliespersecond = serverscanner->replyrate;
+
+	Sys_Thread_UnlockMutex(serverscanner->mutex);
+}
+
 #ifdef DEBUG
 int main()
 {
@@ -1064,9 +1624,9 @@ int main()
 	unsigned int numdown;
 
 #if 1
-	serverscanner = ServerScanner_Create("asgaard.morphos-team.net:27000 master.quakeservers.net:27000");
+	serverscanner = ServerScanner_Create("asgaard.morphos-team.net:27000 master.quakeservers.net:27000", 0);
 #else
-	serverscanner = ServerScanner_Create("127.0.0.1:27000");
+	serverscanner = ServerScanner_Create("127.0.0.1:27000", 0);
 #endif
 	if (serverscanner)
 	{
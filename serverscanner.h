@@ -69,9 +69,20 @@ struct QWServer
 	unsigned int numplayers;
 	const struct QWSpectator *spectators;
 	unsigned int numspectators;
+	unsigned int stale; /* Loaded from the cache and not yet refreshed */
+	unsigned int changecount; /* Incremented every time the scanner updates the server */
 };
 
-struct ServerScanner *ServerScanner_Create(const char *masters);
+struct ServerScannerProgress
+{
+	unsigned int numservers;
+	unsigned int numscanned; /* Replied or given up on */
+	unsigned int numpinged; /* Ditto */
+	unsigned int inflight;
+	unsigned int repliespersecond;
+};
+
+struct ServerScanner *ServerScanner_Create(const char *masters, const char *cachefile);
 void ServerScanner_Delete(struct ServerScanner *serverscanner);
 
 void ServerScanner_DoStuff(struct ServerScanner *serverscanner);
@@ -80,6 +91,8 @@ const struct QWServer **ServerScanner_GetServers(struct ServerScanner *serversca
 void ServerScanner_FreeServers(struct ServerScanner *serverscanner, const struct QWServer **servers);
 void ServerScanner_RescanServer(struct ServerScanner *serverscanner, const struct QWServer *server);
 enum ServerScannerStatus ServerScanner_GetStatus(struct ServerScanner *serverscanner);
+void ServerScanner_GetProgress(struct ServerScanner *serverscanner, struct ServerScannerProgress *progress);
+int ServerScanner_SaveCache(struct ServerScanner *serverscanner, const char *filename);
 
 
 
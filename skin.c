@@ -25,9 +25,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "image.h"
 #include "skinimp.h"
 #include "skin.h"
+#include "sys_thread.h"
 
 static cvar_t baseskin = { "baseskin", "base" };
 static cvar_t noskins = { "noskins", "0" };
+static cvar_t skin_cachesize = { "skin_cachesize", "64" };
 
 static void *defaultskin;
 
@@ -39,11 +41,15 @@ enum SkinSourceType
 	SKINSOURCE_TEXTURE_TRUECOLOUR,
 };
 
+#define SKINRANGE_TOP 1
+#define SKINRANGE_BOTTOM 2
+
 struct SkinSource
 {
 	struct SkinSource *next;
 
 	enum SkinSourceType type;
+	unsigned int ranges;
 
 	struct SkinTranslation *translations;
 
@@ -69,21 +75,49 @@ struct SkinTranslation
 {
 	struct SkinTranslation *next;
 
+	/* Finished translations, most recently used first */
+	struct SkinTranslation *lruprev;
+	struct SkinTranslation *lrunext;
+
+	/* Queued for or finished by the skin thread */
+	struct SkinTranslation *jobnext;
+
+	struct SkinSource *source;
+
 	unsigned int topcolour;
 	unsigned int bottomcolour;
 
-	struct SkinImp *skinimp;
+	unsigned int pending;
+
+	struct SkinImpData *skinimpdata;
+	struct SkinImp *skinimp; /* 0 if the translation failed */
 };
 
 struct SkinSource *skinsources;
 
+static struct SkinTranslation *lrufirst;
+static struct SkinTranslation *lrulast;
+static unsigned int lrucount;
+
+static struct SysThread *skinthread;
+static struct SysMutex *skinmutex;
+static struct SysSignal *skinsignal;
+static struct SysSignal *skindonesignal;
+static volatile unsigned int skinquit;
+
+/* Protected by skinmutex */
+static struct SkinTranslation *skinjobs;
+static struct SkinTranslation *skinjobsdone;
+
+static unsigned int skinpending;
+
 static void Skin_SetupTexture(struct SkinSource *source)
 {
 	unsigned int x;
 	unsigned int y;
 	unsigned int width;
 	unsigned int height;
-	const char *p;
+	const unsigned char *p;
 
 	width = source->data.texture.width;
 	height = source->data.texture.height;
@@ -94,25 +128,26 @@ static void Skin_SetupTexture(struct SkinSource *source)
 	if (height > 194)
 		height = 194;
 
-	source->type = SKINSOURCE_TEXTURE_PALETTED;
+	source->ranges = 0;
 
 	p = source->data.texture.data;
-	for(y=0;y<height;y++)
+	for(y=0;y<height && source->ranges != (SKINRANGE_TOP|SKINRANGE_BOTTOM);y++)
 	{
 		for(x=0;x<width;x++)
 		{
-			if ((p[x] >= 16 && p[x] < 32) || (p[x] >= 96 && p[x] < 112))
-			{
-				source->type = SKINSOURCE_TEXTURE_PALETTED_TRANSLATED;
-				break;
-			}
+			if (p[x] >= 16 && p[x] < 32)
+				source->ranges |= SKINRANGE_TOP;
+			else if (p[x] >= 96 && p[x] < 112)
+				source->ranges |= SKINRANGE_BOTTOM;
 		}
 
-		if (source->type == SKINSOURCE_TEXTURE_PALETTED_TRANSLATED)
-			break;
-
 		p += source->data.texture.width;
 	}
+
+	if (source->ranges)
+		source->type = SKINSOURCE_TEXTURE_PALETTED_TRANSLATED;
+	else
+		source->type = SKINSOURCE_TEXTURE_PALETTED;
 }
 
 static struct SkinSource *Skin_GetSource(const char *skinname)
@@ -200,20 +235,351 @@ static struct SkinSource *Skin_GetSource(const char *skinname)
 	return 0;
 }
 
-static void Skin_DeleteSource(struct SkinSource *source)
+static void Skin_LRURemove(struct SkinTranslation *translation)
+{
+	if (translation->lruprev)
+		translation->lruprev->lrunext = translation->lrunext;
+	else
+		lrufirst = translation->lrunext;
+
+	if (translation->lrunext)
+		translation->lrunext->lruprev = translation->lruprev;
+	else
+		lrulast = translation->lruprev;
+
+	translation->lruprev = 0;
+	translation->lrunext = 0;
+
+	lrucount--;
+}
+
+static void Skin_LRUAddFirst(struct SkinTranslation *translation)
+{
+	translation->lruprev = 0;
+	translation->lrunext = lrufirst;
+
+	if (lrufirst)
+		lrufirst->lruprev = translation;
+	else
+		lrulast = translation;
+
+	lrufirst = translation;
+
+	lrucount++;
+}
+
+static void Skin_DeleteTranslation(struct SkinTranslation *translation)
+{
+	struct SkinTranslation **prev;
+
+	prev = &translation->source->translations;
+	while(*prev != translation)
+		prev = &(*prev)->next;
+
+	*prev = translation->next;
+
+	Skin_LRURemove(translation);
+
+	if (translation->skinimp)
+		SkinImp_Destroy(translation->skinimp);
+
+	free(translation);
+}
+
+/* Drops the least recently used translations until the cache is within its
+ * limit. Never goes below what a full server can show at once. */
+static void Skin_TrimCache(void)
+{
+	unsigned int maxcount;
+
+	maxcount = skin_cachesize.value > 32 ? skin_cachesize.value : 32;
+
+	while(lrucount > maxcount)
+		Skin_DeleteTranslation(lrulast);
+}
+
+static void Skin_TranslateTexture(const struct SkinSource *source, unsigned char *translated, unsigned int topcolour, unsigned int bottomcolour)
+{
+	unsigned char table[256];
+	const unsigned char *src;
+	unsigned char *dst;
+	unsigned int top;
+	unsigned int bottom;
+	unsigned int width;
+	unsigned int height;
+	unsigned int x;
+	unsigned int y;
+	unsigned int i;
+
+	top = topcolour * 16;
+	bottom = bottomcolour * 16;
+
+	for(i=0;i<16;i++)
+	{
+		table[i] = i;
+	}
+
+	if (top < 128)
+	{
+		for(i=0;i<16;i++)
+		{
+			table[i + 16] = top + i;
+		}
+	}
+	else
+	{
+		for(i=0;i<16;i++)
+		{
+			table[i + 16] = top + 15 - i;
+		}
+	}
+
+	for(i=32;i<96;i++)
+	{
+		table[i] = i;
+	}
+
+	if (bottom < 128)
+	{
+		for(i=0;i<16;i++)
+		{
+			table[i + 96] = bottom + i;
+		}
+	}
+	else
+	{
+		for(i=0;i<16;i++)
+		{
+			table[i + 96] = bottom + 15 - i;
+		}
+	}
+
+	for(i=112;i<256;i++)
+	{
+		table[i] = i;
+	}
+
+	src = source->data.texture.data;
+	dst = translated;
+
+	width = source->data.texture.width;
+	if (width > 296)
+		width = 296;
+
+	height = source->data.texture.height;
+	if (height > 194)
+		height = 194;
+
+	for(y=0;y<height;y++)
+	{
+		for(x=0;x<width;x++)
+		{
+			dst[x] = table[src[x]];
+		}
+
+		for(;x<296;x++)
+		{
+			dst[x] = 0;
+		}
+
+		src += source->data.texture.width;
+		dst += 296;
+	}
+
+	if (y != 194)
+		memset(dst, 0, (194-y)*296);
+}
+
+/* Only reads the source texture, which never changes while a translation of it
+ * is pending, so this is safe to run on the skin thread. */
+static void Skin_PrepareTranslation(struct SkinTranslation *translation)
+{
+	const struct SkinSource *source;
+	unsigned char *translated;
+
+	source = translation->source;
+
+	if (source->type == SKINSOURCE_TEXTURE_PALETTED)
+		translation->skinimpdata = SkinImp_PrepareTexturePaletted(source->data.texture.data, 296, 194, source->data.texture.width);
+	else if (source->type == SKINSOURCE_TEXTURE_PALETTED_TRANSLATED)
+	{
+		translated = malloc(296*194);
+		if (translated)
+		{
+			Skin_TranslateTexture(source, translated, translation->topcolour, translation->bottomcolour);
+
+			translation->skinimpdata = SkinImp_PrepareTexturePaletted(translated, 296, 194, 296);
+
+			free(translated);
+		}
+	}
+}
+
+static void Skin_FinishTranslation(struct SkinTranslation *translation)
+{
+	if (translation->skinimpdata)
+	{
+		translation->skinimp = SkinImp_CreateFromData(translation->skinimpdata);
+		SkinImp_FreeData(translation->skinimpdata);
+		translation->skinimpdata = 0;
+	}
+
+	translation->pending = 0;
+
+	Skin_LRUAddFirst(translation);
+}
+
+static void Skin_Thread(void *arg)
+{
+	struct SkinTranslation *translation;
+
+	while(1)
+	{
+		Sys_Thread_WaitSignal(skinsignal);
+
+		if (skinquit)
+			break;
+
+		while(1)
+		{
+			Sys_Thread_LockMutex(skinmutex);
+			translation = skinjobs;
+			if (translation)
+				skinjobs = translation->jobnext;
+			Sys_Thread_UnlockMutex(skinmutex);
+
+			if (translation == 0)
+				break;
+
+			Skin_PrepareTranslation(translation);
+
+			Sys_Thread_LockMutex(skinmutex);
+			translation->jobnext = skinjobsdone;
+			skinjobsdone = translation;
+			Sys_Thread_UnlockMutex(skinmutex);
+
+			Sys_Thread_SendSignal(skindonesignal);
+		}
+	}
+}
+
+/* Uploads whatever the skin thread has finished since the last call */
+static void Skin_CollectJobs(void)
 {
-	struct SkinSource *s;
 	struct SkinTranslation *translation;
 	struct SkinTranslation *next;
 
-	next = source->translations;
+	if (skinpending == 0)
+		return;
+
+	Sys_Thread_LockMutex(skinmutex);
+	next = skinjobsdone;
+	skinjobsdone = 0;
+	Sys_Thread_UnlockMutex(skinmutex);
+
 	while((translation = next))
 	{
-		next = translation->next;
+		next = translation->jobnext;
+		translation->jobnext = 0;
 
-		SkinImp_Destroy(translation->skinimp);
-		free(translation);
+		Skin_FinishTranslation(translation);
+
+		skinpending--;
+	}
+
+	Skin_TrimCache();
+}
+
+static void Skin_WaitJobs(void)
+{
+	while(skinpending)
+	{
+		Sys_Thread_WaitSignal(skindonesignal);
+		Skin_CollectJobs();
 	}
+}
+
+static void Skin_QueueTranslation(struct SkinTranslation *translation)
+{
+	translation->pending = 1;
+
+	if (skinthread)
+	{
+		Sys_Thread_LockMutex(skinmutex);
+		translation->jobnext = skinjobs;
+		skinjobs = translation;
+		Sys_Thread_UnlockMutex(skinmutex);
+
+		skinpending++;
+
+		Sys_Thread_SendSignal(skinsignal);
+	}
+	else
+	{
+		Skin_PrepareTranslation(translation);
+		Skin_FinishTranslation(translation);
+		Skin_TrimCache();
+	}
+}
+
+static void Skin_StartThread(void)
+{
+	if (skinthread)
+		return;
+
+	skinmutex = Sys_Thread_CreateMutex();
+	skinsignal = Sys_Thread_CreateSignal();
+	skindonesignal = Sys_Thread_CreateSignal();
+	if (skinmutex && skinsignal && skindonesignal)
+	{
+		skinthread = Sys_Thread_CreateThread(Skin_Thread, 0);
+		if (skinthread)
+		{
+			Sys_Thread_SetThreadPriority(skinthread, SYSTHREAD_PRIORITY_LOW);
+			return;
+		}
+	}
+
+	/* Fall back to translating on the main thread */
+	if (skindonesignal)
+		Sys_Thread_DeleteSignal(skindonesignal);
+	if (skinsignal)
+		Sys_Thread_DeleteSignal(skinsignal);
+	if (skinmutex)
+		Sys_Thread_DeleteMutex(skinmutex);
+
+	skindonesignal = 0;
+	skinsignal = 0;
+	skinmutex = 0;
+}
+
+static void Skin_StopThread(void)
+{
+	if (skinthread == 0)
+		return;
+
+	Skin_WaitJobs();
+
+	skinquit = 1;
+	Sys_Thread_SendSignal(skinsignal);
+	Sys_Thread_DeleteThread(skinthread);
+	skinthread = 0;
+	skinquit = 0;
+
+	Sys_Thread_DeleteSignal(skindonesignal);
+	Sys_Thread_DeleteSignal(skinsignal);
+	Sys_Thread_DeleteMutex(skinmutex);
+	skindonesignal = 0;
+	skinsignal = 0;
+	skinmutex = 0;
+}
+
+static void Skin_DeleteSource(struct SkinSource *source)
+{
+	struct SkinSource *s;
+
+	while(source->translations)
+		Skin_DeleteTranslation(source->translations);
 
 	if (source == skinsources)
 		skinsources = source->next;
@@ -243,11 +609,17 @@ static void Skin_DeleteSource(struct SkinSource *source)
 	free(source);
 }
 
+/* Translations are shared by every player using the same skin and the colours
+ * the skin actually shows. Paletted skins are converted on the skin thread; until
+ * a translation is ready, another one of the same skin is returned if there is
+ * one, or 0 to make the caller fall back to the model's own skin. */
 struct SkinImp *Skin_GetTranslation(const char *skinname, unsigned int topcolour, unsigned int bottomcolour)
 {
 	struct SkinSource *source;
 	struct SkinTranslation *translation;
-	struct SkinImp *skinimp;
+	struct SkinTranslation *fallback;
+
+	Skin_CollectJobs();
 
 	source = Skin_GetSource(skinname);
 	if (!source)
@@ -259,149 +631,81 @@ struct SkinImp *Skin_GetTranslation(const char *skinname, unsigned int topcolour
 	if (bottomcolour > 13)
 		bottomcolour = 13;
 
+	if (source->type != SKINSOURCE_TEXTURE_PALETTED_TRANSLATED)
+	{
+		topcolour = 0;
+		bottomcolour = 0;
+	}
+	else
+	{
+		if (!(source->ranges & SKINRANGE_TOP))
+			topcolour = 0;
+
+		if (!(source->ranges & SKINRANGE_BOTTOM))
+			bottomcolour = 0;
+	}
+
 	translation = source->translations;
 	while(translation)
 	{
-		if ((translation->topcolour == topcolour && translation->bottomcolour == bottomcolour)
-		 || source->type == SKINSOURCE_SOLIDCOLOUR
-		 || source->type == SKINSOURCE_TEXTURE_PALETTED)
-		{
-			return translation->skinimp;
-		}
+		if (translation->topcolour == topcolour && translation->bottomcolour == bottomcolour)
+			break;
 
 		translation = translation->next;
 	}
 
-	translation = malloc(sizeof(*translation));
-	if (translation)
+	if (translation == 0)
 	{
+		translation = malloc(sizeof(*translation));
+		if (translation == 0)
+			return 0;
+
 		memset(translation, 0, sizeof(*translation));
 
-		skinimp = 0;
+		translation->source = source;
+		translation->topcolour = topcolour;
+		translation->bottomcolour = bottomcolour;
+
+		translation->next = source->translations;
+		source->translations = translation;
 
 		if (source->type == SKINSOURCE_SOLIDCOLOUR)
-			skinimp = SkinImp_CreateSolidColour(source->data.solidcolour.colours);
-		else if (source->type == SKINSOURCE_TEXTURE_PALETTED)
-			skinimp = SkinImp_CreateTexturePaletted(source->data.texture.data, 296, 194, source->data.texture.width);
-		else if (source->type == SKINSOURCE_TEXTURE_PALETTED_TRANSLATED)
 		{
-			unsigned char table[256];
-			unsigned char *translated;
-			unsigned char *src;
-			unsigned char *dst;
-			unsigned int top;
-			unsigned int bottom;
-			unsigned int width;
-			unsigned int height;
-			unsigned int x;
-			unsigned int y;
-			unsigned int i;
-
-			translated = malloc(296*194);
-			if (translated)
-			{
-				top = topcolour * 16;
-				bottom = bottomcolour * 16;
-
-				for(i=0;i<16;i++)
-				{
-					table[i] = i;
-				}
-
-				if (top < 128)
-				{
-					for(i=0;i<16;i++)
-					{
-						table[i + 16] = top + i;
-					}
-				}
-				else
-				{
-					for(i=0;i<16;i++)
-					{
-						table[i + 16] = top + 15 - i;
-					}
-				}
-
-				for(i=32;i<96;i++)
-				{
-					table[i] = i;
-				}
-
-				if (bottom < 128)
-				{
-					for(i=0;i<16;i++)
-					{
-						table[i + 96] = bottom + i;
-					}
-				}
-				else
-				{
-					for(i=0;i<16;i++)
-					{
-						table[i + 96] = bottom + 15 - i;
-					}
-				}
-
-				for(i=112;i<256;i++)
-				{
-					table[i] = i;
-				}
-
-				src = source->data.texture.data;
-				dst = translated;
-
-				width = source->data.texture.width;
-				if (width > 296)
-					width = 296;
-
-				height = source->data.texture.height;
-				if (height > 194)
-					height = 194;
-
-				for(y=0;y<height;y++)
-				{
-					for(x=0;x<width;x++)
-					{
-						dst[x] = table[src[x]];
-					}
-
-					for(;x<296;x++)
-					{
-						dst[x] = 0;
-					}
-
-					src += source->data.texture.width;
-					dst += 296;
-				}
-
-				if (y != 194)
-					memset(dst, 0, (194-y)*296);
-
-				skinimp = SkinImp_CreateTexturePaletted(translated, 296, 194, 296);
-
-				free(translated);
-			}
+			translation->skinimp = SkinImp_CreateSolidColour(source->data.solidcolour.colours);
+			Skin_LRUAddFirst(translation);
+			Skin_TrimCache();
 		}
 		else if (source->type == SKINSOURCE_TEXTURE_TRUECOLOUR)
-			skinimp = SkinImp_CreateTextureTruecolour(source->data.texture.data, source->data.texture.width, source->data.texture.height);
-
-		if (skinimp)
 		{
-			translation->topcolour = topcolour;
-			translation->bottomcolour = bottomcolour;
-			translation->skinimp = skinimp;
+			translation->skinimp = SkinImp_CreateTextureTruecolour(source->data.texture.data, source->data.texture.width, source->data.texture.height);
+			Skin_LRUAddFirst(translation);
+			Skin_TrimCache();
+		}
+		else
+			Skin_QueueTranslation(translation);
+	}
 
-			translation->next = source->translations;
-			source->translations = translation;
+	if (translation->pending)
+	{
+		fallback = source->translations;
+		while(fallback)
+		{
+			if (!fallback->pending && fallback->skinimp)
+				return fallback->skinimp;
 
-			return skinimp; 
+			fallback = fallback->next;
 		}
 
-		free(translation);
+		return 0;
 	}
 
-	return 0;
+	if (translation != lrufirst)
+	{
+		Skin_LRURemove(translation);
+		Skin_LRUAddFirst(translation);
+	}
+
+	return translation->skinimp;
 }
 
 void Skin_SetDefault(void *data, unsigned int width, unsigned int height)
@@ -437,6 +741,9 @@ void Skin_SetDefault(void *data, unsigned int width, unsigned int height)
 
 void Skin_FreeAll()
 {
+	if (skinthread)
+		Skin_WaitJobs();
+
 	while(skinsources)
 		Skin_DeleteSource(skinsources);
 }
@@ -446,16 +753,19 @@ void Skin_CvarInit()
 	Cvar_SetCurrentGroup(CVAR_GROUP_SKIN);
 	Cvar_Register(&baseskin);
 	Cvar_Register(&noskins);
+	Cvar_Register(&skin_cachesize);
 	Cvar_ResetCurrentGroup();
 }
 
 void Skin_Init()
 {
+	Skin_StartThread();
 }
 
 void Skin_Shutdown()
 {
 	Skin_FreeAll();
+	Skin_StopThread();
 
 	free(defaultskin);
 	defaultskin = 0;
@@ -19,6 +19,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 struct SkinImp *SkinImp_CreateSolidColour(float *colours);
 struct SkinImp *SkinImp_CreateTexturePaletted(void *data, unsigned int width, unsigned int height, unsigned int modulo);
+/* Does the conversion work of SkinImp_CreateTexturePaletted() without touching
+ * any renderer state, so it can be called from any thread. The result is turned
+ * into a SkinImp by SkinImp_CreateFromData() on the main thread. */
+struct SkinImpData *SkinImp_PrepareTexturePaletted(void *data, unsigned int width, unsigned int height, unsigned int modulo);
+struct SkinImp *SkinImp_CreateFromData(struct SkinImpData *skinimpdata);
+void SkinImp_FreeData(struct SkinImpData *skinimpdata);
 struct SkinImp *SkinImp_CreateTextureTruecolour(void *data, unsigned int width, unsigned int height);
 void SkinImp_Destroy(struct SkinImp *skinimp);
 
@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "qwsvdef.h"
 #include "pmove.h"
+#include "pvscache.h"
 
 int SV_PMTypeForClient (client_t *cl);
 
@@ -97,11 +98,11 @@ int SV_TranslateEntnum(int num) {
 //entity that should be visible to not show up, especially when the bob crosses a waterline.
 
 int		fatbytes;
-byte	fatpvs[MAX_MAP_LEAFS/8];
+byte	fatpvs[PVSCACHE_ROWBYTES(MAX_MAP_LEAFS)] __attribute__((aligned(16)));
 
 void SV_AddToFatPVS (vec3_t org, mnode_t *node) {
 	int i;
-	byte *pvs;
+	unsigned long *pvs;
 	mplane_t *plane;
 	float d;
 
@@ -109,9 +110,9 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node) {
 		// if this is a leaf, accumulate the pvs bits
 		if (node->contents < 0) {
 			if (node->contents != CONTENTS_SOLID) {
-				pvs = Mod_LeafPVS ( (mleaf_t *)node, sv.worldmodel);
-				for (i = 0; i < fatbytes; i++)
-					fatpvs[i] |= pvs[i];
+				pvs = (unsigned long *)Mod_LeafPVS ( (mleaf_t *)node, sv.worldmodel);
+				for (i = 0; i < fatbytes / sizeof(unsigned long); i++)
+					((unsigned long *)fatpvs)[i] |= pvs[i];
 			}
 			return;
 		}
@@ -131,7 +132,7 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node) {
 
 //Calculates a PVS that is the inclusive or of all leafs within 8 pixels of the given point.
 byte *SV_FatPVS (vec3_t org) {
-	fatbytes = (sv.worldmodel->numleafs + 31) >> 3;
+	fatbytes = PVSCACHE_ROWBYTES(sv.worldmodel->numleafs);
 	memset (fatpvs, 0, fatbytes);
 	SV_AddToFatPVS (org, sv.worldmodel->nodes);
 	return fatpvs;
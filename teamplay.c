@@ -35,6 +35,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "ignore.h"
 #include "ruleset.h"
+#include "multimatch.h"
 
 #include "strl.h"
 
@@ -1640,10 +1641,40 @@ typedef struct locdata_s
 {
 	vec3_t coord;
 	char *name;
+	unsigned int index;		// order in the file, the first of equally near locs wins
 	struct locdata_s *next;
 } locdata_t;
 
 static locdata_t	*locdata = NULL;
+static locdata_t	*locdata_last = NULL;
+static unsigned int	locdata_count;
+
+// implicit k-d tree over all loc points: the middle element of every range
+// splits it on the axis stored next to it
+static locdata_t	**loc_kdtree;
+static unsigned char	*loc_kdtree_axis;
+static int		loc_kdtree_sortaxis;
+
+// TP_LocationName results for the current frame
+#define LOC_CACHE_SIZE 4
+
+typedef struct loccache_s
+{
+	vec3_t location;
+	int framecount;
+	char name[1024];
+} loccache_t;
+
+static loccache_t	loc_cache[LOC_CACHE_SIZE];
+static unsigned int	loc_cache_next;
+
+static void TP_ClearLocCache(void)
+{
+	int i;
+
+	for (i = 0; i < LOC_CACHE_SIZE; i++)
+		loc_cache[i].framecount = -1;
+}
 
 static void TP_ClearLocs(void)
 {
@@ -1657,27 +1688,147 @@ static void TP_ClearLocs(void)
 	}
 
 	locdata = NULL;
+	locdata_last = NULL;
+	locdata_count = 0;
+
+	free(loc_kdtree);
+	free(loc_kdtree_axis);
+	loc_kdtree = NULL;
+	loc_kdtree_axis = NULL;
+
+	TP_ClearLocCache();
 }
 
 static void TP_AddLocNode(vec3_t coord, char *name)
 {
-	locdata_t *newnode, *node;
+	locdata_t *newnode;
 
 	newnode = Q_Malloc(sizeof(locdata_t));
 	newnode->name = strdup(name);
+	newnode->index = locdata_count++;
 	newnode->next = NULL;
 	memcpy(newnode->coord, coord, sizeof(vec3_t));
 
 	if (!locdata)
-	{
 		locdata = newnode;
+	else
+		locdata_last->next = newnode;
+
+	locdata_last = newnode;
+}
+
+static int TP_LocCompare(const void *p1, const void *p2)
+{
+	const locdata_t *l1, *l2;
+
+	l1 = *((const locdata_t **) p1);
+	l2 = *((const locdata_t **) p2);
+
+	if (l1->coord[loc_kdtree_sortaxis] < l2->coord[loc_kdtree_sortaxis])
+		return -1;
+	if (l1->coord[loc_kdtree_sortaxis] > l2->coord[loc_kdtree_sortaxis])
+		return 1;
+
+	return 0;
+}
+
+static void TP_BuildLocTree(unsigned int start, unsigned int end)
+{
+	vec3_t mins, maxs;
+	unsigned int i, mid;
+	int axis;
+
+	if (start >= end)
+		return;
+
+	VectorCopy(loc_kdtree[start]->coord, mins);
+	VectorCopy(loc_kdtree[start]->coord, maxs);
+	for (i = start + 1; i < end; i++)
+	{
+		for (axis = 0; axis < 3; axis++)
+		{
+			mins[axis] = min(mins[axis], loc_kdtree[i]->coord[axis]);
+			maxs[axis] = max(maxs[axis], loc_kdtree[i]->coord[axis]);
+		}
+	}
+
+	loc_kdtree_sortaxis = 0;
+	for (axis = 1; axis < 3; axis++)
+	{
+		if (maxs[axis] - mins[axis] > maxs[loc_kdtree_sortaxis] - mins[loc_kdtree_sortaxis])
+			loc_kdtree_sortaxis = axis;
+	}
+
+	qsort(loc_kdtree + start, end - start, sizeof(*loc_kdtree), TP_LocCompare);
+
+	mid = (start + end) / 2;
+	loc_kdtree_axis[mid] = loc_kdtree_sortaxis;
+
+	TP_BuildLocTree(start, mid);
+	TP_BuildLocTree(mid + 1, end);
+}
+
+// the linear search is kept for when there is no memory for the tree
+static void TP_CreateLocTree(void)
+{
+	locdata_t *node;
+	unsigned int i;
+
+	loc_kdtree = malloc(locdata_count * sizeof(*loc_kdtree));
+	loc_kdtree_axis = malloc(locdata_count);
+	if (!loc_kdtree || !loc_kdtree_axis)
+	{
+		free(loc_kdtree);
+		free(loc_kdtree_axis);
+		loc_kdtree = NULL;
+		loc_kdtree_axis = NULL;
 		return;
 	}
 
-	for (node = locdata; node->next; node = node->next)
-		;
+	for (node = locdata, i = 0; node; node = node->next, i++)
+		loc_kdtree[i] = node;
 
-	node->next = newnode;
+	TP_BuildLocTree(0, locdata_count);
+}
+
+static void TP_NearestLocInTree(vec3_t location, unsigned int start, unsigned int end, locdata_t **best, float *mindist)
+{
+	locdata_t *node;
+	unsigned int mid;
+	float dist, diff;
+	vec3_t vec;
+	int axis;
+
+	while (start < end)
+	{
+		mid = (start + end) / 2;
+		node = loc_kdtree[mid];
+		axis = loc_kdtree_axis[mid];
+
+		VectorSubtract(location, node->coord, vec);
+		dist = vec[0] * vec[0] + vec[1] * vec[1] + vec[2] * vec[2];
+		if (!*best || dist < *mindist || (dist == *mindist && node->index < (*best)->index))
+		{
+			*best = node;
+			*mindist = dist;
+		}
+
+		diff = vec[axis];
+		if (diff < 0)
+		{
+			TP_NearestLocInTree(location, start, mid, best, mindist);
+			if (diff * diff > *mindist)
+				return;
+			start = mid + 1;
+		}
+		else
+		{
+			TP_NearestLocInTree(location, mid + 1, end, best, mindist);
+			if (diff * diff > *mindist)
+				return;
+			end = mid;
+		}
+	}
 }
 
 #define SKIPBLANKS(ptr) while (*ptr == ' ' || *ptr == '\t' || *ptr == '\r') ptr++
@@ -1817,6 +1968,7 @@ _next:
 
 	if (loc_numentries)
 	{
+		TP_CreateLocTree();
 		if (!quiet)
 			Com_Printf ("Loaded locfile \"%s\" (%i loc points)\n", COM_SkipPath(locname), loc_numentries);
 	}
@@ -1869,14 +2021,15 @@ static locmacro_t locmacros[] =
 
 char *TP_LocationName(vec3_t location)
 {
-	char *in, *out, *value;
+	char *in, *out, *value, *buf;
 	int i;
 	float dist, mindist;
 	vec3_t vec;
 	static locdata_t *node, *best;
 	cvar_t *cvar;
 	static qboolean recursive;
-	static char	buf[1024], newbuf[MAX_LOC_NAME];
+	static char	newbuf[MAX_LOC_NAME];
+	loccache_t *cache;
 
 	if (!locdata || cls.state != ca_active)
 		return tp_name_someplace.string;
@@ -1884,17 +2037,30 @@ char *TP_LocationName(vec3_t location)
 	if (recursive)
 		return "";
 
+	for (i = 0; i < LOC_CACHE_SIZE; i++)
+	{
+		if (loc_cache[i].framecount == cls.framecount && VectorCompare(loc_cache[i].location, location))
+			return loc_cache[i].name;
+	}
+
 	best = NULL;
 	mindist = 0;
 
-	for (node = locdata; node; node = node->next)
+	if (loc_kdtree)
 	{
-		VectorSubtract(location, node->coord, vec);
-		dist = vec[0] * vec[0] + vec[1] * vec[1] + vec[2] * vec[2];
-		if (!best || dist < mindist)
+		TP_NearestLocInTree(location, 0, locdata_count, &best, &mindist);
+	}
+	else
+	{
+		for (node = locdata; node; node = node->next)
 		{
-			best = node;
-			mindist = dist;
+			VectorSubtract(location, node->coord, vec);
+			dist = vec[0] * vec[0] + vec[1] * vec[1] + vec[2] * vec[2];
+			if (!best || dist < mindist)
+			{
+				best = node;
+				mindist = dist;
+			}
 		}
 	}
 
@@ -1939,11 +2105,21 @@ char *TP_LocationName(vec3_t location)
 done_locmacros:
 	*out = 0;
 
+	cache = &loc_cache[loc_cache_next];
+	loc_cache_next = (loc_cache_next + 1) % LOC_CACHE_SIZE;
+
+	// not valid until it is filled in, in case the expansion ends up in here again
+	cache->framecount = -1;
+
+	buf = cache->name;
 	buf[0] = 0;
 	recursive = true;
-	Cmd_ExpandString(newbuf, buf, sizeof(buf));
+	Cmd_ExpandString(newbuf, buf, sizeof(cache->name));
 	recursive = false;
 
+	VectorCopy(location, cache->location);
+	cache->framecount = cls.framecount;
+
 	return buf;
 }
 
@@ -1954,11 +2130,43 @@ typedef struct msg_trigger_s
 	char	name[32];
 	char	string[64];
 	int		level;
+	unsigned int pattern;
 	struct msg_trigger_s *next;
 } msg_trigger_t;
 
 static msg_trigger_t *msg_triggers;
 
+/* All trigger strings and the anti-fake strings below are compiled into one
+ * automaton, so each print is only scanned once. It is rebuilt lazily after
+ * the triggers have changed. */
+static struct MultiMatch *msg_trigger_matcher;
+static unsigned char *msg_trigger_found;
+static unsigned int msg_trigger_numpatterns;
+static qboolean msg_triggers_changed = true;
+
+static const char *msg_trigger_fixedstrings[] =
+{
+	/* Fake proxy replies */
+	"f_version", "f_system", "f_server", "f_speed", "f_modified",
+	/* TF flag messages */
+	" has your key!",
+	" has taken your Key",
+	" has your flag",
+	" took your flag!",
+	"   flag!",
+	"   ",
+	"   ",
+	" took the blue flag",
+	" took the red flag",
+	" Has the Red Flag",
+	" Has the Blue Flag",
+};
+
+#define MSG_TRIGGER_FIRSTFAKEPROXY 0
+#define MSG_TRIGGER_NUMFAKEPROXY 5
+#define MSG_TRIGGER_FIRSTFLAG 5
+#define MSG_TRIGGER_NUMFIXED (sizeof(msg_trigger_fixedstrings) / sizeof(*msg_trigger_fixedstrings))
+
 void TP_ResetAllTriggers(void)
 {
 	msg_trigger_t *temp;
@@ -1969,6 +2177,8 @@ void TP_ResetAllTriggers(void)
 		Z_Free(msg_triggers);
 		msg_triggers = temp;
 	}
+
+	msg_triggers_changed = true;
 }
 
 void TP_DumpTriggers(FILE *f)
@@ -2055,6 +2265,7 @@ void TP_MsgTrigger_f (void)
 		}
 
 		Q_strncpyz (trig->string, Cmd_Argv(2), sizeof(trig->string));
+		msg_triggers_changed = true;
 		if (c == 5 && !Q_strcasecmp (Cmd_Argv(3), "-l"))
 		{
 			if (!strcmp(Cmd_Argv(4), "t"))
@@ -2071,18 +2282,62 @@ void TP_MsgTrigger_f (void)
 	}
 }
 
-static qboolean TP_IsFlagMessage(char *message)
+static void TP_BuildMsgTriggerMatcher(void)
 {
-	if	(	strstr(message, " has your key!") ||
-			strstr(message, " has taken your Key") ||
-			strstr(message, " has your flag") ||
-			strstr(message, " took your flag!") ||
-			strstr(message, "   flag!") ||
-			strstr(message, "   ") || strstr(message, "   ") ||
-			strstr(message, " took the blue flag") || strstr(message, " took the red flag") ||
-			strstr(message, " Has the Red Flag") || strstr(message, " Has the Blue Flag")
-		)
-		return true;
+	msg_trigger_t *t;
+	const char **patterns;
+	unsigned int i, numpatterns;
+
+	if (msg_trigger_matcher)
+	{
+		MultiMatch_Delete(msg_trigger_matcher);
+		msg_trigger_matcher = 0;
+	}
+
+	free(msg_trigger_found);
+	msg_trigger_found = 0;
+
+	msg_triggers_changed = false;
+
+	numpatterns = MSG_TRIGGER_NUMFIXED;
+	for (t = msg_triggers; t; t = t->next)
+		t->pattern = numpatterns++;
+
+	patterns = malloc(numpatterns * sizeof(*patterns));
+	msg_trigger_found = malloc(numpatterns);
+	if (patterns && msg_trigger_found)
+	{
+		for (i = 0; i < MSG_TRIGGER_NUMFIXED; i++)
+			patterns[i] = msg_trigger_fixedstrings[i];
+
+		for (t = msg_triggers; t; t = t->next)
+			patterns[t->pattern] = t->string;
+
+		msg_trigger_matcher = MultiMatch_Create(patterns, numpatterns);
+		msg_trigger_numpatterns = numpatterns;
+	}
+
+	free(patterns);
+}
+
+// falls back to strstr if the matcher couldn't be built
+static qboolean TP_MsgTriggerMatched(char *s, unsigned int pattern, const char *string)
+{
+	if (msg_trigger_matcher)
+		return msg_trigger_found[pattern];
+
+	return strstr(s, string) != NULL;
+}
+
+static qboolean TP_MatchesFixedString(char *s, unsigned int first, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = first; i < first + count; i++)
+	{
+		if (TP_MsgTriggerMatched(s, i, msg_trigger_fixedstrings[i]))
+			return true;
+	}
 
 	return false;
 }
@@ -2096,18 +2351,26 @@ void TP_SearchForMsgTriggers (char *s, int level)
 		return;
 	if (!tp_msgtriggers.value || !Ruleset_AllowMsgTriggers())
 		return;
+	if (!msg_triggers)
+		return;
+
+	if (msg_triggers_changed)
+		TP_BuildMsgTriggerMatcher();
+
+	if (msg_trigger_matcher)
+	{
+		memset(msg_trigger_found, 0, msg_trigger_numpatterns);
+		MultiMatch_Search(msg_trigger_matcher, s, msg_trigger_found);
+	}
 
 	for (t = msg_triggers; t; t = t->next)
 	{
-		if ((t->level == level || (t->level == 3 && level == 4)) && t->string[0] && strstr(s, t->string))
+		if ((t->level == level || (t->level == 3 && level == 4)) && t->string[0] && TP_MsgTriggerMatched(s, t->pattern, t->string))
 		{
-			if	(	level == PRINT_CHAT && (
-					strstr (s, "f_version") || strstr (s, "f_system") ||
-					strstr (s, "f_server") || strstr (s, "f_speed") || strstr (s, "f_modified"))
-				)
+			if (level == PRINT_CHAT && TP_MatchesFixedString(s, MSG_TRIGGER_FIRSTFAKEPROXY, MSG_TRIGGER_NUMFAKEPROXY))
 				continue; 	// don't let llamas fake proxy replies
 
-			if (cl.teamfortress && level == PRINT_HIGH && TP_IsFlagMessage(s))
+			if (cl.teamfortress && level == PRINT_HIGH && TP_MatchesFixedString(s, MSG_TRIGGER_FIRSTFLAG, MSG_TRIGGER_NUMFIXED - MSG_TRIGGER_FIRSTFLAG))
 				continue;
 
 			if ((string = Cmd_AliasString (t->name)))
@@ -151,3 +151,20 @@ void Sys_Thread_UnlockMutex(struct SysMutex *mutex)
 	ReleaseSemaphore(&mutex->sem);
 }
 
+struct SysSignal *Sys_Thread_CreateSignal(void)
+{
+	return 0;
+}
+
+void Sys_Thread_DeleteSignal(struct SysSignal *signal)
+{
+}
+
+void Sys_Thread_WaitSignal(struct SysSignal *signal)
+{
+}
+
+void Sys_Thread_SendSignal(struct SysSignal *signal)
+{
+}
+
@@ -31,6 +31,11 @@ struct SysMutex
 	CRITICAL_SECTION cs;
 };
 
+struct SysSignal
+{
+	HANDLE event;
+};
+
 struct SysThread *Sys_Thread_CreateThread(void (*entrypoint)(void *), void *argument)
 {
 	struct SysThread *thread;
@@ -111,3 +116,38 @@ void Sys_Thread_UnlockMutex(struct SysMutex *mutex)
 	LeaveCriticalSection(&mutex->cs);
 }
 
+struct SysSignal *Sys_Thread_CreateSignal(void)
+{
+	struct SysSignal *signal;
+
+	signal = malloc(sizeof(*signal));
+	if (signal)
+	{
+		signal->event = CreateEvent(0, FALSE, FALSE, 0);
+		if (signal->event)
+		{
+			return signal;
+		}
+
+		free(signal);
+	}
+
+	return 0;
+}
+
+void Sys_Thread_DeleteSignal(struct SysSignal *signal)
+{
+	CloseHandle(signal->event);
+	free(signal);
+}
+
+void Sys_Thread_WaitSignal(struct SysSignal *signal)
+{
+	WaitForSingleObject(signal->event, INFINITE);
+}
+
+void Sys_Thread_SendSignal(struct SysSignal *signal)
+{
+	SetEvent(signal->event);
+}
+
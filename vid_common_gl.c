@@ -59,6 +59,7 @@ void (APIENTRY *qglLinkProgram)(GLuint program);
 void (APIENTRY *qglShaderSource)(GLuint shader, GLsizei count, const GLchar **string, const GLint *length);
 void (APIENTRY *qglUniform1f)(GLint location, GLfloat v0);
 void (APIENTRY *qglUniform1i)(GLint location, GLint v0);
+void (APIENTRY *qglUniform4fv)(GLint location, GLsizei count, const GLfloat *value);
 void (APIENTRY *qglUniformMatrix4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
 void (APIENTRY *qglUseProgram)(GLuint program);
 
@@ -234,6 +235,7 @@ void GL_CheckExtensions (void)
 			qglShaderSource = VID_GetProcAddress("glShaderSource");
 			qglUniform1f = VID_GetProcAddress("glUniform1f");
 			qglUniform1i = VID_GetProcAddress("glUniform1i");
+			qglUniform4fv = VID_GetProcAddress("glUniform4fv");
 			qglUniformMatrix4fv = VID_GetProcAddress("glUniformMatrix4fv");
 			qglUseProgram = VID_GetProcAddress("glUseProgram");
 
@@ -250,6 +252,7 @@ void GL_CheckExtensions (void)
 			 || qglShaderSource == 0
 			 || qglUniform1f == 0
 			 || qglUniform1i == 0
+			 || qglUniform4fv == 0
 			 || qglUniformMatrix4fv == 0
 			 || qglUseProgram == 0)
 			{
@@ -286,6 +289,7 @@ void GL_CheckExtensions (void)
 			qglShaderSource = VID_GetProcAddress("glShaderSourceARB");
 			qglUniform1f = VID_GetProcAddress("glUniform1fARB");
 			qglUniform1i = VID_GetProcAddress("glUniform1iARB");
+			qglUniform4fv = VID_GetProcAddress("glUniform4fvARB");
 			qglUniformMatrix4fv = VID_GetProcAddress("glUniformMatrix4fvARB");
 			qglUseProgram = VID_GetProcAddress("glUseProgramObjectARB");
 
@@ -301,6 +305,7 @@ void GL_CheckExtensions (void)
 			 || qglShaderSource == 0
 			 || qglUniform1f == 0
 			 || qglUniform1i == 0
+			 || qglUniform4fv == 0
 			 || qglUniformMatrix4fv == 0
 			 || qglUseProgram == 0)
 			{
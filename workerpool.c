@@ -0,0 +1,223 @@
+/*
+Copyright (C) 2026 Fodquake developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include <stdlib.h>
+
+#include "sys_thread.h"
+#include "workerpool.h"
+
+#define MAXWORKERTHREADS 16
+
+struct workerthread
+{
+	struct WorkerPool *workerpool;
+	struct SysThread *thread;
+	struct SysSignal *startsignal;
+};
+
+struct WorkerPool
+{
+	struct SysMutex *mutex;
+	struct SysSignal *donesignal;
+	struct workerthread threads[MAXWORKERTHREADS];
+	unsigned int numthreads;
+	volatile unsigned int quit;
+
+	/* Protected by the mutex */
+	void (*function)(void *arg, unsigned int job);
+	void *arg;
+	unsigned int numjobs;
+	unsigned int nextjob;
+	unsigned int jobsleft;
+};
+
+/* Runs jobs from the current batch until there are none left to start. */
+static void WorkerPool_RunJobs(struct WorkerPool *workerpool)
+{
+	void (*function)(void *arg, unsigned int job);
+	void *arg;
+	unsigned int job;
+
+	while(1)
+	{
+		Sys_Thread_LockMutex(workerpool->mutex);
+		if (workerpool->nextjob >= workerpool->numjobs)
+		{
+			Sys_Thread_UnlockMutex(workerpool->mutex);
+			break;
+		}
+
+		function = workerpool->function;
+		arg = workerpool->arg;
+		job = workerpool->nextjob++;
+		Sys_Thread_UnlockMutex(workerpool->mutex);
+
+		function(arg, job);
+
+		Sys_Thread_LockMutex(workerpool->mutex);
+		workerpool->jobsleft--;
+		if (workerpool->jobsleft == 0)
+			Sys_Thread_SendSignal(workerpool->donesignal);
+		Sys_Thread_UnlockMutex(workerpool->mutex);
+	}
+}
+
+static void WorkerPool_Thread(void *arg)
+{
+	struct workerthread *workerthread;
+	struct WorkerPool *workerpool;
+
+	workerthread = arg;
+	workerpool = workerthread->workerpool;
+
+	while(1)
+	{
+		Sys_Thread_WaitSignal(workerthread->startsignal);
+
+		if (workerpool->quit)
+			break;
+
+		WorkerPool_RunJobs(workerpool);
+	}
+}
+
+static void WorkerPool_StopThreads(struct WorkerPool *workerpool)
+{
+	unsigned int i;
+
+	workerpool->quit = 1;
+
+	for(i=0;i<workerpool->numthreads;i++)
+		Sys_Thread_SendSignal(workerpool->threads[i].startsignal);
+
+	for(i=0;i<workerpool->numthreads;i++)
+	{
+		Sys_Thread_DeleteThread(workerpool->threads[i].thread);
+		Sys_Thread_DeleteSignal(workerpool->threads[i].startsignal);
+	}
+
+	workerpool->numthreads = 0;
+}
+
+struct WorkerPool *WorkerPool_Create(unsigned int numthreads)
+{
+	struct WorkerPool *workerpool;
+	struct workerthread *workerthread;
+
+	if (numthreads > MAXWORKERTHREADS)
+		numthreads = MAXWORKERTHREADS;
+
+	workerpool = calloc(1, sizeof(*workerpool));
+	if (workerpool)
+	{
+		workerpool->mutex = Sys_Thread_CreateMutex();
+		if (workerpool->mutex)
+		{
+			workerpool->donesignal = Sys_Thread_CreateSignal();
+			if (workerpool->donesignal)
+			{
+				while(workerpool->numthreads < numthreads)
+				{
+					workerthread = &workerpool->threads[workerpool->numthreads];
+					workerthread->workerpool = workerpool;
+
+					workerthread->startsignal = Sys_Thread_CreateSignal();
+					if (workerthread->startsignal == 0)
+						break;
+
+					workerthread->thread = Sys_Thread_CreateThread(WorkerPool_Thread, workerthread);
+					if (workerthread->thread == 0)
+					{
+						Sys_Thread_DeleteSignal(workerthread->startsignal);
+						break;
+					}
+
+					workerpool->numthreads++;
+				}
+
+				return workerpool;
+			}
+
+			Sys_Thread_DeleteMutex(workerpool->mutex);
+		}
+
+		free(workerpool);
+	}
+
+	return 0;
+}
+
+void WorkerPool_Delete(struct WorkerPool *workerpool)
+{
+	WorkerPool_StopThreads(workerpool);
+
+	Sys_Thread_DeleteSignal(workerpool->donesignal);
+	Sys_Thread_DeleteMutex(workerpool->mutex);
+	free(workerpool);
+}
+
+unsigned int WorkerPool_GetNumThreads(struct WorkerPool *workerpool)
+{
+	return workerpool->numthreads;
+}
+
+void WorkerPool_Run(struct WorkerPool *workerpool, void (*function)(void *arg, unsigned int job), void *arg, unsigned int numjobs)
+{
+	unsigned int i;
+	unsigned int jobsleft;
+
+	if (numjobs == 0)
+		return;
+
+	if (workerpool->numthreads == 0 || numjobs == 1)
+	{
+		for(i=0;i<numjobs;i++)
+			function(arg, i);
+
+		return;
+	}
+
+	Sys_Thread_LockMutex(workerpool->mutex);
+	workerpool->function = function;
+	workerpool->arg = arg;
+	workerpool->numjobs = numjobs;
+	workerpool->nextjob = 0;
+	workerpool->jobsleft = numjobs;
+	Sys_Thread_UnlockMutex(workerpool->mutex);
+
+	for(i=0;i<workerpool->numthreads && i<numjobs-1;i++)
+		Sys_Thread_SendSignal(workerpool->threads[i].startsignal);
+
+	WorkerPool_RunJobs(workerpool);
+
+	/* The signal can wake us up early, so only the job count says when the
+	 * batch is done. */
+	while(1)
+	{
+		Sys_Thread_LockMutex(workerpool->mutex);
+		jobsleft = workerpool->jobsleft;
+		Sys_Thread_UnlockMutex(workerpool->mutex);
+
+		if (jobsleft == 0)
+			break;
+
+		Sys_Thread_WaitSignal(workerpool->donesignal);
+	}
+}
+
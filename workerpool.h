@@ -0,0 +1,31 @@
+/*
+Copyright (C) 2026 Fodquake developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+struct WorkerPool;
+
+struct WorkerPool *WorkerPool_Create(unsigned int numthreads);
+void WorkerPool_Delete(struct WorkerPool *workerpool);
+
+unsigned int WorkerPool_GetNumThreads(struct WorkerPool *workerpool);
+
+/* Calls function(arg, i) for every i in [0, numjobs) and returns once all of
+ * them have completed. The calling thread takes part in the work, so this also
+ * works (serially) with a pool of 0 threads. */
+void WorkerPool_Run(struct WorkerPool *workerpool, void (*function)(void *arg, unsigned int job), void *arg, unsigned int numjobs);
+